@@ -6,14 +6,18 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include "freertos/FreeRTOS.h"
 
 #include "audio_player.h"
 #include "spiram_fifo.h"
+#include "common_frame.h"
+#include "common_sniff.h"
 #include "freertos/task.h"
 #define LOG_LOCAL_LEVEL ESP_LOG_VERBOSE
 #include "esp_system.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 
 #include "fdk_aac_decoder.h"
 //#include "helix_aac_decoder.h"
@@ -27,15 +31,201 @@
 //#define PRIO_MAD configMAX_PRIORITIES - 4
 
 
+/* audio to buffer before the decoder starts, per buffer_pref_t */
+static const uint32_t preroll_ms[] = {
+    [BUF_PREF_FAST] = 500,
+    [BUF_PREF_SAFE] = 3000
+};
+#define PREROLL_MIN_BYTES	2048
+/* first fill level at which the fifo is probed for frame headers */
+#define PREROLL_PROBE_BYTES	4096
+/* frames averaged for the header bitrate, VBR streams vary per frame */
+#define PREROLL_PROBE_FRAMES	16
+/* ingress needs some time before its rate means anything */
+#define PREROLL_INGRESS_MS	1000
+
+/* frame mode: room to find and complete the frames, two of the largest MP3 frames */
+#define FRAME_ASM_SIZE	(8*1024)
+
+/* a stopped decoder worker leaves its stream in well under that: it sees
+ * CMD_STOP or eof between two frames or fifo waits */
+#define DECODER_STOP_MS	1000
+
+/* decoder workers, created for the first stream that needs them and kept */
+static TaskHandle_t vs_task = NULL;
+static TaskHandle_t mp3_task = NULL;
+static TaskHandle_t aac_task = NULL;
+/* start request to the worker, for the decoder start latency */
+static int64_t decoder_request_us;
+static int64_t switch_us;		/* station switch, 0 once its first sample is out */
+
 static player_t *player_instance = NULL;
 static component_status_t player_status = UNINITIALIZED;
 
+static struct {
+    TickType_t start;           /* stream start */
+    TickType_t decoder_start;
+    uint32_t bytes_in;
+    uint32_t probe_at;          /* fill level of the next header probe, 0: done */
+    long underrun_base;
+} preroll;
+static player_stats_t stats;
+
+/* frame mode assembly of the network data into whole frames */
+static struct {
+    uint8_t *buf;
+    unsigned fill;
+    bool locked;
+    frame_header_t hdr;         /* header the stream was locked on */
+    uint32_t skipped;           /* bytes discarded while searching */
+    uint32_t frames;            /* frames written since the stream start */
+    uint32_t resyncs;           /* sync losses since the stream start */
+} frames;
+
+static const char *rate_source_str[] = { "none", "header", "icy-br", "ingress" };
+
+static uint32_t ticks_to_ms(TickType_t ticks)
+{
+    return ticks * portTICK_PERIOD_MS;
+}
+
+/* average bitrate of the first frames in the fifo, 0 if no frames found */
+static uint16_t probe_fifo_bitrate()
+{
+    char *data;
+    unsigned len;
+    frame_header_t hdr, next;
+    uint32_t bytes = 0, samples = 0;
+
+    // the decoder is not running yet, the fifo reader side is ours
+    spiRamFifoPeek(&data, &len);
+    int pos = frame_header_find((uint8_t *) data, len, 2, &hdr);
+    if (pos < 0)
+        return 0;
+
+    for (int i = 0; i < PREROLL_PROBE_FRAMES; i++) {
+        if (len - pos < FRAME_HEADER_SIZE)
+            break;
+        if (!frame_header_parse((uint8_t *) data + pos, &next) || !frame_header_match(&hdr, &next))
+            break;
+        bytes += next.frame_len;
+        samples += next.samples;
+        pos += next.frame_len;
+    }
+    if (samples == 0)
+        return 0;
+
+    ESP_LOGD(TAG, "probed %s frames, %" PRIu32 " Hz", (hdr.kind == FRAME_ADTS) ? "ADTS" : "MPEG", hdr.sample_rate);
+    return (uint64_t) bytes * 8 * hdr.sample_rate / samples / 1000;
+}
+
+/* best known bitrate of the stream in kbit/s */
+static uint16_t stream_bitrate(rate_source_t *source)
+{
+    if (stats.rate_source == RATE_HEADER)
+    {
+        *source = RATE_HEADER;
+        return stats.bitrate;
+    }
+
+    // first parsed MP3/ADTS headers, retried with more data behind an ID3 tag
+    unsigned fill = spiRamFifoFill();
+    if (preroll.probe_at && fill >= preroll.probe_at)
+    {
+        uint16_t bitrate = probe_fifo_bitrate();
+        preroll.probe_at <<= 1;
+        if (preroll.probe_at > spiRamFifoLen())
+            preroll.probe_at = 0;
+        if (bitrate)
+        {
+            preroll.probe_at = 0;
+            *source = RATE_HEADER;
+            return bitrate;
+        }
+    }
+
+    if (player_instance->media_stream->bitrate)
+    {
+        *source = RATE_ICY;
+        return player_instance->media_stream->bitrate;
+    }
+
+    uint32_t elapsed = ticks_to_ms(xTaskGetTickCount() - preroll.start);
+    if (elapsed >= PREROLL_INGRESS_MS)
+    {
+        *source = RATE_INGRESS;
+        return (uint64_t) preroll.bytes_in * 8 / elapsed;
+    }
+
+    *source = RATE_NONE;
+    return 0;
+}
+
+/* fifo fill level at which the decoder starts */
+static uint32_t preroll_bytes()
+{
+    uint32_t len = spiRamFifoLen();
+    uint32_t bytes;
+
+    stats.bitrate = stream_bitrate(&stats.rate_source);
+    stats.preroll_ms = preroll_ms[player_instance->buffer_pref];
+    if (stats.bitrate == 0)
+        return len * (bigSram() ? 15 : 80) / 100;
+
+    // kbit/s * ms / 8 = bytes
+    bytes = stats.bitrate * stats.preroll_ms / 8;
+    if (bytes < PREROLL_MIN_BYTES)
+        bytes = PREROLL_MIN_BYTES;
+    if (bytes > len * 90 / 100)
+        bytes = len * 90 / 100;
+    return bytes;
+}
+
+static void update_play_stats()
+{
+    stats.play_ms = ticks_to_ms(xTaskGetTickCount() - preroll.decoder_start);
+    stats.underruns = spiRamGetUnderrunCt() - preroll.underrun_base;
+}
+
+/* the decoder for the data in the fifo, many stations send a wrong Content-Type or none */
+static content_type_t sniff_content_type(content_type_t declared)
+{
+    static const content_type_t sniffed_type[] = {
+        [SNIFF_UNKNOWN] = MIME_UNKNOWN,
+        [SNIFF_MPEG] = AUDIO_MPEG,
+        [SNIFF_ADTS] = AUDIO_AAC,
+        [SNIFF_OGG] = AUDIO_OGG,
+        [SNIFF_FLAC] = AUDIO_FLAC,
+        [SNIFF_MP4] = AUDIO_MP4
+    };
+    char *data;
+    unsigned len;
+    sniff_t sniff;
+
+    // the decoder is not running yet, the fifo reader side is ours
+    spiRamFifoPeek(&data, &len);
+    sniff_stream((uint8_t *) data, len, &sniff);
+    ESP_LOGD(TAG, "sniffed %s at %" PRIu32 ", confidence %u", sniff_format_str(sniff.format), sniff.offset, sniff.confidence);
+
+    content_type_t type = sniffed_type[sniff.format];
+    // a declared type gives way to a confident sniff only, no type to any guess
+    if (type == MIME_UNKNOWN || type == declared)
+        return declared;
+    if (sniff.confidence < SNIFF_CONFIDENT && declared != MIME_UNKNOWN)
+        return declared;
+    if (type == AUDIO_AAC && declared == OCTET_STREAM)
+        return declared;
+    ESP_LOGW(TAG, "Content-Type %d, data is %s (confidence %u)", declared, sniff_format_str(sniff.format), sniff.confidence);
+    return type;
+}
+
 static int start_decoder_task(player_t *player)
 {
     TaskFunction_t task_func;
     char * task_name;
     uint16_t stack_depth;
 	int priority = PRIO_MAD;
+    TaskHandle_t *task;
 
     ESP_LOGD(TAG, "RAM left %" PRIu32 "", esp_get_free_heap_size());
 	if (get_audio_output_mode() == VS1053)
@@ -44,6 +234,7 @@ static int start_decoder_task(player_t *player)
         task_name = (char*)"vsTask";
         stack_depth = 3000;
 		priority = PRIO_VS1053;
+        task = &vs_task;
 	} else
     switch (player->media_stream->content_type)
     {
@@ -51,9 +242,11 @@ static int start_decoder_task(player_t *player)
             task_func = mp3_decoder_task;
             task_name = (char*)"mp3_decoder_task";
             stack_depth = 8448;
+            task = &mp3_task;
             break;
 
 		case AUDIO_AAC:
+		case AUDIO_MP4:
         case OCTET_STREAM: // probably .aac
 			if (!bigSram())
 			{
@@ -66,30 +259,152 @@ static int start_decoder_task(player_t *player)
             task_func = fdkaac_decoder_task;
             task_name = (char*)"fdkaac_decoder_task";
             stack_depth = 6900; //6144; 
+            task = &aac_task;
             break;
 
+        case AUDIO_OGG:
+        case AUDIO_FLAC:
+            ESP_LOGE(TAG, "no decoder for %s, VS1053 only", (player->media_stream->content_type == AUDIO_OGG) ? "Ogg" : "FLAC");
+			spiRamFifoReset();
+            return -1;
+
         default:
             ESP_LOGW(TAG, "unknown mime type: %d", player->media_stream->content_type);
 			spiRamFifoReset();
             return -1;
     }
 
-	if (((task_func != NULL)) && (xTaskCreatePinnedToCore(task_func, task_name, stack_depth, player,
-			priority, NULL, CPU_MAD) != pdPASS)) 
+	decoder_request_us = esp_timer_get_time();
+	// the worker waits for a notification per stream
+	if ((*task == NULL) && (xTaskCreatePinnedToCore(task_func, task_name, stack_depth, player,
+			priority, task, CPU_MAD) != pdPASS)) 
 	{
-									
+		*task = NULL;
 		ESP_LOGE(TAG, "ERROR creating decoder task! Out of memory?");
 		spiRamFifoReset();
 		return -1;
-	} else {
-		player->decoder_status = RUNNING;
 	}
+	player->decoder_status = RUNNING;
+	xTaskNotifyGive(*task);
 	
-	ESP_LOGD(TAG, "decoder task created: %s", task_name);
+	ESP_LOGD(TAG, "decoder started: %s", task_name);
 
     return 0;
 }
 
+/* the caller is one of the decoder workers, e.g. stopping the player on an output error */
+static bool in_decoder_task()
+{
+	TaskHandle_t self = xTaskGetCurrentTaskHandle();
+	return self == vs_task || self == mp3_task || self == aac_task;
+}
+
+/* wait for the worker to leave its stream, the fifo reset on its way out
+ * done. false if it is still in it after DECODER_STOP_MS */
+static bool decoder_wait_stopped()
+{
+	TickType_t start = xTaskGetTickCount();
+
+	while (player_instance->decoder_status == RUNNING)
+	{
+		// a worker cannot wait for itself, it stops when it returns
+		if (in_decoder_task())
+			return false;
+		if (ticks_to_ms(xTaskGetTickCount() - start) >= DECODER_STOP_MS)
+		{
+			ESP_LOGE(TAG, "decoder still running %u ms after the stop", DECODER_STOP_MS);
+			return false;
+		}
+		vTaskDelay(1);
+	}
+	return true;
+}
+
+/* called by the decoder worker once it can take the stream */
+void audio_player_decoder_ready()
+{
+    stats.decoder_start_us = esp_timer_get_time() - decoder_request_us;
+    ESP_LOGD(TAG, "decoder ready in %" PRIu32 " us", stats.decoder_start_us);
+}
+
+void audio_player_switch()
+{
+    switch_us = esp_timer_get_time();
+}
+
+void audio_player_first_sample()
+{
+    if (switch_us == 0)
+        return;
+    stats.first_sample_ms = (esp_timer_get_time() - switch_us) / 1000;
+    switch_us = 0;
+    ESP_LOGI(TAG, "First sample %" PRIu32 " ms after the switch (tune-in %" PRIu32 " ms, decoder ready in %" PRIu32 " us)",
+             stats.first_sample_ms, stats.tune_in_ms, stats.decoder_start_us);
+}
+
+/* leave frame mode, the data kept so far goes to the fifo as it is */
+static void frame_mode_abort()
+{
+    ESP_LOGW(TAG, "no frames in %" PRIu32 " bytes, frame mode off", frames.skipped);
+    spiRamFifoSetFrameMode(false);
+    spiRamFifoWrite((char *) frames.buf, frames.fill);
+    frames.fill = 0;
+}
+
+/* cut the network data into whole frames for the fifo, keep the incomplete tail */
+static void frame_ingest(const char *data, unsigned len)
+{
+    frame_header_t hdr;
+
+    while (len > 0) {
+        unsigned n = min(len, FRAME_ASM_SIZE - frames.fill);
+        unsigned pos = 0;
+        memcpy(frames.buf + frames.fill, data, n);
+        frames.fill += n;
+        data += n;
+        len -= n;
+
+        while (frames.fill - pos >= FRAME_HEADER_SIZE) {
+            if (!frames.locked) {
+                int off = frame_header_find(frames.buf + pos, frames.fill - pos, 1, &hdr);
+                if (off < 0) {
+                    // the tail may hold the start of the next frames
+                    unsigned keep = min(frames.fill - pos, FRAME_ASM_SIZE / 2);
+                    frames.skipped += frames.fill - pos - keep;
+                    pos = frames.fill - keep;
+                    break;
+                }
+                frames.skipped += off;
+                pos += off;
+                frames.hdr = hdr;
+                frames.locked = true;
+            }
+            if (!frame_header_parse(frames.buf + pos, &hdr) || !frame_header_match(&frames.hdr, &hdr)) {
+                ESP_LOGD(TAG, "frame sync lost after %" PRIu32 " frames", frames.frames);
+                frames.locked = false;
+                frames.resyncs++;
+                frames.skipped++;
+                pos++;
+                continue;
+            }
+            if (hdr.frame_len > frames.fill - pos)
+                break;
+            spiRamFifoWriteFrame((char *) frames.buf + pos, hdr.frame_len, frame_header_duration_us(&hdr));
+            frames.frames++;
+            frames.skipped = 0;
+            pos += hdr.frame_len;
+        }
+        memmove(frames.buf, frames.buf + pos, frames.fill - pos);
+        frames.fill -= pos;
+
+        if (frames.frames == 0 && frames.skipped > FRAME_SYNC_LIMIT) {
+            frame_mode_abort();
+            spiRamFifoWrite(data, len);
+            return;
+        }
+    }
+}
+
 static int t;
 
 /* Writes bytes into the FIFO queue, starts decoder task if necessary. */
@@ -102,19 +417,31 @@ int audio_stream_consumer(const char *recv_buf, ssize_t bytes_read)
         return -2;
     }
 	if (bytes_read >0)
-		spiRamFifoWrite(recv_buf, bytes_read);
+	{
+		if (spiRamFifoGetFrameMode())
+			frame_ingest(recv_buf, bytes_read);
+		else
+			spiRamFifoWrite(recv_buf, bytes_read);
+	}
 
 	if (player_instance->decoder_status != RUNNING ) 
 	{
-//		t = 0;
+		if (bytes_read > 0)
+			preroll.bytes_in += bytes_read;
 		int bytes_in_buf = spiRamFifoFill();
-		uint8_t fill_level = (bytes_in_buf * 100) / spiRamFifoLen();
 
-		//bool buffer_ok = (fill_level > (bigSram()?15:80)); // in %
-		if ((fill_level > (bigSram()?15:80)))
+		if (bytes_in_buf >= preroll_bytes())
 		{
 			t = 0;
 		// buffer is filled, start decoder
+			preroll.decoder_start = xTaskGetTickCount();
+			preroll.underrun_base = spiRamGetUnderrunCt();
+			stats.tune_in_ms = ticks_to_ms(preroll.decoder_start - preroll.start);
+			stats.preroll_bytes = bytes_in_buf;
+			ESP_LOGI(TAG, "Pre-roll %d bytes, %" PRIu32 " ms at %u kbps (%s), tune-in %" PRIu32 " ms",
+				bytes_in_buf, stats.preroll_ms, stats.bitrate, audio_player_rate_source_str(stats.rate_source), stats.tune_in_ms);
+			// the data decides where the Content-Type is wrong or missing
+			player_instance->media_stream->content_type = sniff_content_type(player_instance->media_stream->content_type);
 			if (start_decoder_task(player_instance) != 0) {
 				ESP_LOGE(TAG, "Decoder task failed");
 				audio_player_stop();
@@ -148,10 +475,46 @@ void audio_player_destroy()
     player_status = UNINITIALIZED;
 }
 */
+/* frame mode for the MP3 and ADTS streams if selected, the fifo is empty here */
+static void frame_mode_start()
+{
+    content_type_t type = player_instance->media_stream->content_type;
+    bool on = player_instance->frame_mode && (type == AUDIO_MPEG || type == AUDIO_AAC);
+
+    frames.fill = 0;
+    frames.locked = false;
+    frames.skipped = 0;
+    frames.frames = 0;
+    frames.resyncs = 0;
+    if (on && frames.buf == NULL)
+        frames.buf = kmalloc(FRAME_ASM_SIZE);
+    if (frames.buf == NULL)
+        on = false;
+    if (!spiRamFifoSetFrameMode(on))
+        ESP_LOGE(TAG, "frame mode: no memory for the frame index");
+}
+
 void audio_player_start()
 {
+		// the command and eof still belong to the worker of the last stream until it is out,
+		// a new stream under it would be read by two workers or reset under the new one
+		if (!decoder_wait_stopped())
+		{
+			ESP_LOGE(TAG, "decoder busy, stream not started");
+			player_instance->command = CMD_STOP;
+			return;
+		}
 		if (get_audio_output_mode() != VS1053) renderer_start();
 		player_instance->media_stream->eof = false;
+		memset(&stats, 0, sizeof(stats));
+		preroll.start = xTaskGetTickCount();
+		// a stream that was not switched to counts from its start
+		if (switch_us == 0)
+			switch_us = esp_timer_get_time();
+		preroll.decoder_start = 0;
+		preroll.bytes_in = 0;
+		preroll.probe_at = PREROLL_PROBE_BYTES;
+		frame_mode_start();
 		player_instance->command = CMD_START;
 		player_instance->decoder_command = CMD_NONE;	
 		player_status = RUNNING;
@@ -160,10 +523,18 @@ void audio_player_start()
 void audio_player_stop()
 { 
 //		spiRamFifoReset();
+		if (player_status == RUNNING && preroll.decoder_start != 0)
+		{
+			update_play_stats();
+			ESP_LOGI(TAG, "Played %" PRIu32 " s, %ld underruns, tune-in %" PRIu32 " ms", stats.play_ms / 1000, stats.underruns, stats.tune_in_ms);
+			preroll.decoder_start = 0;
+		}
 		player_instance->decoder_command = CMD_STOP;
 		player_instance->command = CMD_STOP;
 		player_instance->media_stream->eof = true;
 		if (get_audio_output_mode() != VS1053)renderer_stop();
+		// the next start may follow at once
+		decoder_wait_stopped();
 		player_instance->command = CMD_NONE;
 		player_status = STOPPED;
 }
@@ -173,3 +544,57 @@ component_status_t get_player_status()
     return player_status;
 }
 
+void audio_player_get_stats(player_stats_t *player_stats)
+{
+    if (player_status == RUNNING && preroll.decoder_start != 0)
+        update_play_stats();
+    *player_stats = stats;
+}
+
+bool audio_player_get_buffered_ms(uint32_t *ms)
+{
+    if (player_status != RUNNING || preroll.decoder_start == 0)
+        return false;
+    if (spiRamFifoGetFrameMode())
+    {
+        *ms = spiRamFifoBufferedMs();
+        return true;
+    }
+    if (stats.bitrate == 0)
+        return false;
+    // bytes * 8 / kbit/s = ms
+    *ms = (uint64_t) spiRamFifoFill() * 8 / stats.bitrate;
+    return true;
+}
+
+void audio_player_set_buffer_pref(buffer_pref_t pref)
+{
+    player_instance->buffer_pref = pref;
+}
+
+buffer_pref_t audio_player_get_buffer_pref()
+{
+    return player_instance->buffer_pref;
+}
+
+const char *audio_player_rate_source_str(rate_source_t source)
+{
+    return rate_source_str[source];
+}
+
+/* applies from the next stream on */
+void audio_player_set_frame_mode(bool on)
+{
+    player_instance->frame_mode = on;
+}
+
+bool audio_player_get_frame_mode()
+{
+    return player_instance->frame_mode;
+}
+
+uint32_t audio_player_get_resyncs()
+{
+    return frames.resyncs;
+}
+
@@ -25,11 +25,12 @@ typedef enum {
 
 typedef enum
 {
-    MIME_UNKNOWN = 1, OCTET_STREAM, AUDIO_AAC, AUDIO_MP4, AUDIO_MPEG
+    MIME_UNKNOWN = 1, OCTET_STREAM, AUDIO_AAC, AUDIO_MP4, AUDIO_MPEG, AUDIO_OGG, AUDIO_FLAC
 } content_type_t;
 
 typedef struct {
     content_type_t content_type;
+    uint16_t bitrate; /* kbit/s announced by icy-br, 0 if unknown */
     bool eof;
 } media_stream_t;
 
@@ -38,10 +39,42 @@ typedef struct {
     player_command_t decoder_command;
     component_status_t decoder_status;
     buffer_pref_t buffer_pref;
+    bool frame_mode;            /* store MP3/ADTS streams in the fifo as whole frames */
     media_stream_t *media_stream;
 } player_t;
 
+/* where the bitrate used for the pre-roll comes from */
+typedef enum {
+    RATE_NONE, RATE_HEADER, RATE_ICY, RATE_INGRESS
+} rate_source_t;
+
+typedef struct {
+    uint32_t tune_in_ms;        /* stream start to decoder start */
+    uint32_t decoder_start_us;  /* decoder start request to decoder ready for the stream */
+    uint32_t first_sample_ms;   /* station switch to the first samples out, 0 before */
+    uint32_t preroll_bytes;     /* fifo fill at decoder start */
+    uint32_t preroll_ms;        /* pre-roll target of the profile */
+    uint16_t bitrate;           /* kbit/s the pre-roll was computed for */
+    rate_source_t rate_source;
+    uint32_t play_ms;           /* time since decoder start */
+    long underruns;             /* decoder starvations since decoder start */
+} player_stats_t;
+
 component_status_t get_player_status();
+void audio_player_get_stats(player_stats_t *stats);
+/* the fifo content in ms of playback, false before the decoder starts or without a bitrate */
+bool audio_player_get_buffered_ms(uint32_t *ms);
+void audio_player_set_buffer_pref(buffer_pref_t pref);
+buffer_pref_t audio_player_get_buffer_pref();
+const char *audio_player_rate_source_str(rate_source_t source);
+void audio_player_set_frame_mode(bool on);
+bool audio_player_get_frame_mode();
+uint32_t audio_player_get_resyncs();
+void audio_player_decoder_ready();
+/* a new station is being connected: the switch latency is counted from here */
+void audio_player_switch();
+/* called by the renderer or the VS1053 task with the first samples of a stream */
+void audio_player_first_sample();
 
 void audio_player_init(player_t *player_config);
 void audio_player_start();
@@ -0,0 +1,67 @@
+/*
+ * audio_drift.c
+ *
+ *  The fill drifts at the difference of the two clocks: 200 ppm is
+ *  0.2 ms of playback per second. Network bursts move it by seconds, but
+ *  only for seconds, so the fill is low-passed well below their rate and
+ *  a slow PI loop (time constant about 15 minutes) brings it back to the
+ *  setpoint. The integral part ends up at the drift itself.
+ */
+
+#include "audio_drift.h"
+
+// low-pass time constant of the fill, s
+#define DRIFT_TAU 60.0f
+// ppm per ms of fill error, and ppm per ms and second
+#define DRIFT_KP 2.0f
+#define DRIFT_KI 0.001f
+
+static float clamp(float v)
+{
+	if (v > DRIFT_MAX_PPM)
+		return DRIFT_MAX_PPM;
+	if (v < -DRIFT_MAX_PPM)
+		return -DRIFT_MAX_PPM;
+	return v;
+}
+
+void drift_reset(drift_t *d)
+{
+	d->start_ms = 0;
+	d->last_ms = 0;
+	d->level = 0;
+	d->target = -1;
+	d->integral = 0;
+	d->ppm = 0;
+}
+
+int32_t drift_update(drift_t *d, uint32_t now_ms, uint32_t fill_ms)
+{
+	if (d->start_ms == 0)
+	{
+		d->start_ms = d->last_ms = now_ms;
+		d->level = fill_ms;
+		return d->ppm;
+	}
+	uint32_t elapsed = now_ms - d->last_ms;
+	if (elapsed < DRIFT_PERIOD_MS)
+		return d->ppm;
+	d->last_ms = now_ms;
+
+	float dt = elapsed / 1000.0f;
+	float k = dt / DRIFT_TAU;
+	d->level += ((float)fill_ms - d->level) * ((k < 1.0f) ? k : 1.0f);
+
+	if (d->target < 0)
+	{
+		if (now_ms - d->start_ms >= DRIFT_SETTLE_MS)
+			d->target = d->level;
+		return d->ppm;
+	}
+
+	// fill above the setpoint: the stream clock is faster, consume faster
+	float error = d->level - d->target;
+	d->integral = clamp(d->integral + DRIFT_KI * error * dt);
+	d->ppm = clamp(DRIFT_KP * error + d->integral);
+	return d->ppm;
+}
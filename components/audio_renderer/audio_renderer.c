@@ -15,6 +15,7 @@
 #define TAG "Renderer"
 
 #include <stdio.h>
+#include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
 #include "freertos/task.h"
@@ -24,6 +25,7 @@
 #include "esp_system.h"
 #include "esp_log.h"
 #include "esp_attr.h"
+#include "esp_heap_caps.h"
 #include <math.h>
 
 #include "gpio.h"
@@ -31,11 +33,15 @@
 #include "MerusAudio.h"
 #include "audio_player.h"
 #include "audio_renderer.h"
+#include "audio_resampler.h"
+#include "audio_drift.h"
 
 #define EXAMPLE_DATA_BIT_WIDTH (I2S_DATA_BIT_WIDTH_16BIT)
 #define EXAMPLE_SAMPLE_RATE (36000)
 
 static i2s_chan_handle_t tx_handle = NULL;
+// frames the DMA buffers hold: what is still to play once a write returns
+static uint32_t dma_frames = 0;
 
 static volatile int is_overflow = 0;
 
@@ -83,6 +89,53 @@ DRAM_ATTR static const uint16_t SPDIF_BMCLOOKUP[256] =
 		0xccaa, 0x4caa, 0x2caa, 0xacaa, 0x34aa, 0xb4aa, 0xd4aa, 0x54aa,
 		0x32aa, 0xb2aa, 0xd2aa, 0x52aa, 0xcaaa, 0x4aaa, 0x2aaa, 0xaaaa};
 static void write_i2s(const void *buffer, size_t buf_len);
+// stereo frames of silence written on an underflow, about 6 ms at 44.1 kHz
+#define UNDERFLOW_FRAMES 256
+// output frames converted per i2s write: the scratch arena holds that many
+#define SCRATCH_FRAMES 512
+
+// converted output, allocated for the output format and kept from block to block
+static uint8_t *scratch = NULL;
+static renderer_stats_t scratch_stats;
+
+/* bytes an output frame takes once converted */
+static size_t scratch_frame_bytes()
+{
+	if (renderer_instance->output_mode == SPDIF)
+		return 4 * sizeof(uint32_t); // two BMC encoded subframes
+	if (renderer_instance->output_mode != DAC_BUILT_IN && renderer_instance->bit_depth == I2S_DATA_BIT_WIDTH_32BIT)
+		return 2 * sizeof(uint32_t);
+	return 2 * sizeof(uint16_t);
+}
+
+/* the arena for the output format, reallocated only when that format needs more */
+static bool scratch_reserve()
+{
+	size_t size = SCRATCH_FRAMES * scratch_frame_bytes();
+	if (size <= scratch_stats.arena_bytes)
+		return true;
+	heap_caps_free(scratch);
+	scratch = heap_caps_malloc(size, MALLOC_CAP_DMA | MALLOC_CAP_8BIT);
+	if (scratch == NULL)
+	{
+		scratch_stats.arena_bytes = 0;
+		ESP_LOGE(TAG, "scratch arena of %u bytes failed", size);
+		return false;
+	}
+	scratch_stats.arena_bytes = size;
+	scratch_stats.allocs++;
+	ESP_LOGI(TAG, "scratch arena %u bytes", size);
+	return true;
+}
+
+/* a block converted in slices of the arena, its biggest slice */
+static inline void scratch_used(uint32_t frames)
+{
+	size_t bytes = ((frames < SCRATCH_FRAMES) ? frames : SCRATCH_FRAMES) * scratch_frame_bytes();
+	if (bytes > scratch_stats.peak_bytes)
+		scratch_stats.peak_bytes = bytes;
+	scratch_stats.blocks++;
+}
 
 // KaraDio32
 void IRAM_ATTR renderer_volume(uint32_t vol)
@@ -106,191 +159,208 @@ void IRAM_ATTR renderer_volume(uint32_t vol)
 	ESP_LOGD(TAG, "Renderer volume:  %" PRIu32 "", renderer_instance->volume);
 }
 //----------------------------------------------------------------------------------------------
+/*
+ * 16 bit PCM to the output words, volume applied on the way. One kernel per
+ * source layout and output, all from the same template: the layout fixes the
+ * stride and the right channel, the output the word built.
+ */
+typedef void (*pcm_kernel_t)(void *out, const int16_t *ptr_l, const int16_t *ptr_r, uint32_t num_samples, uint32_t mult);
+
+// same truncation as the former in place volume: bits 16 to 31 of the product
+#define VOL16(s, mult) ((uint16_t)(((uint32_t)(int32_t)(s) * (mult)) >> 16))
+
+/* low - high / low - high */
+#define OUT_I2S16(o, i, l, r) ((uint32_t *)(o))[i] = (l) | ((uint32_t)(r) << 16)
+/* the sample in the upper half of each 32 bit slot */
+#define OUT_I2S32(o, i, l, r) ((uint64_t *)(o))[i] = ((uint32_t)(l) << 16) | ((uint64_t)(r) << 48)
+/* The built-in DAC wants unsigned samples, so we shift the range
+ * from -32768-32767 to 0-65535, left in the high half. */
+#define OUT_DAC(o, i, l, r) ((uint32_t *)(o))[i] = ((uint32_t)(uint16_t)((l) + 0x8000) << 16) | (uint16_t)((r) + 0x8000)
+
+#define PCM_KERNEL(name, STRIDE, RIGHT, OUT)                                                           \
+	static void IRAM_ATTR name(void *out, const int16_t *ptr_l, const int16_t *ptr_r, uint32_t num_samples, uint32_t mult) \
+	{                                                                                                  \
+		for (uint32_t i = 0; i < num_samples; i++)                                                     \
+		{                                                                                              \
+			uint16_t left = VOL16(ptr_l[i * STRIDE], mult);                                            \
+			uint16_t right = RIGHT;                                                                    \
+			OUT(out, i, left, right);                                                                  \
+		}                                                                                              \
+	}
+
+// interleaved stereo, left/right halves, mono duplicated
+#define PCM_KERNELS(out_name, OUT)                                           \
+	PCM_KERNEL(pcm_stereo_##out_name, 2, VOL16(ptr_r[i * 2], mult), OUT) \
+	PCM_KERNEL(pcm_halves_##out_name, 1, VOL16(ptr_r[i], mult), OUT)     \
+	PCM_KERNEL(pcm_mono_##out_name, 1, left, OUT)
+
+PCM_KERNELS(i2s16, OUT_I2S16)
+PCM_KERNELS(i2s32, OUT_I2S32)
+PCM_KERNELS(dac, OUT_DAC)
+
+typedef enum
+{
+	LAYOUT_STEREO,
+	LAYOUT_HALVES,
+	LAYOUT_MONO
+} pcm_layout_t;
+
+typedef enum
+{
+	KERNEL_I2S16,
+	KERNEL_I2S32,
+	KERNEL_DAC
+} kernel_out_t;
+
+static const pcm_kernel_t pcm_kernels[3][3] = {
+	[KERNEL_I2S16] = {pcm_stereo_i2s16, pcm_halves_i2s16, pcm_mono_i2s16},
+	[KERNEL_I2S32] = {pcm_stereo_i2s32, pcm_halves_i2s32, pcm_mono_i2s32},
+	[KERNEL_DAC] = {pcm_stereo_dac, pcm_halves_dac, pcm_mono_dac},
+};
+
+// kernel for the last source format and output, chosen again when they change
+static struct
+{
+	pcm_kernel_t convert;
+	pcm_layout_t layout;
+	uint8_t bit_depth, num_channels;
+	pcm_buffer_layout_t buffer_format;
+	output_mode_t output_mode;
+	uint8_t out_depth;
+} kernel;
+
+static pcm_kernel_t kernel_select(pcm_format_t *buf_desc)
+{
+	if (kernel.convert != NULL && kernel.bit_depth == buf_desc->bit_depth && kernel.num_channels == buf_desc->num_channels && kernel.buffer_format == buf_desc->buffer_format && kernel.output_mode == renderer_instance->output_mode && kernel.out_depth == renderer_instance->bit_depth)
+		return kernel.convert;
+
+	kernel.convert = NULL;
+	kernel.bit_depth = buf_desc->bit_depth;
+	kernel.num_channels = buf_desc->num_channels;
+	kernel.buffer_format = buf_desc->buffer_format;
+	kernel.output_mode = renderer_instance->output_mode;
+	kernel.out_depth = renderer_instance->bit_depth;
+
+	// support only 16 bit buffers for now
+	if (buf_desc->bit_depth != I2S_DATA_BIT_WIDTH_16BIT || buf_desc->num_channels < 1 || buf_desc->num_channels > 2)
+		return NULL;
+
+	kernel_out_t out;
+	if (renderer_instance->output_mode == DAC_BUILT_IN)
+		out = KERNEL_DAC;
+	else if (renderer_instance->bit_depth == I2S_DATA_BIT_WIDTH_16BIT)
+		out = KERNEL_I2S16;
+	else if (renderer_instance->bit_depth == I2S_DATA_BIT_WIDTH_32BIT)
+		out = KERNEL_I2S32;
+	else
+	{
+		ESP_LOGE(TAG, "bit depth unsupported: %d", renderer_instance->bit_depth);
+		return NULL;
+	}
+
+	if (buf_desc->num_channels == 1) // duplicate
+		kernel.layout = LAYOUT_MONO;
+	else if (buf_desc->buffer_format == PCM_LEFT_RIGHT)
+		kernel.layout = LAYOUT_HALVES;
+	else
+		kernel.layout = LAYOUT_STEREO;
+	kernel.convert = pcm_kernels[out][kernel.layout];
+	ESP_LOGD(TAG, "pcm kernel %d/%d for %d channels", out, kernel.layout, buf_desc->num_channels);
+	return kernel.convert;
+}
+
 /**
  * I2S is MSB first (big-endian) two's complement (signed) integer format.
  * The I2S module receives and transmits left-channel data first.
  *
  * ESP32 is little-endian.
  */
-static void IRAM_ATTR render_i2s_samples(char *buf, uint32_t buf_len, pcm_format_t *buf_desc)
+static void IRAM_ATTR render_i2s_samples(const char *buf, uint32_t buf_len, pcm_format_t *buf_desc, uint32_t mult)
 {
-	register int res = ESP_OK;
-	uint8_t *outBuf8;
-	uint32_t *outBuf32;
-	uint64_t *outBuf64;
-
-	// handle changed sample rate
-	if (renderer_instance->sample_rate != buf_desc->sample_rate)
-	{
-		ESP_LOGD(TAG, "changing sample rate from %d to %" PRIu32 "", renderer_instance->sample_rate, buf_desc->sample_rate);
-		// uint32_t rate = buf_desc->sample_rate * renderer_instance->sample_rate_modifier;
-		// res =  i2s_set_sample_rates(renderer_instance->i2s_num, rate);
-
-		if (res != ESP_OK)
-		{
-			ESP_LOGE(TAG, "i2s_set_clk error %d", res);
-		}
-		else
-			renderer_instance->sample_rate = buf_desc->sample_rate;
-	}
-
 	uint8_t buf_bytes_per_sample = (buf_desc->bit_depth / 8);
 	uint32_t num_samples = buf_len / buf_bytes_per_sample / buf_desc->num_channels;
-	// KaraDio32 Volume control
-	uint32_t mult = renderer_instance->volume;
-
-	if ((mult != 0x10000))
+	//-------------------------
+	// formats match, we can write the whole block
+	bool native = buf_desc->bit_depth == renderer_instance->bit_depth && buf_desc->buffer_format == PCM_INTERLEAVED && buf_desc->num_channels == 2 && renderer_instance->output_mode != DAC_BUILT_IN && renderer_instance->output_mode != PDM;
+	if (native && mult == 0x10000)
 	{
-		uint32_t pmax = num_samples * buf_desc->num_channels;
-		if (buf_bytes_per_sample == 2)
+		write_i2s(buf, buf_len);
+		return;
+	}
+	if (native && buf_bytes_per_sample == 4)
+	{
+		// the caller's buffer stays as it is: scaled into the arena
+		if (!scratch_reserve())
 		{
-			int16_t *psample;
-			psample = (int16_t *)buf;
-			for (int32_t i = 0; i < pmax; i++)
-			{
-				psample[i] = (((int32_t)psample[i] * mult) >> 16) & 0xFFFF;
-			}
+			renderer_stop();
+			audio_player_stop();
+			return;
 		}
-		else
+		const int32_t *psample = (const int32_t *)buf;
+		int32_t *out = (int32_t *)scratch;
+		scratch_used(num_samples);
+		while (num_samples > 0 && renderer_status != STOPPED)
 		{
-			int32_t *psample;
-			psample = (int32_t *)buf;
-			for (int32_t i = 0; i < pmax; i++)
+			uint32_t n = (num_samples < SCRATCH_FRAMES) ? num_samples : SCRATCH_FRAMES;
+			for (int32_t i = 0; i < n * 2; i++)
 			{
-				psample[i] = ((int64_t)(psample[i] * mult) >> 16) & 0xFFFFFFFF;
+				out[i] = ((int64_t)(psample[i] * mult) >> 16) & 0xFFFFFFFF;
 			}
+			write_i2s(out, n * 2 * sizeof(int32_t));
+			psample += n * 2;
+			num_samples -= n;
 		}
+		return;
 	}
 
-	//-------------------------
-	// formats match, we can write the whole block
-	if (buf_desc->bit_depth == renderer_instance->bit_depth && buf_desc->buffer_format == PCM_INTERLEAVED && buf_desc->num_channels == 2 && renderer_instance->output_mode != DAC_BUILT_IN && renderer_instance->output_mode != PDM)
+	pcm_kernel_t convert = kernel_select(buf_desc);
+	if (convert == NULL)
 	{
-		if (renderer_status == RUNNING)
-		{
-			write_i2s(buf, buf_len);
-		}
+		ESP_LOGD(TAG, "unsupported decoder bit depth: %d", buf_desc->bit_depth);
+		renderer_stop();
+		audio_player_stop();
 		return;
 	}
-
-	// support only 16 bit buffers for now
-	if (buf_desc->bit_depth != I2S_DATA_BIT_WIDTH_16BIT)
+	if (!scratch_reserve())
 	{
-		ESP_LOGD(TAG, "unsupported decoder bit depth: %d", buf_desc->bit_depth);
 		renderer_stop();
 		audio_player_stop();
 		return;
 	}
 
 	// pointer to left / right sample position
-	char *ptr_l = buf;
-	char *ptr_r = buf + buf_bytes_per_sample;
-	uint8_t stride = buf_bytes_per_sample * 2;
+	const int16_t *ptr_l = (const int16_t *)buf;
+	const int16_t *ptr_r = ptr_l + 1;
+	uint8_t stride = buf_desc->num_channels;
 
 	// right half of the buffer contains all the right channel samples
-	if (buf_desc->buffer_format == PCM_LEFT_RIGHT)
+	if (kernel.layout == LAYOUT_HALVES)
 	{
-		ptr_r = buf + buf_len / 2;
-		stride = buf_bytes_per_sample;
-	}
-
-	if (buf_desc->num_channels == 1) // duplicate
-	{
-		ptr_r = ptr_l;
+		ptr_r = ptr_l + num_samples;
+		stride = 1;
 	}
 
-	// har-in-air correction
-	uint32_t outBufBytes = buf_len * (2 / buf_desc->num_channels);
-	if (renderer_instance->bit_depth == I2S_DATA_BIT_WIDTH_32BIT)
-		outBufBytes <<= 1;
-
-	outBuf8 = malloc(outBufBytes);
+	size_t out_frame = scratch_frame_bytes();
+	scratch_used(num_samples);
 
-	if (outBuf8 == NULL)
+	// an arena at a time
+	while (num_samples > 0 && renderer_status != STOPPED)
 	{
-		ESP_LOGE(TAG, "malloc outBuf8 failed len:%" PRIu32 "", buf_len);
-		renderer_stop();
-		audio_player_stop();
-		return;
-	}
-	outBuf32 = (uint32_t *)outBuf8;
-	outBuf64 = (uint64_t *)outBuf8;
-
-	for (int i = 0; i < num_samples; i++)
-	{
-		if (renderer_status == STOPPED)
-			break;
-
-		if ((renderer_instance->output_mode == DAC_BUILT_IN)) //||(renderer_instance->output_mode == PDM))
-		{
-			// assume 16 bit src bit_depth
-			int16_t left = *(int16_t *)ptr_l;
-			int16_t right = *(int16_t *)ptr_r;
-
-			// The built-in DAC wants unsigned samples, so we shift the range
-			// from -32768-32767 to 0-65535.
-			left = left + 0x8000;
-			right = right + 0x8000;
-
-			uint32_t sample = (uint16_t)left;
-			sample = (sample << 16 & 0xffff0000) | ((uint16_t)right);
-
-			outBuf32[i] = sample;
-		}
-
-		else
-		{
-
-			switch (renderer_instance->bit_depth)
-			{
-			case I2S_DATA_BIT_WIDTH_16BIT:; // workaround
-				/* low - high / low - high */
-				const char samp32[4] = {ptr_l[0], ptr_l[1], ptr_r[0], ptr_r[1]};
-				outBuf32[i] = (uint32_t)(*((uint32_t *)samp32));
-				break;
-
-			case I2S_DATA_BIT_WIDTH_32BIT:; // workaround
-
-				const char samp64[8] = {0, 0, ptr_l[0], ptr_l[1], 0, 0, ptr_r[0], ptr_r[1]};
-				outBuf64[i] = *((uint64_t *)samp64);
-				break;
-
-			default:
-				ESP_LOGE(TAG, "bit depth unsupported: %d", renderer_instance->bit_depth);
-			}
-		}
-
-		ptr_r += stride;
-		ptr_l += stride;
+		uint32_t n = (num_samples < SCRATCH_FRAMES) ? num_samples : SCRATCH_FRAMES;
+		convert(scratch, ptr_l, ptr_r, n, mult);
+		//	ESP_LOGI(TAG, "I2S write from %x for %d bytes", (uint32_t)scratch, n * out_frame);
+		write_i2s(scratch, n * out_frame);
+		ptr_l += n * stride;
+		ptr_r += n * stride;
+		num_samples -= n;
 	}
-	//
-	//	ESP_LOGI(TAG, "I2S write from %x for %d bytes", (uint32_t)outBuf8, bytes_left);
-	uint8_t *iobuf = outBuf8;
-	write_i2s(iobuf, buf_len);
-	free(outBuf8);
 }
 
-// for s/pdif
-static bool set_sample_rate(int hz)
+static void apll_fix(int clk)
 {
-	//  if (!i2sOn) return false;
-	if (hz < 32000)
-		return false;
-	if (hz == renderer_instance->sample_rate)
-		return true;
-	ESP_LOGD(TAG, "Changing S/PDIF from %d to %d", renderer_instance->sample_rate, hz);
-
-	renderer_instance->sample_rate = hz;
-	// if (i2s_set_sample_rates(renderer_instance->i2s_num, 2 * hz) != ESP_OK)
-	if (false)
-	{
-		ESP_LOGE(TAG, "ERROR changing S/PDIF sample rate");
-		return false;
-	}
-
-	if ((2 * hz) == 88200)
+	if (renderer_instance->output_mode == SPDIF && clk == 88200)
 	{	// for sdk 3.3 only?
-		// Manually fix the APLL rate for 44100.
+		// Manually fix the APLL rate for 44100 S/PDIF.
 		// See: https://github.com/espressif/esp-idf/issues/2634
 		// sdm0 = 28, sdm1 = 8, sdm2 = 5, odir = 0 -> 88199.977
 #if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
@@ -300,99 +370,148 @@ static bool set_sample_rate(int hz)
 		rtc_clk_apll_enable(1, 28, 8, 5, 0);
 #endif
 	}
-
-	return true;
 }
 
-// S/PDIF volume
-static inline void change_volume16(int16_t *buffer, size_t num_samples)
+/* the output clock to hz: the queued frames play out at the old rate first */
+static bool set_sample_rate(int hz)
 {
-	volatile uint32_t mult = renderer_instance->volume;
+	if (hz == renderer_instance->sample_rate)
+		return true;
+	// S/PDIF sends two 32 bit slots per subframe
+	int clk = (renderer_instance->output_mode == SPDIF) ? 2 * hz : hz;
+	int old_clk = (renderer_instance->output_mode == SPDIF) ? 2 * renderer_instance->sample_rate : renderer_instance->sample_rate;
+	ESP_LOGD(TAG, "Changing output from %d to %d Hz", renderer_instance->sample_rate, hz);
+
+	// drain: the channel sends silence after the last buffer, not a burst at the new rate
+	if (old_clk > 0)
+		vTaskDelay(pdMS_TO_TICKS(dma_frames * 1000 / old_clk) + 1);
+	// no retry on every block if the clock fails: the stream plays at the old rate
+	renderer_instance->sample_rate = hz;
 
-	if (mult != 0x10000) // && (renderer_instance->output_mode != DAC_BUILT_IN) && (renderer_instance->output_mode != PDM))// need volume?
+	i2s_std_clk_config_t clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(clk);
+#if SOC_I2S_SUPPORTS_APLL
+	clk_cfg.clk_src = I2S_CLK_SRC_APLL;
+#endif
+	esp_err_t err = i2s_channel_disable(tx_handle);
+	if (err == ESP_OK)
+		err = i2s_channel_reconfig_std_clock(tx_handle, &clk_cfg);
+	esp_err_t res = i2s_channel_enable(tx_handle);
+	if (err != ESP_OK || res != ESP_OK)
 	{
-		int16_t *psample = buffer;
-		for (int32_t i = 0; i < num_samples; i++)
-		{
-			psample[i] = (((uint32_t)buffer[i] * mult) >> 16) & 0xFFFF;
-		}
+		ESP_LOGE(TAG, "i2s_set_clk error %d %d", err, res);
+		return false;
 	}
+
+	apll_fix(clk);
+	return true;
 }
 
-static void encode_spdif(uint32_t *spdif_buffer, int16_t *buffer, size_t num_samples, pcm_format_t *buf_desc)
+/* the rate the output runs at for a stream at hz */
+static int output_rate(uint32_t hz)
 {
-	// pointer to left / right sample positio
-	int16_t *ptr_l = buffer;
-	int16_t *ptr_r = buffer + 1;
-	uint8_t stride = 2;
+	if (renderer_instance->fixed_rate != 0)
+		return renderer_instance->fixed_rate;
+	// S/PDIF receivers start at 32 kHz: lower rates go up to their family's rate
+	if (renderer_instance->output_mode == SPDIF && hz < 32000)
+		return (hz % 11025 == 0) ? 44100 : 48000;
+	return hz;
+}
 
-	// right half of the buffer contains all the right channel samples
-	if (buf_desc->buffer_format == PCM_LEFT_RIGHT)
-	{
-		ptr_r = buffer + num_samples;
-		stride = 1;
-	}
+/*
+ * A subframe's first word depends on its sample only: the BMC of the high
+ * byte in the low half, of the low byte in the high half, the latter
+ * inverted when the high byte's code ends low. Both halves come out of one
+ * table each, the inversion folded into the high byte's entry as an XOR
+ * mask. The aux bits, parity included, follow from the last bit of the word.
+ */
+DRAM_ATTR static uint32_t spdif_bmc_hi[256]; // BMC in the low half, the inversion of the low byte above
+DRAM_ATTR static uint32_t spdif_bmc_lo[256]; // BMC in the high half
 
-	if (buf_desc->num_channels == 1)
+static void spdif_tables_init()
+{
+	for (int i = 0; i < 256; i++)
 	{
-		ptr_r = ptr_l;
+		uint16_t bmc = SPDIF_BMCLOOKUP[i];
+		spdif_bmc_hi[i] = bmc | ((bmc & 0x8000) ? 0 : 0xffff0000);
+		spdif_bmc_lo[i] = (uint32_t)bmc << 16;
 	}
+}
 
+// Fixed 4 bits auxillary-audio-databits, the first used as parity
+// Depending on first bit of low word, invert the bits
+#define SPDIF_AUX(word) (0xb333 ^ ((uint32_t)((int32_t)(word) >> 31) & 0x7fff))
+
+#define SPDIF_FRAME(p, left, right, preamble)                           \
+	do                                                                  \
+	{                                                                   \
+		uint16_t s_l = (left), s_r = (right);                           \
+		uint32_t w_l = spdif_bmc_lo[s_l & 0xff] ^ spdif_bmc_hi[s_l >> 8]; \
+		uint32_t w_r = spdif_bmc_lo[s_r & 0xff] ^ spdif_bmc_hi[s_r >> 8]; \
+		(p)[0] = w_l;                                                   \
+		(p)[1] = (preamble) | SPDIF_AUX(w_l);                           \
+		(p)[2] = w_r;                                                   \
+		(p)[3] = VUCP_PREAMBLE_W | SPDIF_AUX(w_r);                      \
+	} while (0)
+
+// frames in a channel status block, its first one starts with a 'B' preamble
+#define SPDIF_BLOCK_FRAMES 192
+
+/* volume applied on the way, like the PCM kernels: the source is not written */
+static void IRAM_ATTR encode_spdif(uint32_t *spdif_buffer, const int16_t *ptr_l, const int16_t *ptr_r, uint8_t stride, size_t num_samples, uint32_t mult)
+{
 	uint32_t *spdif_ptr = spdif_buffer;
-	uint16_t hi, lo, aux;
+	uint32_t frame_num = renderer_instance->frame_num;
 
-	for (int i = 0; i < num_samples; i++)
+	while (num_samples > 0)
 	{
-		if (renderer_status == STOPPED)
-			break;
-
-		uint16_t sample_left = *ptr_l;
-
-		// BMC encode and flip left channel bits
-		hi = SPDIF_BMCLOOKUP[(uint8_t)(sample_left >> 8)];
-		lo = SPDIF_BMCLOOKUP[(uint8_t)sample_left];
-		// Low word is inverted depending on first bit of high word
-		lo ^= (~((int16_t)hi) >> 16);
-		spdif_ptr[0] = ((uint32_t)lo << 16) | hi;
-		// Fixed 4 bits auxillary-audio-databits, the first used as parity
-		// Depending on first bit of low word, invert the bits
-		aux = 0xb333 ^ (((uint32_t)((int16_t)lo)) >> 17);
 		// Send 'B' preamble only for the first frame of data-block
-		if (renderer_instance->frame_num == 0)
-		{
-			spdif_ptr[1] = VUCP_PREAMBLE_B | aux;
-		}
-		else
+		if (frame_num == 0)
 		{
-			spdif_ptr[1] = VUCP_PREAMBLE_M | aux;
+			SPDIF_FRAME(spdif_ptr, VOL16(*ptr_l, mult), VOL16(*ptr_r, mult), VUCP_PREAMBLE_B);
+			spdif_ptr += 4;
+			ptr_l += stride;
+			ptr_r += stride;
+			num_samples--;
+			frame_num = 1;
+			continue;
 		}
 
-		uint16_t sample_right = *ptr_r;
-		// BMC encode right channel, similar as above
-		hi = SPDIF_BMCLOOKUP[(uint8_t)(sample_right >> 8)];
-		lo = SPDIF_BMCLOOKUP[(uint8_t)sample_right];
-		lo ^= (~((int16_t)hi) >> 16);
-		spdif_ptr[2] = ((uint32_t)lo << 16) | hi;
-		aux = 0xb333 ^ (((uint32_t)((int16_t)lo)) >> 17);
-		spdif_ptr[3] = VUCP_PREAMBLE_W | aux;
+		// then 'M' up to the end of the block, two frames a turn
+		uint32_t run = SPDIF_BLOCK_FRAMES - frame_num;
+		if (run > num_samples)
+			run = num_samples;
+		num_samples -= run;
+		frame_num += run;
+		if (frame_num == SPDIF_BLOCK_FRAMES)
+			frame_num = 0;
 
-		spdif_ptr += 4;
-		ptr_r += stride;
-		ptr_l += stride;
-
-		if (++(renderer_instance->frame_num) > 191)
-			renderer_instance->frame_num = 0;
+		for (; run >= 2; run -= 2)
+		{
+			SPDIF_FRAME(spdif_ptr, VOL16(ptr_l[0], mult), VOL16(ptr_r[0], mult), VUCP_PREAMBLE_M);
+			SPDIF_FRAME(spdif_ptr + 4, VOL16(ptr_l[stride], mult), VOL16(ptr_r[stride], mult), VUCP_PREAMBLE_M);
+			spdif_ptr += 8;
+			ptr_l += 2 * stride;
+			ptr_r += 2 * stride;
+		}
+		if (run)
+		{
+			SPDIF_FRAME(spdif_ptr, VOL16(*ptr_l, mult), VOL16(*ptr_r, mult), VUCP_PREAMBLE_M);
+			spdif_ptr += 4;
+			ptr_l += stride;
+			ptr_r += stride;
+		}
 	}
+	renderer_instance->frame_num = frame_num;
 }
 
 /* Ported from ESP8266Audio for Ka-Radio32
  * Original source at:
  *      https://github.com/earlephilhower/ESP8266Audio/blob/master/src/AudioOutputSPDIF.cpp
  */
-static void render_spdif_samples(const void *buf, uint32_t buf_len, pcm_format_t *buf_desc)
+static void render_spdif_samples(const void *buf, uint32_t buf_len, pcm_format_t *buf_desc, uint32_t mult)
 {
 
-	int16_t *pcm_buffer = (int16_t *)buf;
+	const int16_t *pcm_buffer = (const int16_t *)buf;
 
 	// support only 16 bit buffers for now
 	if (buf_desc->bit_depth != I2S_DATA_BIT_WIDTH_16BIT)
@@ -410,45 +529,309 @@ static void render_spdif_samples(const void *buf, uint32_t buf_len, pcm_format_t
 	//	uint32_t num_samples = buf_len / ((buf_desc->bit_depth / 8) )/ buf_desc->num_channels;
 
 	// aac max: #define OUTPUT_BUFFER_SIZE  (2048 * sizeof(SHORT) * 2)
-	//	mp3max:  short int short_sample_buff[2][32];
-	size_t bytes_cnt = num_samples * sizeof(uint32_t) * 4;
-
-	//	ESP_LOGI(TAG, "render_spdif_samples len: %d, bytes_cnt: %d",buf_len,bytes_cnt);
+	//	mp3max:  short int samples[1152 * 2];
+	//	ESP_LOGI(TAG, "render_spdif_samples len: %d, samples: %d",buf_len,num_samples);
 
-	uint32_t *spdif_buffer = heap_caps_malloc(bytes_cnt, MALLOC_CAP_DEFAULT);
-	if (spdif_buffer == NULL)
+	if (!scratch_reserve())
 	{
-		ESP_LOGE(TAG, "spdif buf failed len:%" PRIu32 " ", buf_len);
 		renderer_stop();
 		audio_player_stop();
 		return;
 	}
 
-	// handle changed sample rate
-	if (set_sample_rate(buf_desc->sample_rate) != true)
+	// pointer to left / right sample position
+	const int16_t *ptr_l = pcm_buffer;
+	const int16_t *ptr_r = pcm_buffer + 1;
+	uint8_t stride = buf_desc->num_channels;
+
+	// right half of the buffer contains all the right channel samples
+	if (buf_desc->buffer_format == PCM_LEFT_RIGHT)
+	{
+		ptr_r = pcm_buffer + num_samples;
+		stride = 1;
+	}
+
+	if (buf_desc->num_channels == 1)
 	{
-		ESP_LOGE(TAG, "i2s_set_clk error");
+		ptr_r = ptr_l;
 	}
 
-	// adjust digital volume
-	change_volume16(pcm_buffer, num_samples * buf_desc->num_channels);
+	// generate SPDIF stream, an arena at a time
+	scratch_used(num_samples);
+	while (num_samples > 0 && renderer_status != STOPPED)
+	{
+		uint32_t n = (num_samples < SCRATCH_FRAMES) ? num_samples : SCRATCH_FRAMES;
+		encode_spdif((uint32_t *)scratch, ptr_l, ptr_r, stride, n, mult);
+		write_i2s(scratch, n * 4 * sizeof(uint32_t));
+		ptr_l += n * stride;
+		ptr_r += n * stride;
+		num_samples -= n;
+	}
+}
 
-	// generate SPDIF stream
-	encode_spdif(spdif_buffer, pcm_buffer, num_samples, buf_desc);
-	write_i2s(spdif_buffer, buf_len);
-	free(spdif_buffer);
+/* the output format conversion, KaraDio32 volume control on the way */
+static void IRAM_ATTR render_format(const char *buf, uint32_t buf_len, pcm_format_t *buf_desc, uint32_t mult)
+{
+	if (renderer_instance->output_mode == SPDIF)
+		render_spdif_samples(buf, buf_len, buf_desc, mult);
+	else
+		render_i2s_samples(buf, buf_len, buf_desc, mult);
+}
+
+/*
+ * Bass and treble for the outputs without a VS1053, from its SCI_BASS
+ * settings: RBJ shelving biquads, S = 1, then a mid/side width matrix.
+ * The biquads run in direct form I on 16.8 samples with Q28 coefficients
+ * and first order error feedback, which keeps the low bass shelf free of
+ * truncation noise and limit cycles. The volume is folded into the width
+ * matrix, so the output conversion after it runs at unity.
+ */
+#define TONE_Q 28
+#define TONE_FRAMES SCRATCH_FRAMES
+
+typedef struct
+{
+	int32_t b0, b1, b2, a1, a2;
+} biquad_t;
+
+typedef struct
+{
+	int32_t x1, x2, y1, y2;
+	int32_t err;
+} biquad_state_t;
+
+static struct
+{
+	volatile bool dirty;		// settings changed, coefficients to compute
+	bool on;
+	int8_t treble;				// 1.5 dB steps, -8 to 7
+	uint8_t treble_khz;			// 1 to 15
+	uint8_t bass;				// dB, 0 to 15
+	uint8_t bass_freq;			// 10 Hz steps, 2 to 15
+	uint8_t spatial;			// 0 to 3
+	uint32_t rate;				// the coefficients are for
+	biquad_t low, high;
+	int32_t direct, cross;		// width matrix, Q16
+	biquad_state_t state[2][2]; // low and high shelf, left and right
+} tone;
+
+static int16_t toned[TONE_FRAMES * 2];
+
+/* gain in dB, halfway at f0 */
+static void tone_shelf(biquad_t *q, bool high, double db, double f0, double fs)
+{
+	double A = pow(10, db / 40);
+	double w0 = 2 * M_PI * f0 / fs;
+	double cw = cos(w0);
+	double sa = 2 * sqrt(A) * sin(w0) / 2 * sqrt(2); // 2 sqrt(A) alpha
+	double sign = high ? -1 : 1;
+	double b0 = A * ((A + 1) - sign * (A - 1) * cw + sa);
+	double b1 = sign * 2 * A * ((A - 1) - sign * (A + 1) * cw);
+	double b2 = A * ((A + 1) - sign * (A - 1) * cw - sa);
+	double a0 = (A + 1) + sign * (A - 1) * cw + sa;
+	double a1 = -sign * 2 * ((A - 1) + sign * (A + 1) * cw);
+	double a2 = (A + 1) + sign * (A - 1) * cw - sa;
+	double one = 1 << TONE_Q;
+	q->b0 = lrint(b0 / a0 * one);
+	q->b1 = lrint(b1 / a0 * one);
+	q->b2 = lrint(b2 / a0 * one);
+	q->a1 = lrint(a1 / a0 * one);
+	q->a2 = lrint(a2 / a0 * one);
+}
+
+/* coefficients for the settings at rate, the filter states kept */
+static void tone_design(uint32_t rate)
+{
+	static const float widths[4] = {1.0f, 1.25f, 1.5f, 2.0f};
+	tone.dirty = false;
+	tone.rate = rate;
+	// the VS1053 boosts above its bass limit: the shelf is halfway an octave up
+	tone_shelf(&tone.low, false, tone.bass, tone.bass_freq * 20.0, rate);
+	double f0 = tone.treble_khz * 1000.0;
+	if (f0 > rate * 0.45)
+		f0 = rate * 0.45;
+	tone_shelf(&tone.high, true, tone.treble * 1.5, f0, rate);
+	float w = widths[tone.spatial];
+	tone.direct = lrintf((1 + w) / 2 * 0x10000);
+	tone.cross = lrintf((1 - w) / 2 * 0x10000);
+	ESP_LOGD(TAG, "tone at %" PRIu32 " Hz: bass %d dB at %d Hz, treble %d x 1.5 dB at %d Hz, width %d%%", rate,
+			 tone.bass, tone.bass_freq * 20, tone.treble, (int)f0, (int)(w * 100));
+}
+
+static inline int32_t IRAM_ATTR biquad(const biquad_t *q, biquad_state_t *s, int32_t x)
+{
+	int64_t acc = (int64_t)q->b0 * x + (int64_t)q->b1 * s->x1 + (int64_t)q->b2 * s->x2 - (int64_t)q->a1 * s->y1 - (int64_t)q->a2 * s->y2 + s->err;
+	int32_t y = acc >> TONE_Q;
+	s->err = acc & ((1 << TONE_Q) - 1);
+	s->x2 = s->x1;
+	s->x1 = x;
+	s->y2 = s->y1;
+	s->y1 = y;
+	return y;
+}
+
+static inline int16_t IRAM_ATTR tone_out(int64_t y)
+{
+	// 16.8 samples by Q16 gains
+	y = (y + (1 << 23)) >> 24;
+	if (y > INT16_MAX)
+		return INT16_MAX;
+	if (y < INT16_MIN)
+		return INT16_MIN;
+	return y;
+}
+
+/* shelves, width and volume from any 16 bit layout to interleaved stereo */
+static void IRAM_ATTR tone_process(int16_t *out, const int16_t *ptr_l, const int16_t *ptr_r, uint8_t stride, uint32_t num_samples, uint32_t mult)
+{
+	int64_t direct = ((int64_t)tone.direct * mult) >> 16;
+	int64_t cross = ((int64_t)tone.cross * mult) >> 16;
+	bool low = tone.bass != 0;
+	bool high = tone.treble != 0;
+
+	for (uint32_t i = 0; i < num_samples; i++)
+	{
+		int32_t l = *ptr_l * 256;
+		int32_t r = *ptr_r * 256;
+		ptr_l += stride;
+		ptr_r += stride;
+		if (low)
+		{
+			l = biquad(&tone.low, &tone.state[0][0], l);
+			r = biquad(&tone.low, &tone.state[0][1], r);
+		}
+		if (high)
+		{
+			l = biquad(&tone.high, &tone.state[1][0], l);
+			r = biquad(&tone.high, &tone.state[1][1], r);
+		}
+		*out++ = tone_out(l * direct + r * cross);
+		*out++ = tone_out(r * direct + l * cross);
+	}
+}
+
+static void IRAM_ATTR render_tone(const char *buf, uint32_t buf_len, pcm_format_t *buf_desc)
+{
+	if (tone.dirty || tone.rate != buf_desc->sample_rate)
+		tone_design(buf_desc->sample_rate);
+
+	uint32_t num_samples = buf_len / sizeof(int16_t) / buf_desc->num_channels;
+	const int16_t *ptr_l = (const int16_t *)buf;
+	const int16_t *ptr_r = ptr_l + 1;
+	uint8_t stride = buf_desc->num_channels;
+	if (buf_desc->num_channels == 1)
+		ptr_r = ptr_l;
+	else if (buf_desc->buffer_format == PCM_LEFT_RIGHT)
+	{
+		ptr_r = ptr_l + num_samples;
+		stride = 1;
+	}
+
+	pcm_format_t out_desc = {
+		.sample_rate = buf_desc->sample_rate,
+		.bit_depth = I2S_DATA_BIT_WIDTH_16BIT,
+		.num_channels = 2,
+		.buffer_format = PCM_INTERLEAVED};
+	while (num_samples > 0 && renderer_status == RUNNING)
+	{
+		uint32_t n = (num_samples < TONE_FRAMES) ? num_samples : TONE_FRAMES;
+		tone_process(toned, ptr_l, ptr_r, stride, n, renderer_instance->volume);
+		render_format((const char *)toned, n * 2 * sizeof(int16_t), &out_desc, 0x10000);
+		ptr_l += n * stride;
+		ptr_r += n * stride;
+		num_samples -= n;
+	}
+}
+
+static void IRAM_ATTR render_output(const char *buf, uint32_t buf_len, pcm_format_t *buf_desc)
+{
+	if (tone.on && buf_desc->bit_depth == I2S_DATA_BIT_WIDTH_16BIT)
+		render_tone(buf, buf_len, buf_desc);
+	else
+		render_format(buf, buf_len, buf_desc, renderer_instance->volume);
+}
+
+// a stream at another rate than the output goes through the resampler, a chunk at a time
+#define RESAMPLED_FRAMES SCRATCH_FRAMES
+static resampler_t resampler;
+static int16_t resampled[RESAMPLED_FRAMES * 2];
+
+static drift_t drift;
+// no block rendered yet since the start: the next one is the first sample of a stream
+static bool first_block;
+
+/* correction of the clock drift, from the fifo fill once a second */
+static int32_t drift_ppm()
+{
+	uint32_t fill_ms;
+	if (!audio_player_get_buffered_ms(&fill_ms))
+		return drift.ppm;
+	uint32_t now = xTaskGetTickCount() * portTICK_PERIOD_MS;
+	return drift_update(&drift, (now != 0) ? now : 1, fill_ms);
+}
+
+static void IRAM_ATTR render_resampled(const char *buf, uint32_t buf_len, pcm_format_t *buf_desc, int out_rate, int32_t ppm)
+{
+	uint8_t channels = buf_desc->num_channels;
+	if (resampler.in_rate != buf_desc->sample_rate || resampler.out_rate != out_rate || resampler.channels != channels)
+	{
+		if (!resampler_setup(&resampler, buf_desc->sample_rate, out_rate, channels))
+		{
+			ESP_LOGE(TAG, "no resampler from %" PRIu32 " to %d Hz", buf_desc->sample_rate, out_rate);
+			renderer_stop();
+			audio_player_stop();
+			return;
+		}
+	}
+	if (resampler.ppm != ppm)
+		resampler_trim(&resampler, ppm);
+
+	uint32_t num_samples = buf_len / sizeof(int16_t) / channels;
+	const int16_t *ptr_l = (const int16_t *)buf;
+	const int16_t *ptr_r = ptr_l + 1;
+	uint8_t stride = channels;
+	if (buf_desc->buffer_format == PCM_LEFT_RIGHT)
+	{
+		ptr_r = ptr_l + num_samples;
+		stride = 1;
+	}
+
+	pcm_format_t out_desc = {
+		.sample_rate = out_rate,
+		.bit_depth = I2S_DATA_BIT_WIDTH_16BIT,
+		.num_channels = channels,
+		.buffer_format = PCM_INTERLEAVED};
+	while (num_samples > 0 && renderer_status == RUNNING)
+	{
+		uint32_t used;
+		uint32_t n = resampler_run(&resampler, ptr_l, ptr_r, stride, num_samples, &used, resampled, RESAMPLED_FRAMES);
+		if (n > 0)
+			render_output((const char *)resampled, n * channels * sizeof(int16_t), &out_desc);
+		ptr_l += used * stride;
+		ptr_r += used * stride;
+		num_samples -= used;
+	}
 }
 
 // Decoded frame
-void IRAM_ATTR render_samples(char *buf, uint32_t buf_len, pcm_format_t *buf_desc)
+void IRAM_ATTR render_samples(const char *buf, uint32_t buf_len, pcm_format_t *buf_desc)
 {
 	if (renderer_status != RUNNING)
 		return;
+	if (first_block)
+	{
+		first_block = false;
+		audio_player_first_sample();
+	}
 
-	if (renderer_instance->output_mode == SPDIF)
-		render_spdif_samples(buf, buf_len, buf_desc);
+	int out_rate = output_rate(buf_desc->sample_rate);
+	set_sample_rate(out_rate);
+	// 16 bit streams only: the others play at the output clock, drift uncorrected
+	bool trim = renderer_instance->drift;
+	if ((out_rate != buf_desc->sample_rate || trim) && buf_desc->bit_depth == I2S_DATA_BIT_WIDTH_16BIT)
+		render_resampled(buf, buf_len, buf_desc, out_rate, trim ? drift_ppm() : 0);
 	else
-		render_i2s_samples(buf, buf_len, buf_desc);
+		render_output(buf, buf_len, buf_desc);
 }
 
 void renderer_zero_dma_buffer()
@@ -459,6 +842,60 @@ void renderer_zero_dma_buffer()
 	ESP_LOGI(TAG, "clean buffer");
 }
 
+// silence for the outputs that do not go quiet on their own
+static int16_t silence[UNDERFLOW_FRAMES * 2];
+
+bool renderer_underflow()
+{
+	if (renderer_status != RUNNING)
+		return true;
+	// the I2S channel clears what it is not fed: silence for PCM codecs, PDM and MERUS.
+	// Zeros are no S/PDIF frames and the built-in DAC is silent at mid scale.
+	if (renderer_instance->output_mode != SPDIF && renderer_instance->output_mode != DAC_BUILT_IN)
+		return true;
+	// no output clock yet to write it at
+	if (renderer_instance->sample_rate <= 0)
+		return true;
+	pcm_format_t format = {
+		.sample_rate = renderer_instance->sample_rate,
+		.bit_depth = I2S_DATA_BIT_WIDTH_16BIT,
+		.num_channels = 2,
+		.buffer_format = PCM_INTERLEAVED};
+	render_samples((const char *)silence, sizeof(silence), &format);
+	return false;
+}
+
+void renderer_fixed_rate(uint32_t hz)
+{
+	// the next block switches the clock
+	renderer_instance->fixed_rate = hz;
+}
+
+void renderer_tone(int8_t treble, uint8_t treble_khz, uint8_t bass, uint8_t bass_freq, uint8_t spatial)
+{
+	tone.treble = (treble < -8) ? -8 : ((treble > 7) ? 7 : treble);
+	tone.treble_khz = (treble_khz < 1) ? 1 : ((treble_khz > 15) ? 15 : treble_khz);
+	tone.bass = (bass > 15) ? 15 : bass;
+	tone.bass_freq = (bass_freq < 2) ? 2 : ((bass_freq > 15) ? 15 : bass_freq);
+	tone.spatial = (spatial > 3) ? 3 : spatial;
+	// the next block takes the new coefficients
+	tone.dirty = true;
+	tone.on = tone.treble != 0 || tone.bass != 0 || tone.spatial != 0;
+}
+
+void renderer_drift(bool on)
+{
+	if (on && !renderer_instance->drift)
+		drift_reset(&drift);
+	renderer_instance->drift = on;
+}
+
+void renderer_get_stats(renderer_stats_t *stats)
+{
+	*stats = scratch_stats;
+	stats->drift_ppm = drift.ppm;
+}
+
 renderer_config_t *renderer_get()
 {
 	return renderer_instance;
@@ -470,6 +907,7 @@ void renderer_init(renderer_config_t *config)
 	// update global
 	renderer_instance = config;
 	renderer_instance->frame_num = 0;
+	spdif_tables_init();
 
 	renderer_status = INITIALIZED;
 }
@@ -480,6 +918,13 @@ void renderer_start()
 		return;
 
 	renderer_instance->frame_num = 0;
+	// use is counted per stream, allocations for as long as the arena is kept, sized for the output format before the first block
+	scratch_stats.peak_bytes = 0;
+	scratch_stats.blocks = 0;
+	scratch_reserve();
+	drift_reset(&drift);
+	memset(tone.state, 0, sizeof(tone.state));
+	first_block = true;
 	ESP_LOGD(TAG, "Start");
 	renderer_status = RUNNING;
 }
@@ -491,7 +936,8 @@ void renderer_stop()
 	//	if(renderer_status == RUNNING)
 
 	renderer_status = STOPPED;
-	ESP_LOGD(TAG, "Stop");
+	ESP_LOGD(TAG, "Stop, scratch arena %u bytes, peak %u, %" PRIu32 " allocations for %" PRIu32 " blocks",
+			 scratch_stats.arena_bytes, scratch_stats.peak_bytes, scratch_stats.allocs, scratch_stats.blocks);
 
 	renderer_instance->frame_num = 0;
 }
@@ -501,6 +947,12 @@ void renderer_destroy()
 	renderer_status = UNINITIALIZED;
 	ESP_ERROR_CHECK(i2s_channel_disable(tx_handle));
 	ESP_ERROR_CHECK(i2s_del_channel(tx_handle));
+	tx_handle = NULL;
+	heap_caps_free(scratch);
+	scratch = NULL;
+	scratch_stats.arena_bytes = 0;
+	scratch_stats.allocs = 0;
+	resampler_free(&resampler);
 	ESP_LOGI(TAG, "render destroyed");
 }
 
@@ -511,12 +963,12 @@ static void IRAM_ATTR write_i2s(const void *buffer, size_t bytes_cnt)
 	size_t bytes_written = 0;
 	while ((bytes_left > 0) && (renderer_status != STOPPED))
 	{
-		esp_err_t res = i2s_channel_write(tx_handle, buf, bytes_cnt, &bytes_written, 1000);
+		esp_err_t res = i2s_channel_write(tx_handle, buf, bytes_left, &bytes_written, 1000);
 		if (res != ESP_OK)
 		{
 			ESP_LOGE(TAG, "i2s_write error %d", res);
 		}
-		if (bytes_written != bytes_cnt)
+		if (bytes_written != bytes_left)
 		{
 			ESP_LOGV(TAG, "written: %d, len: %d", bytes_written, bytes_left);
 		}
@@ -525,14 +977,18 @@ static void IRAM_ATTR write_i2s(const void *buffer, size_t bytes_cnt)
 	}
 }
 
+/* set up the output channel, once: it stays enabled from stream to stream */
 bool i2s_init()
 {
 	renderer_config_t *config;
 	config = renderer_get();
 
+	if (tx_handle != NULL)
+		return true;
+
 	config->bit_depth = I2S_DATA_BIT_WIDTH_16BIT;
 	config->i2s_num = I2S_NUM_0;
-	config->sample_rate = 44100;
+	config->sample_rate = (config->fixed_rate != 0) ? config->fixed_rate : 44100;
 	config->sample_rate_modifier = 1.0;
 	config->output_mode = get_audio_output_mode();
 
@@ -575,7 +1031,16 @@ bool i2s_init()
 	gpio_get_i2s(&lrck, &bclk, &i2sdata);
 
 	i2s_chan_config_t chan_cfg = I2S_CHANNEL_DEFAULT_CONFIG(config->i2s_num, I2S_ROLE_MASTER);
-	ESP_ERROR_CHECK(i2s_new_channel(&chan_cfg, &tx_handle, NULL));
+	// silence rather than the last DMA buffers over and over between streams
+	chan_cfg.auto_clear = true;
+	dma_frames = chan_cfg.dma_desc_num * chan_cfg.dma_frame_num;
+	esp_err_t err = i2s_new_channel(&chan_cfg, &tx_handle, NULL);
+	if (err != ESP_OK)
+	{
+		ESP_LOGE(TAG, "i2s_new_channel error %d", err);
+		tx_handle = NULL;
+		return false;
+	}
 
 	i2s_std_config_t std_cfg =
 		{
@@ -602,11 +1067,19 @@ bool i2s_init()
 	std_cfg.clk_cfg.clk_src = I2S_CLK_SRC_APLL;
 #endif
 	/* Initialize the tx channel handle to standard mode */
-	ESP_ERROR_CHECK(i2s_channel_init_std_mode(tx_handle, &std_cfg));
-
-	ESP_LOGI(TAG, "I2S tx channels have been initialized to standard output mode\n");
-
-	ESP_ERROR_CHECK(i2s_channel_enable(tx_handle));
+	err = i2s_channel_init_std_mode(tx_handle, &std_cfg);
+	if (err == ESP_OK)
+	{
+		ESP_LOGI(TAG, "I2S tx channels have been initialized to standard output mode\n");
+		err = i2s_channel_enable(tx_handle);
+	}
+	if (err != ESP_OK)
+	{
+		ESP_LOGE(TAG, "i2s channel setup error %d", err);
+		i2s_del_channel(tx_handle);
+		tx_handle = NULL;
+		return false;
+	}
 	ESP_LOGI(TAG, "I2S tx channel enabled\n");
 
 	if (config->output_mode == I2S_MERUS)
@@ -614,11 +1087,8 @@ bool i2s_init()
 		if (init_ma120(0x50))		   // setup ma120x0p and initial volume
 			config->output_mode = I2S; // error, back to I2S
 	}
-	else if (config->output_mode == SPDIF)
-	{
-		config->sample_rate = 0;
-		set_sample_rate(44100);
-	}
+	else
+		apll_fix(sample_rate);
 
 	return true;
 }
\ No newline at end of file
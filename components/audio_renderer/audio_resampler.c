@@ -0,0 +1,209 @@
+/*
+ * audio_resampler.c
+ *
+ *  Polyphase sample rate conversion for the renderer's fixed output rate.
+ *
+ *  The filter is a Kaiser windowed sinc at the lower of the two Nyquist
+ *  frequencies, tabulated for RESAMPLER_PHASES + 1 fractional positions.
+ *  For an output frame the coefficients are interpolated between the two
+ *  phases around its position, once for both channels.
+ *
+ *  Q15 coefficients are not enough: their rounding differs from phase to
+ *  phase and comes out as noise about 85 dB down. They are kept in Q23 and
+ *  split for the dot product into a Q15 high part and an 8 bit low part,
+ *  two 32 bit sums instead of 64 bit arithmetic.
+ */
+
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
+
+#include "esp_log.h"
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
+
+#include "audio_resampler.h"
+
+#define TAG "Resampler"
+
+// cutoff, as a part of the lower Nyquist frequency, and window shape
+#define RESAMPLER_CUTOFF 0.90f
+#define RESAMPLER_BETA 10.0f
+
+#define COEF_BITS 23
+#define COEF_ONE (1 << COEF_BITS)
+#define PHASE_BITS (__builtin_ctz(RESAMPLER_PHASES))
+// filter delay: the output at position 0 is centered on the first input frame
+#define HALF (RESAMPLER_TAPS / 2 - 1)
+
+/* zeroth order modified Bessel function of the first kind, for the window */
+static float bessel_i0(float x)
+{
+	float sum = 1.0f, term = 1.0f;
+	for (int k = 1; k < 32 && term > 1e-9f * sum; k++)
+	{
+		term *= (x / (2.0f * k)) * (x / (2.0f * k));
+		sum += term;
+	}
+	return sum;
+}
+
+bool resampler_setup(resampler_t *rs, uint32_t in_rate, uint32_t out_rate, uint8_t channels)
+{
+	// the history must hold the input an output frame steps over
+	if (in_rate == 0 || out_rate == 0 || in_rate / out_rate >= RESAMPLER_TAPS / 2 || channels < 1 || channels > 2)
+		return false;
+	if (rs->coefs == NULL)
+	{
+		rs->coefs = heap_caps_malloc((RESAMPLER_PHASES + 1) * RESAMPLER_TAPS * sizeof(int32_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+		if (rs->coefs == NULL)
+		{
+			ESP_LOGE(TAG, "no memory for the filter");
+			return false;
+		}
+	}
+
+	// cycles per input frame
+	float fc = 0.5f * RESAMPLER_CUTOFF * ((out_rate < in_rate) ? (float)out_rate / in_rate : 1.0f);
+	float i0_beta = bessel_i0(RESAMPLER_BETA);
+	float half = RESAMPLER_TAPS / 2.0f;
+
+	for (int p = 0; p <= RESAMPLER_PHASES; p++)
+	{
+		float h[RESAMPLER_TAPS];
+		float sum = 0;
+		for (int k = 0; k < RESAMPLER_TAPS; k++)
+		{
+			// from the output position to tap k
+			float d = k - HALF - (float)p / RESAMPLER_PHASES;
+			float x = 2.0f * fc * d;
+			float sinc = (x == 0) ? 1.0f : sinf((float)M_PI * x) / ((float)M_PI * x);
+			float w = d / half;
+			w = (w <= -1.0f || w >= 1.0f) ? 0 : bessel_i0(RESAMPLER_BETA * sqrtf(1.0f - w * w)) / i0_beta;
+			h[k] = sinc * w;
+			sum += h[k];
+		}
+		// unity gain at DC for each phase, the rounding left on the center tap
+		int32_t *row = rs->coefs + p * RESAMPLER_TAPS;
+		int32_t total = 0;
+		for (int k = 0; k < RESAMPLER_TAPS; k++)
+		{
+			row[k] = lrintf(h[k] / sum * COEF_ONE);
+			total += row[k];
+		}
+		row[HALF + (p * 2 >= RESAMPLER_PHASES)] += COEF_ONE - total;
+	}
+
+	rs->in_rate = in_rate;
+	rs->out_rate = out_rate;
+	rs->channels = channels;
+	rs->ppm = 0;
+	rs->step = ((uint64_t)in_rate << 32) / out_rate;
+	rs->pos = 0;
+	rs->fill = HALF;
+	memset(rs->hist, 0, sizeof(rs->hist));
+	ESP_LOGI(TAG, "%" PRIu32 " Hz to %" PRIu32 " Hz, %d channels", in_rate, out_rate, channels);
+	return true;
+}
+
+void resampler_trim(resampler_t *rs, int32_t ppm)
+{
+	uint64_t step = ((uint64_t)rs->in_rate << 32) / rs->out_rate;
+	rs->ppm = ppm;
+	rs->step = step + (int64_t)step * ppm / 1000000;
+}
+
+void resampler_free(resampler_t *rs)
+{
+	heap_caps_free(rs->coefs);
+	rs->coefs = NULL;
+	rs->in_rate = 0;
+}
+
+/* a channel through the coefficients of the frame, rounded and clipped */
+static inline int16_t IRAM_ATTR dot(const int16_t *x, const int16_t *hi, const uint8_t *lo)
+{
+	int32_t acc_hi = 0, acc_lo = 0;
+	for (int k = 0; k < RESAMPLER_TAPS; k++)
+	{
+		acc_hi += x[k] * hi[k];
+		acc_lo += x[k] * lo[k];
+	}
+	int64_t y = (int64_t)acc_hi * 256 + acc_lo;
+	y = (y + (1 << (COEF_BITS - 1))) >> COEF_BITS;
+	if (y > INT16_MAX)
+		return INT16_MAX;
+	if (y < INT16_MIN)
+		return INT16_MIN;
+	return y;
+}
+
+uint32_t IRAM_ATTR resampler_run(resampler_t *rs, const int16_t *ptr_l, const int16_t *ptr_r, uint8_t stride, uint32_t num_samples,
+								 uint32_t *used, int16_t *out, uint32_t out_max)
+{
+	uint32_t produced = 0;
+	uint32_t taken = 0;
+
+	for (;;)
+	{
+		// every output whose taps are in the history
+		while (produced < out_max)
+		{
+			uint32_t ip = rs->pos >> 32;
+			if (ip + RESAMPLER_TAPS > rs->fill)
+				break;
+			uint32_t f = (uint32_t)rs->pos;
+			const int32_t *c = rs->coefs + (f >> (32 - PHASE_BITS)) * RESAMPLER_TAPS;
+			int32_t frac = (f >> (16 - PHASE_BITS)) & 0xffff;
+
+			// the filter at the frame's position
+			int16_t hi[RESAMPLER_TAPS];
+			uint8_t lo[RESAMPLER_TAPS];
+			for (int k = 0; k < RESAMPLER_TAPS; k++)
+			{
+				int32_t coef = c[k] + (int32_t)(((int64_t)(c[k + RESAMPLER_TAPS] - c[k]) * frac) >> 16);
+				hi[k] = coef >> 8;
+				lo[k] = coef & 0xff;
+			}
+
+			*out++ = dot(rs->hist[0] + ip, hi, lo);
+			if (rs->channels == 2)
+				*out++ = dot(rs->hist[1] + ip, hi, lo);
+			rs->pos += rs->step;
+			produced++;
+		}
+		if (produced == out_max || taken == num_samples)
+			break;
+
+		// drop the frames behind the next output, take more input after the rest
+		uint32_t ip = rs->pos >> 32;
+		uint32_t keep = rs->fill - ip;
+		for (int ch = 0; ch < rs->channels; ch++)
+			memmove(rs->hist[ch], rs->hist[ch] + ip, keep * sizeof(int16_t));
+		rs->pos -= (uint64_t)ip << 32;
+		rs->fill = keep;
+
+		uint32_t n = RESAMPLER_TAPS + RESAMPLER_CHUNK - keep;
+		if (n > num_samples - taken)
+			n = num_samples - taken;
+		int16_t *hl = rs->hist[0] + keep;
+		int16_t *hr = rs->hist[1] + keep;
+		for (uint32_t i = 0; i < n; i++)
+		{
+			hl[i] = *ptr_l;
+			ptr_l += stride;
+		}
+		if (rs->channels == 2)
+		{
+			for (uint32_t i = 0; i < n; i++)
+			{
+				hr[i] = *ptr_r;
+				ptr_r += stride;
+			}
+		}
+		rs->fill += n;
+		taken += n;
+	}
+	*used = taken;
+	return produced;
+}
@@ -0,0 +1,38 @@
+/*
+ * audio_drift.h
+ *
+ *  Drift between the clock of a live stream and the local I2S clock,
+ *  estimated from the trend of the fifo fill. The correction, in ppm of
+ *  the rate the renderer consumes the stream at, holds the fill where it
+ *  settled after the pre-roll.
+ */
+
+#ifndef INCLUDE_AUDIO_DRIFT_H_
+#define INCLUDE_AUDIO_DRIFT_H_
+
+#include <stdint.h>
+
+/* fill samples taken at most that often */
+#define DRIFT_PERIOD_MS 1000
+/* play time before the setpoint is taken: network bursts of the start die out */
+#define DRIFT_SETTLE_MS 30000
+/* bound of the correction, 0.9 cent of pitch */
+#define DRIFT_MAX_PPM 500
+
+typedef struct
+{
+    uint32_t start_ms;      /* first sample, 0 before it */
+    uint32_t last_ms;       /* last sample */
+    float level;            /* fill low-passed, ms */
+    float target;           /* level the fill is held at, ms, negative until settled */
+    float integral;         /* integral part of the correction, ppm */
+    int32_t ppm;            /* correction: positive consumes the stream faster */
+} drift_t;
+
+/* a new stream: no setpoint, no correction */
+void drift_reset(drift_t *d);
+
+/* the fill in ms of playback at now_ms, now_ms not 0; returns the correction */
+int32_t drift_update(drift_t *d, uint32_t now_ms, uint32_t fill_ms);
+
+#endif /* INCLUDE_AUDIO_DRIFT_H_ */
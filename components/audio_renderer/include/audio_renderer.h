@@ -18,7 +18,9 @@
 typedef struct
 {
     output_mode_t output_mode;
-    int sample_rate;
+    int sample_rate;            /* of the output clock */
+    uint32_t fixed_rate;        /* 0: the output follows the streams, else they are resampled to it */
+    bool drift;                 /* resample to the clock drift of the stream */
     float sample_rate_modifier;
     uint8_t bit_depth;
     i2s_port_t i2s_num;
@@ -39,21 +41,41 @@ typedef struct
     pcm_buffer_layout_t buffer_format;
 } pcm_format_t;
 
+typedef struct
+{
+    size_t arena_bytes;     /* scratch arena for the format conversions */
+    size_t peak_bytes;      /* most of it used by one write */
+    uint32_t allocs;        /* arena allocations since the renderer was set up */
+    uint32_t blocks;        /* blocks of this stream converted through it */
+    int32_t drift_ppm;      /* clock drift correction */
+} renderer_stats_t;
 
-/* generic renderer interface */
-void render_samples(char *buf, uint32_t len, pcm_format_t *format);
+/* generic renderer interface, the buffer is not written */
+void render_samples(const char *buf, uint32_t len, pcm_format_t *format);
 
 /* render callback for libmad */
-void render_sample_block(short *sample_buff_ch0, short *sample_buff_ch1, int num_samples, unsigned int num_channels);
+void render_sample_block(short *sample_buff, int num_samples, unsigned int num_channels);
 
 void renderer_volume(uint32_t volume);
+/* 0: the output clock follows the stream rate; 44100 or 48000: streams are resampled to it */
+void renderer_fixed_rate(uint32_t hz);
+/* bass and treble shelves and stereo width, in the ranges of the VS1053 SCI_BASS:
+ * treble -8 to 7 x 1.5 dB above treble_khz, bass 0 to 15 dB above bass_freq x 10 Hz, spatial 0 to 3 */
+void renderer_tone(int8_t treble, uint8_t treble_khz, uint8_t bass, uint8_t bass_freq, uint8_t spatial);
+/* keep the fifo fill centered on live streams by resampling to their clock drift */
+void renderer_drift(bool on);
 void renderer_init(renderer_config_t *config);
 void renderer_start();
 void renderer_stop();
 void renderer_destroy();
 
 void renderer_zero_dma_buffer();
+/* the decoder has nothing to render: keep the output quiet.
+ * false if a block of silence was written, call again while starved;
+ * true if the output stays quiet by itself, the decoder can sleep */
+bool renderer_underflow();
 renderer_config_t *renderer_get();
+void renderer_get_stats(renderer_stats_t *stats);
 
 bool i2s_init();
 
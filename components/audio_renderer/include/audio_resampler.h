@@ -0,0 +1,52 @@
+/*
+ * audio_resampler.h
+ *
+ *  Sample rate conversion of 16 bit PCM for a fixed output rate:
+ *  windowed sinc polyphase filter, fixed point, linear interpolation
+ *  between the phases for any ratio.
+ */
+
+#ifndef INCLUDE_AUDIO_RESAMPLER_H_
+#define INCLUDE_AUDIO_RESAMPLER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define RESAMPLER_TAPS 32
+/* phases of the filter table, a power of two */
+#define RESAMPLER_PHASES 64
+/* input frames taken in per turn */
+#define RESAMPLER_CHUNK 256
+
+typedef struct
+{
+    uint32_t in_rate;
+    uint32_t out_rate;
+    uint8_t channels;
+    int32_t ppm;            /* trim of the ratio */
+    uint64_t step;          /* input frames per output frame, 32.32 fixed point */
+    uint64_t pos;           /* of the next output frame in hist, 32.32 fixed point */
+    uint32_t fill;          /* frames in hist */
+    int32_t *coefs;         /* RESAMPLER_PHASES + 1 rows of RESAMPLER_TAPS, Q23 */
+    int16_t hist[2][RESAMPLER_TAPS + RESAMPLER_CHUNK];
+} resampler_t;
+
+/* filter for in_rate to out_rate, mono or stereo; the history is cleared */
+bool resampler_setup(resampler_t *rs, uint32_t in_rate, uint32_t out_rate, uint8_t channels);
+
+/* take ppm more input frames per output frame than the nominal ratio, for clock drift */
+void resampler_trim(resampler_t *rs, int32_t ppm);
+
+/* free the filter table */
+void resampler_free(resampler_t *rs);
+
+/**
+ * Convert up to num_samples input frames, taken at ptr_l and ptr_r every
+ * stride samples, into at most out_max interleaved frames at out.
+ * Returns the frames written, *used the input frames consumed: it stops
+ * when out is full or the input is used up.
+ */
+uint32_t resampler_run(resampler_t *rs, const int16_t *ptr_l, const int16_t *ptr_r, uint8_t stride, uint32_t num_samples,
+                       uint32_t *used, int16_t *out, uint32_t out_max);
+
+#endif /* INCLUDE_AUDIO_RESAMPLER_H_ */
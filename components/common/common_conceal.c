@@ -0,0 +1,84 @@
+/*
+ * common_conceal.c
+ *
+ *  Repeat-and-fade concealment of lost frames of interleaved 16 bit PCM.
+ *
+ *  A lost frame is replaced by the last good frame, faded so that a run of
+ *  CONCEAL_MAX_RUN losses ends in silence. Every seam, into a repeat or back
+ *  into decoded audio, is crossfaded from the tail of the last good frame
+ *  played backwards, which picks up exactly where the output left off.
+ */
+
+#include "common_conceal.h"
+
+#include <string.h>
+
+/* Q15 gain at the end of each lost frame of a run, the first starts at 1.0 */
+static const int32_t run_gain[CONCEAL_MAX_RUN + 1] = { 32768, 24576, 12288, 0 };
+
+/*
+ * Crossfade pcm in over its first n samples from the last good frame's tail
+ * played backwards at gain g, which starts on the sample the output ended on.
+ */
+static void xfade_from_tail(const conceal_t *c, int16_t *pcm, unsigned n, unsigned nch, int32_t g)
+{
+    for (unsigned i = 0; i < n; i++) {
+        int32_t w = (int32_t) (i << 15) / n;
+        const int16_t *old = &c->tail[(c->tail_len - 1 - i) * nch];
+        for (unsigned ch = 0; ch < nch; ch++) {
+            int32_t o = (old[ch] * g) >> 15;
+            pcm[i * nch + ch] = (int16_t) ((pcm[i * nch + ch] * w + o * (32768 - w)) >> 15);
+        }
+    }
+}
+
+void conceal_reset(conceal_t *c)
+{
+    c->tail_len = 0;
+    c->run = 0;
+}
+
+void conceal_good(conceal_t *c, int16_t *pcm, unsigned samples, unsigned nch)
+{
+    unsigned n = (samples < CONCEAL_XFADE) ? samples : CONCEAL_XFADE;
+
+    if (c->run > 0 && c->tail_len > 0 && c->nch == nch) {
+        xfade_from_tail(c, pcm, (n < c->tail_len) ? n : c->tail_len, nch, run_gain[c->run]);
+        c->recovered++;
+    }
+    c->run = 0;
+
+    if (nch <= 2) {
+        memcpy(c->tail, &pcm[(samples - n) * nch], n * nch * sizeof(int16_t));
+        c->tail_len = n;
+        c->nch = nch;
+    } else {
+        c->tail_len = 0;
+    }
+}
+
+bool conceal_lost(conceal_t *c, const int16_t *last, int16_t *out, unsigned samples, unsigned nch)
+{
+    if (c->tail_len == 0 || c->nch != nch || samples == 0)
+        return false;
+
+    if (c->run >= CONCEAL_MAX_RUN) {
+        memset(out, 0, samples * nch * sizeof(int16_t));
+        c->muted++;
+        return true;
+    }
+
+    // ramp linearly from the gain the previous frame ended on
+    int32_t g0 = run_gain[c->run];
+    int32_t g1 = run_gain[c->run + 1];
+    for (unsigned i = 0; i < samples; i++) {
+        int32_t g = g0 + (int32_t) ((int64_t) (g1 - g0) * i / samples);
+        for (unsigned ch = 0; ch < nch; ch++)
+            out[i * nch + ch] = (int16_t) ((last[i * nch + ch] * g) >> 15);
+    }
+    // the repeat starts over, hide the seam to where the output left off
+    xfade_from_tail(c, out, (samples < c->tail_len) ? samples : c->tail_len, nch, g0);
+    c->run++;
+    c->concealed++;
+    return true;
+}
@@ -0,0 +1,241 @@
+/*
+ * common_frame.c
+ *
+ *  MPEG audio and ADTS frame header parsing.
+ */
+
+#include "common_frame.h"
+
+#include <string.h>
+
+/* kbit/s, index 0 is "free format", 15 is invalid */
+static const uint16_t mpeg1_bitrates[3][15] = {
+    { 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448 },
+    { 0, 32, 48, 56,  64,  80,  96, 112, 128, 160, 192, 224, 256, 320, 384 },
+    { 0, 32, 40, 48,  56,  64,  80,  96, 112, 128, 160, 192, 224, 256, 320 }
+};
+
+static const uint16_t mpeg2_bitrates[2][15] = {
+    { 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256 },
+    { 0,  8, 16, 24, 32, 40, 48,  56,  64,  80,  96, 112, 128, 144, 160 }
+};
+
+static const uint32_t mpeg_sample_rates[3] = { 44100, 48000, 32000 };
+
+static const uint32_t adts_sample_rates[13] = {
+    96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050, 16000, 12000, 11025, 8000, 7350
+};
+
+static bool mpeg_header_parse(const uint8_t *p, frame_header_t *hdr)
+{
+    uint8_t version = (p[1] >> 3) & 3;
+    uint8_t layer = 4 - ((p[1] >> 1) & 3);
+    uint8_t br_index = p[2] >> 4;
+    uint8_t sr_index = (p[2] >> 2) & 3;
+    uint8_t padding = (p[2] >> 1) & 1;
+
+    // reserved version, reserved layer, free format or bad bitrate, bad sample rate
+    if (version == 1 || layer == 4 || br_index == 0 || br_index == 15 || sr_index == 3)
+        return false;
+
+    hdr->kind = FRAME_MPEG;
+    hdr->layer = layer;
+    hdr->channels = ((p[3] >> 6) == 3) ? 1 : 2;
+    hdr->sample_rate = mpeg_sample_rates[sr_index];
+
+    if (version == 3) {
+        hdr->version = 1;
+        hdr->bitrate = mpeg1_bitrates[layer - 1][br_index];
+    } else {
+        hdr->version = (version == 2) ? 2 : 25;
+        hdr->bitrate = mpeg2_bitrates[(layer == 1) ? 0 : 1][br_index];
+        hdr->sample_rate >>= (version == 2) ? 1 : 2;
+    }
+
+    if (layer == 1) {
+        hdr->samples = 384;
+        hdr->frame_len = (12000 * hdr->bitrate / hdr->sample_rate + padding) * 4;
+    } else if (layer == 3 && hdr->version != 1) {
+        hdr->samples = 576;
+        hdr->frame_len = 72000 * hdr->bitrate / hdr->sample_rate + padding;
+    } else {
+        hdr->samples = 1152;
+        hdr->frame_len = 144000 * hdr->bitrate / hdr->sample_rate + padding;
+    }
+
+    return true;
+}
+
+static bool adts_header_parse(const uint8_t *p, frame_header_t *hdr)
+{
+    uint8_t sr_index = (p[2] >> 2) & 0xf;
+    uint8_t channel_cfg = ((p[2] & 1) << 2) | (p[3] >> 6);
+    uint16_t frame_len = ((p[3] & 3) << 11) | (p[4] << 3) | (p[5] >> 5);
+    uint8_t raw_blocks = (p[6] & 3) + 1;
+
+    if (sr_index >= 13 || frame_len < FRAME_HEADER_SIZE)
+        return false;
+
+    hdr->kind = FRAME_ADTS;
+    hdr->version = (p[1] & 0x08) ? 2 : 4;
+    hdr->layer = 0;
+    hdr->channels = (channel_cfg == 0 || channel_cfg > 2) ? 2 : channel_cfg;
+    hdr->sample_rate = adts_sample_rates[sr_index];
+    hdr->frame_len = frame_len;
+    hdr->samples = 1024 * raw_blocks;
+    hdr->bitrate = (uint32_t) frame_len * 8 * hdr->sample_rate / hdr->samples / 1000;
+
+    return true;
+}
+
+bool frame_header_parse(const uint8_t *p, frame_header_t *hdr)
+{
+    if (p[0] != 0xff)
+        return false;
+
+    // ADTS: 12 bit sync word, layer always 0
+    if ((p[1] & 0xf6) == 0xf0)
+        return adts_header_parse(p, hdr);
+
+    // MPEG audio: 11 bit sync word
+    if ((p[1] & 0xe0) == 0xe0)
+        return mpeg_header_parse(p, hdr);
+
+    return false;
+}
+
+bool frame_header_match(const frame_header_t *a, const frame_header_t *b)
+{
+    return a->kind == b->kind && a->version == b->version && a->layer == b->layer
+            && a->sample_rate == b->sample_rate;
+}
+
+uint32_t frame_header_duration_ms(const frame_header_t *hdr)
+{
+    return hdr->samples * 1000 / hdr->sample_rate;
+}
+
+uint32_t frame_header_duration_us(const frame_header_t *hdr)
+{
+    return (uint64_t) hdr->samples * 1000000 / hdr->sample_rate;
+}
+
+int frame_header_find(const uint8_t *p, size_t len, int confirm, frame_header_t *hdr)
+{
+    const uint8_t *end = p + len;
+    const uint8_t *pos = p;
+
+    while (end - pos >= FRAME_HEADER_SIZE) {
+        pos = memchr(pos, 0xff, end - pos - FRAME_HEADER_SIZE + 1);
+        if (pos == NULL)
+            break;
+
+        if (frame_header_parse(pos, hdr)) {
+            const uint8_t *next = pos + hdr->frame_len;
+            frame_header_t next_hdr;
+            int i;
+
+            for (i = 0; i < confirm; i++) {
+                if (end - next < FRAME_HEADER_SIZE)
+                    break;
+                if (!frame_header_parse(next, &next_hdr) || !frame_header_match(hdr, &next_hdr))
+                    break;
+                next += next_hdr.frame_len;
+            }
+            if (i == confirm)
+                return pos - p;
+        }
+        pos++;
+    }
+
+    return -1;
+}
+
+uint32_t frame_id3v2_size(const uint8_t *p, size_t len)
+{
+    if (len < 10 || memcmp(p, "ID3", 3) != 0 || p[3] == 0xff || p[4] == 0xff
+            || ((p[6] | p[7] | p[8] | p[9]) & 0x80))
+        return 0;
+    uint32_t size = ((uint32_t) p[6] << 21) | (p[7] << 14) | (p[8] << 7) | p[9];
+    // header, tag, footer
+    return 10 + size + ((p[5] & 0x10) ? 10 : 0);
+}
+
+frame_sync_result_t frame_sync_scan(frame_sync_t *s, const uint8_t *p, size_t len, size_t window, size_t *pos)
+{
+    const uint8_t *start = p, *end = p + len;
+    const uint8_t *next;
+    frame_header_t hdr, next_hdr;
+    uint32_t tag;
+    int i;
+
+    while (1) {
+        if (s->id3_left > 0) {
+            size_t n = (s->id3_left < (size_t) (end - p)) ? s->id3_left : (size_t) (end - p);
+            s->id3_left -= n;
+            p += n;
+            if (s->id3_left > 0)
+                break;
+        }
+        if (end - p < FRAME_HEADER_SIZE)
+            break;
+        if ((tag = frame_id3v2_size(p, end - p)) > 0) {
+            s->id3_left = tag;
+            continue;
+        }
+
+        next = memchr(p, 0xff, end - p - FRAME_HEADER_SIZE + 1);
+        if (next == NULL) {
+            p = end - FRAME_HEADER_SIZE + 1;
+            break;
+        }
+        p = next;
+        if (!frame_header_parse(p, &hdr) || hdr.kind != FRAME_MPEG) {
+            p++;
+            continue;
+        }
+
+        // the locked stream goes on in another channel mode, nothing to confirm
+        if (p == start && s->word != 0 && s->skipped == 0 && ((frame_sync_word(p) ^ s->word) & ~FRAME_SYNC_MODE) == 0)
+            i = FRAME_SYNC_CONFIRM;
+        else
+            i = 0;
+        for (next = p + hdr.frame_len; i < FRAME_SYNC_CONFIRM; i++) {
+            if (end - next < FRAME_HEADER_SIZE)
+                break;
+            if (!frame_header_parse(next, &next_hdr) || !frame_header_match(&hdr, &next_hdr))
+                break;
+            next += next_hdr.frame_len;
+        }
+        if (i < FRAME_SYNC_CONFIRM && end - next < FRAME_HEADER_SIZE) {
+            // the chain runs out of data: wait for more unless that is all the reader shows
+            if ((size_t) (end - p) < window)
+                break;
+            if (i == 0) {
+                p++;
+                continue;
+            }
+        } else if (i < FRAME_SYNC_CONFIRM) {
+            p++;
+            continue;
+        }
+
+        // locked
+        s->skipped += p - start;
+        s->gap = s->skipped;
+        if (s->skipped > 0 && s->word != 0)
+            s->resyncs++;
+        s->word = frame_sync_word(p);
+        s->skipped = 0;
+        *pos = p - start;
+        return (s->gap > 0) ? FRAME_SYNC_GAP : FRAME_SYNC_FOUND;
+    }
+
+    s->skipped += p - start;
+    *pos = p - start;
+    if (s->skipped > FRAME_SYNC_LIMIT) {
+        s->off = true;
+        return FRAME_SYNC_FOUND;
+    }
+    return FRAME_SYNC_MORE;
+}
@@ -0,0 +1,238 @@
+/*
+ * common_m3u8.c
+ *
+ *  HLS playlist parsing.
+ *
+ *  A master playlist comes down to one media playlist: the best audio only
+ *  variant up to M3U8_MAX_BANDWIDTH, or the audio rendition of video
+ *  variants. Of a media playlist only the segments from the one the client
+ *  needs next are kept, live playlists list few anyway.
+ */
+
+#include "common_m3u8.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* value of the attribute name in the attribute list up to end, quotes removed, into out */
+static bool attr_get(const char *list, const char *end, const char *name, char *out, size_t size)
+{
+    size_t len = strlen(name);
+    const char *p;
+
+    for (p = list; p + len < end; p++) {
+        // whole attribute names only: BANDWIDTH is not AVERAGE-BANDWIDTH
+        if ((p == list || p[-1] == ',') && p[len] == '=' && memcmp(p, name, len) == 0)
+            break;
+    }
+    if (p + len >= end)
+        return false;
+
+    p += len + 1;
+    const char *stop;
+    if (p < end && *p == '"') {
+        p++;
+        stop = memchr(p, '"', end - p);
+    } else {
+        stop = memchr(p, ',', end - p);
+    }
+    if (stop == NULL)
+        stop = end;
+    if ((size_t) (stop - p) >= size)
+        return false;
+    memcpy(out, p, stop - p);
+    out[stop - p] = 0;
+    return true;
+}
+
+static bool codecs_video(const char *codecs)
+{
+    static const char *video[] = { "avc1", "avc3", "hvc1", "hev1", "vp09", "av01" };
+
+    for (int i = 0; i < sizeof(video) / sizeof(video[0]); i++)
+        if (strstr(codecs, video[i]))
+            return true;
+    return false;
+}
+
+/* "9.984" to 9984 */
+static uint32_t duration_ms(const char *s)
+{
+    char *end;
+    uint32_t ms = strtoul(s, &end, 10) * 1000;
+
+    if (*end == '.') {
+        uint32_t scale = 100;
+        for (end++; *end >= '0' && *end <= '9' && scale > 0; end++, scale /= 10)
+            ms += (*end - '0') * scale;
+    }
+    return ms;
+}
+
+/* a URI cut short would be fetched as another one: one that does not fit is left empty */
+static void copy_uri(char *dst, const char *src, size_t len)
+{
+    if (len > M3U8_URI_MAX - 1)
+        len = 0;
+    memcpy(dst, src, len);
+    dst[len] = 0;
+}
+
+/* line starts with the tag */
+#define IS_TAG(line, len, tag) ((len) >= sizeof(tag) - 1 && memcmp(line, tag, sizeof(tag) - 1) == 0)
+
+bool m3u8_parse(const char *text, uint32_t from_seq, m3u8_t *pl)
+{
+    char value[M3U8_URI_MAX];
+    const char *line, *next;
+    // master: the variant being read and the best one so far
+    bool variant = false, variant_video = false;
+    uint32_t variant_bw = 0;
+    bool best_video = true;
+    // the audio rendition, kept in the segment list a master playlist does not use
+    char *rendition = pl->seg[0].uri;
+    bool rendition_default = false;
+    // media
+    uint32_t seq = 0, duration = 0;
+    bool discontinuity = false;
+
+    memset(pl, 0, sizeof(*pl));
+    // UTF-8 byte order mark
+    if (memcmp(text, "\xef\xbb\xbf", 3) == 0)
+        text += 3;
+    if (strncmp(text, "#EXTM3U", 7) != 0)
+        return false;
+    // a plain m3u names streams, not segments
+    if (strstr(text, "#EXT-X-TARGETDURATION") == NULL && strstr(text, "#EXT-X-STREAM-INF") == NULL)
+        return false;
+
+    for (line = text; *line != 0; line = next) {
+        const char *end = strchr(line, '\n');
+        next = (end != NULL) ? end + 1 : line + strlen(line);
+        if (end == NULL)
+            end = next;
+        while (end > line && (end[-1] == '\r' || end[-1] == ' '))
+            end--;
+        size_t len = end - line;
+        if (len == 0)
+            continue;
+
+        if (line[0] != '#') {
+            if (variant) {
+                // take audio only over video, then the highest bitrate that is not too high
+                bool better;
+                if (pl->uri[0] == 0 || variant_video != best_video)
+                    better = (pl->uri[0] == 0) || !variant_video;
+                else if (variant_bw <= M3U8_MAX_BANDWIDTH)
+                    better = (pl->bandwidth > M3U8_MAX_BANDWIDTH) || (variant_bw > pl->bandwidth);
+                else
+                    better = (pl->bandwidth > M3U8_MAX_BANDWIDTH) && (variant_bw < pl->bandwidth);
+                // one whose URI does not fit is passed over
+                if (better && len < M3U8_URI_MAX) {
+                    copy_uri(pl->uri, line, len);
+                    pl->bandwidth = variant_bw;
+                    best_video = variant_video;
+                }
+                variant = false;
+            } else if (!pl->master) {
+                if (seq >= from_seq && pl->count < M3U8_SEGMENTS) {
+                    m3u8_segment_t *s = &pl->seg[pl->count++];
+                    s->seq = seq;
+                    s->duration_ms = duration;
+                    s->discontinuity = discontinuity;
+                    copy_uri(s->uri, line, len);
+                }
+                pl->last_seq = seq++;
+                duration = 0;
+                discontinuity = false;
+            }
+            continue;
+        }
+
+        if (IS_TAG(line, len, "#EXT-X-STREAM-INF:")) {
+            const char *list = line + 18;
+            pl->master = true;
+            variant = true;
+            variant_bw = attr_get(list, end, "BANDWIDTH", value, sizeof(value)) ? strtoul(value, NULL, 10) : 0;
+            variant_video = attr_get(list, end, "CODECS", value, sizeof(value)) && codecs_video(value);
+        } else if (IS_TAG(line, len, "#EXT-X-MEDIA:")) {
+            const char *list = line + 13;
+            pl->master = true;
+            if (!rendition_default && attr_get(list, end, "TYPE", value, sizeof(value)) && strcmp(value, "AUDIO") == 0
+                    && attr_get(list, end, "URI", rendition, M3U8_URI_MAX))
+                rendition_default = attr_get(list, end, "DEFAULT", value, sizeof(value)) && strcmp(value, "YES") == 0;
+        } else if (IS_TAG(line, len, "#EXT-X-TARGETDURATION:")) {
+            pl->target_ms = strtoul(line + 22, NULL, 10) * 1000;
+        } else if (IS_TAG(line, len, "#EXT-X-MEDIA-SEQUENCE:")) {
+            seq = strtoul(line + 22, NULL, 10);
+            pl->first_seq = seq;
+        } else if (IS_TAG(line, len, "#EXTINF:")) {
+            duration = duration_ms(line + 8);
+        } else if (IS_TAG(line, len, "#EXT-X-DISCONTINUITY") && len == 20) {
+            discontinuity = true;
+        } else if (IS_TAG(line, len, "#EXT-X-ENDLIST")) {
+            pl->endlist = true;
+        } else if (IS_TAG(line, len, "#EXT-X-KEY:")) {
+            if (attr_get(line + 11, end, "METHOD", value, sizeof(value)) && strcmp(value, "NONE") != 0)
+                pl->unsupported = true;
+        } else if (IS_TAG(line, len, "#EXT-X-MAP:")) {
+            pl->unsupported = true;
+        }
+    }
+
+    if (pl->master) {
+        // video variants only, their audio comes as a rendition of its own
+        if (best_video && rendition[0] != 0) {
+            strcpy(pl->uri, rendition);
+            pl->bandwidth = 0;
+        }
+        pl->seg[0].uri[0] = 0;
+        return pl->uri[0] != 0;
+    }
+    if (pl->last_seq < pl->first_seq)
+        pl->last_seq = pl->first_seq;
+    return true;
+}
+
+bool m3u8_resolve(const char *base, const char *ref, char *out, size_t size)
+{
+    size_t keep;
+
+    if (strncmp(ref, "http://", 7) == 0 || strncmp(ref, "https://", 8) == 0) {
+        keep = 0;
+    } else {
+        const char *host = strstr(base, "://");
+        host = (host != NULL) ? host + 3 : base;
+        if (ref[0] == '/' && ref[1] == '/') {
+            // scheme relative
+            keep = host - 2 - base;
+        } else if (ref[0] == '/') {
+            // host relative
+            const char *path = strchr(host, '/');
+            keep = (path != NULL) ? (size_t) (path - base) : strlen(base);
+        } else {
+            // directory of the base, its query left out
+            const char *end = strchr(host, '?');
+            if (end == NULL)
+                end = base + strlen(base);
+            const char *slash = end;
+            while (slash > host && *slash != '/')
+                slash--;
+            if (*slash != '/') {
+                if (strlen(base) + 1 + strlen(ref) >= size)
+                    return false;
+                strcpy(out, base);
+                strcat(out, "/");
+                strcat(out, ref);
+                return true;
+            }
+            keep = slash + 1 - base;
+        }
+    }
+
+    if (keep + strlen(ref) >= size)
+        return false;
+    memmove(out, base, keep);
+    strcpy(out + keep, ref);
+    return true;
+}
@@ -0,0 +1,705 @@
+/*
+ * common_mp4.c
+ *
+ *  AAC access units out of an MP4 (ISO BMFF) stream, read front to back.
+ *
+ *  The stream is never held whole: boxes are walked as they come through
+ *  the decoder's input buffer, the few small ones needed are parsed once
+ *  buffered, the sample tables are read entry by entry into a size per
+ *  sample and runs of contiguous samples, everything else is skipped.
+ *  The first sound track carrying AAC is played. A progressive file only
+ *  plays if its moov comes ahead of the mdat, there is no going back.
+ */
+
+#include "common_mp4.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+
+#define TAG "mp4"
+
+#define FOURCC(a, b, c, d) (((uint32_t) (a) << 24) | ((uint32_t) (b) << 16) | ((uint32_t) (c) << 8) | (uint32_t) (d))
+
+enum { ST_BOX, ST_SKIP, ST_TABLE, ST_MDAT, ST_FAILED };
+enum { TAB_STSZ, TAB_STSC, TAB_STCO, TAB_CO64, TAB_TRUN };
+
+/* trun flags */
+#define TRUN_DATA_OFFSET 0x001
+#define TRUN_FIRST_FLAGS 0x004
+#define TRUN_DURATION 0x100
+#define TRUN_SIZE 0x200
+#define TRUN_FLAGS 0x400
+#define TRUN_CTO 0x800
+/* tfhd flags */
+#define TFHD_BASE_OFFSET 0x01
+#define TFHD_DESCRIPTION 0x02
+#define TFHD_DURATION 0x08
+#define TFHD_SIZE 0x10
+
+static uint32_t be32(const uint8_t *p)
+{
+    return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3];
+}
+
+static uint16_t be16(const uint8_t *p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+static void fourcc_str(uint32_t type, char *s)
+{
+    for (int i = 0; i < 4; i++) {
+        char c = type >> (24 - 8 * i);
+        s[i] = (c >= ' ' && c <= '~') ? c : '?';
+    }
+    s[4] = 0;
+}
+
+/* advance to the stream position target as far as buffered, true once there */
+static bool skip_to(buffer_t *buf, uint32_t target)
+{
+    uint32_t pos = buf->bytes_consumed;
+
+    if (target > pos)
+        buf_seek_rel(buf, min(target - pos, buf_data_unread(buf)));
+    return buf->bytes_consumed >= target;
+}
+
+static void fail(mp4_t *m, const char *why)
+{
+    ESP_LOGE(TAG, "%s", why);
+    m->state = ST_FAILED;
+}
+
+/* room for n sample sizes, fewer if over the limit or out of memory */
+static uint32_t sizes_room(mp4_t *m, uint32_t n)
+{
+    if (n > m->sizes_max)
+        n = m->sizes_max;
+    if (n > m->sizes_alloc) {
+        uint32_t alloc = max(n, min(m->sizes_max, max(256, m->sizes_alloc * 2)));
+        uint16_t *sizes = realloc(m->sizes, alloc * sizeof(uint16_t));
+        if (sizes == NULL) {
+            ESP_LOGE(TAG, "no memory for %" PRIu32 " sample sizes", alloc);
+            return m->sizes_alloc;
+        }
+        m->sizes = sizes;
+        m->sizes_alloc = alloc;
+    }
+    return n;
+}
+
+static uint32_t sample_size(mp4_t *m, uint32_t i)
+{
+    return m->const_size ? m->const_size : m->sizes[i];
+}
+
+/* count samples from offset, merged with the run before when they follow it */
+static void add_run(mp4_t *m, uint32_t offset, uint32_t count)
+{
+    if (count == 0)
+        return;
+    if (m->run_count > 0 && m->data_end != 0 && m->data_end == offset) {
+        m->runs[m->run_count - 1].count += count;
+    } else if (m->run_count < MP4_RUNS) {
+        m->runs[m->run_count].offset = offset;
+        m->runs[m->run_count].count = count;
+        m->run_count++;
+    } else if (m->run_count == MP4_RUNS) {
+        ESP_LOGW(TAG, "more than %d runs of samples, the rest is dropped", MP4_RUNS);
+        m->run_count++;
+    }
+    m->assigned += count;
+}
+
+/* samples of the moov or of the fragment start over */
+static void samples_clear(mp4_t *m)
+{
+    m->const_size = 0;
+    m->count = 0;
+    m->fill = 0;
+    m->next = 0;
+    m->run_count = 0;
+    m->run = 0;
+    m->run_left = 0;
+    m->assigned = 0;
+    m->data_end = 0;
+}
+
+/* an ISO 14496-1 descriptor of tag at *p, *p moved to its body */
+static bool descriptor(const uint8_t **p, const uint8_t *end, uint8_t tag, uint32_t *len)
+{
+    const uint8_t *q = *p;
+
+    if (q >= end || *q++ != tag)
+        return false;
+    *len = 0;
+    for (int i = 0; i < 4 && q < end; i++) {
+        *len = (*len << 7) | (*q & 0x7f);
+        if (!(*q++ & 0x80))
+            break;
+    }
+    *p = q;
+    return q + *len <= end;
+}
+
+/* the AudioSpecificConfig in an esds box body */
+static bool esds_parse(mp4_t *m, const uint8_t *p, const uint8_t *end)
+{
+    uint32_t len;
+
+    // version and flags, then the ES descriptor
+    p += 4;
+    if (!descriptor(&p, end, 0x03, &len) || len < 3)
+        return false;
+    uint8_t flags = p[2];
+    p += 3;
+    if (flags & 0x80)
+        p += 2;
+    if ((flags & 0x40) && p < end)
+        p += 1 + *p;
+    if (flags & 0x20)
+        p += 2;
+
+    if (!descriptor(&p, end, 0x04, &len) || len < 13)
+        return false;
+    // ISO 14496-3 AAC, ISO 13818-7 AAC main, LC and SSR
+    uint8_t object = p[0];
+    if (object != 0x40 && object != 0x66 && object != 0x67 && object != 0x68) {
+        ESP_LOGW(TAG, "audio object type 0x%02x not supported", object);
+        return false;
+    }
+    p += 13;
+
+    if (!descriptor(&p, end, 0x05, &len) || len == 0 || len > MP4_ASC_MAX)
+        return false;
+    memcpy(m->asc, p, len);
+    m->asc_len = len;
+    return true;
+}
+
+/* the esds among the boxes from p to end, QuickTime puts it in a wave box */
+static bool esds_find(mp4_t *m, const uint8_t *p, const uint8_t *end)
+{
+    while (p + 8 <= end) {
+        uint32_t size = be32(p);
+        uint32_t type = be32(p + 4);
+        if (size < 8 || size > end - p)
+            return false;
+        if (type == FOURCC('e', 's', 'd', 's') && size >= 12)
+            return esds_parse(m, p + 8, p + size);
+        if (type == FOURCC('w', 'a', 'v', 'e'))
+            return esds_find(m, p + 8, p + size);
+        p += size;
+    }
+    return false;
+}
+
+/* a sample entry of the sound trak being read, the whole box from p */
+static bool sample_entry(mp4_t *m, const uint8_t *p, uint32_t size)
+{
+    uint32_t type = be32(p + 4);
+    char name[5];
+
+    if (type != FOURCC('m', 'p', '4', 'a')) {
+        fourcc_str(type, name);
+        ESP_LOGW(TAG, "track %" PRIu32 " codec %s not supported", m->trak_id, name);
+        return false;
+    }
+    // sample entry, then the sound fields: 20 bytes, 16 more in QuickTime version 1, 36 in version 2
+    uint32_t off = 8 + 8 + 20;
+    if (size < off)
+        return false;
+    uint16_t version = be16(p + 16);
+    off += (version == 1) ? 16 : (version == 2) ? 36 : 0;
+    return off < size && esds_find(m, p + off, p + size);
+}
+
+static void tfhd_parse(mp4_t *m, const uint8_t *p, uint32_t size)
+{
+    uint32_t flags = be32(p + 8) & 0xffffff;
+    uint32_t id = be32(p + 12);
+    const uint8_t *q = p + 16;
+
+    m->traf_taken = (id == m->track_id);
+    if (!m->traf_taken)
+        return;
+
+    m->default_size = 0;
+    for (int i = 0; i < m->trex_count; i++)
+        if (m->trex[i].id == id)
+            m->default_size = m->trex[i].size;
+
+    // data offsets count from the moof, or the given base
+    m->base = m->moof_start;
+    if (flags & TFHD_BASE_OFFSET) {
+        if (be32(q) != 0)
+            ESP_LOGW(TAG, "base data offset over 4 GB");
+        m->base = be32(q + 4);
+        q += 8;
+    }
+    m->data_end = m->base;
+    if (flags & TFHD_DESCRIPTION)
+        q += 4;
+    if (flags & TFHD_DURATION)
+        q += 4;
+    if ((flags & TFHD_SIZE) && q + 4 <= p + size)
+        m->default_size = be32(q);
+}
+
+/* a box that is parsed whole, at p */
+static void small_box(mp4_t *m, uint32_t type, const uint8_t *p, uint32_t size)
+{
+    switch (type) {
+    case FOURCC('t', 'k', 'h', 'd'):
+        if (size >= 32)
+            m->trak_id = be32(p + ((p[8] == 1) ? 28 : 20));
+        break;
+
+    case FOURCC('h', 'd', 'l', 'r'):
+        if (size >= 20)
+            m->trak_sound = (be32(p + 16) == FOURCC('s', 'o', 'u', 'n'));
+        break;
+
+    case FOURCC('t', 'r', 'e', 'x'):
+        if (size >= 32 && m->trex_count < MP4_TREX) {
+            m->trex[m->trex_count].id = be32(p + 12);
+            m->trex[m->trex_count].size = be32(p + 24);
+            m->trex_count++;
+        }
+        break;
+
+    case FOURCC('t', 'f', 'h', 'd'):
+        if (size >= 16)
+            tfhd_parse(m, p, size);
+        break;
+
+    default:
+        // a sample entry of a sound trak
+        if (m->track_id == 0 && sample_entry(m, p, size)) {
+            m->track_id = m->trak_id ? m->trak_id : 1;
+            m->trak_taken = true;
+            ESP_LOGI(TAG, "AAC track %" PRIu32 ", config of %d bytes", m->track_id, m->asc_len);
+        }
+        break;
+    }
+}
+
+/* the fixed part of a table at p is buffered, set the entries up */
+static void table_start(mp4_t *m, uint8_t table, const uint8_t *p, uint32_t head, uint32_t pos)
+{
+    uint32_t flags = be32(p) & 0xffffff;
+    uint32_t entries = be32(p + 4);
+
+    m->table = table;
+    m->table_flags = flags;
+    switch (table) {
+    case TAB_STSZ:
+        m->const_size = entries;
+        entries = be32(p + 8);
+        m->count = entries;
+        m->fill = 0;
+        if (m->const_size != 0) {
+            entries = 0;
+        } else {
+            m->count = sizes_room(m, entries);
+            if (m->count < entries) {
+                ESP_LOGW(TAG, "%" PRIu32 " samples, the ones after %" PRIu32 " are dropped", entries, m->count);
+                m->dropped += entries - m->count;
+            }
+            entries = m->count;
+        }
+        m->entry_size = 4;
+        break;
+
+    case TAB_STSC:
+        m->stsc_count = 0;
+        m->entry_size = 12;
+        break;
+
+    case TAB_STCO:
+    case TAB_CO64:
+        m->chunk = 0;
+        m->stsc_pos = 0;
+        m->entry_size = (table == TAB_CO64) ? 8 : 4;
+        break;
+
+    case TAB_TRUN: {
+        // from the base of the traf, or following the trun before
+        uint32_t offset = (flags & TRUN_DATA_OFFSET) ? m->base + be32(p + 8) : m->data_end;
+        m->entry_size = 4 * __builtin_popcount(flags & (TRUN_DURATION | TRUN_SIZE | TRUN_FLAGS | TRUN_CTO));
+        uint32_t room = sizes_room(m, m->count + entries) - m->count;
+        if (room < entries) {
+            ESP_LOGW(TAG, "fragment of more than %" PRIu32 " samples", m->sizes_max);
+            m->dropped += entries - room;
+        }
+        add_run(m, offset, room);
+        m->count += room;
+        m->data_end = offset;
+        if (m->entry_size == 0) {
+            // every sample of the default size
+            for (uint32_t i = 0; i < entries; i++) {
+                if (m->fill < m->count)
+                    m->sizes[m->fill++] = min(m->default_size, 0xffff);
+                m->data_end += m->default_size;
+            }
+            entries = 0;
+        }
+        break;
+    }
+    }
+
+    // entries past the end of the box are not believed
+    if (m->entry_size != 0 && entries > (m->box_end - pos - head) / m->entry_size)
+        entries = (m->box_end - pos - head) / m->entry_size;
+    m->left = entries;
+    m->state = ST_TABLE;
+}
+
+/* the next table entry, buffered */
+static void table_entry(mp4_t *m, buffer_t *buf)
+{
+    switch (m->table) {
+    case TAB_STSZ: {
+        uint32_t size = fread32(buf, 0);
+        m->sizes[m->fill++] = min(size, 0xffff);
+        break;
+    }
+
+    case TAB_STSC:
+        if (m->stsc_count < MP4_STSC) {
+            m->stsc[m->stsc_count].first_chunk = fread32(buf, 0);
+            m->stsc[m->stsc_count].per_chunk = fread32(buf, 0);
+            m->stsc_count++;
+            buf_seek_rel(buf, 4);
+        } else {
+            buf_seek_rel(buf, 12);
+        }
+        break;
+
+    case TAB_STCO:
+    case TAB_CO64: {
+        uint32_t offset = fread32(buf, 0);
+        if (m->table == TAB_CO64) {
+            if (offset != 0)
+                ESP_LOGW(TAG, "chunk offset over 4 GB");
+            offset = fread32(buf, 0);
+        }
+        // samples in the chunk from the stsc entry that covers it
+        m->chunk++;
+        while (m->stsc_pos + 1 < m->stsc_count && m->stsc[m->stsc_pos + 1].first_chunk <= m->chunk)
+            m->stsc_pos++;
+        uint32_t n = (m->stsc_count > 0) ? m->stsc[m->stsc_pos].per_chunk : 0;
+        if (m->assigned + n > m->count)
+            n = (m->assigned < m->count) ? m->count - m->assigned : 0;
+
+        // the chunk's length if its sizes are read, to merge the chunks that follow each other
+        uint32_t first = m->assigned, bytes = 0;
+        add_run(m, offset, n);
+        if (m->const_size != 0) {
+            bytes = n * m->const_size;
+        } else if (first + n <= m->fill) {
+            for (uint32_t i = first; i < first + n; i++)
+                bytes += m->sizes[i];
+        } else {
+            offset = 0;
+        }
+        m->data_end = (offset != 0) ? offset + bytes : 0;
+        break;
+    }
+
+    case TAB_TRUN: {
+        uint32_t size = m->default_size;
+        uint32_t flags = m->table_flags;
+        if (flags & TRUN_DURATION)
+            buf_seek_rel(buf, 4);
+        if (flags & TRUN_SIZE)
+            size = fread32(buf, 0);
+        if (flags & TRUN_FLAGS)
+            buf_seek_rel(buf, 4);
+        if (flags & TRUN_CTO)
+            buf_seek_rel(buf, 4);
+        if (m->fill < m->count)
+            m->sizes[m->fill++] = min(size, 0xffff);
+        m->data_end += size;
+        break;
+    }
+    }
+}
+
+typedef enum { BOX_NEXT, BOX_MORE, BOX_CONFIG } box_result_t;
+
+/* the box starting at the read position, it is left unread on BOX_MORE */
+static box_result_t box_start(mp4_t *m, buffer_t *buf)
+{
+    uint32_t pos = buf->bytes_consumed;
+    size_t unread = buf_data_unread(buf);
+
+    // leave the containers that end here
+    while (m->depth > 0 && pos >= m->end[m->depth - 1])
+        m->depth--;
+
+    if (unread < 8)
+        return BOX_MORE;
+    const uint8_t *p = buf->read_pos;
+    uint64_t size = be32(p);
+    uint32_t type = be32(p + 4);
+    uint32_t head = 8;
+    if (size == 1) {
+        if (unread < 16)
+            return BOX_MORE;
+        size = ((uint64_t) be32(p + 8) << 32) | be32(p + 12);
+        head = 16;
+    } else if (size == 0) {
+        // up to the end of the stream
+        size = UINT32_MAX - pos;
+    }
+    if (size < head) {
+        fail(m, "bad box size");
+        return BOX_NEXT;
+    }
+    m->box_end = (pos + size > UINT32_MAX) ? UINT32_MAX : pos + (uint32_t) size;
+    m->state = ST_SKIP;
+
+    // containers, and the bytes ahead of their boxes
+    uint32_t skip = (type == FOURCC('s', 't', 's', 'd')) ? 8 : 0;
+    if (unread < head + skip)
+        return BOX_MORE;
+    bool enter = false;
+    switch (type) {
+    case FOURCC('m', 'o', 'o', 'v'):
+        enter = !m->moov;
+        m->moov = true;
+        break;
+    case FOURCC('t', 'r', 'a', 'k'):
+        // the first track found is played
+        enter = (m->track_id == 0);
+        m->trak_id = 0;
+        m->trak_sound = false;
+        m->trak_taken = false;
+        m->stsd_end = 0;
+        break;
+    case FOURCC('m', 'i', 'n', 'f'):
+        enter = m->trak_sound;
+        break;
+    case FOURCC('m', 'd', 'i', 'a'):
+    case FOURCC('s', 't', 'b', 'l'):
+    case FOURCC('m', 'v', 'e', 'x'):
+        enter = true;
+        break;
+    case FOURCC('s', 't', 's', 'd'):
+        enter = true;
+        m->stsd_end = m->box_end;
+        break;
+    case FOURCC('m', 'o', 'o', 'f'):
+        enter = (m->track_id != 0);
+        m->moof_start = pos;
+        m->fragments++;
+        samples_clear(m);
+        break;
+    case FOURCC('t', 'r', 'a', 'f'):
+        enter = true;
+        m->traf_taken = false;
+        break;
+    }
+    if (enter && m->depth < MP4_DEPTH) {
+        m->end[m->depth++] = m->box_end;
+        buf_seek_rel(buf, head + skip);
+        m->state = ST_BOX;
+        return BOX_NEXT;
+    }
+
+    switch (type) {
+    case FOURCC('t', 'k', 'h', 'd'):
+    case FOURCC('h', 'd', 'l', 'r'):
+    case FOURCC('t', 'r', 'e', 'x'):
+    case FOURCC('t', 'f', 'h', 'd'):
+        break;
+    case FOURCC('s', 't', 's', 'z'):
+    case FOURCC('s', 't', 's', 'c'):
+    case FOURCC('s', 't', 'c', 'o'):
+    case FOURCC('c', 'o', '6', '4'):
+        if (m->trak_taken) {
+            uint8_t table = (type == FOURCC('s', 't', 's', 'z')) ? TAB_STSZ : (type == FOURCC('s', 't', 's', 'c')) ? TAB_STSC
+                          : (type == FOURCC('s', 't', 'c', 'o')) ? TAB_STCO : TAB_CO64;
+            uint32_t fixed = (table == TAB_STSZ) ? 12 : 8;
+            if (size < head + fixed)
+                return BOX_NEXT;
+            if (unread < head + fixed)
+                return BOX_MORE;
+            table_start(m, table, p + head, head + fixed, pos);
+            buf_seek_rel(buf, head + fixed);
+        }
+        return BOX_NEXT;
+    case FOURCC('t', 'r', 'u', 'n'):
+        if (m->traf_taken && size >= head + 8) {
+            if (unread < head + 8)
+                return BOX_MORE;
+            uint32_t flags = be32(p + head);
+            uint32_t fixed = 8 + ((flags & TRUN_DATA_OFFSET) ? 4 : 0) + ((flags & TRUN_FIRST_FLAGS) ? 4 : 0);
+            if (size < head + fixed)
+                return BOX_NEXT;
+            if (unread < head + fixed)
+                return BOX_MORE;
+            table_start(m, TAB_TRUN, p + head, head + fixed, pos);
+            buf_seek_rel(buf, head + fixed);
+        }
+        return BOX_NEXT;
+    case FOURCC('m', 'd', 'a', 't'):
+        if (m->count == 0) {
+            if (!m->moov) {
+                fail(m, "moov after the media data, the file is not streamable");
+            } else if (m->track_id == 0) {
+                fail(m, "no AAC track");
+            }
+            return BOX_NEXT;
+        }
+        if (unread < head)
+            return BOX_MORE;
+        buf_seek_rel(buf, head);
+        m->state = ST_MDAT;
+        return BOX_NEXT;
+    default:
+        // sample entries of the sound trak being read
+        if (m->track_id == 0 && m->depth > 0 && m->stsd_end != 0 && m->end[m->depth - 1] == m->stsd_end)
+            break;
+        return BOX_NEXT;
+    }
+
+    // parsed whole once buffered
+    if (size > buf->len) {
+        char name[5];
+        fourcc_str(type, name);
+        ESP_LOGW(TAG, "%s box of %" PRIu32 " bytes skipped", name, (uint32_t) size);
+        return BOX_NEXT;
+    }
+    if (unread < size)
+        return BOX_MORE;
+    bool taken = (m->track_id == 0);
+    small_box(m, type, p, size);
+    buf_seek_rel(buf, size);
+    m->state = ST_BOX;
+    return (taken && m->track_id != 0) ? BOX_CONFIG : BOX_NEXT;
+}
+
+/* the next sample of the mdat being read, at its end the state moves on and MP4_MORE is returned */
+static mp4_result_t mdat_next(mp4_t *m, buffer_t *buf, uint8_t **au, uint32_t *len)
+{
+    while (1) {
+        if (m->next >= m->count) {
+            m->state = ST_SKIP;
+            return MP4_MORE;
+        }
+        if (m->run_left == 0) {
+            if (m->run >= min(m->run_count, MP4_RUNS)) {
+                // samples no run places
+                m->dropped += m->count - m->next;
+                m->next = m->count;
+                continue;
+            }
+            m->offset = m->runs[m->run].offset;
+            m->run_left = m->runs[m->run].count;
+            m->run++;
+            continue;
+        }
+
+        uint32_t size = sample_size(m, m->next);
+        uint32_t pos = buf->bytes_consumed;
+        if (m->offset >= m->box_end) {
+            // in an mdat to come
+            m->state = ST_SKIP;
+            return MP4_MORE;
+        }
+        if (m->offset < pos || m->offset + size > m->box_end || size > buf->len || size == 0) {
+            // behind or across the end of the box, or bigger than the buffer
+            m->dropped += (size != 0);
+            m->next++;
+            m->run_left--;
+            m->offset += size;
+            continue;
+        }
+        if (!skip_to(buf, m->offset) || buf_data_unread(buf) < size)
+            return MP4_MORE;
+
+        *au = buf->read_pos;
+        *len = size;
+        buf_seek_rel(buf, size);
+        m->next++;
+        m->run_left--;
+        m->offset += size;
+        m->samples++;
+        return MP4_SAMPLE;
+    }
+}
+
+void mp4_open(mp4_t *m, uint32_t sizes_max)
+{
+    memset(m, 0, sizeof(*m));
+    m->sizes_max = sizes_max;
+}
+
+void mp4_reset(mp4_t *m)
+{
+    uint16_t *sizes = m->sizes;
+    uint32_t sizes_alloc = m->sizes_alloc, sizes_max = m->sizes_max;
+
+    memset(m, 0, sizeof(*m));
+    m->sizes = sizes;
+    m->sizes_alloc = sizes_alloc;
+    m->sizes_max = sizes_max;
+}
+
+void mp4_close(mp4_t *m)
+{
+    free(m->sizes);
+    m->sizes = NULL;
+    m->sizes_alloc = 0;
+}
+
+mp4_result_t mp4_next(mp4_t *m, buffer_t *buf, uint8_t **au, uint32_t *len)
+{
+    while (1) {
+        switch (m->state) {
+        case ST_BOX:
+            switch (box_start(m, buf)) {
+            case BOX_MORE:
+                // nothing was consumed, the box is read again
+                m->state = ST_BOX;
+                return MP4_MORE;
+            case BOX_CONFIG:
+                return MP4_CONFIG;
+            case BOX_NEXT:
+                break;
+            }
+            break;
+
+        case ST_SKIP:
+            if (!skip_to(buf, m->box_end))
+                return MP4_MORE;
+            m->state = ST_BOX;
+            break;
+
+        case ST_TABLE:
+            while (m->left > 0 && buf_data_unread(buf) >= m->entry_size) {
+                table_entry(m, buf);
+                m->left--;
+            }
+            if (m->left > 0)
+                return MP4_MORE;
+            m->state = ST_SKIP;
+            break;
+
+        case ST_MDAT: {
+            mp4_result_t res = mdat_next(m, buf, au, len);
+            if (m->state == ST_MDAT)
+                return res;
+            break;
+        }
+
+        default:
+            return MP4_ERROR;
+        }
+    }
+}
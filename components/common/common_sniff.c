@@ -0,0 +1,164 @@
+/*
+ * common_sniff.c
+ *
+ *  Audio format detection from the first bytes of a stream.
+ *
+ *  Ogg and FLAC are recognized by their signatures, MPEG audio and ADTS by
+ *  the longest run of frame headers that point at each other. The
+ *  confidence grows with what was confirmed: a second Ogg page, a FLAC
+ *  STREAMINFO block, each further frame header.
+ */
+
+#include "common_sniff.h"
+
+#include <string.h>
+
+/* frame headers in a row that leave no doubt */
+#define SNIFF_FRAMES 6
+
+static const char *format_str[] = { "unknown", "MPEG", "ADTS", "Ogg", "FLAC", "MP4" };
+
+/* length of the Ogg page at p, 0 if its header is not in p[0..len) */
+static uint32_t ogg_page_len(const uint8_t *p, size_t len)
+{
+    // capture pattern, version 0, header type flags
+    if (len < 27 || memcmp(p, "OggS", 4) != 0 || p[4] != 0 || p[5] > 7)
+        return 0;
+    unsigned segments = p[26];
+    if (len < 27 + segments)
+        return 0;
+    uint32_t page = 27 + segments;
+    for (unsigned i = 0; i < segments; i++)
+        page += p[27 + i];
+    return page;
+}
+
+/* Ogg pages from p on: 0 none, 1 a page header, 2 a page followed by another */
+static int ogg_pages(const uint8_t *p, size_t len)
+{
+    uint32_t page = ogg_page_len(p, len);
+    if (page == 0)
+        return 0;
+    if (page + 4 <= len && memcmp(p + page, "OggS", 4) == 0)
+        return 2;
+    return 1;
+}
+
+/* headers of the same stream in a row from p on */
+static int frame_run(const uint8_t *p, size_t len, frame_header_t *hdr)
+{
+    const uint8_t *end = p + len;
+    frame_header_t next;
+    int n = 1;
+
+    p += hdr->frame_len;
+    while (n < SNIFF_FRAMES && end - p >= FRAME_HEADER_SIZE) {
+        if (!frame_header_parse(p, &next) || !frame_header_match(hdr, &next))
+            break;
+        n++;
+        p += next.frame_len;
+    }
+    return n;
+}
+
+static void sniff_frames(const uint8_t *p, size_t len, sniff_t *res)
+{
+    const uint8_t *end = p + len;
+    const uint8_t *pos = p;
+    frame_header_t hdr;
+
+    while (end - pos >= FRAME_HEADER_SIZE) {
+        pos = memchr(pos, 0xff, end - pos - FRAME_HEADER_SIZE + 1);
+        if (pos == NULL)
+            break;
+        if (frame_header_parse(pos, &hdr)) {
+            int n = frame_run(pos, end - pos, &hdr);
+            if (n > res->frames) {
+                res->format = (hdr.kind == FRAME_ADTS) ? SNIFF_ADTS : SNIFF_MPEG;
+                res->offset = pos - p;
+                res->frames = n;
+                res->hdr = hdr;
+                if (n == SNIFF_FRAMES)
+                    break;
+            }
+        }
+        pos++;
+    }
+    // 10 for a lone header, 100 from SNIFF_FRAMES on
+    if (res->frames > 0)
+        res->confidence = 10 + 90 * (res->frames - 1) / (SNIFF_FRAMES - 1);
+}
+
+void sniff_stream(const uint8_t *p, size_t len, sniff_t *res)
+{
+    memset(res, 0, sizeof(*res));
+    if (len > SNIFF_WINDOW)
+        len = SNIFF_WINDOW;
+
+    uint32_t start = frame_id3v2_size(p, len);
+    if (start >= len) {
+        // the tag fills the window, MP3 is the likely and not a sure guess
+        res->format = (start > 0) ? SNIFF_MPEG : SNIFF_UNKNOWN;
+        res->confidence = (start > 0) ? 30 : 0;
+        res->offset = start;
+        return;
+    }
+
+    const uint8_t *s = p + start;
+    size_t left = len - start;
+
+    if (left >= 4 && memcmp(s, "fLaC", 4) == 0) {
+        res->format = SNIFF_FLAC;
+        res->offset = start;
+        // the first metadata block must be a STREAMINFO of 34 bytes
+        if (left >= 8 && (s[4] & 0x7f) == 0 && s[5] == 0 && s[6] == 0 && s[7] == 34)
+            res->confidence = 100;
+        else
+            res->confidence = 70;
+        return;
+    }
+
+    // ISO BMFF: a file type box, or the movie or fragment of a stream joined without it
+    if (start == 0 && left >= 8 && (memcmp(s + 4, "ftyp", 4) == 0 || memcmp(s + 4, "styp", 4) == 0
+            || memcmp(s + 4, "moov", 4) == 0 || memcmp(s + 4, "moof", 4) == 0)) {
+        uint32_t size = ((uint32_t) s[0] << 24) | (s[1] << 16) | (s[2] << 8) | s[3];
+        res->format = SNIFF_MP4;
+        res->confidence = (size >= 8) ? 100 : 70;
+        return;
+    }
+
+    int pages = ogg_pages(s, left);
+    if (pages > 0) {
+        res->format = SNIFF_OGG;
+        res->offset = start;
+        res->confidence = (pages == 2) ? 100 : 80;
+        return;
+    }
+
+    sniff_frames(s, left, res);
+    res->offset += start;
+    if (res->confidence >= SNIFF_CONFIDENT)
+        return;
+
+    // joined an Ogg stream in the middle, pages start anywhere
+    for (const uint8_t *o = s; (o = memchr(o, 'O', s + left - o)) != NULL; o++) {
+        pages = ogg_pages(o, s + left - o);
+        if (pages > 0) {
+            res->format = SNIFF_OGG;
+            res->offset = o - p;
+            res->frames = 0;
+            res->confidence = (pages == 2) ? 90 : 75;
+            return;
+        }
+    }
+    if (start > 0 && res->format == SNIFF_UNKNOWN) {
+        res->format = SNIFF_MPEG;
+        res->confidence = 30;
+        res->offset = start;
+    }
+}
+
+const char *sniff_format_str(sniff_format_t format)
+{
+    return format_str[format];
+}
@@ -0,0 +1,285 @@
+/*
+ * common_ts.c
+ *
+ *  Audio elementary stream out of HLS media segments: MPEG-TS, or packed
+ *  audio (raw ADTS or MPEG audio behind an ID3 tag).
+ *
+ *  Only what HLS audio needs: the first program of the PAT, the first
+ *  ADTS or MPEG audio stream of its PMT, PSI sections that fit in one
+ *  packet. PES headers are dropped, the payload goes out as it is, the
+ *  ADTS and MPEG audio frames in it carry their own framing.
+ */
+
+#include "common_ts.h"
+#include "common_frame.h"
+
+#include <string.h>
+
+#define TS_SYNC 0x47
+/* bytes that tell a segment's format: an ID3v2 header */
+#define SEG_PROBE 10
+
+static const char *es_str[] = { "unknown", "ADTS", "MPEG" };
+
+/* the section of table_id in a PSI payload, its length without the CRC in *len */
+static const uint8_t *psi_section(const uint8_t *pl, size_t n, uint8_t table_id, size_t *len)
+{
+    // pointer field
+    if (n < 1 || (size_t) pl[0] + 1 >= n)
+        return NULL;
+    n -= pl[0] + 1;
+    pl += pl[0] + 1;
+    if (n < 12 || pl[0] != table_id)
+        return NULL;
+
+    size_t section = ((pl[1] & 0x0f) << 8) | pl[2];
+    if (section < 9 || section + 3 > n)
+        return NULL;
+    *len = section + 3 - 4;
+    return pl;
+}
+
+static void ts_pat(ts_demux_t *d, const uint8_t *pl, size_t n)
+{
+    size_t len;
+    const uint8_t *s = psi_section(pl, n, 0x00, &len);
+    if (s == NULL)
+        return;
+
+    // first program, number 0 is the network PID
+    for (size_t i = 8; i + 4 <= len; i += 4) {
+        uint16_t program = (s[i] << 8) | s[i + 1];
+        if (program != 0) {
+            d->pmt_pid = ((s[i + 2] & 0x1f) << 8) | s[i + 3];
+            return;
+        }
+    }
+}
+
+static void ts_pmt(ts_demux_t *d, const uint8_t *pl, size_t n)
+{
+    size_t len;
+    const uint8_t *s = psi_section(pl, n, 0x02, &len);
+    if (s == NULL)
+        return;
+
+    size_t i = 12 + (((s[10] & 0x0f) << 8) | s[11]);
+    while (i + 5 <= len) {
+        uint8_t type = s[i];
+        uint16_t pid = ((s[i + 1] & 0x1f) << 8) | s[i + 2];
+        ts_es_t es = TS_ES_UNKNOWN;
+
+        // ISO/IEC 13818-7 ADTS, 11172-3 and 13818-3 audio
+        if (type == 0x0f)
+            es = TS_ES_ADTS;
+        else if (type == 0x03 || type == 0x04)
+            es = TS_ES_MPEG;
+        if (es != TS_ES_UNKNOWN) {
+            if (pid != d->audio_pid)
+                d->pes_started = false;
+            d->audio_pid = pid;
+            d->es = es;
+            return;
+        }
+        i += 5 + (((s[i + 3] & 0x0f) << 8) | s[i + 4]);
+    }
+}
+
+static void ts_packet(ts_demux_t *d, const uint8_t *p)
+{
+    bool pusi = p[1] & 0x40;
+    uint16_t pid = ((p[1] & 0x1f) << 8) | p[2];
+    uint8_t afc = (p[3] >> 4) & 3;
+    bool discontinuity = false;
+    const uint8_t *pl = p + 4;
+
+    d->packets++;
+    // transport error indicator
+    if (p[1] & 0x80)
+        return;
+    if (afc & 2) {
+        if (p[4] > TS_PACKET_SIZE - 5)
+            return;
+        discontinuity = (p[4] > 0) && (p[5] & 0x80);
+        pl += 1 + p[4];
+    }
+    if (!(afc & 1) || pl >= p + TS_PACKET_SIZE)
+        return;
+    size_t n = p + TS_PACKET_SIZE - pl;
+
+    if (pid == 0) {
+        if (pusi)
+            ts_pat(d, pl, n);
+        return;
+    }
+    if (d->pmt_pid != 0 && pid == d->pmt_pid) {
+        if (pusi)
+            ts_pmt(d, pl, n);
+        return;
+    }
+    if (d->audio_pid == 0 || pid != d->audio_pid)
+        return;
+
+    uint8_t cc = p[3] & 0x0f;
+    if (d->pes_started && !discontinuity && cc != ((d->cc + 1) & 0x0f)) {
+        // a repeated packet carries nothing new
+        if (cc == d->cc)
+            return;
+        d->cc_errors++;
+    }
+    d->cc = cc;
+
+    if (pusi) {
+        // PES start code, stream id, length, flags, header data length
+        if (n < 9 || pl[0] != 0 || pl[1] != 0 || pl[2] != 1 || (size_t) pl[8] + 9 > n) {
+            d->pes_started = false;
+            return;
+        }
+        n -= pl[8] + 9;
+        pl += pl[8] + 9;
+        d->pes_started = true;
+    } else if (!d->pes_started) {
+        // joined in the middle of a PES
+        return;
+    }
+
+    if (n > 0) {
+        d->es_bytes += n;
+        d->out(d->ctx, pl, n);
+    }
+}
+
+static void raw_out(ts_demux_t *d, const uint8_t *data, size_t len)
+{
+    frame_header_t hdr;
+
+    if (d->es == TS_ES_UNKNOWN && len >= FRAME_HEADER_SIZE && frame_header_parse(data, &hdr))
+        d->es = (hdr.kind == FRAME_ADTS) ? TS_ES_ADTS : TS_ES_MPEG;
+    d->es_bytes += len;
+    d->out(d->ctx, data, len);
+}
+
+/* decide the format of the segment from its first bytes in d->head */
+static void seg_probe(ts_demux_t *d)
+{
+    const uint8_t *h = d->head;
+
+    if (h[0] == TS_SYNC) {
+        // the probe is the start of the first packet
+        d->mode = SEG_TS;
+        return;
+    }
+    if (d->head_len >= SEG_PROBE && memcmp(h, "ID3", 3) == 0 && !((h[6] | h[7] | h[8] | h[9]) & 0x80)) {
+        // packed audio starts with an ID3 tag holding its timestamp
+        uint32_t size = 10 + (((uint32_t) h[6] << 21) | (h[7] << 14) | (h[8] << 7) | h[9]) + ((h[5] & 0x10) ? 10 : 0);
+        d->id3_left = size - d->head_len;
+        d->head_len = 0;
+        d->mode = SEG_ID3;
+        return;
+    }
+    d->mode = SEG_RAW;
+    raw_out(d, d->head, d->head_len);
+    d->head_len = 0;
+}
+
+void ts_demux_init(ts_demux_t *d, ts_output_t out, void *ctx)
+{
+    memset(d, 0, sizeof(*d));
+    d->out = out;
+    d->ctx = ctx;
+}
+
+void ts_demux_segment(ts_demux_t *d, bool discontinuity)
+{
+    // flush what an unfinished probe kept
+    if (d->mode == SEG_START && d->head_len > 0)
+        seg_probe(d);
+    if (discontinuity) {
+        // PIDs and stream may differ, read the PSI again
+        d->pmt_pid = 0;
+        d->audio_pid = 0;
+        d->es = TS_ES_UNKNOWN;
+    }
+    d->mode = SEG_START;
+    d->head_len = 0;
+    d->id3_left = 0;
+    d->pes_started = false;
+}
+
+void ts_demux_push(ts_demux_t *d, const uint8_t *data, size_t len)
+{
+    while (len > 0) {
+        size_t n;
+
+        switch (d->mode) {
+        case SEG_START:
+            n = SEG_PROBE - d->head_len;
+            if (n > len)
+                n = len;
+            memcpy(d->head + d->head_len, data, n);
+            d->head_len += n;
+            data += n;
+            len -= n;
+            if (d->head_len == SEG_PROBE)
+                seg_probe(d);
+            break;
+
+        case SEG_ID3:
+            n = (d->id3_left < len) ? d->id3_left : len;
+            d->id3_left -= n;
+            data += n;
+            len -= n;
+            // ADTS or MPEG audio follows, or another tag
+            if (d->id3_left == 0)
+                d->mode = SEG_START;
+            break;
+
+        case SEG_RAW:
+            raw_out(d, data, len);
+            return;
+
+        case SEG_TS:
+            if (d->head_len > 0) {
+                n = TS_PACKET_SIZE - d->head_len;
+                if (n > len)
+                    n = len;
+                memcpy(d->head + d->head_len, data, n);
+                d->head_len += n;
+                data += n;
+                len -= n;
+                if (d->head_len < TS_PACKET_SIZE)
+                    return;
+                ts_packet(d, d->head);
+                d->head_len = 0;
+            }
+            while (len >= TS_PACKET_SIZE) {
+                if (data[0] != TS_SYNC) {
+                    // lost the packet boundary, find the next sync byte
+                    const uint8_t *sync = memchr(data, TS_SYNC, len);
+                    if (sync == NULL)
+                        return;
+                    len -= sync - data;
+                    data = sync;
+                    continue;
+                }
+                ts_packet(d, data);
+                data += TS_PACKET_SIZE;
+                len -= TS_PACKET_SIZE;
+            }
+            // the start of the next packet, past bytes that are none
+            if (len > 0) {
+                const uint8_t *sync = memchr(data, TS_SYNC, len);
+                if (sync != NULL) {
+                    d->head_len = len - (sync - data);
+                    memcpy(d->head, sync, d->head_len);
+                }
+            }
+            return;
+        }
+    }
+}
+
+const char *ts_es_str(ts_es_t es)
+{
+    return es_str[es];
+}
@@ -0,0 +1,42 @@
+/*
+ * common_conceal.h
+ *
+ *  Repeat-and-fade concealment of lost frames of interleaved 16 bit PCM.
+ */
+
+#ifndef _INCLUDE_COMMON_CONCEAL_H_
+#define _INCLUDE_COMMON_CONCEAL_H_
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+/* lost frames in a row covered by the repeat, it fades to silence over them */
+#define CONCEAL_MAX_RUN 3
+
+/* samples per channel crossfaded at each seam */
+#define CONCEAL_XFADE 128
+
+typedef struct
+{
+    int16_t tail[CONCEAL_XFADE * 2];    /* end of the last good frame */
+    unsigned tail_len;                  /* samples per channel in tail */
+    unsigned nch;
+    uint8_t run;                        /* lost frames in a row */
+    uint32_t concealed;                 /* lost frames replaced by a faded repeat */
+    uint32_t muted;                     /* lost frames beyond CONCEAL_MAX_RUN, replaced by silence */
+    uint32_t recovered;                 /* crossfades back to decoded audio */
+} conceal_t;
+
+/* forget the last good frame, keep the counters */
+void conceal_reset(conceal_t *c);
+
+/* pcm is a good frame: crossfade into it if a concealment was playing, remember its end */
+void conceal_good(conceal_t *c, int16_t *pcm, unsigned samples, unsigned nch);
+
+/**
+ * A frame was lost. Write the substitute for it to out, from the last good
+ * frame in last. Returns false, writing nothing, if there was no good frame.
+ */
+bool conceal_lost(conceal_t *c, const int16_t *last, int16_t *out, unsigned samples, unsigned nch);
+
+#endif /* _INCLUDE_COMMON_CONCEAL_H_ */
@@ -0,0 +1,111 @@
+/*
+ * common_frame.h
+ *
+ *  MPEG audio and ADTS frame header parsing.
+ */
+
+#ifndef _INCLUDE_COMMON_FRAME_H_
+#define _INCLUDE_COMMON_FRAME_H_
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/* bytes needed to parse any frame header */
+#define FRAME_HEADER_SIZE 7
+
+typedef enum
+{
+    FRAME_NONE, FRAME_MPEG, FRAME_ADTS
+} frame_kind_t;
+
+typedef struct
+{
+    frame_kind_t kind;
+    uint8_t version;        /* MPEG: 1, 2 or 25 (2.5). ADTS: 2 or 4 */
+    uint8_t layer;          /* MPEG: 1, 2 or 3. ADTS: 0 */
+    uint8_t channels;
+    uint16_t bitrate;       /* kbit/s */
+    uint16_t frame_len;     /* bytes, header included */
+    uint16_t samples;       /* per channel in this frame */
+    uint32_t sample_rate;
+} frame_header_t;
+
+/* parse the header at p (at least FRAME_HEADER_SIZE bytes). false if not a valid header */
+bool frame_header_parse(const uint8_t *p, frame_header_t *hdr);
+
+/* true if both headers belong to the same stream */
+bool frame_header_match(const frame_header_t *a, const frame_header_t *b);
+
+/* frame duration in ms */
+uint32_t frame_header_duration_ms(const frame_header_t *hdr);
+
+/* frame duration in us */
+uint32_t frame_header_duration_us(const frame_header_t *hdr);
+
+/**
+ * Find the first frame header in p[0..len) that is followed by confirm more
+ * headers of the same stream at the predicted frame lengths.
+ * Returns the offset of the header and fills hdr, or -1 if none was found.
+ */
+int frame_header_find(const uint8_t *p, size_t len, int confirm, frame_header_t *hdr);
+
+/* size of the ID3v2 tag at p[0..len) with header and footer, 0 if there is none */
+uint32_t frame_id3v2_size(const uint8_t *p, size_t len);
+
+/* header bits an MPEG stream repeats in every frame: sync word, version,
+ * layer, sample rate and channel mode */
+#define FRAME_SYNC_MASK 0xfffe0cc0
+/* of those, the channel mode, which a stream may change from one frame to the next */
+#define FRAME_SYNC_MODE 0x000000c0
+/* frames behind a candidate header that must line up before it is trusted */
+#define FRAME_SYNC_CONFIRM 3
+/* bytes without a lock after which the sync is left to the decoder, e.g. free format */
+#define FRAME_SYNC_LIMIT (64 * 1024)
+
+/* frame sync ahead of an MPEG decoder, locked on the header of the current stream */
+typedef struct
+{
+    uint32_t word;          /* masked header of the locked stream, 0 if none */
+    uint32_t id3_left;      /* bytes of an ID3v2 tag still to skip */
+    uint32_t skipped;       /* bytes dropped since the last lock */
+    uint32_t gap;           /* bytes dropped before the last lock */
+    uint32_t resyncs;       /* locks lost and found again */
+    bool off;               /* no lock in FRAME_SYNC_LIMIT bytes, the sync is left to the decoder */
+} frame_sync_t;
+
+typedef enum
+{
+    FRAME_SYNC_MORE = -1,   /* more data needed to decide */
+    FRAME_SYNC_FOUND,       /* the frame follows what came before */
+    FRAME_SYNC_GAP          /* found after bytes were dropped: what the decoder kept from before is stale */
+} frame_sync_result_t;
+
+/* the header at p as the lock compares it */
+static inline uint32_t frame_sync_word(const uint8_t *p)
+{
+    return (((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3]) & FRAME_SYNC_MASK;
+}
+
+/* the frame at p[0..len) continues the locked stream, one compare per frame;
+ * after bytes were dropped it is for the scan to say */
+static inline bool frame_sync_locked(const frame_sync_t *s, const uint8_t *p, size_t len)
+{
+    return s->word != 0 && s->skipped == 0 && len >= 4 && frame_sync_word(p) == s->word;
+}
+
+/**
+ * Find the next MPEG frame in p[0..len) followed by FRAME_SYNC_CONFIRM
+ * frames of the same stream at the predicted lengths, skipping ID3v2 tags
+ * and garbage in bulk. A candidate with window bytes behind it, as much as
+ * the reader ever shows at once, is decided on the frames that fit. One
+ * right where the locked stream left off that only changes the channel
+ * mode is taken as it is: waiting for its chain, the decoder would buffer
+ * again between two frames and lose the bit reservoir.
+ * *pos is set to the offset of the frame, or with FRAME_SYNC_MORE to the
+ * bytes that can be dropped. Once FRAME_SYNC_LIMIT bytes went without a
+ * lock, off is set and FRAME_SYNC_FOUND returned where the scan stopped.
+ */
+frame_sync_result_t frame_sync_scan(frame_sync_t *s, const uint8_t *p, size_t len, size_t window, size_t *pos);
+
+#endif /* _INCLUDE_COMMON_FRAME_H_ */
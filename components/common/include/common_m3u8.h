@@ -0,0 +1,53 @@
+/*
+ * common_m3u8.h
+ *
+ *  HLS playlist parsing.
+ */
+
+#ifndef _INCLUDE_COMMON_M3U8_H_
+#define _INCLUDE_COMMON_M3U8_H_
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define M3U8_URI_MAX 256
+/* segments kept from a media playlist, from the requested sequence number on */
+#define M3U8_SEGMENTS 6
+/* variants above that bitrate are only taken if there is nothing else, bit/s */
+#define M3U8_MAX_BANDWIDTH 400000
+
+typedef struct
+{
+    uint32_t seq;               /* media sequence number */
+    uint32_t duration_ms;
+    bool discontinuity;         /* format or timeline changes from the segment before */
+    char uri[M3U8_URI_MAX];     /* empty if it does not fit: the segment cannot be fetched */
+} m3u8_segment_t;
+
+typedef struct
+{
+    bool master;                /* a variant list, uri is the chosen media playlist */
+    char uri[M3U8_URI_MAX];
+    uint32_t bandwidth;         /* master: of the chosen variant, bit/s */
+
+    uint32_t target_ms;         /* media: upper bound of the segment durations */
+    uint32_t first_seq;         /* media: sequence number of the first segment listed */
+    uint32_t last_seq;          /* media: of the last one */
+    bool endlist;               /* media: no segments will be added */
+    bool unsupported;           /* media: encrypted or fragmented MP4 */
+    uint8_t count;
+    m3u8_segment_t seg[M3U8_SEGMENTS];
+} m3u8_t;
+
+/**
+ * Parse the playlist in text. Of a media playlist the segments from
+ * sequence number from_seq on are kept. Returns false if text is not an
+ * HLS playlist.
+ */
+bool m3u8_parse(const char *text, uint32_t from_seq, m3u8_t *pl);
+
+/* resolve ref against the URL base into out. false if it does not fit */
+bool m3u8_resolve(const char *base, const char *ref, char *out, size_t size);
+
+#endif /* _INCLUDE_COMMON_M3U8_H_ */
@@ -0,0 +1,111 @@
+/*
+ * common_mp4.h
+ *
+ *  AAC access units out of an MP4 (ISO BMFF) stream, read front to back
+ *  through a buffer_t: progressive files with the moov ahead of the mdat,
+ *  and fragmented ones (moof/mdat).
+ */
+
+#ifndef _INCLUDE_COMMON_MP4_H_
+#define _INCLUDE_COMMON_MP4_H_
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "common_buffer.h"
+
+/* nested boxes followed: moov trak mdia minf stbl stsd, or moof traf */
+#define MP4_DEPTH 8
+#define MP4_ASC_MAX 64
+/* runs of contiguous samples, a chunk each in files interleaving audio with video */
+#define MP4_RUNS 256
+#define MP4_STSC 64
+#define MP4_TREX 4
+
+typedef enum
+{
+    MP4_MORE,       /* the next bytes are needed: refill the buffer */
+    MP4_CONFIG,     /* the AudioSpecificConfig of the track is in asc */
+    MP4_SAMPLE,     /* an access unit */
+    MP4_ERROR       /* nothing to play in this stream */
+} mp4_result_t;
+
+typedef struct
+{
+    uint32_t offset;            /* of its first sample in the stream */
+    uint32_t count;
+} mp4_run_t;
+
+typedef struct
+{
+    /* box walk */
+    uint8_t state;
+    uint8_t depth;
+    uint32_t end[MP4_DEPTH];    /* where the open containers end */
+    uint32_t box_end;           /* of the box being skipped or read */
+    uint8_t table;              /* table being read, its entry size and entries to go */
+    uint8_t entry_size;
+    uint32_t table_flags;
+    uint32_t left;
+    bool moov;
+
+    /* track */
+    uint32_t trak_id;           /* of the trak being read */
+    uint32_t stsd_end;          /* its sample entries end there */
+    bool trak_sound;
+    bool trak_taken;            /* the trak being read is the one played */
+    uint32_t track_id;          /* the AAC track played, 0 until found */
+    uint8_t asc[MP4_ASC_MAX];
+    uint8_t asc_len;
+    struct { uint32_t id, size; } trex[MP4_TREX];
+    uint8_t trex_count;
+
+    /* samples of the moov, or of the fragment */
+    uint16_t *sizes;            /* one per sample, grown up to sizes_max */
+    uint32_t sizes_alloc;
+    uint32_t sizes_max;
+    uint32_t const_size;        /* all samples have that size, sizes unused */
+    uint32_t count;
+    uint32_t fill;              /* sizes read so far */
+    uint32_t next;              /* sample to return next */
+    mp4_run_t runs[MP4_RUNS];
+    uint16_t run_count;
+    uint16_t run;               /* run to start next */
+    uint32_t run_left;          /* samples to go in the current run */
+    uint32_t offset;            /* of the next sample */
+    uint32_t assigned;          /* samples placed in runs */
+    uint32_t data_end;          /* end of the last run, 0 if unknown */
+    struct { uint32_t first_chunk, per_chunk; } stsc[MP4_STSC];
+    uint8_t stsc_count;
+    uint8_t stsc_pos;
+    uint32_t chunk;
+
+    /* fragment */
+    uint32_t moof_start;
+    bool traf_taken;
+    uint32_t base;              /* data offsets of the traf count from there */
+    uint32_t default_size;
+
+    uint32_t samples;           /* access units returned */
+    uint32_t fragments;
+    uint32_t dropped;           /* access units lost to the limits or to bad tables */
+} mp4_t;
+
+/* sizes_max bounds the sample sizes kept for a moov or a fragment */
+void mp4_open(mp4_t *m, uint32_t sizes_max);
+
+/* start of a new stream, the buffer must start at position 0 */
+void mp4_reset(mp4_t *m);
+
+/* free the sample size table */
+void mp4_close(mp4_t *m);
+
+/**
+ * Walk the stream in buf up to the next thing for the decoder. On
+ * MP4_SAMPLE *au points to len bytes in buf, valid until the buffer is
+ * refilled. On MP4_MORE the caller refills buf and calls again.
+ */
+mp4_result_t mp4_next(mp4_t *m, buffer_t *buf, uint8_t **au, uint32_t *len);
+
+#endif /* _INCLUDE_COMMON_MP4_H_ */
@@ -0,0 +1,40 @@
+/*
+ * common_sniff.h
+ *
+ *  Audio format detection from the first bytes of a stream.
+ */
+
+#ifndef _INCLUDE_COMMON_SNIFF_H_
+#define _INCLUDE_COMMON_SNIFF_H_
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#include "common_frame.h"
+
+/* bytes of the stream start that are looked at */
+#define SNIFF_WINDOW (8*1024)
+
+/* confidence from which a guess beats the Content-Type */
+#define SNIFF_CONFIDENT 60
+
+typedef enum
+{
+    SNIFF_UNKNOWN, SNIFF_MPEG, SNIFF_ADTS, SNIFF_OGG, SNIFF_FLAC, SNIFF_MP4
+} sniff_format_t;
+
+typedef struct
+{
+    sniff_format_t format;
+    uint8_t confidence;     /* 0 to 100 */
+    uint32_t offset;        /* first frame, page or signature */
+    uint8_t frames;         /* MPEG and ADTS: headers found in a row */
+    frame_header_t hdr;     /* MPEG and ADTS: first header */
+} sniff_t;
+
+/* guess the format of the stream starting at p */
+void sniff_stream(const uint8_t *p, size_t len, sniff_t *res);
+
+const char *sniff_format_str(sniff_format_t format);
+
+#endif /* _INCLUDE_COMMON_SNIFF_H_ */
@@ -0,0 +1,58 @@
+/*
+ * common_ts.h
+ *
+ *  Audio elementary stream out of HLS media segments: MPEG-TS, or packed
+ *  audio (raw ADTS or MPEG audio behind an ID3 tag).
+ */
+
+#ifndef _INCLUDE_COMMON_TS_H_
+#define _INCLUDE_COMMON_TS_H_
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define TS_PACKET_SIZE 188
+
+typedef enum
+{
+    TS_ES_UNKNOWN, TS_ES_ADTS, TS_ES_MPEG
+} ts_es_t;
+
+/* receives the elementary stream, frames may be split across calls */
+typedef void (*ts_output_t)(void *ctx, const uint8_t *data, size_t len);
+
+typedef struct
+{
+    ts_output_t out;
+    void *ctx;
+    ts_es_t es;                 /* audio found in the stream, kept across segments */
+
+    /* segment framing */
+    enum { SEG_START, SEG_TS, SEG_ID3, SEG_RAW } mode;
+    uint8_t head[TS_PACKET_SIZE];   /* partial packet, or the first bytes of a segment */
+    unsigned head_len;
+    uint32_t id3_left;          /* bytes of the ID3 tag still to skip */
+
+    /* MPEG-TS */
+    uint16_t pmt_pid;           /* 0 until the PAT was seen */
+    uint16_t audio_pid;         /* 0 until the PMT was seen */
+    uint8_t cc;                 /* continuity counter of the audio PID */
+    bool pes_started;
+
+    uint32_t packets;
+    uint32_t cc_errors;         /* audio packets lost or repeated */
+    uint32_t es_bytes;
+} ts_demux_t;
+
+void ts_demux_init(ts_demux_t *d, ts_output_t out, void *ctx);
+
+/* a new segment starts, its format is found from its first bytes */
+void ts_demux_segment(ts_demux_t *d, bool discontinuity);
+
+/* feed the next bytes of the segment */
+void ts_demux_push(ts_demux_t *d, const uint8_t *data, size_t len);
+
+const char *ts_es_str(ts_es_t es);
+
+#endif /* _INCLUDE_COMMON_TS_H_ */
@@ -7,41 +7,165 @@
 
 #include <stdbool.h>
 #include <inttypes.h>
+#include <stdlib.h>
 #include <string.h>
 #define LOG_LOCAL_LEVEL ESP_LOG_VERBOSE
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_system.h"
 #include "esp_log.h"
-#include "soc/timer_group_struct.h"
-#include "soc/timer_group_reg.h"
 
 #include "common_buffer.h"
+#include "common_conceal.h"
+#include "common_mp4.h"
+#include "spiram_fifo.h"
 #include "aacdecoder_lib.h"
 #include "audio_player.h"
 #include "audio_renderer.h"
 #include "app_main.h"
-#include "esp_idf_version.h"
 #include "driver/i2s_std.h"
 #define TAG "Fdkaac_decoder"
 
-/* small, its just a transfer bucket for the internal decoder buffer */
-static const uint32_t INPUT_BUFFER_SIZE = 1024;
-
 #define MAX_CHANNELS 2
 #define MAX_FRAME_SIZE 2048
 #define OUTPUT_BUFFER_SIZE (MAX_FRAME_SIZE * sizeof(INT_PCM) * MAX_CHANNELS)
+// the decoder is topped up once the fifo holds the biggest frame: 6144 bits per channel
+#define AAC_LOW_WATER (768 * MAX_CHANNELS)
+// time given to the fifo for the rest of a frame before the gap is concealed
+#define AAC_FRAME_MS 25
+// sleep while muted, the stop request is seen at that pace
+#define AAC_UNDERFLOW_MS 200
+// passes without output or waiting before the idle task is given a tick
+#define AAC_SPINS_MAX 64
+// MP4: boxes and access units are read through this, the bigger ones are skipped
+#define MP4_INPUT_SIZE 4096
+// MP4: sample sizes kept from a moov, about 100 minutes at 44.1 kHz in PSRAM
+#define MP4_SAMPLES_PSRAM (256 * 1024)
+#define MP4_SAMPLES 4096
 
-void fdkaac_decoder_task(void *pvParameters)
+// decoder instance and sample buffer, created by the first stream and kept for the following ones
+static HANDLE_AACDECODER handle = NULL;
+static TRANSPORT_TYPE transport;
+static buffer_t *pcm_buf = NULL;
+// demuxer and its input, created by the first MP4 stream
+static mp4_t *mp4 = NULL;
+static buffer_t *mp4_buf = NULL;
+
+typedef enum
+{
+	FEED_OK,		// input went to the decoder
+	FEED_BUSY,		// boxes were read, nothing to decode yet
+	FEED_STARVED,	// the fifo is empty
+	FEED_FAILED		// nothing to play in the stream
+} feed_t;
+
+static bool mp4_start()
+{
+	if (mp4 == NULL)
+	{
+		mp4 = malloc(sizeof(mp4_t));
+		if (mp4 == NULL)
+			return false;
+		mp4_open(mp4, bigSram() ? MP4_SAMPLES_PSRAM : MP4_SAMPLES);
+	}
+	if (mp4_buf == NULL)
+		mp4_buf = buf_create(MP4_INPUT_SIZE);
+	if (mp4_buf == NULL)
+		return false;
+	mp4_reset(mp4);
+	buf_clear(mp4_buf);
+	return true;
+}
+
+/* the next access unit of the MP4 stream to the decoder, the fifo is read once at most */
+static feed_t mp4_feed()
+{
+	bool filled = false;
+	uint8_t *au;
+	uint32_t len;
+
+	while (1)
+	{
+		switch (mp4_next(mp4, mp4_buf, &au, &len))
+		{
+		case MP4_SAMPLE:
+		{
+			// raw transport: one access unit per fill
+			UINT size = len, left = len;
+			aacDecoder_Fill(handle, &au, &size, &left);
+			return FEED_OK;
+		}
+		case MP4_CONFIG:
+		{
+			UCHAR *conf[] = {mp4->asc};
+			UINT conf_len[] = {mp4->asc_len};
+			if (aacDecoder_ConfigRaw(handle, conf, conf_len) != AAC_DEC_OK)
+			{
+				ESP_LOGE(TAG, "AudioSpecificConfig rejected");
+				return FEED_FAILED;
+			}
+			break;
+		}
+		case MP4_MORE:
+			if (filled)
+				return FEED_BUSY;
+			if (fill_read_buffer(mp4_buf) == 0)
+				return FEED_STARVED;
+			filled = true;
+			break;
+		case MP4_ERROR:
+			return FEED_FAILED;
+		}
+	}
+}
+
+/* the fifo straight into the decoder, as much as it takes */
+static feed_t adts_feed()
+{
+	char *in_pos;
+	unsigned in_len;
+
+	spiRamFifoPeek(&in_pos, &in_len);
+	if (in_len == 0)
+		return FEED_STARVED;
+	// bytes_avail will be updated and indicate "how much data is left"
+	UINT bytes_avail = in_len;
+	aacDecoder_Fill(handle, (UCHAR **)&in_pos, &bytes_avail, &bytes_avail);
+	spiRamFifoCommit(in_len - bytes_avail);
+	return FEED_OK;
+}
+
+/* a pass that neither rendered nor waited, the task runs above the idle task */
+static void spin(uint8_t *spins)
+{
+	if (++(*spins) >= AAC_SPINS_MAX)
+	{
+		*spins = 0;
+		vTaskDelay(1);
+	}
+}
+
+static void fdkaac_decode_stream(player_t *player)
 {
 	// ESP_LOGI(TAG, "(line %u) free heap: %u", __LINE__, esp_get_free_heap_size());
-	player_t *player = pvParameters;
 	// renderer_config_t *renderer_instance;
 	// renderer_instance = renderer_get();
 	AAC_DECODER_ERROR err;
+	pcm_format_t pcm_format = {.buffer_format = PCM_INTERLEAVED};
+	uint32_t concealed = 0, muted = 0;
+
+	/* select bitstream format */
+	bool mp4_stream = (player->media_stream->content_type == AUDIO_MP4);
+	TRANSPORT_TYPE tt = mp4_stream ? TT_MP4_RAW : TT_MP4_ADTS;
+	if (mp4_stream && !mp4_start())
+	{
+		ESP_LOGE(TAG, "malloc(mp4) failed");
+		goto abort;
+	}
+
 	if (!i2s_init())
 	{
-		goto abort1;
+		goto abort;
 	}
 
 	// ESP_LOGD(TAG, "init I2S mode %d, port %d, %d bit, %d Hz", renderer_instance->output_mode, renderer_instance->i2s_num, renderer_instance->bit_depth, renderer_instance->sample_rate);
@@ -50,160 +174,182 @@ void fdkaac_decoder_task(void *pvParameters)
 	// i2s_start(renderer_instance->i2s_num);
 
 	/* allocate sample buffer */
-	buffer_t *pcm_buf = buf_create_dma(OUTPUT_BUFFER_SIZE);
+	if (pcm_buf == NULL)
+		pcm_buf = buf_create_dma(OUTPUT_BUFFER_SIZE);
 	if (pcm_buf == NULL)
 	{
 		ESP_LOGE(TAG, "malloc(pcm_buf) failed");
-		goto abort1;
-	}
-	/* allocate bitstream buffer */
-	//    buffer_t *in_buf = buf_create(INPUT_BUFFER_SIZE*48);
-	buffer_t *in_buf = NULL;
-	int bf = bigSram() ? 12 : 6;
-	in_buf = buf_create_dma(INPUT_BUFFER_SIZE * bf);
-	if (in_buf == NULL)
-	{
-		ESP_LOGE(TAG, "buf_create in_buf failed");
-		buf_destroy(pcm_buf);
-		goto abort1;
+		goto abort;
 	}
 
-	fill_read_buffer(in_buf);
-
-	HANDLE_AACDECODER handle = NULL;
-	pcm_format_t pcm_format = {.buffer_format = PCM_INTERLEAVED};
-
-	/* select bitstream format */
-	if (player->media_stream->content_type == AUDIO_MP4)
+	if (handle != NULL && transport != tt)
 	{
-		goto cleanup;
+		/* the transport is fixed at open */
+		aacDecoder_Close(handle);
+		handle = NULL;
 	}
-	else
+	if (handle == NULL)
 	{
 		/* create decoder instance */
-		handle = aacDecoder_Open(TT_MP4_ADTS, /* num layers */ 1);
-		if (handle == 0)
+		handle = aacDecoder_Open(tt, /* num layers */ 1);
+		if (handle == NULL)
 		{
 			ESP_LOGE(TAG, "aac invalid handle");
-			goto abort1;
+			goto abort;
 		}
-	}
+		transport = tt;
 
-	/* configure instance */
-	aacDecoder_SetParam(handle, AAC_PCM_OUTPUT_INTERLEAVED, 1);
-	aacDecoder_SetParam(handle, AAC_PCM_MIN_OUTPUT_CHANNELS, -1);
-	aacDecoder_SetParam(handle, AAC_PCM_MAX_OUTPUT_CHANNELS, -1);
-	aacDecoder_SetParam(handle, AAC_PCM_LIMITER_ENABLE, 0);
-	aacDecoder_SetParam(handle, AAC_QMF_LOWPOWER, -1);
+		/* configure instance */
+		aacDecoder_SetParam(handle, AAC_PCM_OUTPUT_INTERLEAVED, 1);
+		aacDecoder_SetParam(handle, AAC_PCM_MIN_OUTPUT_CHANNELS, -1);
+		aacDecoder_SetParam(handle, AAC_PCM_MAX_OUTPUT_CHANNELS, -1);
+		aacDecoder_SetParam(handle, AAC_PCM_LIMITER_ENABLE, 0);
+		aacDecoder_SetParam(handle, AAC_QMF_LOWPOWER, -1);
+	}
+	else
+	{
+		/* drop what is left of the previous stream */
+		aacDecoder_SetParam(handle, AAC_TPDEC_CLEAR_BUFFER, 1);
+	}
+	audio_player_decoder_ready();
 
-	const uint32_t flags = 0;
+	// the reused instance resyncs on the first frame of the stream
+	uint32_t flags = AACDEC_INTR;
 	uint32_t pcm_size = 0;
 	bool first_frame = true;
+	uint8_t lost = 0;		   // frames in a row not decoded from the stream
+	uint8_t spins = 0;
 	//    ESP_LOGI(TAG, "(line %u) free heap: %u", __LINE__, esp_get_free_heap_size());
 
 	while (!player->media_stream->eof)
 	{
-		/* re-fill buffer if necessary */
-		size_t bytes_avail = buf_data_unread(in_buf);
-
-		if (bytes_avail == 0)
+		/* top the decoder up from the fifo, or with an access unit out of the MP4 boxes */
+		feed_t fed = mp4_stream ? mp4_feed() : adts_feed();
+		if (fed == FEED_FAILED)
+			goto abort;
+		if (fed == FEED_BUSY)
 		{
-			//       if (bytes_avail < INPUT_BUFFER_SIZE) {
-			fill_read_buffer(in_buf);
-			bytes_avail = buf_data_unread(in_buf);
-			//			vTaskDelay(1);
-			if (player->decoder_command == CMD_STOP)
-				break;
-		}
-		//		watchgog reset
-#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
-		TIMERG0.wdtwprotect.wdt_wkey = TIMG_WDT_WKEY_VALUE;
-		TIMERG0.wdtfeed.wdt_feed = 1;
-		TIMERG0.wdtwprotect.wdt_wkey = 0;
-#else
-		TIMERG0.wdt_wprotect = TIMG_WDT_WKEY_VALUE;
-		TIMERG0.wdt_feed = 1;
-		TIMERG0.wdt_wprotect = 0;
-#endif
-		// bytes_avail will be updated and indicate "how much data is left"
-		//        size_t bytes_avail = buf_data_unread(in_buf);
-		// printf("B%d\n",bytes_avail);
-		aacDecoder_Fill(handle, &in_buf->read_pos, &bytes_avail, &bytes_avail);
-
-		uint32_t bytes_taken = buf_data_unread(in_buf) - bytes_avail;
-		//        buf_seek_rel(in_buf, bytes_taken);
-		in_buf->read_pos += bytes_taken;
-		in_buf->bytes_consumed += bytes_taken;
-
-		if (bytes_taken == 0)
-		{	// blank output
-			//		if (!first_frame) {  // blank output  speed test
-			memset(pcm_buf->base, 0, OUTPUT_BUFFER_SIZE);
-			pcm_buf->len = OUTPUT_BUFFER_SIZE;
-			err = AAC_DEC_OK;
+			spin(&spins);
+			continue;
 		}
+
+		// raw transport: no access unit, nothing to decode
+		if (mp4_stream && fed == FEED_STARVED)
+			err = AAC_DEC_NOT_ENOUGH_BITS;
 		else
-		{
-			err = aacDecoder_DecodeFrame(handle, (short int *)pcm_buf->base,
-										 pcm_buf->len, flags);
+			err = aacDecoder_DecodeFrame(handle, (short int *)pcm_buf->base, pcm_buf->len, flags);
 
-			//		if (err != AAC_DEC_OK) continue;
-			// need more bytes, lets refill
-			if (err == AAC_DEC_TRANSPORT_SYNC_ERROR || err == AAC_DEC_NOT_ENOUGH_BITS)
+		if (err == AAC_DEC_NOT_ENOUGH_BITS)
+		{
+			// no whole frame left in the decoder, top it up as soon as the fifo holds one
+			if (spiRamFifoWaitFill(AAC_LOW_WATER, first_frame ? 0 : AAC_FRAME_MS) >= AAC_LOW_WATER)
+				continue;
+			spins = 0;
+			if (player->decoder_command == CMD_STOP)
+				break;
+			// starved: fade the last frame out through the library's concealment
+			if (!first_frame && lost < CONCEAL_MAX_RUN
+				&& aacDecoder_DecodeFrame(handle, (short int *)pcm_buf->base, pcm_buf->len, flags | AACDEC_CONCEAL) == AAC_DEC_OK)
 			{
-				ESP_LOGW(TAG, "decode error1 0x%08x", err);
+				concealed++;
+				lost++;
+				render_samples((char *)pcm_buf->base, pcm_size, &pcm_format);
 				continue;
 			}
-
-			if ((err != AAC_DEC_OK) && (err != AAC_DEC_INVALID_CODE_BOOK))
+			// then the output goes quiet, the task sleeps until the fifo holds a frame again
+			if (!first_frame && lost == CONCEAL_MAX_RUN)
 			{
-				ESP_LOGW(TAG, "decode error 0x%08x", err);
-				continue;
+				muted++;
+				lost++;
 			}
+			spiRamFifoWaitFill(AAC_LOW_WATER, renderer_underflow() ? AAC_UNDERFLOW_MS : 0);
+			continue;
+		}
 
-			/* print first frame, determine pcm buffer length */
-			if (first_frame)
+		//		if (err != AAC_DEC_OK) continue;
+		if (err == AAC_DEC_TRANSPORT_SYNC_ERROR && !first_frame && lost < CONCEAL_MAX_RUN)
+		{	// a frame went missing in the transport, let the library stand in for it
+			ESP_LOGW(TAG, "decode error1 0x%08x, concealed", err);
+			lost++;
+			if (aacDecoder_DecodeFrame(handle, (short int *)pcm_buf->base, pcm_buf->len, flags | AACDEC_CONCEAL) == AAC_DEC_OK)
 			{
-				first_frame = false;
+				concealed++;
+				render_samples((char *)pcm_buf->base, pcm_size, &pcm_format);
+			}
+			continue;
+		}
+		if (err == AAC_DEC_TRANSPORT_SYNC_ERROR)
+		{
+			ESP_LOGW(TAG, "decode error1 0x%08x", err);
+			spin(&spins);
+			continue;
+		}
+
+		// on decode errors the library has already concealed the output
+		if (!IS_OUTPUT_VALID(err) || (first_frame && err != AAC_DEC_OK))
+		{
+			ESP_LOGW(TAG, "decode error 0x%08x", err);
+			spin(&spins);
+			continue;
+		}
+		if (err != AAC_DEC_OK)
+			concealed++;
+		lost = 0;
 
-				CStreamInfo *mStreamInfo = aacDecoder_GetStreamInfo(handle);
+		/* print first frame, determine pcm buffer length */
+		if (first_frame)
+		{
+			first_frame = false;
+			flags = 0;
 
-				pcm_size = mStreamInfo->frameSize * sizeof(short) // sizeof(int16_t)
-						   * mStreamInfo->numChannels;
+			CStreamInfo *mStreamInfo = aacDecoder_GetStreamInfo(handle);
 
-				ESP_LOGI(TAG, "pcm_size %" PRIu32 ", channels: %d, sample rate: %d, object type: %d, bitrate: %d", pcm_size, mStreamInfo->numChannels,
-						 mStreamInfo->sampleRate, mStreamInfo->aot, mStreamInfo->bitRate);
+			pcm_size = mStreamInfo->frameSize * sizeof(short) // sizeof(int16_t)
+					   * mStreamInfo->numChannels;
 
-				pcm_format.bit_depth = I2S_DATA_BIT_WIDTH_16BIT;
-				pcm_format.num_channels = mStreamInfo->numChannels;
-				pcm_format.sample_rate = mStreamInfo->sampleRate;
-			}
+			ESP_LOGI(TAG, "pcm_size %" PRIu32 ", channels: %d, sample rate: %d, object type: %d, bitrate: %d", pcm_size, mStreamInfo->numChannels,
+					 mStreamInfo->sampleRate, mStreamInfo->aot, mStreamInfo->bitRate);
+
+			pcm_format.bit_depth = I2S_DATA_BIT_WIDTH_16BIT;
+			pcm_format.num_channels = mStreamInfo->numChannels;
+			pcm_format.sample_rate = mStreamInfo->sampleRate;
 		}
+		spins = 0;
 		render_samples((char *)pcm_buf->base, pcm_size, &pcm_format);
 	}
 	//	goto cleanup;
 	// exit on internal error
+abort:
 	player->command = CMD_STOP;
 
-cleanup:
 	// renderer_zero_dma_buffer();
-	ESP_LOGI(TAG, "aac decoder stopped");
-	aacDecoder_Close(handle);
+	ESP_LOGI(TAG, "aac decoder stopped, %" PRIu32 " concealed, %" PRIu32 " muted", concealed, muted);
+	if (mp4_stream && mp4 != NULL)
+	{
+		ESP_LOGI(TAG, "mp4: %" PRIu32 " access units, %" PRIu32 " fragments, %" PRIu32 " dropped", mp4->samples, mp4->fragments, mp4->dropped);
+		// the sample sizes of a long file are big
+		mp4_close(mp4);
+	}
 	//   spiRamFifoReset();
-	buf_destroy(in_buf);
-	buf_destroy(pcm_buf);
 	renderer_zero_dma_buffer();
 	// i2s_stop(renderer_instance->i2s_num);
 	// i2s_driver_uninstall(renderer_instance->i2s_num);
-	player->decoder_status = STOPPED;
+	// STOPPED last, audio_player_stop() waits for it
 	player->decoder_command = CMD_NONE;
+	player->decoder_status = STOPPED;
 
 	//	ESP_LOGD(TAG, "aac_decoder stack: %d\n", uxTaskGetStackHighWaterMark(NULL));
 	//	ESP_LOGI(TAG, "%u free heap %u", __LINE__, esp_get_free_heap_size());
+}
+
+/* AAC decoder worker, created for the first AAC stream, then decodes a stream per notification from the player */
+void fdkaac_decoder_task(void *pvParameters)
+{
+	player_t *player = pvParameters;
 
-	// esp_task_wdt_delete(NULL);
-	vTaskDelete(NULL);
-	return;
-abort1:
-	esp_restart();
-}
\ No newline at end of file
+	while (1)
+	{
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+		fdkaac_decode_stream(player);
+	}
+}
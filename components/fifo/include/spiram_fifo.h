@@ -1,10 +1,40 @@
 #ifndef _SPIRAM_FIFO_H_
 #define _SPIRAM_FIFO_H_
 
+#include <stdint.h>
+#include <stdbool.h>
+
 #define SPIRAMSIZE (30*1024) //for a 23LC1024 chip
+
+// fill level series length and duration histogram size of the telemetry
+#define FIFO_TEL_SAMPLES 120
+#define FIFO_TEL_BUCKETS 8
+
+typedef struct {
+	unsigned len;					// fifo size in bytes
+	unsigned fill;					// current fill in bytes
+	unsigned hot_len, hot_fill;		// internal RAM tier, 0 if not used
+	uint32_t bytes_in, bytes_out;	// totals
+	uint32_t in_rate, out_rate;		// bytes/s over the last period
+	uint32_t underruns, overruns;	// reader starved / writer blocked events
+	uint32_t underrun_ms, overrun_ms;	// total time starved / blocked
+	uint32_t underrun_hist[FIFO_TEL_BUCKETS];	// events by duration
+	uint32_t overrun_hist[FIFO_TEL_BUCKETS];
+	uint32_t frames, frames_dropped;	// frame mode: frames written / dropped on overflow
+	uint32_t buffered_ms;			// frame mode: duration of the buffered frames
+	uint16_t period_ms;				// fill_kb sample period
+	uint16_t samples;				// valid entries in fill_kb
+	uint16_t fill_kb[FIFO_TEL_SAMPLES];
+} fifo_telemetry_t;
+
+// upper bounds in ms of the histogram buckets, the last bucket is open
+extern const uint16_t spiRamFifoHistBounds[FIFO_TEL_BUCKETS - 1];
+
 void*  spiRamFifoInit();
 void  spiRamFifoRead(char *buff, unsigned len);
 void  spiRamFifoWrite(const char *buff, unsigned len);
+void  spiRamFifoPeek(char **buff, unsigned *len);
+void  spiRamFifoCommit(unsigned len);
 unsigned  spiRamFifoFill();
 unsigned  spiRamFifoFree();
 long  spiRamGetOverrunCt();
@@ -13,7 +43,18 @@ void setSPIRAMSIZE(unsigned size);
 unsigned getSPIRAMSIZE();
 
 void spiRamFifoReset();
+void spiRamFifoSetWatermarks(unsigned lowmark, unsigned highmark);
+unsigned spiRamFifoWaitFill(unsigned len, unsigned timeout_ms);
 void spiRamFifoDestroy();
 unsigned spiRamFifoLen();
+// Frame mode: the writer only uses spiRamFifoWriteFrame() and the fifo keeps
+// an index of whole frames, so the buffered duration is known and the oldest
+// frames are dropped when the fifo is full.
+bool spiRamFifoSetFrameMode(bool on);
+bool spiRamFifoGetFrameMode();
+void spiRamFifoWriteFrame(const char *buff, unsigned len, uint32_t duration_us);
+uint32_t spiRamFifoBufferedMs();
+void spiRamFifoGetTelemetry(fifo_telemetry_t *tel);
+void spiRamFifoClearTelemetry();
 
 #endif
@@ -7,22 +7,28 @@
  * thread-aware: the reading and writing can happen in different threads and
  * will block if the fifo is empty and full, respectively.
  *
+ * The fifo is built of single producer / single consumer rings: the writer only
+ * ever moves wpos, the reader only ever moves rpos, so no lock is needed on the
+ * data path. A side that has to wait parks itself on its task notification and
+ * is woken by the other side once the configured watermark is crossed.
+ *
  * Modification history:
  *     2015/06/02, v1.0 File created.
 *******************************************************************************/
 #include "esp_system.h"
 #include "string.h"
 #include <stdio.h>
+#include <stdatomic.h>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/semphr.h"
-#include "freertos/queue.h"
+#include "esp_timer.h"
 
 #include "spiram_fifo.h"
 //#include "spiram.h"
 //#include "esp_heap_trace.h"
 #include "esp_heap_caps.h"
+#include "esp_memory_utils.h"
 //#include "playerconfig.h"
 
 extern void* kmalloc(size_t memorySize);
@@ -34,28 +40,117 @@ extern void* kcalloc(size_t elementCount, size_t elementSize);
 //#define SPIREADSIZE 1024
 #define SPIREADSIZE 1024
 
-static unsigned fifoRpos;
-static unsigned fifoWpos;
-static unsigned fifoFill;
-//static xSemaphoreHandle semCanRead;
-//static xSemaphoreHandle semCanWrite;
-static xSemaphoreHandle mux = NULL;
+// Size of the mirror area behind the end of the buffer. Every byte written to
+// the first FIFO_GUARD bytes of the buffer is also written here, so a reader can
+// always see at least FIFO_GUARD contiguous bytes (a whole MP3 frame of up to
+// 2881 bytes plus the 8 bytes MAD_BUFFER_GUARD) across the wrap point.
+#define FIFO_GUARD (3*1024)
+
+// Maximum time a blocked side sleeps before re-checking the indexes. This is
+// only a safety net against a lost notification, normal wakeups are immediate.
+#define FIFO_WAIT_TICKS pdMS_TO_TICKS(100)
+
+// A single producer / single consumer ring. Read and write positions run from
+// 0 to 2*size-1 so that a full ring (wpos - rpos == size) can be told apart
+// from an empty one (wpos == rpos) without a shared fill counter.
+typedef struct {
+	char *buf;
+	unsigned size;
+	unsigned guard;					// mirrored bytes behind the end of buf
+	atomic_uint rpos;
+	atomic_uint wpos;
+	// Task waiting for data / for room, NULL if none.
+	TaskHandle_t _Atomic readerWait;
+	TaskHandle_t _Atomic writerWait;
+	// Amount of data / room the waiting task needs before it is worth waking it.
+	unsigned readerNeed, writerNeed;
+} fifo_ring_t;
+
+// On boards with PSRAM the fifo has two tiers: the web client writes to the
+// big backing ring in PSRAM, a refill task moves the data on to a small hot
+// ring in internal RAM and the decoder only ever reads the hot ring.
+// Without PSRAM, or when the fifo is too small to be worth it, there is only
+// the backing ring and the decoder reads it directly.
+#define FIFO_HOT_SIZE (16*1024)
+// largest block moved by one refill step, and the free room in the hot ring
+// that restarts a parked refill task.
+#define FIFO_REFILL_CHUNK (4*1024)
+#define FIFO_REFILL_ROOM (2*1024)
+// just above the web client task that fills the backing ring
+#define FIFO_REFILL_PRIO 11
+#define FIFO_REFILL_CPU 0
+
+static fifo_ring_t back;
+static fifo_ring_t hot;
+static fifo_ring_t *egress = &back;		// the ring the decoder reads
+static TaskHandle_t refillTask;
+static atomic_bool refillHold, refillBusy;
+// The decoder is held out of the egress ring by a reset the same way: it
+// only touches the ring between readerEnter() and readerLeave().
+static atomic_bool readerHold, readerBusy;
+static atomic_uint resetGen;					// bumped by each reset
+static unsigned peekGen;						// resetGen at the last peek
+
 static long fifoOvfCnt, fifoUdrCnt;
 
+// Frame mode. The writer stores whole compressed frames and describes each
+// one in a side index. Two cursors walk the index by the bytes consumed: the
+// backing ring reader's one gives the frame boundaries for dropping the
+// oldest frames, the decoder's one keeps the buffered duration exact.
+// In single tier mode both cursors move together.
+#define FRAME_DROPPED 1
+typedef struct {
+	uint32_t us;			// duration
+	uint16_t size;			// bytes
+	uint16_t flags;
+} fifo_frame_t;
+
+static bool frameMode;
+static fifo_frame_t *frames;
+static unsigned frameCap;
+static atomic_uint frameHead;					// next entry the writer fills
+static unsigned backIdx, backOff;				// backing ring reader cursor
+static atomic_uint outIdx;						// decoder cursor
+static unsigned outOff;
+static atomic_uint frameDrop;					// room the writer needs, 0 if none
+static _Atomic uint32_t frameUs;				// duration of the buffered frames
+
 //Low watermark where we restart the reader thread.
 //#define FIFO_LOWMARK (16*1024)
 #define FIFO_LOWMARK (512)
+//Free room needed before we restart the writer thread.
+#define FIFO_HIGHMARK (SPIREADSIZE)
+
+static unsigned fifoLowmark = FIFO_LOWMARK;
+static unsigned fifoHighmark = FIFO_HIGHMARK;
+
+// Telemetry. Each side counts in its own block, the reader in telOut, the
+// writer in telIn, so no counter has two writers; the other side and the
+// readers of the telemetry only load whole words. A clear takes a copy that
+// is subtracted on the way out. The fill level series is sampled by
+// whichever side first notices that a period has elapsed.
+#define FIFO_TEL_PERIOD_MS 500
+const uint16_t spiRamFifoHistBounds[FIFO_TEL_BUCKETS - 1] = {10, 50, 100, 250, 500, 1000, 2500};
+typedef struct {
+	uint32_t bytes;
+	uint32_t events, ms;					// underruns / overruns, time starved / blocked
+	uint32_t hist[FIFO_TEL_BUCKETS];
+	uint32_t frames, frames_dropped;		// writer in frame mode
+} tel_side_t;
+static tel_side_t telIn, telOut;
+static tel_side_t telInBase, telOutBase;		// at the last clear
+static fifo_telemetry_t tel = { .period_ms = FIFO_TEL_PERIOD_MS };	// rates and fill series
+static uint32_t telBytesIn, telBytesOut;		// at the last sample
+static unsigned telFirst;						// oldest entry of tel.fill_kb
+static _Atomic int64_t telSampleTime;
+static int64_t udrStart, ovfStart;				// 0 if not starved / blocked
 
 #ifdef FAKE_SPI_BUFF
 //Re-define a bunch of things so we use the internal buffer
 #undef SPIRAMSIZE
-//static  char fakespiram[SPIRAMSIZE];
-static  char *fakespiram;
-
-#define spiRamWrite(pos, buf, n) memcpy(&fakespiram[pos], buf, n)
-#define spiRamRead(pos, buf, n) memcpy(buf, &fakespiram[pos], n)
 #endif
 
+// requested size of the backing ring
 static unsigned SPIRAMSIZE = (30*1024);
 
 void setSPIRAMSIZE(unsigned size)
@@ -67,143 +162,676 @@ unsigned getSPIRAMSIZE()
 	return SPIRAMSIZE ;
 }
 
+// distance between two positions of the 2*size index space
+static inline unsigned fifoDist(fifo_ring_t *r, unsigned from, unsigned to)
+{
+	return (to >= from) ? (to - from) : (to + 2 * r->size - from);
+}
+
+// advance a position, wrapping at 2*size
+static inline unsigned fifoAdvance(fifo_ring_t *r, unsigned pos, unsigned n)
+{
+	pos += n;
+	if (pos >= 2 * r->size) pos -= 2 * r->size;
+	return pos;
+}
+
+// offset in the buffer of a position
+static inline unsigned fifoOffset(fifo_ring_t *r, unsigned pos)
+{
+	return (pos >= r->size) ? (pos - r->size) : pos;
+}
+
+static inline unsigned ringFill(fifo_ring_t *r)
+{
+	return fifoDist(r, atomic_load(&r->rpos), atomic_load(&r->wpos));
+}
+
+// wake the task parked in *waiter if the condition it waits for is met.
+static inline void fifoWake(TaskHandle_t _Atomic *waiter)
+{
+	TaskHandle_t task = atomic_exchange(waiter, NULL);
+	if (task != NULL) xTaskNotifyGive(task);
+}
+
+// Park the calling task until fifoWake() is called on waiter. ready() is
+// checked again after publishing the handle so that a wakeup between the
+// caller's own check and the publish can not be lost.
+static bool fifoPark(TaskHandle_t _Atomic *waiter, bool (*ready)(fifo_ring_t *), fifo_ring_t *r, TickType_t ticks)
+{
+	ulTaskNotifyTake(pdTRUE, 0); // drop a stale notification
+	atomic_store(waiter, xTaskGetCurrentTaskHandle());
+	if (ready(r)) {
+		atomic_store(waiter, NULL);
+		return true;
+	}
+	ulTaskNotifyTake(pdTRUE, ticks);
+	atomic_store(waiter, NULL);
+	return ready(r);
+}
+
+static bool readerReady(fifo_ring_t *r)
+{
+	return ringFill(r) >= r->readerNeed;
+}
+
+static bool writerReady(fifo_ring_t *r)
+{
+	return (r->size - ringFill(r)) >= r->writerNeed;
+}
+
+// Copy n bytes behind the written ones without handing them to the reader,
+// n must fit in the free room and must not cross the end of the buffer.
+// Bytes landing in the guarded head are mirrored behind the end.
+static void ringCopy(fifo_ring_t *r, const char *buff, unsigned n)
+{
+	unsigned off = fifoOffset(r, atomic_load_explicit(&r->wpos, memory_order_relaxed));
+	memcpy(&r->buf[off], buff, n);
+	if (off < r->guard)
+		memcpy(&r->buf[r->size + off], buff, (n < r->guard - off) ? n : r->guard - off);
+}
+
+// Hand the n bytes copied last to the reader.
+static void ringPublish(fifo_ring_t *r, unsigned n)
+{
+	unsigned wpos = atomic_load_explicit(&r->wpos, memory_order_relaxed);
+	atomic_store(&r->wpos, fifoAdvance(r, wpos, n));
+	// Tell reader thread there's some data in the fifo.
+	if ((atomic_load(&r->readerWait) != NULL) && readerReady(r))
+		fifoWake(&r->readerWait);
+}
+
+// Append n bytes, as ringCopy.
+static void ringPut(fifo_ring_t *r, const char *buff, unsigned n)
+{
+	ringCopy(r, buff, n);
+	ringPublish(r, n);
+}
+
+// move the backing ring reader cursor over n bytes
+static void frameBackAdvance(unsigned n)
+{
+	while ((n > 0) && (backIdx != atomic_load(&frameHead))) {
+		unsigned rem = frames[backIdx % frameCap].size - backOff;
+		if (n < rem) {
+			backOff += n;
+			return;
+		}
+		n -= rem;
+		backIdx++;
+		backOff = 0;
+	}
+}
+
+// move the decoder cursor over n bytes, forgetting the finished frames
+static void frameOutAdvance(unsigned n)
+{
+	unsigned idx = atomic_load_explicit(&outIdx, memory_order_relaxed);
+	for (;;) {
+		fifo_frame_t *f = &frames[idx % frameCap];
+		if (idx == atomic_load(&frameHead)) break;
+		if (!(f->flags & FRAME_DROPPED)) {
+			unsigned rem = f->size - outOff;
+			if (n < rem) {
+				outOff += n;
+				break;
+			}
+			n -= rem;
+		}
+		atomic_fetch_sub(&frameUs, f->us);
+		idx++;
+		outOff = 0;
+	}
+	atomic_store(&outIdx, idx);
+}
+
+// Drop n bytes that have been read.
+static void ringTake(fifo_ring_t *r, unsigned n)
+{
+	if (frameMode) {
+		if (r == &back) frameBackAdvance(n);
+		if (r == egress) frameOutAdvance(n);
+	}
+	unsigned rpos = atomic_load_explicit(&r->rpos, memory_order_relaxed);
+	atomic_store(&r->rpos, fifoAdvance(r, rpos, n));
+	// Indicate writer thread there's some free room in the fifo
+	if ((atomic_load(&r->writerWait) != NULL) && writerReady(r))
+		fifoWake(&r->writerWait);
+}
+
+// Drop the unread bytes of a ring as its reader would, the reader held out.
+// The writer may go on, only rpos moves.
+static void ringDiscard(fifo_ring_t *r)
+{
+	unsigned n = ringFill(r);
+	if (n == 0) return;
+	ringTake(r, n);
+	// the decoder cursor also goes over the frames still in the backing ring
+	if (frameMode && (r != egress)) frameOutAdvance(n);
+}
+
+// Enter the egress ring as its reader, false while a reset holds it out.
+static bool readerEnter(void)
+{
+	atomic_store(&readerBusy, true);
+	if (!atomic_load(&readerHold)) return true;
+	atomic_store(&readerBusy, false);
+	return false;
+}
+
+static inline void readerLeave(void)
+{
+	atomic_store(&readerBusy, false);
+}
+
+static inline unsigned telBucket(uint32_t ms)
+{
+	unsigned i;
+	for (i = 0; i < FIFO_TEL_BUCKETS - 1; i++)
+		if (ms < spiRamFifoHistBounds[i]) break;
+	return i;
+}
+
+// record the start of a starvation / blocked period
+static inline void telBegin(int64_t *start)
+{
+	if (*start == 0) *start = esp_timer_get_time();
+}
+
+// record the end of a starvation / blocked period in the histogram
+static void telEnd(int64_t *start, tel_side_t *side)
+{
+	if (*start == 0) return;
+	uint32_t ms = (esp_timer_get_time() - *start) / 1000;
+	*start = 0;
+	side->events++;
+	side->ms += ms;
+	side->hist[telBucket(ms)]++;
+}
+
+// take a fill level sample and update the rates once per period
+static void telSample(void)
+{
+	int64_t now = esp_timer_get_time();
+	int64_t last = atomic_load(&telSampleTime);
+	if (now - last < FIFO_TEL_PERIOD_MS * 1000) return;
+	if (!atomic_compare_exchange_strong(&telSampleTime, &last, now)) return;
+
+	uint32_t in = telIn.bytes, out = telOut.bytes;
+	uint32_t us = now - last;
+	tel.in_rate = (uint64_t)(in - telBytesIn) * 1000000 / us;
+	tel.out_rate = (uint64_t)(out - telBytesOut) * 1000000 / us;
+	telBytesIn = in;
+	telBytesOut = out;
+
+	uint16_t kb = spiRamFifoFill() / 1024;
+	if (tel.samples < FIFO_TEL_SAMPLES) {
+		tel.fill_kb[(telFirst + tel.samples++) % FIFO_TEL_SAMPLES] = kb;
+	} else {
+		tel.fill_kb[telFirst] = kb;
+		telFirst = (telFirst + 1) % FIFO_TEL_SAMPLES;
+	}
+}
+
+// bytes of the whole frames at the backing ring reader cursor that fit in n
+static unsigned frameWhole(unsigned n)
+{
+	unsigned idx = backIdx;
+	unsigned head = atomic_load(&frameHead);
+	unsigned bytes = 0;
+	unsigned size = frames[idx % frameCap].size - backOff;
+	while ((idx != head) && (bytes + size <= n)) {
+		bytes += size;
+		idx++;
+		size = frames[idx % frameCap].size;
+	}
+	return bytes;
+}
+
+// Drop the oldest frames of the backing ring until the room the writer asked
+// for is free. Called by the backing ring reader while it holds no pointer
+// into the ring. The refill task only calls it between frames, the decoder
+// of a single tier fifo loses the rest of a frame it has started.
+static void frameDropOldest(void)
+{
+	unsigned want = atomic_exchange(&frameDrop, 0);
+	if (want == 0) return;
+	bool tiered = (egress != &back);
+	unsigned head = atomic_load(&frameHead);
+	unsigned fill = ringFill(&back);
+	unsigned room = back.size - fill;
+	unsigned idx = backIdx;
+	unsigned bytes = 0;
+	// only frames that are all in the ring: the writer may be inside the last one
+	if (backOff) {
+		bytes = frames[idx % frameCap].size - backOff;
+		if (bytes > fill) return;
+		if (tiered) frames[idx % frameCap].size = backOff;
+		idx++;
+	}
+	// in single tier mode dropping also frees index entries
+	while (((room + bytes < want) || (!tiered && (head - idx >= frameCap))) && (idx != head)
+			&& (bytes + frames[idx % frameCap].size <= fill)) {
+		bytes += frames[idx % frameCap].size;
+		if (tiered) frames[idx % frameCap].flags |= FRAME_DROPPED;
+		telIn.frames_dropped++;
+		idx++;
+	}
+	if (tiered) {
+		// the decoder cursor skips the dropped frames without their bytes
+		unsigned rpos = atomic_load_explicit(&back.rpos, memory_order_relaxed);
+		atomic_store(&back.rpos, fifoAdvance(&back, rpos, bytes));
+		backIdx = idx;
+		backOff = 0;
+		fifoWake(&back.writerWait);
+	} else if (bytes)
+		ringTake(&back, bytes);
+}
+
+// Move data from the backing ring to the hot ring. The task is the reader of
+// the backing ring and the writer of the hot ring. It never blocks for long
+// so that refillStop() can always get hold of it.
+static void refillTaskFunc(void *pvParams)
+{
+	for (;;) {
+		atomic_store(&refillBusy, true);
+		if (atomic_load(&refillHold) || (hot.buf == NULL)) {
+			atomic_store(&refillBusy, false);
+			ulTaskNotifyTake(pdTRUE, FIFO_WAIT_TICKS);
+			continue;
+		}
+		if (frameMode && (backOff == 0)) frameDropOldest();
+		unsigned rpos = atomic_load_explicit(&back.rpos, memory_order_relaxed);
+		unsigned avail = fifoDist(&back, rpos, atomic_load(&back.wpos));
+		unsigned room = hot.size - ringFill(&hot);
+		if (avail == 0) {
+			back.readerNeed = 1;
+			fifoPark(&back.readerWait, readerReady, &back, FIFO_WAIT_TICKS);
+			continue;
+		}
+		if ((room < FIFO_REFILL_ROOM) && (room < avail)) {
+			hot.writerNeed = FIFO_REFILL_ROOM;
+			fifoPark(&hot.writerWait, writerReady, &hot, FIFO_WAIT_TICKS);
+			continue;
+		}
+		unsigned n = (avail < room) ? avail : room;
+		unsigned off = fifoOffset(&back, rpos);
+		unsigned hoff = fifoOffset(&hot, atomic_load_explicit(&hot.wpos, memory_order_relaxed));
+		if (n > FIFO_REFILL_CHUNK) n = FIFO_REFILL_CHUNK;
+		if (n > back.size - off) n = back.size - off;
+		if (n > hot.size - hoff) n = hot.size - hoff;
+		if (frameMode) {
+			// move whole frames so that a drop does not cut one in two
+			unsigned whole = frameWhole(n);
+			unsigned rem = frames[backIdx % frameCap].size - backOff;
+			if (whole)
+				n = whole;
+			else if (n == room) {
+				hot.writerNeed = (rem < hot.size) ? rem : hot.size;
+				fifoPark(&hot.writerWait, writerReady, &hot, FIFO_WAIT_TICKS);
+				continue;
+			} else if (n == avail) {
+				back.readerNeed = rem;
+				fifoPark(&back.readerWait, readerReady, &back, FIFO_WAIT_TICKS);
+				continue;
+			}
+		}
+		// out of the backing ring before it is in the hot one: the fill
+		// may miss a chunk in flight, but never counts it twice
+		ringCopy(&hot, &back.buf[off], n);
+		ringTake(&back, n);
+		ringPublish(&hot, n);
+	}
+}
+
+// Wait until the refill task is out of the rings. It stays idle until
+// refillStart(). Must not be called by the refill task itself.
+static void refillStop(void)
+{
+	if (refillTask == NULL) return;
+	atomic_store(&refillHold, true);
+	xTaskNotifyGive(refillTask);
+	while (atomic_load(&refillBusy))
+		vTaskDelay(1);
+}
+
+static void refillStart(void)
+{
+	atomic_store(&refillHold, false);
+	if (refillTask != NULL) xTaskNotifyGive(refillTask);
+}
+
 //Initialize the FIFO
 void* spiRamFifoInit() {
-	fakespiram = kmalloc(SPIRAMSIZE);
-	fifoRpos=0;
-	fifoWpos=0;
-	fifoFill=0;
+	back.size = SPIRAMSIZE;
+	back.guard = (SPIRAMSIZE < FIFO_GUARD) ? SPIRAMSIZE : FIFO_GUARD;
+	back.buf = kmalloc(back.size + back.guard);
+	atomic_store(&back.rpos, 0);
+	atomic_store(&back.wpos, 0);
 	fifoOvfCnt=0;
 	fifoUdrCnt=0;
-//	vSemaphoreCreateBinary(semCanRead);
-//	vSemaphoreCreateBinary(semCanWrite);
-if (mux == NULL)
-		mux=xSemaphoreCreateMutex();
+	egress = &back;
+	// add the hot tier in front of a big PSRAM backing ring
+	if (back.buf && esp_ptr_external_ram(back.buf) && (back.size >= 4 * FIFO_HOT_SIZE)) {
+		hot.size = FIFO_HOT_SIZE;
+		hot.guard = FIFO_GUARD;
+		hot.buf = heap_caps_malloc(hot.size + hot.guard, MALLOC_CAP_DMA | MALLOC_CAP_8BIT);
+		atomic_store(&hot.rpos, 0);
+		atomic_store(&hot.wpos, 0);
+		if ((hot.buf != NULL) && (refillTask == NULL))
+			xTaskCreatePinnedToCore(refillTaskFunc, "fifoRefill", 2048, NULL, FIFO_REFILL_PRIO, &refillTask, FIFO_REFILL_CPU);
+		if ((hot.buf != NULL) && (refillTask == NULL)) {
+			free(hot.buf);
+			hot.buf = NULL;
+		}
+		if (hot.buf != NULL) {
+			egress = &hot;
+			refillStart();
+		}
+	}
 //	spiRamInit();
-	return ( fakespiram);
+	return (back.buf);
 }
 
+static void frameReset(void)
+{
+	atomic_store(&frameHead, 0);
+	atomic_store(&outIdx, 0);
+	atomic_store(&frameDrop, 0);
+	atomic_store(&frameUs, 0);
+	backIdx = 0;
+	backOff = 0;
+	outOff = 0;
+}
+
+// Empty the fifo. Any task but the refill task may call it, the decoder and
+// the web client running: the readers are held out of the rings while their
+// unread data is dropped, the writer goes on and keeps what it writes after.
 void spiRamFifoReset() {
-	xSemaphoreTake(mux, portMAX_DELAY);
-	fifoRpos=0;
-	fifoWpos=0;
-	fifoFill=0;
+	refillStop();
+	atomic_store(&readerHold, true);
+	while (atomic_load(&readerBusy))
+		vTaskDelay(1);
+	if (egress != &back) ringDiscard(egress);
+	ringDiscard(&back);
+	// a peek taken before does not commit into the data after
+	atomic_fetch_add(&resetGen, 1);
 	fifoOvfCnt=0;
 	fifoUdrCnt=0;
-	memset( fakespiram, 0, SPIRAMSIZE );
-//	xSemaphoreGive(semCanWrite);
-//	xSemaphoreTake(semCanRead, portMAX_DELAY);
-	xSemaphoreGive(mux);
+	atomic_store(&readerHold, false);
+	refillStart();
+}
+
+// Set the fill level that wakes a blocked reader and the free room that
+// wakes a blocked writer. 0 keeps the current value.
+void spiRamFifoSetWatermarks(unsigned lowmark, unsigned highmark) {
+	if (lowmark) fifoLowmark = lowmark;
+	if (highmark) fifoHighmark = highmark;
 }
 
 //Read bytes from the FIFO
 void spiRamFifoRead(char *buff, unsigned len) {
-//	unsigned n;
+	fifo_ring_t *r = egress;
 	while (len > 0) {
-//		heap_caps_check_integrity_all(true) ;
+		if (!readerEnter()) {
+			vTaskDelay(1);
+			continue;
+		}
+		if (frameMode && (r == &back)) frameDropOldest();
+		unsigned rpos = atomic_load_explicit(&r->rpos, memory_order_relaxed);
+		unsigned fill = fifoDist(r, rpos, atomic_load_explicit(&r->wpos, memory_order_acquire));
 		unsigned n = len;
-//		unsigned fifomFill;
-		//printf("i%d\n",n);
-		if (xSemaphoreTake(mux, portMAX_DELAY))
-		{
 		if (n>SPIREADSIZE) n=SPIREADSIZE;			//don't read more than SPIREADSIZE
-		if (n>(SPIRAMSIZE-fifoRpos)) n = SPIRAMSIZE - fifoRpos; //don't read past end of buffer
-		if (fifoFill < n) {
-			//printf("FIFO empty.\n");
+		if (n>(r->size-fifoOffset(r, rpos))) n = r->size - fifoOffset(r, rpos); //don't read past end of buffer
+		if (fill < n) {
 			//Drat, not enough data in FIFO. Wait till there's some written and try again.
-			fifoUdrCnt++;
-			xSemaphoreGive(mux);
-//			if (fifomFill < FIFO_LOWMARK) xSemaphoreTake(semCanRead, portMAX_DELAY);
-			vTaskDelay(10);
+			if (udrStart == 0) fifoUdrCnt++;
+			telBegin(&udrStart);
+			r->readerNeed = (n < fifoLowmark) ? fifoLowmark : n;
+			if (r->readerNeed > r->size) r->readerNeed = r->size;
+			readerLeave();
+			fifoPark(&r->readerWait, readerReady, r, FIFO_WAIT_TICKS);
 		} else {
 			//Read the data.
-			spiRamRead(fifoRpos, buff, n);
+			memcpy(buff, &r->buf[fifoOffset(r, rpos)], n);
 			buff += n;
 			len -= n;
-			fifoFill -= n;
-			fifoRpos += n;
-			if (fifoRpos>=SPIRAMSIZE) fifoRpos=0;
-			//printf("r%d\n",n);
-			xSemaphoreGive(mux);
-//			xSemaphoreGive(semCanWrite); //Indicate writer thread there's some free room in the fifo
+			ringTake(r, n);
+			readerLeave();
+			telOut.bytes += n;
+			telEnd(&udrStart, &telOut);
+			telSample();
 		}
-		} else {printf("spiRamFifoRead MUX take failed\n"); }
 	}
 }
 
 //Write bytes to the FIFO
 void spiRamFifoWrite(const char *buff, unsigned buffLen) {
-//	unsigned n;
+	fifo_ring_t *r = &back;
 	while (buffLen > 0) {
+		unsigned wpos = atomic_load_explicit(&r->wpos, memory_order_relaxed);
+		unsigned fill = fifoDist(r, atomic_load_explicit(&r->rpos, memory_order_acquire), wpos);
 		unsigned n = buffLen;
-		if (xSemaphoreTake(mux, portMAX_DELAY))
-		{
 		// don't read more than SPIREADSIZE
 		if (n > SPIREADSIZE) n = SPIREADSIZE;
 
 		// don't read past end of buffer
-		if (n > (SPIRAMSIZE - fifoWpos)) {
-			n = SPIRAMSIZE - fifoWpos;
+		if (n > (r->size - fifoOffset(r, wpos))) {
+			n = r->size - fifoOffset(r, wpos);
 		}
 
-		if ((SPIRAMSIZE - fifoFill) < n) {
-            //printf("FIFO full.\n");
+		if ((r->size - fill) < n) {
 			// Drat, not enough free room in FIFO. Wait till there's some read and try again.
-			fifoOvfCnt++;
-			xSemaphoreGive(mux);
-//			printf("FIFO full.\n");
-//			xSemaphoreTake(semCanWrite, portMAX_DELAY);
-			vTaskDelay(10);
+			if (ovfStart == 0) fifoOvfCnt++;
+			telBegin(&ovfStart);
+			r->writerNeed = (n < fifoHighmark) ? fifoHighmark : n;
+			if (r->writerNeed > r->size) r->writerNeed = r->size;
+			fifoPark(&r->writerWait, writerReady, r, FIFO_WAIT_TICKS);
 		} else {
-			// Write the data.
-			spiRamWrite(fifoWpos, buff, n);
+			ringPut(r, buff, n);
 			buff += n;
 			buffLen -= n;
-			fifoFill += n;
-			fifoWpos += n;
-			if (fifoWpos >= SPIRAMSIZE) fifoWpos = 0;
-			//printf("w%d\n",n);
-			xSemaphoreGive(mux);
-//			xSemaphoreGive(semCanRead); // Tell reader thread there's some data in the fifo.
+			telIn.bytes += n;
+			telEnd(&ovfStart, &telIn);
+			telSample();
 		}
-		} else {printf(" spiRamFifoWrite MUX take failed\n"); }
 	}
 }
 
+// room for the next frame in the ring and in the index
+static bool frameWriterReady(fifo_ring_t *r)
+{
+	return writerReady(r) && (atomic_load(&frameHead) - atomic_load(&outIdx) < frameCap);
+}
+
+// Write one whole frame in frame mode. If the frame does not fit, the oldest
+// frames are dropped by the reader side instead of waiting for the decoder.
+void spiRamFifoWriteFrame(const char *buff, unsigned len, uint32_t duration_us) {
+	if (!frameMode) {
+		spiRamFifoWrite(buff, len);
+		return;
+	}
+	if ((len == 0) || (len > back.size)) return;
+	back.writerNeed = len;
+	while (!frameWriterReady(&back)) {
+		if (ovfStart == 0) fifoOvfCnt++;
+		telBegin(&ovfStart);
+		atomic_store(&frameDrop, len);
+		if (egress != &back) xTaskNotifyGive(refillTask);
+		fifoPark(&back.writerWait, frameWriterReady, &back, FIFO_WAIT_TICKS);
+	}
+	// a read or a reset may have made the room: no drop left pending into this frame
+	atomic_store(&frameDrop, 0);
+	// the entry is published before the bytes so readers always find it
+	unsigned head = atomic_load_explicit(&frameHead, memory_order_relaxed);
+	frames[head % frameCap] = (fifo_frame_t) { .us = duration_us, .size = len, .flags = 0 };
+	atomic_fetch_add(&frameUs, duration_us);
+	atomic_store(&frameHead, head + 1);
+	telIn.frames++;
+	spiRamFifoWrite(buff, len);
+}
+
+// Switch frame mode on or off. Only between streams, with the fifo empty.
+// Returns false if the index could not be allocated.
+bool spiRamFifoSetFrameMode(bool on) {
+	refillStop();
+	frameMode = false;
+	frameReset();
+	if (on && (frames == NULL)) {
+		// room for frames averaging 96 bytes, 32 kbit/s MP3 at 48 kHz
+		frameCap = back.size / 96;
+		if (frameCap < 64) frameCap = 64;
+		frames = kmalloc(frameCap * sizeof(fifo_frame_t));
+	}
+	frameMode = on && (frames != NULL);
+	if (egress != &back) refillStart();
+	return frameMode == on;
+}
+
+bool spiRamFifoGetFrameMode() {
+	return frameMode;
+}
+
+// Duration of the buffered frames in frame mode, 0 otherwise.
+uint32_t spiRamFifoBufferedMs() {
+	return frameMode ? atomic_load(&frameUs) / 1000 : 0;
+}
+
+// Expose the unread data in place: *buff points to the next byte to read and
+// *len is the number of contiguous bytes behind it. Nothing is consumed until
+// spiRamFifoCommit(). Only the reader task may call this. A reset in between
+// drops the data behind the pointer and the commit that follows.
+void spiRamFifoPeek(char **buff, unsigned *len) {
+	fifo_ring_t *r = egress;
+	*buff = r->buf;
+	*len = 0;
+	if (!readerEnter()) return;
+	peekGen = atomic_load(&resetGen);
+	if (frameMode && (r == &back)) frameDropOldest();
+	unsigned rpos = atomic_load_explicit(&r->rpos, memory_order_relaxed);
+	unsigned fill = fifoDist(r, rpos, atomic_load(&r->wpos));
+	unsigned off = fifoOffset(r, rpos);
+	unsigned n = r->size - off + r->guard;
+	*buff = &r->buf[off];
+	*len = (fill < n) ? fill : n;
+	readerLeave();
+	if (fill == 0) {
+		if (udrStart == 0) fifoUdrCnt++;
+		telBegin(&udrStart);
+	}
+}
+
+// Consume len bytes previously exposed by spiRamFifoPeek().
+void spiRamFifoCommit(unsigned len) {
+	fifo_ring_t *r = egress;
+	if (!readerEnter()) return;
+	unsigned fill = ringFill(r);
+	if (len > fill) len = fill;
+	if ((len == 0) || (peekGen != atomic_load(&resetGen))) {
+		readerLeave();
+		return;
+	}
+	ringTake(r, len);
+	readerLeave();
+	telOut.bytes += len;
+	telEnd(&udrStart, &telOut);
+	telSample();
+}
+
+// Block until at least len bytes can be peeked or read without waiting, or
+// timeout_ms elapsed. Returns the number of such bytes. With the hot tier
+// len is capped to the size of the hot ring.
+unsigned spiRamFifoWaitFill(unsigned len, unsigned timeout_ms) {
+	fifo_ring_t *r = egress;
+	TickType_t start = xTaskGetTickCount();
+	TickType_t timeout = pdMS_TO_TICKS(timeout_ms);
+	if (len > r->size) len = r->size;
+	if (ringFill(r) < len) {
+		if (udrStart == 0) fifoUdrCnt++;
+		telBegin(&udrStart);
+	}
+	while (ringFill(r) < len) {
+		TickType_t elapsed = xTaskGetTickCount() - start;
+		if (elapsed >= timeout) break;
+		r->readerNeed = len;
+		fifoPark(&r->readerWait, readerReady, r, timeout - elapsed);
+	}
+	unsigned fill = ringFill(r);
+	if (fill >= len)
+		telEnd(&udrStart, &telOut);
+	telSample();
+	return fill;
+}
+
 //Get amount of bytes in use
 unsigned spiRamFifoFill() {
-//	unsigned ret;
-	xSemaphoreTake(mux, portMAX_DELAY);
-	unsigned ret=fifoFill;
-	xSemaphoreGive(mux);
-	return ret;
-
+	unsigned fill = ringFill(&back);
+	if (egress == &hot) fill += ringFill(&hot);
+	return fill;
 }
 
+// free room for the writer
 unsigned spiRamFifoFree() {
-	return (SPIRAMSIZE-spiRamFifoFill());
+	return (back.size - ringFill(&back));
 }
 
 void spiRamFifoDestroy() {
-	
-	if (fakespiram) free (fakespiram);
+	refillStop();
+	egress = &back;
+	if (hot.buf) free (hot.buf);
+	hot.buf = NULL;
+	if (back.buf) free (back.buf);
+	back.buf = NULL;
+	frameMode = false;
+	if (frames) free (frames);
+	frames = NULL;
 }
 unsigned spiRamFifoLen() {
-	return SPIRAMSIZE;
+	return back.size + ((egress == &hot) ? hot.size : 0);
 }
 
 long spiRamGetOverrunCt() {
-//	long ret;
-	xSemaphoreTake(mux, portMAX_DELAY);
-	 long ret=fifoOvfCnt;
-	xSemaphoreGive(mux);
-	return ret;
+	return fifoOvfCnt;
 }
 
 long spiRamGetUnderrunCt() {
-//	long ret;
-	xSemaphoreTake(mux, portMAX_DELAY);
-	long ret=fifoUdrCnt;
-	xSemaphoreGive(mux);
-	return ret;
-}
\ No newline at end of file
+	return fifoUdrCnt;
+}
+
+// Copy of the telemetry, fill_kb is returned oldest sample first.
+void spiRamFifoGetTelemetry(fifo_telemetry_t *t) {
+	*t = tel;
+	t->bytes_in = telIn.bytes - telInBase.bytes;
+	t->bytes_out = telOut.bytes - telOutBase.bytes;
+	t->underruns = telOut.events - telOutBase.events;
+	t->overruns = telIn.events - telInBase.events;
+	t->underrun_ms = telOut.ms - telOutBase.ms;
+	t->overrun_ms = telIn.ms - telInBase.ms;
+	for (unsigned i = 0; i < FIFO_TEL_BUCKETS; i++) {
+		t->underrun_hist[i] = telOut.hist[i] - telOutBase.hist[i];
+		t->overrun_hist[i] = telIn.hist[i] - telInBase.hist[i];
+	}
+	t->frames = telIn.frames - telInBase.frames;
+	t->frames_dropped = telIn.frames_dropped - telInBase.frames_dropped;
+	for (unsigned i = 0; i < tel.samples; i++)
+		t->fill_kb[i] = tel.fill_kb[(telFirst + i) % FIFO_TEL_SAMPLES];
+	t->len = spiRamFifoLen();
+	t->fill = spiRamFifoFill();
+	t->hot_len = (egress == &hot) ? hot.size : 0;
+	t->hot_fill = (egress == &hot) ? ringFill(&hot) : 0;
+	t->buffered_ms = spiRamFifoBufferedMs();
+	// account for a period still in progress
+	if (udrStart) t->underrun_ms += (esp_timer_get_time() - udrStart) / 1000;
+	if (ovfStart) t->overrun_ms += (esp_timer_get_time() - ovfStart) / 1000;
+}
+
+void spiRamFifoClearTelemetry() {
+	telInBase = telIn;
+	telOutBase = telOut;
+	memset(&tel, 0, sizeof(tel));
+	tel.period_ms = FIFO_TEL_PERIOD_MS;
+	telBytesIn = telIn.bytes;
+	telBytesOut = telOut.bytes;
+	telFirst = 0;
+	atomic_store(&telSampleTime, esp_timer_get_time());
+}
@@ -1,2 +1,2 @@
-char unalChar(unsigned char const *adr);
+unsigned char unalChar(unsigned char const *adr);
 short unalShort(short const unsigned *adr);
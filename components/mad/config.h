@@ -14,10 +14,18 @@
 /* #undef OPT_ACCURACY */
 
 /* Define to optimize for speed over accuracy. */
+#ifndef OPT_ACCURACY
 #define OPT_SPEED 1
+#endif
 
 /* Define to enable a fast subband synthesis approximation optimization. */
+#ifndef OPT_ACCURACY
 #define OPT_SSO
+#endif
+
+/* Define to decode Layer III Huffman pairs through wide lookup tables
+   (one pair per lookup, 7.5 KB of tables; no gain measured yet). */
+/* #undef OPT_HUFFLUT */
 
 /* Define to influence a strict interpretation of the ISO/IEC standards, even
    if this is in opposition with best accepted practices. */
@@ -69,7 +77,16 @@
 /* #undef inline */
 #endif
 
+/* Fixed-point multiply backend: use the high-word multiply on the ESP32
+   Xtensa (MULSH) and RISC-V (MULH) cores, the portable one elsewhere,
+   unless the build picks one. */
+#if defined(FPM_64BIT) || defined(FPM_MULSH) || defined(FPM_DEFAULT)
+/* picked by the build */
+#elif defined(__XTENSA__) || defined(__riscv)
+#define FPM_MULSH
+#else
 #define FPM_DEFAULT
+#endif
 
 /* Define to `int' if <sys/types.h> does not define. */
 /* #undef pid_t */
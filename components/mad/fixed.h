@@ -420,6 +420,49 @@ mad_fixed_t mad_f_mul_inline(mad_fixed_t x, mad_fixed_t y)
 
 #  define MAD_F_SCALEBITS  MAD_F_FRACBITS
 
+/* --- High-word multiply -------------------------------------------------- */
+
+# elif defined(FPM_MULSH)
+
+/*
+ * This version is for cores that have a 32x32 multiply returning the high
+ * word of the 64-bit product (Xtensa MULSH, RISC-V MULH) but no cheap way
+ * to carry a 64-bit accumulator. Only the high words are accumulated and
+ * the low words are discarded, so each product is truncated to 2^-32 before
+ * the final scale; this is still far more accurate than FPM_DEFAULT, which
+ * throws away 28 bits of the operands before multiplying.
+ *
+ * Because MAD_F_MLX() is provided, OPT_SPEED also enables the Q31 DCT in
+ * the subband synthesis.
+ */
+#  if defined(__XTENSA__)
+#   define MAD_F_MULSH(x, y)  \
+    ({ mad_fixed64hi_t __hi;  \
+       asm ("mulsh	%0, %1, %2"  \
+	    : "=a" (__hi)  \
+	    : "%a" (x), "a" (y));  \
+       __hi;  \
+    })
+#  else
+/* compiles to a single MULH on RV32IM and to IMUL on x86 hosts */
+#   define MAD_F_MULSH(x, y)  \
+    ((mad_fixed64hi_t) (((mad_fixed64_t) (x) * (y)) >> 32))
+#  endif
+
+#  define MAD_F_MLX(hi, lo, x, y)  \
+    ((void) ((lo) = 0), (hi) = MAD_F_MULSH((x), (y)))
+
+#  define MAD_F_MLA(hi, lo, x, y)  \
+    ((hi) += MAD_F_MULSH((x), (y)))
+
+#  define MAD_F_MLN(hi, lo)  \
+    ((hi) = -(hi))
+
+#  define mad_f_scale64(hi, lo)  \
+    ((void) (lo), (mad_fixed_t) ((hi) << (32 - MAD_F_SCALEBITS)))
+
+#  define MAD_F_SCALEBITS  MAD_F_FRACBITS
+
 /* --- Default ------------------------------------------------------------- */
 
 # elif defined(FPM_DEFAULT)
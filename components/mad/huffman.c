@@ -3069,6 +3069,10 @@ union huffpair const hufftab24[] = {
 # undef V
 # undef PTR
 
+# if defined(OPT_HUFFLUT)
+#  include "hufflut.dat"
+# endif
+
 /* external tables */
 
 union huffquad const *const mad_huff_quad_table[2] = { hufftabA, hufftabB };
@@ -3107,3 +3111,40 @@ struct hufftable const mad_huff_pair_table[32] = {
   /* 30 */ { hufftab24, 11, 4 },
   /* 31 */ { hufftab24, 13, 4 }
 };
+
+# if defined(OPT_HUFFLUT)
+unsigned short const *const mad_huff_pair_lut[32] = {
+  /*  0 */ 0,
+  /*  1 */ hufflut1,
+  /*  2 */ hufflut2,
+  /*  3 */ hufflut3,
+  /*  4 */ 0 /* not used */,
+  /*  5 */ hufflut5,
+  /*  6 */ hufflut6,
+  /*  7 */ hufflut7,
+  /*  8 */ hufflut8,
+  /*  9 */ hufflut9,
+  /* 10 */ hufflut10,
+  /* 11 */ hufflut11,
+  /* 12 */ hufflut12,
+  /* 13 */ hufflut13,
+  /* 14 */ 0 /* not used */,
+  /* 15 */ hufflut15,
+  /* 16 */ hufflut16,
+  /* 17 */ hufflut16,
+  /* 18 */ hufflut16,
+  /* 19 */ hufflut16,
+  /* 20 */ hufflut16,
+  /* 21 */ hufflut16,
+  /* 22 */ hufflut16,
+  /* 23 */ hufflut16,
+  /* 24 */ hufflut24,
+  /* 25 */ hufflut24,
+  /* 26 */ hufflut24,
+  /* 27 */ hufflut24,
+  /* 28 */ hufflut24,
+  /* 29 */ hufflut24,
+  /* 30 */ hufflut24,
+  /* 31 */ hufflut24
+};
+# endif
@@ -63,4 +63,14 @@ struct hufftable {
 extern union huffquad const *const mad_huff_quad_table[2];
 extern struct hufftable const mad_huff_pair_table[32];
 
+# if defined(OPT_HUFFLUT)
+/* one lookup of HUFFLUT_BITS bits decodes most pair codes (see hufflut.dat) */
+#  define HUFFLUT_BITS		8
+#  define HUFFLUT_X(e)		((e) & 0xf)
+#  define HUFFLUT_Y(e)		(((e) >> 4) & 0xf)
+#  define HUFFLUT_LEN(e)	((e) >> 8)
+
+extern unsigned short const *const mad_huff_pair_lut[32];
+# endif
+
 # endif
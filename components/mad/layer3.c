@@ -343,7 +343,6 @@ static mad_fixed_t const imdct_s[6][6] = {
 #include "imdct_s.dat"
 };
 
-#if !defined(ASO_IMDCT)
 /*
  * windowing coefficients for long blocks
  * derived from section 2.4.3.4.10.3 of ISO/IEC 11172-3
@@ -390,7 +389,6 @@ static mad_fixed_t const window_l[36] = {
     MAD_F(0x0216a2a2) /* 0.130526192 */,
     MAD_F(0x00b2aa3e) /* 0.043619387 */,
 };
-#endif /* ASO_IMDCT */
 
 /*
  * windowing coefficients for short blocks
@@ -973,6 +971,9 @@ static enum mad_error III_huffdecode(struct mad_bitptr *ptr, mad_fixed_t xr[576]
     union huffpair const *table;
     unsigned int linbits, startbits, big_values, reqhits;
     mad_fixed_t reqcache[16];
+# if defined(OPT_HUFFLUT)
+    unsigned short const *lut;
+# endif
 
     sfbound = xrptr + unalChar(sfbwidth++);
     rcount = channel->region0_count + 1;
@@ -981,6 +982,9 @@ static enum mad_error III_huffdecode(struct mad_bitptr *ptr, mad_fixed_t xr[576]
     table = entry->table;
     linbits = entry->linbits;
     startbits = entry->startbits;
+# if defined(OPT_HUFFLUT)
+    lut = mad_huff_pair_lut[channel->table_select[0]];
+# endif
 
     if (table == 0)
       return MAD_ERROR_BADHUFFTABLE;
@@ -994,8 +998,11 @@ static enum mad_error III_huffdecode(struct mad_bitptr *ptr, mad_fixed_t xr[576]
     while (big_values-- && cachesz + bits_left > 0)
     {
       union huffpair const *pair;
-      unsigned int clumpsz, value;
+      unsigned int clumpsz, value, x, y;
       register mad_fixed_t requantized;
+# if defined(OPT_HUFFLUT)
+      unsigned int hit;
+# endif
 
       if (xrptr == sfbound)
       {
@@ -1014,6 +1021,9 @@ static enum mad_error III_huffdecode(struct mad_bitptr *ptr, mad_fixed_t xr[576]
           table = entry->table;
           linbits = entry->linbits;
           startbits = entry->startbits;
+# if defined(OPT_HUFFLUT)
+          lut = mad_huff_pair_lut[channel->table_select[region]];
+# endif
 
           if (table == 0)
             return MAD_ERROR_BADHUFFTABLE;
@@ -1040,24 +1050,40 @@ static enum mad_error III_huffdecode(struct mad_bitptr *ptr, mad_fixed_t xr[576]
 
       /* hcod (0..19) */
 
-      clumpsz = startbits;
-      pair = &table[MASK(bitcache, cachesz, clumpsz)];
+# if defined(OPT_HUFFLUT)
+      /* most codes resolve in one lookup, longer ones walk the tree */
+      hit = lut ? lut[MASK(bitcache, cachesz, HUFFLUT_BITS)] : 0;
 
-      while (!pair->final)
+      if (hit)
       {
-        cachesz -= clumpsz;
-
-        clumpsz = pair->ptr.bits;
-        pair = &table[pair->ptr.offset + MASK(bitcache, cachesz, clumpsz)];
+        x = HUFFLUT_X(hit);
+        y = HUFFLUT_Y(hit);
+        cachesz -= HUFFLUT_LEN(hit);
       }
+      else
+# endif
+      {
+        clumpsz = startbits;
+        pair = &table[MASK(bitcache, cachesz, clumpsz)];
 
-      cachesz -= pair->value.hlen;
+        while (!pair->final)
+        {
+          cachesz -= clumpsz;
+
+          clumpsz = pair->ptr.bits;
+          pair = &table[pair->ptr.offset + MASK(bitcache, cachesz, clumpsz)];
+        }
+
+        x = pair->value.x;
+        y = pair->value.y;
+        cachesz -= pair->value.hlen;
+      }
 
       if (linbits)
       {
         /* x (0..14) */
 
-        value = pair->value.x;
+        value = x;
 
         switch (value)
         {
@@ -1094,7 +1120,7 @@ static enum mad_error III_huffdecode(struct mad_bitptr *ptr, mad_fixed_t xr[576]
 
         /* y (0..14) */
 
-        value = pair->value.y;
+        value = y;
 
         switch (value)
         {
@@ -1133,7 +1159,7 @@ static enum mad_error III_huffdecode(struct mad_bitptr *ptr, mad_fixed_t xr[576]
       {
         /* x (0..1) */
 
-        value = pair->value.x;
+        value = x;
 
         if (value == 0)
           xrptr[0] = 0;
@@ -1152,7 +1178,7 @@ static enum mad_error III_huffdecode(struct mad_bitptr *ptr, mad_fixed_t xr[576]
 
         /* y (0..1) */
 
-        value = pair->value.y;
+        value = y;
 
         if (value == 0)
           xrptr[1] = 0;
@@ -1628,11 +1654,8 @@ static void III_aliasreduce(mad_fixed_t xr[576], int lines)
   }
 }
 
-#if defined(ASO_IMDCT)
-void III_imdct_l(mad_fixed_t const[18], mad_fixed_t[36], unsigned int);
-#else
-#if 1
-static void fastsdct(mad_fixed_t const x[9], mad_fixed_t y[18])
+/* the 9 outputs go to every other slot, y[0] to y[16] */
+static void fastsdct(mad_fixed_t const x[9], mad_fixed_t *y)
 {
   mad_fixed_t a0, a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12;
   mad_fixed_t a13, a14, a15, a16, a17, a18, a19, a20, a21, a22, a23, a24, a25;
@@ -1733,7 +1756,7 @@ static inline void sdctII(mad_fixed_t const x[18], mad_fixed_t X[18])
     tmp[i + 2] = mad_f_mul(x[i + 2] - x[18 - (i + 2) - 1], scale[i + 2]);
   }
 
-  fastsdct(tmp, X);
+  fastsdct(tmp, &X[1]);
 
   /* output accumulation */
 
@@ -1786,433 +1809,78 @@ static inline void dctIV(mad_fixed_t const y[18], mad_fixed_t X[18])
   X[17] = X[17] / 2 - X[16];
 }
 
-/*
- * NAME:	imdct36
- * DESCRIPTION:	perform X[18]->x[36] IMDCT using Szu-Wei Lee's fast algorithm
- */
-static inline void imdct36(mad_fixed_t const x[18], mad_fixed_t y[36])
-{
-  mad_fixed_t tmp[18] = {0, 0, 0, 0, 0, 0, 0, 0, 0,
-                         0, 0, 0, 0, 0, 0, 0, 0, 0};
-  int i;
-
-  /* DCT-IV */
-
-  dctIV(x, tmp);
-
-  /* convert 18-point DCT-IV to 36-point IMDCT */
-
-  for (i = 0; i < 9; i += 3)
-  {
-    y[i + 0] = tmp[9 + (i + 0)];
-    y[i + 1] = tmp[9 + (i + 1)];
-    y[i + 2] = tmp[9 + (i + 2)];
-  }
-  for (i = 9; i < 27; i += 3)
-  {
-    y[i + 0] = -tmp[36 - (9 + (i + 0)) - 1];
-    y[i + 1] = -tmp[36 - (9 + (i + 1)) - 1];
-    y[i + 2] = -tmp[36 - (9 + (i + 2)) - 1];
-  }
-  for (i = 27; i < 36; i += 3)
-  {
-    y[i + 0] = -tmp[(i + 0) - 27];
-    y[i + 1] = -tmp[(i + 1) - 27];
-    y[i + 2] = -tmp[(i + 2) - 27];
-  }
-}
-#else
-/*
- * NAME:	imdct36
- * DESCRIPTION:	perform X[18]->x[36] IMDCT
- */
-static inline void imdct36(mad_fixed_t const X[18], mad_fixed_t x[36])
-{
-  mad_fixed_t t0, t1, t2, t3, t4, t5, t6, t7;
-  mad_fixed_t t8, t9, t10, t11, t12, t13, t14, t15;
-  register mad_fixed64hi_t hi;
-  register mad_fixed64lo_t lo;
-
-  MAD_F_ML0(hi, lo, X[4], MAD_F(0x0ec835e8));
-  MAD_F_MLA(hi, lo, X[13], MAD_F(0x061f78aa));
-
-  t6 = MAD_F_MLZ(hi, lo);
-
-  MAD_F_MLA(hi, lo, (t14 = X[1] - X[10]), -MAD_F(0x061f78aa));
-  MAD_F_MLA(hi, lo, (t15 = X[7] + X[16]), -MAD_F(0x0ec835e8));
-
-  t0 = MAD_F_MLZ(hi, lo);
-
-  MAD_F_MLA(hi, lo, (t8 = X[0] - X[11] - X[12]), MAD_F(0x0216a2a2));
-  MAD_F_MLA(hi, lo, (t9 = X[2] - X[9] - X[14]), MAD_F(0x09bd7ca0));
-  MAD_F_MLA(hi, lo, (t10 = X[3] - X[8] - X[15]), -MAD_F(0x0cb19346));
-  MAD_F_MLA(hi, lo, (t11 = X[5] - X[6] - X[17]), -MAD_F(0x0fdcf549));
-
-  x[7] = MAD_F_MLZ(hi, lo);
-  x[10] = -x[7];
-
-  MAD_F_ML0(hi, lo, t8, -MAD_F(0x0cb19346));
-  MAD_F_MLA(hi, lo, t9, MAD_F(0x0fdcf549));
-  MAD_F_MLA(hi, lo, t10, MAD_F(0x0216a2a2));
-  MAD_F_MLA(hi, lo, t11, -MAD_F(0x09bd7ca0));
-
-  x[19] = x[34] = MAD_F_MLZ(hi, lo) - t0;
-
-  t12 = X[0] - X[3] + X[8] - X[11] - X[12] + X[15];
-  t13 = X[2] + X[5] - X[6] - X[9] - X[14] - X[17];
-
-  MAD_F_ML0(hi, lo, t12, -MAD_F(0x0ec835e8));
-  MAD_F_MLA(hi, lo, t13, MAD_F(0x061f78aa));
-
-  x[22] = x[31] = MAD_F_MLZ(hi, lo) + t0;
-
-  MAD_F_ML0(hi, lo, X[1], -MAD_F(0x09bd7ca0));
-  MAD_F_MLA(hi, lo, X[7], MAD_F(0x0216a2a2));
-  MAD_F_MLA(hi, lo, X[10], -MAD_F(0x0fdcf549));
-  MAD_F_MLA(hi, lo, X[16], MAD_F(0x0cb19346));
-
-  t1 = MAD_F_MLZ(hi, lo) + t6;
-
-  MAD_F_ML0(hi, lo, X[0], MAD_F(0x03768962));
-  MAD_F_MLA(hi, lo, X[2], MAD_F(0x0e313245));
-  MAD_F_MLA(hi, lo, X[3], -MAD_F(0x0ffc19fd));
-  MAD_F_MLA(hi, lo, X[5], -MAD_F(0x0acf37ad));
-  MAD_F_MLA(hi, lo, X[6], MAD_F(0x04cfb0e2));
-  MAD_F_MLA(hi, lo, X[8], -MAD_F(0x0898c779));
-  MAD_F_MLA(hi, lo, X[9], MAD_F(0x0d7e8807));
-  MAD_F_MLA(hi, lo, X[11], MAD_F(0x0f426cb5));
-  MAD_F_MLA(hi, lo, X[12], -MAD_F(0x0bcbe352));
-  MAD_F_MLA(hi, lo, X[14], MAD_F(0x00b2aa3e));
-  MAD_F_MLA(hi, lo, X[15], -MAD_F(0x07635284));
-  MAD_F_MLA(hi, lo, X[17], -MAD_F(0x0f9ee890));
-
-  x[6] = MAD_F_MLZ(hi, lo) + t1;
-  x[11] = -x[6];
-
-  MAD_F_ML0(hi, lo, X[0], -MAD_F(0x0f426cb5));
-  MAD_F_MLA(hi, lo, X[2], -MAD_F(0x00b2aa3e));
-  MAD_F_MLA(hi, lo, X[3], MAD_F(0x0898c779));
-  MAD_F_MLA(hi, lo, X[5], MAD_F(0x0f9ee890));
-  MAD_F_MLA(hi, lo, X[6], MAD_F(0x0acf37ad));
-  MAD_F_MLA(hi, lo, X[8], -MAD_F(0x07635284));
-  MAD_F_MLA(hi, lo, X[9], -MAD_F(0x0e313245));
-  MAD_F_MLA(hi, lo, X[11], -MAD_F(0x0bcbe352));
-  MAD_F_MLA(hi, lo, X[12], -MAD_F(0x03768962));
-  MAD_F_MLA(hi, lo, X[14], MAD_F(0x0d7e8807));
-  MAD_F_MLA(hi, lo, X[15], MAD_F(0x0ffc19fd));
-  MAD_F_MLA(hi, lo, X[17], MAD_F(0x04cfb0e2));
-
-  x[23] = x[30] = MAD_F_MLZ(hi, lo) + t1;
-
-  MAD_F_ML0(hi, lo, X[0], -MAD_F(0x0bcbe352));
-  MAD_F_MLA(hi, lo, X[2], MAD_F(0x0d7e8807));
-  MAD_F_MLA(hi, lo, X[3], -MAD_F(0x07635284));
-  MAD_F_MLA(hi, lo, X[5], MAD_F(0x04cfb0e2));
-  MAD_F_MLA(hi, lo, X[6], MAD_F(0x0f9ee890));
-  MAD_F_MLA(hi, lo, X[8], -MAD_F(0x0ffc19fd));
-  MAD_F_MLA(hi, lo, X[9], -MAD_F(0x00b2aa3e));
-  MAD_F_MLA(hi, lo, X[11], MAD_F(0x03768962));
-  MAD_F_MLA(hi, lo, X[12], -MAD_F(0x0f426cb5));
-  MAD_F_MLA(hi, lo, X[14], MAD_F(0x0e313245));
-  MAD_F_MLA(hi, lo, X[15], MAD_F(0x0898c779));
-  MAD_F_MLA(hi, lo, X[17], -MAD_F(0x0acf37ad));
-
-  x[18] = x[35] = MAD_F_MLZ(hi, lo) - t1;
-
-  MAD_F_ML0(hi, lo, X[4], MAD_F(0x061f78aa));
-  MAD_F_MLA(hi, lo, X[13], -MAD_F(0x0ec835e8));
-
-  t7 = MAD_F_MLZ(hi, lo);
-
-  MAD_F_MLA(hi, lo, X[1], -MAD_F(0x0cb19346));
-  MAD_F_MLA(hi, lo, X[7], MAD_F(0x0fdcf549));
-  MAD_F_MLA(hi, lo, X[10], MAD_F(0x0216a2a2));
-  MAD_F_MLA(hi, lo, X[16], -MAD_F(0x09bd7ca0));
-
-  t2 = MAD_F_MLZ(hi, lo);
-
-  MAD_F_MLA(hi, lo, X[0], MAD_F(0x04cfb0e2));
-  MAD_F_MLA(hi, lo, X[2], MAD_F(0x0ffc19fd));
-  MAD_F_MLA(hi, lo, X[3], -MAD_F(0x0d7e8807));
-  MAD_F_MLA(hi, lo, X[5], MAD_F(0x03768962));
-  MAD_F_MLA(hi, lo, X[6], -MAD_F(0x0bcbe352));
-  MAD_F_MLA(hi, lo, X[8], -MAD_F(0x0e313245));
-  MAD_F_MLA(hi, lo, X[9], MAD_F(0x07635284));
-  MAD_F_MLA(hi, lo, X[11], -MAD_F(0x0acf37ad));
-  MAD_F_MLA(hi, lo, X[12], MAD_F(0x0f9ee890));
-  MAD_F_MLA(hi, lo, X[14], MAD_F(0x0898c779));
-  MAD_F_MLA(hi, lo, X[15], MAD_F(0x00b2aa3e));
-  MAD_F_MLA(hi, lo, X[17], MAD_F(0x0f426cb5));
-
-  x[5] = MAD_F_MLZ(hi, lo);
-  x[12] = -x[5];
-
-  MAD_F_ML0(hi, lo, X[0], MAD_F(0x0acf37ad));
-  MAD_F_MLA(hi, lo, X[2], -MAD_F(0x0898c779));
-  MAD_F_MLA(hi, lo, X[3], MAD_F(0x0e313245));
-  MAD_F_MLA(hi, lo, X[5], -MAD_F(0x0f426cb5));
-  MAD_F_MLA(hi, lo, X[6], -MAD_F(0x03768962));
-  MAD_F_MLA(hi, lo, X[8], MAD_F(0x00b2aa3e));
-  MAD_F_MLA(hi, lo, X[9], -MAD_F(0x0ffc19fd));
-  MAD_F_MLA(hi, lo, X[11], MAD_F(0x0f9ee890));
-  MAD_F_MLA(hi, lo, X[12], -MAD_F(0x04cfb0e2));
-  MAD_F_MLA(hi, lo, X[14], MAD_F(0x07635284));
-  MAD_F_MLA(hi, lo, X[15], MAD_F(0x0d7e8807));
-  MAD_F_MLA(hi, lo, X[17], -MAD_F(0x0bcbe352));
-
-  x[0] = MAD_F_MLZ(hi, lo) + t2;
-  x[17] = -x[0];
-
-  MAD_F_ML0(hi, lo, X[0], -MAD_F(0x0f9ee890));
-  MAD_F_MLA(hi, lo, X[2], -MAD_F(0x07635284));
-  MAD_F_MLA(hi, lo, X[3], -MAD_F(0x00b2aa3e));
-  MAD_F_MLA(hi, lo, X[5], MAD_F(0x0bcbe352));
-  MAD_F_MLA(hi, lo, X[6], MAD_F(0x0f426cb5));
-  MAD_F_MLA(hi, lo, X[8], MAD_F(0x0d7e8807));
-  MAD_F_MLA(hi, lo, X[9], MAD_F(0x0898c779));
-  MAD_F_MLA(hi, lo, X[11], -MAD_F(0x04cfb0e2));
-  MAD_F_MLA(hi, lo, X[12], -MAD_F(0x0acf37ad));
-  MAD_F_MLA(hi, lo, X[14], -MAD_F(0x0ffc19fd));
-  MAD_F_MLA(hi, lo, X[15], -MAD_F(0x0e313245));
-  MAD_F_MLA(hi, lo, X[17], -MAD_F(0x03768962));
-
-  x[24] = x[29] = MAD_F_MLZ(hi, lo) + t2;
-
-  MAD_F_ML0(hi, lo, X[1], -MAD_F(0x0216a2a2));
-  MAD_F_MLA(hi, lo, X[7], -MAD_F(0x09bd7ca0));
-  MAD_F_MLA(hi, lo, X[10], MAD_F(0x0cb19346));
-  MAD_F_MLA(hi, lo, X[16], MAD_F(0x0fdcf549));
-
-  t3 = MAD_F_MLZ(hi, lo) + t7;
-
-  MAD_F_ML0(hi, lo, X[0], MAD_F(0x00b2aa3e));
-  MAD_F_MLA(hi, lo, X[2], MAD_F(0x03768962));
-  MAD_F_MLA(hi, lo, X[3], -MAD_F(0x04cfb0e2));
-  MAD_F_MLA(hi, lo, X[5], -MAD_F(0x07635284));
-  MAD_F_MLA(hi, lo, X[6], MAD_F(0x0898c779));
-  MAD_F_MLA(hi, lo, X[8], MAD_F(0x0acf37ad));
-  MAD_F_MLA(hi, lo, X[9], -MAD_F(0x0bcbe352));
-  MAD_F_MLA(hi, lo, X[11], -MAD_F(0x0d7e8807));
-  MAD_F_MLA(hi, lo, X[12], MAD_F(0x0e313245));
-  MAD_F_MLA(hi, lo, X[14], MAD_F(0x0f426cb5));
-  MAD_F_MLA(hi, lo, X[15], -MAD_F(0x0f9ee890));
-  MAD_F_MLA(hi, lo, X[17], -MAD_F(0x0ffc19fd));
-
-  x[8] = MAD_F_MLZ(hi, lo) + t3;
-  x[9] = -x[8];
-
-  MAD_F_ML0(hi, lo, X[0], -MAD_F(0x0e313245));
-  MAD_F_MLA(hi, lo, X[2], MAD_F(0x0bcbe352));
-  MAD_F_MLA(hi, lo, X[3], MAD_F(0x0f9ee890));
-  MAD_F_MLA(hi, lo, X[5], -MAD_F(0x0898c779));
-  MAD_F_MLA(hi, lo, X[6], -MAD_F(0x0ffc19fd));
-  MAD_F_MLA(hi, lo, X[8], MAD_F(0x04cfb0e2));
-  MAD_F_MLA(hi, lo, X[9], MAD_F(0x0f426cb5));
-  MAD_F_MLA(hi, lo, X[11], -MAD_F(0x00b2aa3e));
-  MAD_F_MLA(hi, lo, X[12], -MAD_F(0x0d7e8807));
-  MAD_F_MLA(hi, lo, X[14], -MAD_F(0x03768962));
-  MAD_F_MLA(hi, lo, X[15], MAD_F(0x0acf37ad));
-  MAD_F_MLA(hi, lo, X[17], MAD_F(0x07635284));
-
-  x[21] = x[32] = MAD_F_MLZ(hi, lo) + t3;
-
-  MAD_F_ML0(hi, lo, X[0], -MAD_F(0x0d7e8807));
-  MAD_F_MLA(hi, lo, X[2], MAD_F(0x0f426cb5));
-  MAD_F_MLA(hi, lo, X[3], MAD_F(0x0acf37ad));
-  MAD_F_MLA(hi, lo, X[5], -MAD_F(0x0ffc19fd));
-  MAD_F_MLA(hi, lo, X[6], -MAD_F(0x07635284));
-  MAD_F_MLA(hi, lo, X[8], MAD_F(0x0f9ee890));
-  MAD_F_MLA(hi, lo, X[9], MAD_F(0x03768962));
-  MAD_F_MLA(hi, lo, X[11], -MAD_F(0x0e313245));
-  MAD_F_MLA(hi, lo, X[12], MAD_F(0x00b2aa3e));
-  MAD_F_MLA(hi, lo, X[14], MAD_F(0x0bcbe352));
-  MAD_F_MLA(hi, lo, X[15], -MAD_F(0x04cfb0e2));
-  MAD_F_MLA(hi, lo, X[17], -MAD_F(0x0898c779));
-
-  x[20] = x[33] = MAD_F_MLZ(hi, lo) - t3;
-
-  MAD_F_ML0(hi, lo, t14, -MAD_F(0x0ec835e8));
-  MAD_F_MLA(hi, lo, t15, MAD_F(0x061f78aa));
-
-  t4 = MAD_F_MLZ(hi, lo) - t7;
-
-  MAD_F_ML0(hi, lo, t12, MAD_F(0x061f78aa));
-  MAD_F_MLA(hi, lo, t13, MAD_F(0x0ec835e8));
-
-  x[4] = MAD_F_MLZ(hi, lo) + t4;
-  x[13] = -x[4];
-
-  MAD_F_ML0(hi, lo, t8, MAD_F(0x09bd7ca0));
-  MAD_F_MLA(hi, lo, t9, -MAD_F(0x0216a2a2));
-  MAD_F_MLA(hi, lo, t10, MAD_F(0x0fdcf549));
-  MAD_F_MLA(hi, lo, t11, -MAD_F(0x0cb19346));
-
-  x[1] = MAD_F_MLZ(hi, lo) + t4;
-  x[16] = -x[1];
-
-  MAD_F_ML0(hi, lo, t8, -MAD_F(0x0fdcf549));
-  MAD_F_MLA(hi, lo, t9, -MAD_F(0x0cb19346));
-  MAD_F_MLA(hi, lo, t10, -MAD_F(0x09bd7ca0));
-  MAD_F_MLA(hi, lo, t11, -MAD_F(0x0216a2a2));
-
-  x[25] = x[28] = MAD_F_MLZ(hi, lo) + t4;
-
-  MAD_F_ML0(hi, lo, X[1], -MAD_F(0x0fdcf549));
-  MAD_F_MLA(hi, lo, X[7], -MAD_F(0x0cb19346));
-  MAD_F_MLA(hi, lo, X[10], -MAD_F(0x09bd7ca0));
-  MAD_F_MLA(hi, lo, X[16], -MAD_F(0x0216a2a2));
-
-  t5 = MAD_F_MLZ(hi, lo) - t6;
-
-  MAD_F_ML0(hi, lo, X[0], MAD_F(0x0898c779));
-  MAD_F_MLA(hi, lo, X[2], MAD_F(0x04cfb0e2));
-  MAD_F_MLA(hi, lo, X[3], MAD_F(0x0bcbe352));
-  MAD_F_MLA(hi, lo, X[5], MAD_F(0x00b2aa3e));
-  MAD_F_MLA(hi, lo, X[6], MAD_F(0x0e313245));
-  MAD_F_MLA(hi, lo, X[8], -MAD_F(0x03768962));
-  MAD_F_MLA(hi, lo, X[9], MAD_F(0x0f9ee890));
-  MAD_F_MLA(hi, lo, X[11], -MAD_F(0x07635284));
-  MAD_F_MLA(hi, lo, X[12], MAD_F(0x0ffc19fd));
-  MAD_F_MLA(hi, lo, X[14], -MAD_F(0x0acf37ad));
-  MAD_F_MLA(hi, lo, X[15], MAD_F(0x0f426cb5));
-  MAD_F_MLA(hi, lo, X[17], -MAD_F(0x0d7e8807));
-
-  x[2] = MAD_F_MLZ(hi, lo) + t5;
-  x[15] = -x[2];
-
-  MAD_F_ML0(hi, lo, X[0], MAD_F(0x07635284));
-  MAD_F_MLA(hi, lo, X[2], MAD_F(0x0acf37ad));
-  MAD_F_MLA(hi, lo, X[3], MAD_F(0x03768962));
-  MAD_F_MLA(hi, lo, X[5], MAD_F(0x0d7e8807));
-  MAD_F_MLA(hi, lo, X[6], -MAD_F(0x00b2aa3e));
-  MAD_F_MLA(hi, lo, X[8], MAD_F(0x0f426cb5));
-  MAD_F_MLA(hi, lo, X[9], -MAD_F(0x04cfb0e2));
-  MAD_F_MLA(hi, lo, X[11], MAD_F(0x0ffc19fd));
-  MAD_F_MLA(hi, lo, X[12], -MAD_F(0x0898c779));
-  MAD_F_MLA(hi, lo, X[14], MAD_F(0x0f9ee890));
-  MAD_F_MLA(hi, lo, X[15], -MAD_F(0x0bcbe352));
-  MAD_F_MLA(hi, lo, X[17], MAD_F(0x0e313245));
-
-  x[3] = MAD_F_MLZ(hi, lo) + t5;
-  x[14] = -x[3];
-
-  MAD_F_ML0(hi, lo, X[0], -MAD_F(0x0ffc19fd));
-  MAD_F_MLA(hi, lo, X[2], -MAD_F(0x0f9ee890));
-  MAD_F_MLA(hi, lo, X[3], -MAD_F(0x0f426cb5));
-  MAD_F_MLA(hi, lo, X[5], -MAD_F(0x0e313245));
-  MAD_F_MLA(hi, lo, X[6], -MAD_F(0x0d7e8807));
-  MAD_F_MLA(hi, lo, X[8], -MAD_F(0x0bcbe352));
-  MAD_F_MLA(hi, lo, X[9], -MAD_F(0x0acf37ad));
-  MAD_F_MLA(hi, lo, X[11], -MAD_F(0x0898c779));
-  MAD_F_MLA(hi, lo, X[12], -MAD_F(0x07635284));
-  MAD_F_MLA(hi, lo, X[14], -MAD_F(0x04cfb0e2));
-  MAD_F_MLA(hi, lo, X[15], -MAD_F(0x03768962));
-  MAD_F_MLA(hi, lo, X[17], -MAD_F(0x00b2aa3e));
-
-  x[26] = x[27] = MAD_F_MLZ(hi, lo) + t5;
-}
-#endif
-
 /*
  * NAME:	III_imdct_l()
- * DESCRIPTION:	perform IMDCT and windowing for long blocks
+ * DESCRIPTION:	perform IMDCT, windowing and overlap-add for long blocks
  */
-static void III_imdct_l(mad_fixed_t const X[18], mad_fixed_t z[36],
+static void III_imdct_l(mad_fixed_t const X[18], mad_fixed_t overlap[18],
+                        mad_fixed_t sample[18][32], unsigned int sb,
                         unsigned int block_type)
 {
+  mad_fixed_t tmp[18];
   unsigned int i;
 
-  /* IMDCT */
-
-  imdct36(X, z);
+  /*
+   * 18-point DCT-IV (Szu-Wei Lee's algorithm). The 36 IMDCT outputs are
+   * z[0..8] = tmp[9..17], z[9..26] = -tmp[17..0], z[27..35] = -tmp[0..8];
+   * they are windowed as they are read and never stored. z[0..17] is
+   * added to the previous overlap, z[18..35] becomes the next one.
+   */
 
-  /* windowing */
+  dctIV(X, tmp);
 
   switch (block_type)
   {
   case 0: /* normal window */
-#if defined(ASO_INTERLEAVE1)
-    register mad_fixed_t tmp1, tmp2;
-
-    tmp1 = window_l[0];
-    tmp2 = window_l[1];
-
-    for (i = 0; i < 34; i += 2)
-    {
-      z[i + 0] = mad_f_mul(z[i + 0], tmp1);
-      tmp1 = window_l[i + 2];
-      z[i + 1] = mad_f_mul(z[i + 1], tmp2);
-      tmp2 = window_l[i + 3];
-    }
-
-    z[34] = mad_f_mul(z[34], tmp1);
-    z[35] = mad_f_mul(z[35], tmp2);
-
-#elif defined(ASO_INTERLEAVE2)
-    register mad_fixed_t tmp1, tmp2;
-
-    tmp1 = z[0];
-    tmp2 = window_l[0];
-
-    for (i = 0; i < 35; ++i)
-    {
-      z[i] = mad_f_mul(tmp1, tmp2);
-      tmp1 = z[i + 1];
-      tmp2 = window_l[i + 1];
-    }
-
-    z[35] = mad_f_mul(tmp1, tmp2);
-
-#elif 1
-    for (i = 0; i < 36; i += 4)
+    for (i = 0; i < 9; ++i)
     {
-      z[i + 0] = mad_f_mul(z[i + 0], window_l[i + 0]);
-      z[i + 1] = mad_f_mul(z[i + 1], window_l[i + 1]);
-      z[i + 2] = mad_f_mul(z[i + 2], window_l[i + 2]);
-      z[i + 3] = mad_f_mul(z[i + 3], window_l[i + 3]);
+      sample[i + 0][sb] = mad_f_mul( tmp[ 9 + i], window_l[i +  0]) + overlap[i + 0];
+      sample[i + 9][sb] = mad_f_mul(-tmp[17 - i], window_l[i +  9]) + overlap[i + 9];
+      overlap[i + 0]    = mad_f_mul(-tmp[ 8 - i], window_l[i + 18]);
+      overlap[i + 9]    = mad_f_mul(-tmp[ 0 + i], window_l[i + 27]);
     }
-#else
-    for (i = 0; i < 36; ++i)
-      z[i] = mad_f_mul(z[i], window_l[i]);
-#endif
     break;
 
   case 1: /* start block */
-    for (i = 0; i < 18; i += 3)
+    for (i = 0; i < 9; ++i)
     {
-      z[i + 0] = mad_f_mul(z[i + 0], window_l[i + 0]);
-      z[i + 1] = mad_f_mul(z[i + 1], window_l[i + 1]);
-      z[i + 2] = mad_f_mul(z[i + 2], window_l[i + 2]);
+      sample[i + 0][sb] = mad_f_mul( tmp[ 9 + i], window_l[i + 0]) + overlap[i + 0];
+      sample[i + 9][sb] = mad_f_mul(-tmp[17 - i], window_l[i + 9]) + overlap[i + 9];
     }
-    /*  (i = 18; i < 24; ++i) z[i] unchanged */
-    for (i = 24; i < 30; ++i)
-      z[i] = mad_f_mul(z[i], window_s[i - 18]);
-    for (i = 30; i < 36; ++i)
-      z[i] = 0;
+    for (i = 0; i < 6; ++i)
+      overlap[i] = -tmp[8 - i];
+    for (i = 6; i < 9; ++i)
+      overlap[i] = mad_f_mul(-tmp[8 - i], window_s[i]);
+    for (i = 9; i < 12; ++i)
+      overlap[i] = mad_f_mul(-tmp[i - 9], window_s[i]);
+    for (i = 12; i < 18; ++i)
+      overlap[i] = 0;
     break;
 
   case 3: /* stop block */
     for (i = 0; i < 6; ++i)
-      z[i] = 0;
-    for (i = 6; i < 12; ++i)
-      z[i] = mad_f_mul(z[i], window_s[i - 6]);
-    /*  (i = 12; i < 18; ++i) z[i] unchanged */
-    for (i = 18; i < 36; i += 3)
+      sample[i][sb] = overlap[i];
+    for (i = 6; i < 9; ++i)
+      sample[i][sb] = mad_f_mul(tmp[9 + i], window_s[i - 6]) + overlap[i];
+    for (i = 9; i < 12; ++i)
+      sample[i][sb] = mad_f_mul(-tmp[26 - i], window_s[i - 6]) + overlap[i];
+    for (i = 12; i < 18; ++i)
+      sample[i][sb] = -tmp[26 - i] + overlap[i];
+    for (i = 0; i < 9; ++i)
     {
-      z[i + 0] = mad_f_mul(z[i + 0], window_l[i + 0]);
-      z[i + 1] = mad_f_mul(z[i + 1], window_l[i + 1]);
-      z[i + 2] = mad_f_mul(z[i + 2], window_l[i + 2]);
+      overlap[i + 0] = mad_f_mul(-tmp[8 - i], window_l[i + 18]);
+      overlap[i + 9] = mad_f_mul(-tmp[0 + i], window_l[i + 27]);
     }
     break;
   }
 }
-#endif /* ASO_IMDCT */
 
 /*
  * NAME:	III_imdct_s()
- * DESCRIPTION:	perform IMDCT and windowing for short blocks
+ * DESCRIPTION:	perform IMDCT, windowing and overlap-add for short blocks
  */
-static void III_imdct_s(mad_fixed_t const X[18], mad_fixed_t z[36])
+static void III_imdct_s(mad_fixed_t const X[18], mad_fixed_t overlap[18],
+                        mad_fixed_t sample[18][32], unsigned int sb)
 {
   mad_fixed_t y[36], *yptr;
   mad_fixed_t const *wptr;
@@ -2261,84 +1929,37 @@ static void III_imdct_s(mad_fixed_t const X[18], mad_fixed_t z[36])
     X += 6;
   }
 
-  /* windowing, overlapping and concatenation */
+  /*
+   * windowing, concatenation and overlap-add: the three windows land at
+   * 6..17, 12..23 and 18..29 of the 36-point output, the first half of
+   * which is added to the previous overlap
+   */
 
   yptr = &y[0];
   wptr = &window_s[0];
 
   for (i = 0; i < 6; ++i)
   {
-    z[i + 0] = 0;
-    z[i + 6] = mad_f_mul(yptr[0 + 0], wptr[0]);
+    sample[i + 0][sb] = overlap[i + 0];
+    sample[i + 6][sb] = mad_f_mul(yptr[0 + 0], wptr[0]) + overlap[i + 6];
 
     MAD_F_ML0(hi, lo, yptr[0 + 6], wptr[6]);
     MAD_F_MLA(hi, lo, yptr[12 + 0], wptr[0]);
 
-    z[i + 12] = MAD_F_MLZ(hi, lo);
+    sample[i + 12][sb] = MAD_F_MLZ(hi, lo) + overlap[i + 12];
 
     MAD_F_ML0(hi, lo, yptr[12 + 6], wptr[6]);
     MAD_F_MLA(hi, lo, yptr[24 + 0], wptr[0]);
 
-    z[i + 18] = MAD_F_MLZ(hi, lo);
-
-    z[i + 24] = mad_f_mul(yptr[24 + 6], wptr[6]);
-    z[i + 30] = 0;
+    overlap[i + 0] = MAD_F_MLZ(hi, lo);
+    overlap[i + 6] = mad_f_mul(yptr[24 + 6], wptr[6]);
+    overlap[i + 12] = 0;
 
     ++yptr;
     ++wptr;
   }
 }
 
-/*
- * NAME:	III_overlap()
- * DESCRIPTION:	perform overlap-add of windowed IMDCT outputs
- */
-static void III_overlap(mad_fixed_t const output[36], mad_fixed_t overlap[18],
-                        mad_fixed_t sample[18][32], unsigned int sb)
-{
-  unsigned int i;
-
-#if defined(ASO_INTERLEAVE2)
-  {
-    register mad_fixed_t tmp1, tmp2;
-
-    tmp1 = overlap[0];
-    tmp2 = overlap[1];
-
-    for (i = 0; i < 16; i += 2)
-    {
-      sample[i + 0][sb] = output[i + 0 + 0] + tmp1;
-      overlap[i + 0] = output[i + 0 + 18];
-      tmp1 = overlap[i + 2];
-
-      sample[i + 1][sb] = output[i + 1 + 0] + tmp2;
-      overlap[i + 1] = output[i + 1 + 18];
-      tmp2 = overlap[i + 3];
-    }
-
-    sample[16][sb] = output[16 + 0] + tmp1;
-    overlap[16] = output[16 + 18];
-    sample[17][sb] = output[17 + 0] + tmp2;
-    overlap[17] = output[17 + 18];
-  }
-#elif 0
-  for (i = 0; i < 18; i += 2)
-  {
-    sample[i + 0][sb] = output[i + 0 + 0] + overlap[i + 0];
-    overlap[i + 0] = output[i + 0 + 18];
-
-    sample[i + 1][sb] = output[i + 1 + 0] + overlap[i + 1];
-    overlap[i + 1] = output[i + 1 + 18];
-  }
-#else
-  for (i = 0; i < 18; ++i)
-  {
-    sample[i][sb] = output[i + 0] + overlap[i];
-    overlap[i] = output[i + 18];
-  }
-#endif
-}
-
 /*
  * NAME:	III_overlap_z()
  * DESCRIPTION:	perform "overlap-add" of zero IMDCT outputs
@@ -2496,7 +2117,6 @@ static enum mad_error III_decode(struct mad_bitptr *ptr, struct mad_frame *frame
       struct channel const *channel = &granule->ch[ch];
       mad_fixed_t(*sample)[32] = &frame->sbsample[ch][18 * gr];
       unsigned int sb, l, i, sblimit;
-      mad_fixed_t output[36];
 
       if (channel->block_type == 2)
       {
@@ -2532,8 +2152,8 @@ static enum mad_error III_decode(struct mad_bitptr *ptr, struct mad_frame *frame
         /* long blocks */
         for (sb = 0; sb < 2; ++sb, l += 18)
         {
-          III_imdct_l(&xr[ch][l], output, block_type);
-          III_overlap(output, (*frame->overlap)[ch][sb], sample, sb);
+          III_imdct_l(&xr[ch][l], (*frame->overlap)[ch][sb], sample, sb,
+                      block_type);
         }
       }
       else
@@ -2541,8 +2161,7 @@ static enum mad_error III_decode(struct mad_bitptr *ptr, struct mad_frame *frame
         /* short blocks */
         for (sb = 0; sb < 2; ++sb, l += 18)
         {
-          III_imdct_s(&xr[ch][l], output);
-          III_overlap(output, (*frame->overlap)[ch][sb], sample, sb);
+          III_imdct_s(&xr[ch][l], (*frame->overlap)[ch][sb], sample, sb);
         }
       }
 
@@ -2561,8 +2180,8 @@ static enum mad_error III_decode(struct mad_bitptr *ptr, struct mad_frame *frame
         /* long blocks */
         for (sb = 2; sb < sblimit; ++sb, l += 18)
         {
-          III_imdct_l(&xr[ch][l], output, channel->block_type);
-          III_overlap(output, (*frame->overlap)[ch][sb], sample, sb);
+          III_imdct_l(&xr[ch][l], (*frame->overlap)[ch][sb], sample, sb,
+                      channel->block_type);
 
           if (sb & 1)
             III_freqinver(sample, sb);
@@ -2573,8 +2192,7 @@ static enum mad_error III_decode(struct mad_bitptr *ptr, struct mad_frame *frame
         /* short blocks */
         for (sb = 2; sb < sblimit; ++sb, l += 18)
         {
-          III_imdct_s(&xr[ch][l], output);
-          III_overlap(output, (*frame->overlap)[ch][sb], sample, sb);
+          III_imdct_s(&xr[ch][l], (*frame->overlap)[ch][sb], sample, sb);
 
           if (sb & 1)
             III_freqinver(sample, sb);
@@ -2596,6 +2214,9 @@ static enum mad_error III_decode(struct mad_bitptr *ptr, struct mad_frame *frame
   return MAD_ERROR_NONE;
 }
 
+/* room for the largest standard bitrate Layer III frame and the guard */
+# define MD_INPLACE_ROOM	(1441 + MAD_BUFFER_GUARD)
+
 /*
  * NAME:	layer->III()
  * DESCRIPTION:	decode a single Layer III frame
@@ -2605,15 +2226,18 @@ int mad_layer_III(struct mad_stream *stream, struct mad_frame *frame)
   struct mad_header *header = &frame->header;
   unsigned int nch, priv_bitlen, next_md_begin = 0;
   unsigned int si_len, data_bitlen, md_len;
-  unsigned int frame_space, frame_used, frame_free;
+  unsigned int frame_space, frame_used, frame_free, md_front;
   struct mad_bitptr ptr;
   struct sideinfo si;
   enum mad_error error;
   int result = 0;
   static mad_fixed_t ovlbuf[2 * 32 * 18];
 
-  /* allocate Layer III dynamic structures */
-  frame->overlap = (void *)ovlbuf;
+  /* allocate Layer III dynamic structures, a new frame starts from silence */
+  if (frame->overlap == 0) {
+    memset(ovlbuf, 0, sizeof(ovlbuf));
+    frame->overlap = (void *)ovlbuf;
+  }
   stream->main_data = &MainData;
   /*
     if (stream->main_data == 0) {
@@ -2704,6 +2328,7 @@ int mad_layer_III(struct mad_stream *stream, struct mad_frame *frame)
   md_len = si.main_data_begin + frame_space - next_md_begin;
 
   frame_used = 0;
+  md_front = 0;
 
   if (si.main_data_begin == 0)
   {
@@ -2712,6 +2337,26 @@ int mad_layer_III(struct mad_stream *stream, struct mad_frame *frame)
 
     frame_used = md_len;
   }
+  else if (stream->md_inplace == stream->this_frame)
+  {
+    /*
+     * The reservoir is the free tail of the previous frame, right in front
+     * of this frame's header. Move it up against this frame's main_data,
+     * over the header and side information already decoded, and read
+     * main_data in place instead of assembling it in stream->main_data.
+     */
+    unsigned char *md = (unsigned char *) mad_bit_nextbyte(&stream->ptr);
+
+    memmove(md - si.main_data_begin,
+            stream->this_frame - si.main_data_begin, si.main_data_begin);
+    mad_bit_init(&ptr, md - si.main_data_begin);
+
+    if (md_len > si.main_data_begin)
+      frame_used = md_len - si.main_data_begin;
+
+    /* all of this frame's main_data now runs up to the next header */
+    md_front = si.main_data_begin + frame_space;
+  }
   else
   {
     if (si.main_data_begin > stream->md_len)
@@ -2743,6 +2388,10 @@ int mad_layer_III(struct mad_stream *stream, struct mad_frame *frame)
 
   frame_free = frame_space - frame_used;
 
+  /* main_data bytes right in front of the next frame's header */
+  if (md_front < frame_free)
+    md_front = frame_free;
+
   /* decode main_data */
 
   if (result == 0)
@@ -2768,9 +2417,22 @@ int mad_layer_III(struct mad_stream *stream, struct mad_frame *frame)
 	  data_bitlen, stream->anc_bitlen);
 #endif
 
+  /* leave the reservoir in place if the next frame will be read from here */
+
+  stream->md_inplace = 0;
+
+  if ((stream->options & MAD_OPTION_INPLACEMD) &&
+      !(header->flags & MAD_FLAG_FREEFORMAT) &&
+      md_front >= next_md_begin &&
+      stream->bufend - stream->next_frame >= MD_INPLACE_ROOM)
+  {
+    stream->md_inplace = stream->next_frame;
+    stream->md_len = 0;
+  }
+
   /* preload main_data buffer with up to 511 bytes for next frame(s) */
 
-  if (frame_free >= next_md_begin)
+  else if (md_front >= next_md_begin)
   {
     memcpy(*stream->main_data,
            stream->next_frame - next_md_begin, next_md_begin);
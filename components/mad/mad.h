@@ -463,6 +463,49 @@ mad_fixed_t mad_f_mul_inline(mad_fixed_t x, mad_fixed_t y)
 
 #  define MAD_F_SCALEBITS  MAD_F_FRACBITS
 
+/* --- High-word multiply -------------------------------------------------- */
+
+# elif defined(FPM_MULSH)
+
+/*
+ * This version is for cores that have a 32x32 multiply returning the high
+ * word of the 64-bit product (Xtensa MULSH, RISC-V MULH) but no cheap way
+ * to carry a 64-bit accumulator. Only the high words are accumulated and
+ * the low words are discarded, so each product is truncated to 2^-32 before
+ * the final scale; this is still far more accurate than FPM_DEFAULT, which
+ * throws away 28 bits of the operands before multiplying.
+ *
+ * Because MAD_F_MLX() is provided, OPT_SPEED also enables the Q31 DCT in
+ * the subband synthesis.
+ */
+#  if defined(__XTENSA__)
+#   define MAD_F_MULSH(x, y)  \
+    ({ mad_fixed64hi_t __hi;  \
+       asm ("mulsh	%0, %1, %2"  \
+	    : "=a" (__hi)  \
+	    : "%a" (x), "a" (y));  \
+       __hi;  \
+    })
+#  else
+/* compiles to a single MULH on RV32IM and to IMUL on x86 hosts */
+#   define MAD_F_MULSH(x, y)  \
+    ((mad_fixed64hi_t) (((mad_fixed64_t) (x) * (y)) >> 32))
+#  endif
+
+#  define MAD_F_MLX(hi, lo, x, y)  \
+    ((void) ((lo) = 0), (hi) = MAD_F_MULSH((x), (y)))
+
+#  define MAD_F_MLA(hi, lo, x, y)  \
+    ((hi) += MAD_F_MULSH((x), (y)))
+
+#  define MAD_F_MLN(hi, lo)  \
+    ((hi) = -(hi))
+
+#  define mad_f_scale64(hi, lo)  \
+    ((void) (lo), (mad_fixed_t) ((hi) << (32 - MAD_F_SCALEBITS)))
+
+#  define MAD_F_SCALEBITS  MAD_F_FRACBITS
+
 /* --- Default ------------------------------------------------------------- */
 
 # elif defined(FPM_DEFAULT)
@@ -713,6 +756,8 @@ struct mad_stream {
 
 					/* Layer III main_data() */
   unsigned int md_len;			/* bytes in main_data */
+  unsigned char const *md_inplace;	/* frame whose main_data is read in
+					   place (MAD_OPTION_INPLACEMD) */
 
   int options;				/* decoding options (see below) */
   enum mad_error error;			/* error code (see above) */
@@ -720,7 +765,9 @@ struct mad_stream {
 
 enum {
   MAD_OPTION_IGNORECRC      = 0x0001,	/* ignore CRC errors */
-  MAD_OPTION_HALFSAMPLERATE = 0x0002	/* generate PCM at 1/2 sample rate */
+  MAD_OPTION_HALFSAMPLERATE = 0x0002,	/* generate PCM at 1/2 sample rate */
+  MAD_OPTION_INPLACEMD      = 0x0004	/* Layer III main_data may be read
+					   in place, the buffer is writable */
 # if 0  /* not yet implemented */
   MAD_OPTION_LEFTCHANNEL    = 0x0010,	/* decode left channel only */
   MAD_OPTION_RIGHTCHANNEL   = 0x0020,	/* decode right channel only */
@@ -851,6 +898,7 @@ struct mad_pcm {
   unsigned int samplerate;		/* sampling frequency (Hz) */
   unsigned short channels;		/* number of channels */
   unsigned short length;		/* number of samples per channel */
+  short int samples[1152 * 2];		/* interleaved PCM output */
 };
 
 struct mad_synth {
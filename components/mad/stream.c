@@ -54,6 +54,7 @@ void mad_stream_init(struct mad_stream *stream)
 
   stream->main_data  = 0;
   stream->md_len     = 0;
+  stream->md_inplace = 0;
 
   stream->options    = 0;
   stream->error      = MAD_ERROR_NONE;
@@ -89,6 +90,9 @@ void mad_stream_buffer(struct mad_stream *stream,
 
   stream->sync = 1;
 
+  /* the reservoir may not be resident in the new buffer */
+  stream->md_inplace = 0;
+
   mad_bit_init(&stream->ptr, buffer);
 }
 
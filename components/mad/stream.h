@@ -78,6 +78,8 @@ struct mad_stream {
   main_data_t *main_data;
 					/* Layer III main_data() */
   unsigned int md_len;			/* bytes in main_data */
+  unsigned char const *md_inplace;	/* frame whose main_data is read in
+					   place (MAD_OPTION_INPLACEMD) */
 
   int options;				/* decoding options (see below) */
   enum mad_error error;			/* error code (see above) */
@@ -85,7 +87,9 @@ struct mad_stream {
 
 enum {
   MAD_OPTION_IGNORECRC      = 0x0001,	/* ignore CRC errors */
-  MAD_OPTION_HALFSAMPLERATE = 0x0002	/* generate PCM at 1/2 sample rate */
+  MAD_OPTION_HALFSAMPLERATE = 0x0002,	/* generate PCM at 1/2 sample rate */
+  MAD_OPTION_INPLACEMD      = 0x0004	/* Layer III main_data may be read
+					   in place, the buffer is writable */
 # if 0  /* not yet implemented */
   MAD_OPTION_LEFTCHANNEL    = 0x0010,	/* decode left channel only */
   MAD_OPTION_RIGHTCHANNEL   = 0x0020,	/* decode right channel only */
@@ -29,6 +29,7 @@ struct mad_pcm {
   unsigned int samplerate;		/* sampling frequency (Hz) */
   unsigned short channels;		/* number of channels */
   unsigned short length;		/* number of samples per channel */
+  short int samples[1152 * 2];		/* interleaved PCM output */
 };
 
 struct mad_synth {
@@ -66,7 +67,7 @@ void mad_synth_mute(struct mad_synth *);
 void mad_synth_frame(struct mad_synth *, struct mad_frame const *);
 
 void render_sample_block_mono(short *short_sample_buff, int no_samples);
-void render_sample_block(short *sample_buff_ch0, short *sample_buff_ch1, int num_samples, unsigned int num_channels);
+void render_sample_block(short *sample_buff, int num_samples, unsigned int num_channels);
 void set_dac_sample_rate(int rate);
 
 
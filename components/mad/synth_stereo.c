@@ -601,23 +601,21 @@ void synth_full(struct mad_synth *synth, struct mad_frame const *frame,
   register mad_fixed64hi_t hi;
   register mad_fixed64lo_t lo;
   mad_fixed_t raw_sample;
-  short int short_sample_buff[2][32];
+  short int *pcm;
 
   phase = synth->phase;
+  pcm   = synth->pcm.samples;
 
   if (nch > 2)
     return;
 
   for (s = 0; s < ns; ++s)
   {
-    memset (short_sample_buff[0], 0x00, sizeof(short_sample_buff[0]));
-    memset (short_sample_buff[1], 0x00, sizeof(short_sample_buff[0]));
-
     for (ch = 0; ch < nch; ++ch)
     {
       sbsample = (void*) &frame->sbsample[ch];
       filter   = &synth->filter[ch];
-      pcm1     = short_sample_buff[ch];
+      pcm1     = pcm + ch;
 
       dct32((*sbsample)[s], phase >> 1,
 	    (*filter)[0][phase & 1], (*filter)[1][phase & 1]);
@@ -656,8 +654,9 @@ void synth_full(struct mad_synth *synth, struct mad_frame const *frame,
 
       raw_sample = SHIFT(MLZ(hi, lo));
       raw_sample = scale(raw_sample);
-      (*pcm1++) += (short int)raw_sample;
-      pcm2 = pcm1 + 30;
+      *pcm1 = (short int)raw_sample;
+      pcm1 += nch;
+      pcm2 = pcm1 + 30 * nch;
 
       for (sb = 1; sb < 16; ++sb)
       {
@@ -690,7 +689,8 @@ void synth_full(struct mad_synth *synth, struct mad_frame const *frame,
 
         raw_sample = SHIFT(MLZ(hi, lo));
         raw_sample = scale(raw_sample);
-        (*pcm1++) += (short int)raw_sample;
+        *pcm1 = (short int)raw_sample;
+      pcm1 += nch;
 
         ptr = *Dptr - pe;
         ML0(hi, lo, (*fe)[0], ptr[31 - 16]);
@@ -714,7 +714,8 @@ void synth_full(struct mad_synth *synth, struct mad_frame const *frame,
 
         raw_sample = SHIFT(MLZ(hi, lo));
         raw_sample = scale(raw_sample);
-        (*pcm2--) += (short int)raw_sample;
+        *pcm2 = (short int)raw_sample;
+        pcm2 -= nch;
 
         ++fo;
       }
@@ -733,17 +734,194 @@ void synth_full(struct mad_synth *synth, struct mad_frame const *frame,
 
       raw_sample = SHIFT(-MLZ(hi, lo));
       raw_sample = scale(raw_sample);
-      (*pcm1) += (short int)raw_sample;
+      *pcm1 = (short int)raw_sample;
 
     }  /* Channel For */
 
-    /* Render block */
-    render_sample_block(short_sample_buff[0], short_sample_buff[1], 32, nch);
-
+    pcm += 32 * nch;
     phase = (phase + 1) % 16;
 
   } /* Block for */
 }
+
+/*
+ * The stereo window products below load each D[] coefficient once and apply
+ * it to both channels. The right channel's filter outputs sit at a fixed
+ * offset from the left channel's in synth->filter, so a single set of
+ * filter pointers serves both.
+ */
+
+# define CH1	(2 * 2 * 16)
+
+# define ML0_2(f, k, c)  \
+    do {  \
+      d = (c);  \
+      ML0(hi0, lo0, (f)[0][k], d);  \
+      ML0(hi1, lo1, (f)[CH1][k], d);  \
+    } while (0)
+
+# define MLA_2(f, k, c)  \
+    do {  \
+      d = (c);  \
+      MLA(hi0, lo0, (f)[0][k], d);  \
+      MLA(hi1, lo1, (f)[CH1][k], d);  \
+    } while (0)
+
+# define MLN_2()  \
+    do {  \
+      MLN(hi0, lo0);  \
+      MLN(hi1, lo1);  \
+    } while (0)
+
+/*
+ * NAME:	synth->full_stereo()
+ * DESCRIPTION:	perform full frequency PCM synthesis of both channels in a
+ *		single pass
+ */
+static
+void synth_full_stereo(struct mad_synth *synth, struct mad_frame const *frame,
+		       unsigned int nch, unsigned int ns)
+{
+  unsigned int phase, s, sb, pe, po;
+  short int *pcm1, *pcm2;
+  register mad_fixed_t (*fe)[8], (*fx)[8], (*fo)[8];
+  register mad_fixed_t const (*Dptr)[32], *ptr;
+  register mad_fixed64hi_t hi0, hi1;
+  register mad_fixed64lo_t lo0, lo1;
+  mad_fixed_t d;
+  short int *pcm;
+
+  phase = synth->phase;
+  pcm   = synth->pcm.samples;
+
+  for (s = 0; s < ns; ++s)
+  {
+    dct32(frame->sbsample[0][s], phase >> 1,
+	  synth->filter[0][0][phase & 1], synth->filter[0][1][phase & 1]);
+    dct32(frame->sbsample[1][s], phase >> 1,
+	  synth->filter[1][0][phase & 1], synth->filter[1][1][phase & 1]);
+
+    pe = phase & ~1;
+    po = ((phase - 1) & 0xf) | 1;
+
+    /* calculate 16 samples per channel */
+
+    fe = &synth->filter[0][0][ phase & 1][0];
+    fx = &synth->filter[0][0][~phase & 1][0];
+    fo = &synth->filter[0][1][~phase & 1][0];
+
+    Dptr = &D[0];
+
+    ptr = *Dptr + po;
+    ML0_2(fx, 0, ptr[ 0]);
+    MLA_2(fx, 1, ptr[14]);
+    MLA_2(fx, 2, ptr[12]);
+    MLA_2(fx, 3, ptr[10]);
+    MLA_2(fx, 4, ptr[ 8]);
+    MLA_2(fx, 5, ptr[ 6]);
+    MLA_2(fx, 6, ptr[ 4]);
+    MLA_2(fx, 7, ptr[ 2]);
+    MLN_2();
+
+    ptr = *Dptr + pe;
+    MLA_2(fe, 0, ptr[ 0]);
+    MLA_2(fe, 1, ptr[14]);
+    MLA_2(fe, 2, ptr[12]);
+    MLA_2(fe, 3, ptr[10]);
+    MLA_2(fe, 4, ptr[ 8]);
+    MLA_2(fe, 5, ptr[ 6]);
+    MLA_2(fe, 6, ptr[ 4]);
+    MLA_2(fe, 7, ptr[ 2]);
+
+    pcm1 = pcm;
+    pcm1[0] = (short int) scale(SHIFT(MLZ(hi0, lo0)));
+    pcm1[1] = (short int) scale(SHIFT(MLZ(hi1, lo1)));
+    pcm1 += 2;
+    pcm2 = pcm1 + 30 * 2;
+
+    for (sb = 1; sb < 16; ++sb)
+    {
+      ++fe;
+      ++Dptr;
+
+      /* D[32 - sb][i] == -D[sb][31 - i] */
+
+      ptr = *Dptr + po;
+      ML0_2(fo, 0, ptr[ 0]);
+      MLA_2(fo, 1, ptr[14]);
+      MLA_2(fo, 2, ptr[12]);
+      MLA_2(fo, 3, ptr[10]);
+      MLA_2(fo, 4, ptr[ 8]);
+      MLA_2(fo, 5, ptr[ 6]);
+      MLA_2(fo, 6, ptr[ 4]);
+      MLA_2(fo, 7, ptr[ 2]);
+      MLN_2();
+
+      ptr = *Dptr + pe;
+      MLA_2(fe, 7, ptr[ 2]);
+      MLA_2(fe, 6, ptr[ 4]);
+      MLA_2(fe, 5, ptr[ 6]);
+      MLA_2(fe, 4, ptr[ 8]);
+      MLA_2(fe, 3, ptr[10]);
+      MLA_2(fe, 2, ptr[12]);
+      MLA_2(fe, 1, ptr[14]);
+      MLA_2(fe, 0, ptr[ 0]);
+
+      pcm1[0] = (short int) scale(SHIFT(MLZ(hi0, lo0)));
+      pcm1[1] = (short int) scale(SHIFT(MLZ(hi1, lo1)));
+      pcm1 += 2;
+
+      ptr = *Dptr - pe;
+      ML0_2(fe, 0, ptr[31 - 16]);
+      MLA_2(fe, 1, ptr[31 - 14]);
+      MLA_2(fe, 2, ptr[31 - 12]);
+      MLA_2(fe, 3, ptr[31 - 10]);
+      MLA_2(fe, 4, ptr[31 -  8]);
+      MLA_2(fe, 5, ptr[31 -  6]);
+      MLA_2(fe, 6, ptr[31 -  4]);
+      MLA_2(fe, 7, ptr[31 -  2]);
+
+      ptr = *Dptr - po;
+      MLA_2(fo, 7, ptr[31 -  2]);
+      MLA_2(fo, 6, ptr[31 -  4]);
+      MLA_2(fo, 5, ptr[31 -  6]);
+      MLA_2(fo, 4, ptr[31 -  8]);
+      MLA_2(fo, 3, ptr[31 - 10]);
+      MLA_2(fo, 2, ptr[31 - 12]);
+      MLA_2(fo, 1, ptr[31 - 14]);
+      MLA_2(fo, 0, ptr[31 - 16]);
+
+      pcm2[0] = (short int) scale(SHIFT(MLZ(hi0, lo0)));
+      pcm2[1] = (short int) scale(SHIFT(MLZ(hi1, lo1)));
+      pcm2 -= 2;
+
+      ++fo;
+    }
+
+    ++Dptr;
+
+    ptr = *Dptr + po;
+    ML0_2(fo, 0, ptr[ 0]);
+    MLA_2(fo, 1, ptr[14]);
+    MLA_2(fo, 2, ptr[12]);
+    MLA_2(fo, 3, ptr[10]);
+    MLA_2(fo, 4, ptr[ 8]);
+    MLA_2(fo, 5, ptr[ 6]);
+    MLA_2(fo, 6, ptr[ 4]);
+    MLA_2(fo, 7, ptr[ 2]);
+
+    pcm1[0] = (short int) scale(SHIFT(-MLZ(hi0, lo0)));
+    pcm1[1] = (short int) scale(SHIFT(-MLZ(hi1, lo1)));
+
+    pcm += 32 * 2;
+    phase = (phase + 1) % 16;
+  }
+}
+
+# undef ML0_2
+# undef MLA_2
+# undef MLN_2
+# undef CH1
 #endif
 
 /*
@@ -763,23 +941,21 @@ void synth_half(struct mad_synth *synth, struct mad_frame const *frame,
   register mad_fixed64hi_t hi;
   register mad_fixed64lo_t lo;
   mad_fixed_t raw_sample;
-  short int short_sample_buff[2][16];
+  short int *pcm;
 
   phase = synth->phase;
+  pcm   = synth->pcm.samples;
 
   if (nch > 2)
     return;
 
   for (s = 0; s < ns; ++s)
   {
-    memset (short_sample_buff[0], 0x00, sizeof(short_sample_buff[0]));
-    memset (short_sample_buff[1], 0x00, sizeof(short_sample_buff[0]));
-
     for (ch = 0; ch < nch; ++ch)
     {
       sbsample = (void *) &frame->sbsample[ch];
       filter   = &synth->filter[ch];
-      pcm1 = short_sample_buff[ch];
+      pcm1     = pcm + ch;
 
       dct32((*sbsample)[s], phase >> 1,
 	    (*filter)[0][phase & 1], (*filter)[1][phase & 1]);
@@ -818,14 +994,21 @@ void synth_half(struct mad_synth *synth, struct mad_frame const *frame,
 
       raw_sample = SHIFT(MLZ(hi, lo));
       raw_sample = scale(raw_sample);
-      (*pcm1++) += (short int)raw_sample;
-      pcm2 = pcm1 + 14;
+      *pcm1 = (short int)raw_sample;
+      pcm1 += nch;
+      pcm2 = pcm1 + 14 * nch;
 
       for (sb = 1; sb < 16; ++sb)
       {
         ++fe;
         ++Dptr;
 
+        /* only the even subbands contribute at half rate */
+        if (sb & 1) {
+          ++fo;
+          continue;
+        }
+
         /* D[32 - sb][i] == -D[sb][31 - i] */
 
         ptr = *Dptr + po;
@@ -852,7 +1035,8 @@ void synth_half(struct mad_synth *synth, struct mad_frame const *frame,
 
         raw_sample = SHIFT(MLZ(hi, lo));
         raw_sample = scale(raw_sample);
-        (*pcm1++) += (short int)raw_sample;
+        *pcm1 = (short int)raw_sample;
+      pcm1 += nch;
 
         ptr = *Dptr - pe;
         ML0(hi, lo, (*fe)[0], ptr[31 - 16]);
@@ -876,7 +1060,8 @@ void synth_half(struct mad_synth *synth, struct mad_frame const *frame,
 
         raw_sample = SHIFT(MLZ(hi, lo));
         raw_sample = scale(raw_sample);
-        (*pcm2--) += (short int)raw_sample;
+        *pcm2 = (short int)raw_sample;
+        pcm2 -= nch;
 
         ++fo;
       }
@@ -895,13 +1080,11 @@ void synth_half(struct mad_synth *synth, struct mad_frame const *frame,
 
       raw_sample = SHIFT(-MLZ(hi, lo));
       raw_sample = scale(raw_sample);
-      (*pcm1) += (short int)raw_sample;
+      *pcm1 = (short int)raw_sample;
 
     } /* Channel For */
 
-    /* Block render */
-    render_sample_block(short_sample_buff[0], short_sample_buff[1], 16, nch);
-
+    pcm += 16 * nch;
     phase = (phase + 1) % 16;
 
   }/* Block For */
@@ -926,6 +1109,10 @@ void mad_synth_frame(struct mad_synth *synth, struct mad_frame const *frame)
   synth->pcm.length     = 32 * ns;
 
   synth_frame = synth_full;
+# if !defined(ASO_SYNTH)
+  if (nch == 2)
+    synth_frame = synth_full_stereo;
+# endif
 
   if (frame->options & MAD_OPTION_HALFSAMPLERATE) {
     synth->pcm.samplerate /= 2;
@@ -936,4 +1123,7 @@ void mad_synth_frame(struct mad_synth *synth, struct mad_frame const *frame)
 
   synth_frame(synth, frame, nch, ns);
   synth->phase = (synth->phase + ns) % 16;
+
+  /* hand the whole frame to the renderer in one go */
+  render_sample_block(synth->pcm.samples, synth->pcm.length, nch);
 }
@@ -26,33 +26,52 @@
 #include "spiram_fifo.h"
 #include "mp3_decoder.h"
 #include "common_buffer.h"
+#include "common_frame.h"
+#include "common_conceal.h"
 
 #define TAG "Mp3_Decoder"
 
-// The theoretical maximum frame size is 2881 bytes,
-// MPEG 2.5 Layer II, 8000 Hz @ 160 kbps, with a padding slot plus 8 byte MAD_BUFFER_GUARD.
-#define MAX_FRAME_SIZE (2889)
-
 // The theoretical minimum frame size of 24 plus 8 byte MAD_BUFFER_GUARD.
 #define MIN_FRAME_SIZE (32)
 
+// Contiguous bytes the fifo always exposes (its FIFO_GUARD). A candidate
+// seen with this much data behind it is decided on the frames that fit.
+#define SYNC_WINDOW (3*1024)
+
 static long buf_underrun_cnt;
 
+// stands in for frames whose data MAD could not decode
+static conceal_t conceal;
+
+/* frame sync ahead of MAD, locked on the header of the current stream */
+static frame_sync_t frame_sync;
+
 /* default MAD buffer format */
 pcm_format_t mad_buffer_fmt = {
     .sample_rate = 44100,
     .bit_depth = I2S_DATA_BIT_WIDTH_16BIT,
     .num_channels = 2,
-    .buffer_format = PCM_LEFT_RIGHT
+    .buffer_format = PCM_INTERLEAVED
 };
 
-static enum mad_flow input(struct mad_stream *stream, buffer_t *buf, player_t *player)
+/* MAD decodes in place from the fifo: the frames consumed by the previous
+ * pass are committed, then the next contiguous region is handed to MAD. */
+static enum mad_flow input(struct mad_stream *stream, player_t *player)
 {
-    int bytes_to_read;
+    unsigned bytes_left = 0;
+    unsigned bytes_needed;
+    char *read_pos;
+    unsigned read_len;
 
     // next_frame is the position MAD is interested in resuming from
-    uint32_t bytes_consumed  = stream->next_frame - stream->buffer;
-    buf_seek_rel(buf, bytes_consumed);
+    if (stream->buffer != NULL) {
+        spiRamFifoCommit(stream->next_frame - stream->buffer);
+        bytes_left = stream->bufend - stream->next_frame;
+    }
+
+    // MAD could not use the bytes left, we need more than that to progress.
+    // Otherwise wait for at least a few of the smallest possible frame.
+    bytes_needed = min(max(bytes_left + 1, MIN_FRAME_SIZE * 4), spiRamFifoLen());
 
     while (1) {
 
@@ -61,44 +80,61 @@ static enum mad_flow input(struct mad_stream *stream, buffer_t *buf, player_t *p
             return MAD_FLOW_STOP;
         }
 
-        // Calculate amount of bytes we need to fill buffer.
-        bytes_to_read = min(buf_free_capacity(buf), spiRamFifoFill());
-//		bytes_to_read = min(buf_free_capacity_after_purge(buf), spiRamFifoFill());
+        if (spiRamFifoWaitFill(bytes_needed, 0) >= bytes_needed)
+            break;
 
-        // Can't take anything?
-        if (bytes_to_read == 0) {
+        // EOF reached, stop decoder when all frames have been consumed
+        if(player->media_stream->eof) {
+            return MAD_FLOW_STOP;
+        }
 
-            // EOF reached, stop decoder when all frames have been consumed
-            if(player->media_stream->eof) {
-                return MAD_FLOW_STOP;
-            }
+        //Wait until there is enough data in the buffer. This only happens when the data feed
+        //rate is too low, and shouldn't normally be needed!
+        ESP_LOGV(TAG, "Buffer underflow, need %u bytes.", bytes_needed);
 
-            //Wait until there is enough data in the buffer. This only happens when the data feed
-            //rate is too low, and shouldn't normally be needed!
-            ESP_LOGV(TAG, "Buffer underflow, need %d bytes.", buf_free_capacity(buf));
-//           ESP_LOGD(TAG, "Buffer underflow, need %d bytes.", buf_free_capacity_after_purge(buf));
- 
-			buf_underrun_cnt++;
-            //We both silence the output as well as wait a while by pushing silent samples into the i2s system.
-            //This waits for about 200mS
-            renderer_zero_dma_buffer();
-			vTaskDelay(20);
-        } else {
-            //Read some bytes from the FIFO to re-fill the buffer.
-            fill_read_buffer(buf);
-
-            // break the loop if we have at least enough to decode a few of the smallest possible frame
-            if(buf_data_unread(buf) >= (MIN_FRAME_SIZE * 4))
-                break;
-        }
+        buf_underrun_cnt++;
+        //We both silence the output as well as wait until the writer
+        //brought enough data, or for about 200mS.
+        renderer_zero_dma_buffer();
+        spiRamFifoWaitFill(bytes_needed, 200);
     }
 
     // Okay, let MAD decode the buffer.
-    mad_stream_buffer(stream, (unsigned char*) buf->read_pos, buf_data_unread(buf));
+    spiRamFifoPeek(&read_pos, &read_len);
+    mad_stream_buffer(stream, (unsigned char*) read_pos, read_len);
     return MAD_FLOW_CONTINUE;
 }
 
 
+/* the next frame continues the locked stream */
+static inline bool sync_locked(const struct mad_stream *stream)
+{
+    return frame_sync_locked(&frame_sync, stream->next_frame, stream->bufend - stream->next_frame);
+}
+
+/* Move next_frame to the next frame of the stream, see frame_sync_scan.
+ * Returns -1 if more data is needed to decide, in which case the bytes
+ * before next_frame can be dropped. */
+static int sync_scan(struct mad_stream *stream)
+{
+    size_t pos;
+    frame_sync_result_t ret = frame_sync_scan(&frame_sync, stream->next_frame, stream->bufend - stream->next_frame,
+            SYNC_WINDOW, &pos);
+
+    stream->next_frame += pos;
+    if (frame_sync.off) {
+        ESP_LOGW(TAG, "no sync in %" PRIu32 " bytes, left to MAD", frame_sync.skipped);
+        return 0;
+    }
+    if (ret == FRAME_SYNC_GAP) {
+        ESP_LOGD(TAG, "sync after %" PRIu32 " bytes", frame_sync.gap);
+        // the bit reservoir in front of the gap is stale
+        stream->sync = 0;
+        stream->md_len = 0;
+    }
+    return (ret == FRAME_SYNC_MORE) ? -1 : 0;
+}
+
 //Routine to print out an error
 static enum mad_flow error(void *data, struct mad_stream *stream, struct mad_frame *frame) {
     ESP_LOGD(TAG,"dec err 0x%04x (%s)", stream->error, mad_stream_errorstr(stream));
@@ -107,39 +143,43 @@ static enum mad_flow error(void *data, struct mad_stream *stream, struct mad_fra
 
 
 
-//This is the main mp3 decoding task. It will grab data from the input buffer FIFO in the SPI ram and
+// MAD state, allocated by the first stream and kept for the following ones
+static struct mad_stream *stream;
+static struct mad_frame *frame;
+static struct mad_synth *synth;
+static short *conceal_pcm;
+
+//Decodes one stream. It will grab data from the input buffer FIFO in the SPI ram and
 //output it to the I2S port.
-void mp3_decoder_task(void *pvParameters)
+static void mp3_decode_stream(player_t *player)
 {
-    player_t *player = pvParameters;
-
     int ret;
-    struct mad_stream *stream;
-    struct mad_frame *frame;
-    struct mad_synth *synth;
 
 	//renderer_config_t *renderer_instance;
 	//renderer_instance = renderer_get();
 
     //Allocate structs needed for mp3 decoding
-    stream = malloc(sizeof(struct mad_stream));
-    frame = malloc(sizeof(struct mad_frame));
-    synth = malloc(sizeof(struct mad_synth));
-    buffer_t *buf = buf_create(MAX_FRAME_SIZE);
+    if (stream == NULL) stream = malloc(sizeof(struct mad_stream));
+    if (frame == NULL) frame = malloc(sizeof(struct mad_frame));
+    if (synth == NULL) synth = malloc(sizeof(struct mad_synth));
+    if (conceal_pcm == NULL) conceal_pcm = malloc(sizeof(synth->pcm.samples));
 
-    if (stream==NULL) { ESP_LOGE(TAG,"malloc(stream) failed"); goto abort1; }
-    if (synth==NULL) { ESP_LOGE(TAG,"malloc(synth) failed"); goto abort1; }
-    if (frame==NULL) { ESP_LOGE(TAG,"malloc(frame) failed"); goto abort1; }
-    if (buf==NULL) { ESP_LOGE(TAG,"buf_create() failed"); goto abort1; }
+    if (stream==NULL) { ESP_LOGE(TAG,"malloc(stream) failed"); goto abort; }
+    if (synth==NULL) { ESP_LOGE(TAG,"malloc(synth) failed"); goto abort; }
+    if (frame==NULL) { ESP_LOGE(TAG,"malloc(frame) failed"); goto abort; }
+    if (conceal_pcm==NULL) { ESP_LOGE(TAG,"malloc(conceal_pcm) failed"); goto abort; }
 
     buf_underrun_cnt = 0;
+    memset(&frame_sync, 0, sizeof(frame_sync));
+    memset(&conceal, 0, sizeof(conceal));
 
     ESP_LOGD(TAG, "Decoder start.");
 
 	if (!i2s_init()) 
 	{
-		goto abort0;
+		goto abort;
 	}
+	audio_player_decoder_ready();
 	
 	
 	//ESP_LOGD(TAG, "init I2S mode %d, port %d, %d bit, %d Hz", renderer_instance->output_mode, renderer_instance->i2s_num, renderer_instance->bit_depth, renderer_instance->sample_rate);
@@ -149,6 +189,8 @@ void mp3_decoder_task(void *pvParameters)
 
     //Initialize mp3 parts
     mad_stream_init(stream);
+    // the fifo window is ours until committed, let layer III read its bit reservoir in place
+    mad_stream_options(stream, MAD_OPTION_INPLACEMD);
     mad_frame_init(frame);
     mad_synth_init(synth);
 
@@ -156,19 +198,30 @@ void mp3_decoder_task(void *pvParameters)
     while(1) {
 
         // calls mad_stream_buffer internally
-        if (input(stream, buf, player) == MAD_FLOW_STOP) break;
+        if (input(stream, player) == MAD_FLOW_STOP) break;
      
         // decode frames until MAD complains
         while(1) 
         {
             if(player->decoder_command == CMD_STOP) goto abort;
-         
+
+            // find the frame ourselves rather than have MAD step through garbage byte by byte
+            if (!frame_sync.off && !sync_locked(stream) && sync_scan(stream) < 0)
+                break;
+
             // returns 0 or -1
             ret = mad_frame_decode(frame, stream);
             if (ret == -1) 
             {
                 if (!MAD_RECOVERABLE(stream->error)) break; //We're most likely out of buffer and need to call input() again
                 error(NULL, stream, frame);
+                // the header was good, so the frame had its slot in time: fill it instead of leaving a gap
+                if ((stream->error & 0xff00) == 0x0200
+                        && conceal_lost(&conceal, synth->pcm.samples, conceal_pcm, synth->pcm.length, synth->pcm.channels))
+                {
+                    mad_buffer_fmt.num_channels = synth->pcm.channels;
+                    render_samples((char *) conceal_pcm, synth->pcm.length * sizeof(short) * synth->pcm.channels, &mad_buffer_fmt);
+                }
                 continue;
             }
             mad_synth_frame(synth, frame);
@@ -187,28 +240,33 @@ void mp3_decoder_task(void *pvParameters)
 	//i2s_stop(renderer_instance->i2s_num);
 	//i2s_zero_dma_buffer(renderer_instance->i2s_num);
 
-    if (synth != NULL) free(synth);
-    if (frame != NULL) free(frame);
-    if (stream != NULL) free(stream);
-    if (buf != NULL) buf_destroy(buf);
-
     // clear semaphore for reader task
     spiRamFifoReset();
 	renderer_zero_dma_buffer();
 	//i2s_stop(renderer_instance->i2s_num);
 	//i2s_driver_uninstall(renderer_instance->i2s_num);	
-    player->decoder_status = STOPPED;
+    // STOPPED last, audio_player_stop() waits for it
     player->decoder_command = CMD_NONE;
-    ESP_LOGD(TAG, "Decoder stopped.\n");
+    player->decoder_status = STOPPED;
+    ESP_LOGD(TAG, "Decoder stopped, %" PRIu32 " resyncs, %" PRIu32 " concealed, %" PRIu32 " muted, %" PRIu32 " recovered.\n",
+            frame_sync.resyncs, conceal.concealed, conceal.muted, conceal.recovered);
 //    ESP_LOGD(TAG, "MAD decoder stack: %d\n", uxTaskGetStackHighWaterMark(NULL));
-    vTaskDelete(NULL);
-	return;
+}
 
-abort1:
-abort0:
-	esp_restart();
+//This is the mp3 decoder worker. It is created for the first mp3 stream and then
+//decodes a stream each time the player notifies it.
+void mp3_decoder_task(void *pvParameters)
+{
+    player_t *player = pvParameters;
+
+    while (1)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        mp3_decode_stream(player);
+    }
 }
 
+
 /* Called by the NXP modifications of libmad. Sets the needed output sample rate. */
 static int prevRate;
 void set_dac_sample_rate(int rate)
@@ -220,12 +278,14 @@ void set_dac_sample_rate(int rate)
     mad_buffer_fmt.sample_rate = rate;
 }
 
-/* render callback for the libmad synth */
-void render_sample_block(short *sample_buff_ch0, short *sample_buff_ch1, int num_samples, unsigned int num_channels)
+/* render callback for the libmad synth, called once per frame with
+ * interleaved samples */
+void render_sample_block(short *sample_buff, int num_samples, unsigned int num_channels)
 {
 	mad_buffer_fmt.num_channels = num_channels;
+    conceal_good(&conceal, sample_buff, num_samples, num_channels);
     uint32_t len = num_samples * sizeof(short) * num_channels;
-    render_samples((char*) sample_buff_ch0, len, &mad_buffer_fmt);
+    render_samples((char*) sample_buff, len, &mad_buffer_fmt);
     return;
 }
 
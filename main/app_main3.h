@@ -337,6 +337,8 @@ timer_config_t config;
 static renderer_config_t *create_renderer_config()
 {
     renderer_config_t *renderer_config = kcalloc(1, sizeof(renderer_config_t));
+    renderer_config->fixed_rate = getFixedRate();
+    renderer_config->drift = (g_device->options & T_DRIFT) != 0;
 
     if(renderer_config->output_mode == I2S_MERUS) {
         renderer_config->bit_depth = I2S_BITS_PER_SAMPLE_32BIT;
@@ -1126,6 +1128,7 @@ void app_main()
 
 	audio_player_init(player_config);	  
 	renderer_init(create_renderer_config());
+	renderer_tone(g_device->treble, g_device->freqtreble, g_device->bass, g_device->freqbass, g_device->spacial);
 	
 	// LCD Display infos
     lcd_welcome(localIp,"STARTED");
@@ -0,0 +1,766 @@
+/*
+ * HLS live streaming
+ *
+ * clientTask feeds, HLS_FETCHERS tasks download. The current segment drains
+ * into the fifo while it still downloads and the next ones come in at the
+ * same time over connections of their own, so a segment boundary costs no
+ * request round trip. Segments go to PSRAM, in grow-only buffers kept
+ * across segments and streams.
+ */
+#define TAG "hls"
+#define LOG_LOCAL_LEVEL ESP_LOG_VERBOSE
+
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+#include "lwip/netdb.h"
+#include "wolfssl/wolfcrypt/settings.h"
+#include "user_settings.h"
+#include "wolfssl/ssl.h"
+
+#include "hls.h"
+#include "common_m3u8.h"
+#include "common_ts.h"
+#include "audio_player.h"
+#include "spiram_fifo.h"
+#include "eeprom.h"
+#include "app_main.h"
+
+#define HLS_SLOTS 3			 // the segment fed and the ones prefetched
+#define HLS_FETCHERS 2		 // parallel downloads
+#define HLS_LIVE_EDGE 3		 // a live stream starts that many segments before the newest
+#define HLS_URL_MAX (M3U8_URI_MAX + 64)
+#define HLS_PLAYLIST_MAX (32 * 1024)
+#define HLS_SEGMENT_MAX (1024 * 1024)
+#define HLS_BUFFER_MIN (16 * 1024)
+#define HLS_REDIRECTS 3
+#define HLS_TIMEOUT_S 6
+#define HLS_FEED 1440		 // bytes handed to the demuxer at once
+#define HLS_RETRY_MS 2000	 // playlist reload after a failed one
+#define HLS_RETRIES 5		 // failed playlist reloads in a row before giving up
+#define HLS_PLAYLIST HLS_SLOTS // job number of the playlist
+
+extern player_t *player_config;
+extern WOLFSSL_CTX *wctx;
+
+typedef enum
+{
+	SLOT_FREE,
+	SLOT_FETCHING,
+	SLOT_DONE,
+	SLOT_FAILED
+} slot_state_t;
+
+typedef struct
+{
+	volatile slot_state_t state;
+	uint32_t seq;
+	bool discontinuity;
+	char url[HLS_URL_MAX];
+	uint8_t *buf;
+	size_t size;
+	size_t max;
+	volatile size_t fill;
+	int64_t queued_us; // fetch asked
+	int64_t first_us;  // first body byte
+	int64_t done_us;   // complete or failed
+} hls_slot_t;
+
+typedef struct
+{
+	int fd;
+	WOLFSSL *ssl;
+} conn_t;
+
+typedef struct
+{
+	bool done;		// last chunk seen
+	bool ext;		// skipping a chunk extension
+	bool digits;	// size line started
+	size_t size;
+	size_t left;	// data bytes of the chunk still to come
+} chunk_t;
+
+typedef struct
+{
+	uint32_t segments;
+	uint32_t gaps;	   // segments skipped: failed, expired or not resolvable
+	uint32_t late;	   // segments not complete when their turn came
+	uint32_t fifo_min; // fifo fill when a segment's turn came, lowest
+	int32_t lead_min;  // ms a segment was complete before its turn, lowest
+	uint32_t stall_ms; // waited for bytes of the current segment
+} hls_stats_t;
+
+static hls_slot_t slots[HLS_SLOTS + 1]; // the playlist last
+static QueueHandle_t jobs = NULL;
+static SemaphoreHandle_t lock = NULL;	  // slot buffers and fill
+static SemaphoreHandle_t tls_lock = NULL; // wolfSSL is built single threaded
+static volatile bool aborting = false;
+
+static const hls_hooks_t *hooks;
+static bool stopping;
+static ts_demux_t demux;
+static m3u8_t pl, fresh;
+static char media[HLS_URL_MAX];
+static uint8_t feed[HLS_FEED];
+static uint8_t es[HLS_FEED];
+static size_t es_len;
+static int feed_result;
+static bool audio_started;
+static hls_stats_t stats;
+
+//////////////////////////////////////////////////////////////////
+// HTTP
+//////////////////////////////////////////////////////////////////
+
+static int conn_read(conn_t *c, void *buf, int n)
+{
+	if (c->ssl != NULL)
+		return wolfSSL_read(c->ssl, buf, n);
+	return recv(c->fd, buf, n, 0);
+}
+
+static bool conn_write(conn_t *c, const char *buf, int n)
+{
+	if (c->ssl != NULL)
+		return wolfSSL_write(c->ssl, buf, n) == n;
+	return send(c->fd, buf, n, 0) == n;
+}
+
+static void conn_close(conn_t *c)
+{
+	if (c->ssl != NULL)
+	{
+		wolfSSL_free(c->ssl);
+		c->ssl = NULL;
+		xSemaphoreGive(tls_lock);
+	}
+	if (c->fd >= 0)
+	{
+		shutdown(c->fd, SHUT_RDWR);
+		close(c->fd);
+		c->fd = -1;
+	}
+}
+
+// connect to the server of url. host gets host[:port] for the request, *path the path
+static bool conn_open(conn_t *c, const char *url, char *host, size_t size, const char **path)
+{
+	bool tls = strncmp(url, "https://", 8) == 0;
+	const char *h = strstr(url, "://");
+	struct addrinfo hints = {.ai_family = AF_INET, .ai_socktype = SOCK_STREAM};
+	struct addrinfo *res = NULL;
+	struct timeval timeout = {.tv_sec = HLS_TIMEOUT_S, .tv_usec = 0};
+	char name[64];
+	const char *port;
+
+	c->fd = -1;
+	c->ssl = NULL;
+	h = (h != NULL) ? h + 3 : url;
+	*path = strchr(h, '/');
+	size_t len = (*path != NULL) ? (size_t)(*path - h) : strlen(h);
+	if (*path == NULL)
+		*path = "/";
+	if (len == 0 || len >= size || len >= sizeof(name))
+		return false;
+	memcpy(host, h, len);
+	host[len] = 0;
+	strcpy(name, host);
+	char *colon = strchr(name, ':');
+	if (colon != NULL)
+	{
+		*colon = 0;
+		port = colon + 1;
+	}
+	else
+		port = tls ? "443" : "80";
+
+	if (getaddrinfo(name, port, &hints, &res) != 0 || res == NULL)
+	{
+		ESP_LOGW(TAG, "No ip found for %s", name);
+		return false;
+	}
+	c->fd = socket(res->ai_family, res->ai_socktype, 0);
+	if (c->fd < 0 || connect(c->fd, res->ai_addr, res->ai_addrlen) < 0)
+	{
+		ESP_LOGW(TAG, "%s connect errno: %d", name, errno);
+		freeaddrinfo(res);
+		conn_close(c);
+		return false;
+	}
+	freeaddrinfo(res);
+	setsockopt(c->fd, SOL_SOCKET, SO_RCVTIMEO, (char *)&timeout, sizeof(timeout));
+
+	if (tls)
+	{
+		xSemaphoreTake(tls_lock, portMAX_DELAY);
+		if ((c->ssl = wolfSSL_new(wctx)) == NULL)
+		{
+			xSemaphoreGive(tls_lock);
+			conn_close(c);
+			return false;
+		}
+		wolfSSL_set_fd(c->ssl, c->fd);
+		if (wolfSSL_connect(c->ssl) != SSL_SUCCESS)
+		{
+			ESP_LOGW(TAG, "%s wolfSSL_connect error: %d", name, wolfSSL_get_error(c->ssl, 0));
+			conn_close(c);
+			return false;
+		}
+	}
+	return true;
+}
+
+// value of the response header name, not terminated, its length in *len
+static const char *header_find(const char *head, const char *name, size_t *len)
+{
+	size_t n = strlen(name);
+
+	for (const char *line = strstr(head, "\r\n"); line != NULL; line = strstr(line, "\r\n"))
+	{
+		line += 2;
+		if (strncasecmp(line, name, n) == 0 && line[n] == ':')
+		{
+			const char *v = line + n + 1;
+			while (*v == ' ')
+				v++;
+			const char *end = strstr(v, "\r\n");
+			*len = (end != NULL) ? (size_t)(end - v) : strlen(v);
+			return v;
+		}
+	}
+	return NULL;
+}
+
+// append body bytes to the slot, total is the announced length or 0
+static bool slot_store(hls_slot_t *s, const uint8_t *data, size_t n, size_t total)
+{
+	if (aborting)
+		return false;
+	// one more for the zero ending a playlist
+	if (s->fill + n + 1 > s->size)
+	{
+		size_t size = (s->size > 0) ? s->size : HLS_BUFFER_MIN;
+		while (size < s->fill + n + 1)
+			size *= 2;
+		if (size < total + 1)
+			size = total + 1;
+		if (size > s->max)
+			size = s->max;
+		if (size < s->fill + n + 1)
+		{
+			ESP_LOGW(TAG, "%s over %u bytes", s->url, (unsigned)s->max);
+			return false;
+		}
+		uint8_t *buf = kmalloc(size);
+		if (buf == NULL)
+		{
+			ESP_LOGE(TAG, "kmalloc fails for %u", (unsigned)size);
+			return false;
+		}
+		xSemaphoreTake(lock, portMAX_DELAY);
+		if (s->buf != NULL)
+		{
+			memcpy(buf, s->buf, s->fill);
+			free(s->buf);
+		}
+		s->buf = buf;
+		s->size = size;
+		xSemaphoreGive(lock);
+	}
+	if (s->fill == 0)
+		s->first_us = esp_timer_get_time();
+	memcpy(s->buf + s->fill, data, n);
+	xSemaphoreTake(lock, portMAX_DELAY);
+	s->fill += n;
+	xSemaphoreGive(lock);
+	return true;
+}
+
+// chunked transfer coding
+static bool dechunk(chunk_t *ch, hls_slot_t *s, const uint8_t *data, size_t n)
+{
+	while (n > 0 && !ch->done)
+	{
+		if (ch->left > 0)
+		{
+			size_t k = (ch->left < n) ? ch->left : n;
+			if (!slot_store(s, data, k, 0))
+				return false;
+			ch->left -= k;
+			data += k;
+			n -= k;
+			continue;
+		}
+		// size line, the CRLF ending the data before it is skipped here too
+		char c = *data++;
+		n--;
+		if (c == '\n')
+		{
+			if (ch->digits)
+			{
+				ch->done = (ch->size == 0);
+				ch->left = ch->size;
+			}
+			ch->size = 0;
+			ch->digits = false;
+			ch->ext = false;
+		}
+		else if (c == ';')
+			ch->ext = true;
+		else if (!ch->ext && isxdigit((unsigned char)c))
+		{
+			ch->size = ch->size * 16 + ((c <= '9') ? c - '0' : (c | 0x20) - 'a' + 10);
+			ch->digits = true;
+		}
+	}
+	return true;
+}
+
+// download the url of the slot into it
+static bool http_get(hls_slot_t *s)
+{
+	char url[HLS_URL_MAX];
+	char head[1024];
+	char host[64];
+	const char *path;
+	conn_t c;
+
+	strcpy(url, s->url);
+	for (int redirect = 0; redirect <= HLS_REDIRECTS; redirect++)
+	{
+		if (!conn_open(&c, url, host, sizeof(host), &path))
+			return false;
+		int len = snprintf(head, sizeof(head), "GET %s HTTP/1.1\r\nHost: %s\r\nUser-Agent: %s\r\nConnection: close\r\n\r\n",
+						   path, host, g_device->ua);
+		if (len >= sizeof(head) || !conn_write(&c, head, len))
+		{
+			conn_close(&c);
+			return false;
+		}
+
+		// response header
+		char *body = NULL;
+		len = 0;
+		while (body == NULL && len < sizeof(head) - 1)
+		{
+			int n = conn_read(&c, head + len, sizeof(head) - 1 - len);
+			if (n <= 0)
+				break;
+			len += n;
+			head[len] = 0;
+			body = strstr(head, "\r\n\r\n");
+		}
+		if (body == NULL || strncmp(head, "HTTP/1.", 7) != 0)
+		{
+			ESP_LOGW(TAG, "%s: no response", url);
+			conn_close(&c);
+			return false;
+		}
+		body += 4;
+		int status = atoi(head + 9);
+		size_t vlen;
+		const char *v;
+
+		if (status >= 300 && status < 400 && (v = header_find(head, "Location", &vlen)) != NULL)
+		{
+			char location[HLS_URL_MAX];
+			conn_close(&c);
+			if (vlen >= sizeof(location))
+				return false;
+			memcpy(location, v, vlen);
+			location[vlen] = 0;
+			if (!m3u8_resolve(url, location, head, sizeof(head)) || strlen(head) >= sizeof(url))
+				return false;
+			// relative references resolve against where it moved
+			strcpy(url, head);
+			strcpy(s->url, url);
+			continue;
+		}
+		if (status != 200)
+		{
+			ESP_LOGW(TAG, "%s: HTTP %d", url, status);
+			conn_close(&c);
+			return false;
+		}
+
+		size_t total = ((v = header_find(head, "Content-Length", &vlen)) != NULL) ? strtoul(v, NULL, 10) : 0;
+		bool chunked = ((v = header_find(head, "Transfer-Encoding", &vlen)) != NULL) && strncasecmp(v, "chunked", 7) == 0;
+		chunk_t ch = {0};
+		const uint8_t *data = (const uint8_t *)body;
+		int n = len - (body - head);
+		bool ok = true;
+
+		while (1)
+		{
+			if (n > 0)
+				ok = chunked ? dechunk(&ch, s, data, n) : slot_store(s, data, n, total);
+			if (!ok || ch.done || (total > 0 && s->fill >= total))
+				break;
+			n = conn_read(&c, head, sizeof(head));
+			data = (const uint8_t *)head;
+			if (n <= 0)
+			{
+				// the end of the connection ends a body of unknown length
+				ok = !chunked && total == 0 && n == 0;
+				break;
+			}
+		}
+		conn_close(&c);
+		return ok;
+	}
+	ESP_LOGW(TAG, "%s: too many redirects", s->url);
+	return false;
+}
+
+static void hls_fetch_task(void *pvParams)
+{
+	uint8_t job;
+
+	while (1)
+	{
+		if (xQueueReceive(jobs, &job, portMAX_DELAY) != pdTRUE)
+			continue;
+		hls_slot_t *s = &slots[job];
+		bool ok = !aborting && http_get(s);
+		xSemaphoreTake(lock, portMAX_DELAY);
+		s->done_us = esp_timer_get_time();
+		s->state = ok ? SLOT_DONE : SLOT_FAILED;
+		xSemaphoreGive(lock);
+	}
+}
+
+static bool hls_init()
+{
+	if (jobs != NULL)
+		return true;
+	lock = xSemaphoreCreateMutex();
+	tls_lock = xSemaphoreCreateMutex();
+	jobs = xQueueCreate(HLS_SLOTS + 1, sizeof(uint8_t));
+	if (lock == NULL || tls_lock == NULL || jobs == NULL)
+		return false;
+	for (int i = 0; i < HLS_SLOTS; i++)
+		slots[i].max = HLS_SEGMENT_MAX;
+	slots[HLS_PLAYLIST].max = HLS_PLAYLIST_MAX;
+	for (int i = 0; i < HLS_FETCHERS; i++)
+		if (xTaskCreatePinnedToCore(hls_fetch_task, "hls_fetch", 5120, NULL, PRIO_HLS, NULL, CPU_HLS) != pdPASS)
+		{
+			ESP_LOGE(TAG, "hls_fetch task failed");
+			return false;
+		}
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////
+// feeder
+//////////////////////////////////////////////////////////////////
+
+// the playlist goes ahead of segments waiting for a fetcher
+static void fetch(uint8_t job)
+{
+	hls_slot_t *s = &slots[job];
+
+	s->fill = 0;
+	s->first_us = 0;
+	s->done_us = 0;
+	s->queued_us = esp_timer_get_time();
+	s->state = SLOT_FETCHING;
+	if (job == HLS_PLAYLIST)
+		xQueueSendToFront(jobs, &job, portMAX_DELAY);
+	else
+		xQueueSendToBack(jobs, &job, portMAX_DELAY);
+}
+
+static bool stopped()
+{
+	if (!stopping && (hooks->stop() || feed_result == -2))
+		stopping = true;
+	return stopping;
+}
+
+static void es_flush()
+{
+	if (es_len == 0 || feed_result < 0)
+		return;
+	if (!audio_started)
+	{
+		player_config->media_stream->content_type = (demux.es == TS_ES_ADTS)   ? AUDIO_AAC
+													: (demux.es == TS_ES_MPEG) ? AUDIO_MPEG
+																			   : MIME_UNKNOWN;
+		ESP_LOGI(TAG, "%s audio", ts_es_str(demux.es));
+		audio_player_start();
+		audio_started = true;
+		if (hooks->started != NULL)
+			hooks->started();
+	}
+	feed_result = audio_stream_consumer((const char *)es, es_len);
+	es_len = 0;
+}
+
+static void es_out(void *ctx, const uint8_t *data, size_t len)
+{
+	while (len > 0)
+	{
+		size_t n = (len < sizeof(es) - es_len) ? len : sizeof(es) - es_len;
+		memcpy(es + es_len, data, n);
+		es_len += n;
+		data += n;
+		len -= n;
+		if (es_len == sizeof(es))
+			es_flush();
+	}
+}
+
+static void segment_end(hls_slot_t *s, int64_t need_us, unsigned fifo)
+{
+	int32_t lead = (int32_t)((need_us - s->done_us) / 1000);
+
+	stats.segments++;
+	// the fifo is empty at the first
+	if (stats.segments == 2 || (stats.segments > 2 && fifo < stats.fifo_min))
+		stats.fifo_min = fifo;
+	if (lead < 0)
+		stats.late++;
+	if (s->state == SLOT_FAILED)
+		stats.gaps++;
+	else if (stats.segments == 1 || lead < stats.lead_min)
+		stats.lead_min = lead;
+	ESP_LOGI(TAG, "seq %" PRIu32 "%s: %u bytes, first byte %d ms, fetch %d ms, ready %d ms before its turn, fifo %u",
+			 s->seq, (s->state == SLOT_FAILED) ? " failed" : "", (unsigned)s->fill,
+			 s->first_us ? (int)((s->first_us - s->queued_us) / 1000) : -1,
+			 (int)((s->done_us - s->queued_us) / 1000), (int)lead, fifo);
+	s->state = SLOT_FREE;
+}
+
+hls_result_t hls_run(const char *url, const hls_hooks_t *h)
+{
+	hls_slot_t *list = &slots[HLS_PLAYLIST];
+	hls_slot_t *cur = NULL;
+	hls_result_t result = HLS_FAILED;
+	uint32_t next_seq, sched_seq;
+	int64_t refresh_us = 0, need_us = 0, wait_us = 0;
+	size_t fed = 0;
+	unsigned fifo = 0;
+	int retries = 0;
+
+	if (!bigSram() || strlen(url) >= sizeof(media) || !hls_init())
+		return HLS_NOT_HLS;
+	hooks = h;
+	stopping = false;
+	aborting = false;
+	audio_started = false;
+	feed_result = 0;
+	es_len = 0;
+	memset(&stats, 0, sizeof(stats));
+	strcpy(media, url);
+
+	// a master playlist names the media playlist
+	for (int level = 0;; level++)
+	{
+		strcpy(list->url, media);
+		fetch(HLS_PLAYLIST);
+		while (list->state == SLOT_FETCHING)
+		{
+			if (stopped())
+			{
+				result = HLS_STOPPED;
+				goto end;
+			}
+			vTaskDelay(pdMS_TO_TICKS(20));
+		}
+		if (list->state != SLOT_DONE)
+		{
+			ESP_LOGE(TAG, "%s: playlist failed", media);
+			goto end;
+		}
+		list->buf[list->fill] = 0;
+		if (!m3u8_parse((const char *)list->buf, 0, &pl))
+		{
+			if (level == 0)
+				result = HLS_NOT_HLS;
+			goto end;
+		}
+		strcpy(media, list->url);
+		if (!pl.master)
+			break;
+		if (level > 0 || !m3u8_resolve(media, pl.uri, list->url, sizeof(media)))
+			goto end;
+		strcpy(media, list->url);
+		ESP_LOGI(TAG, "variant %" PRIu32 " bit/s: %s", pl.bandwidth, media);
+	}
+	if (pl.unsupported)
+	{
+		ESP_LOGE(TAG, "encrypted or fragmented MP4 segments are not supported");
+		goto end;
+	}
+
+	next_seq = pl.first_seq;
+	if (!pl.endlist && pl.last_seq + 1 >= pl.first_seq + HLS_LIVE_EDGE)
+		next_seq = pl.last_seq + 1 - HLS_LIVE_EDGE;
+	m3u8_parse((const char *)list->buf, next_seq, &pl);
+	sched_seq = next_seq;
+	list->state = SLOT_FREE;
+	refresh_us = esp_timer_get_time() + pl.target_ms * 1000LL;
+	ESP_LOGI(TAG, "%s playlist, segments %" PRIu32 "-%" PRIu32 ", target %" PRIu32 " ms, start at %" PRIu32,
+			 pl.endlist ? "closed" : "live", pl.first_seq, pl.last_seq, pl.target_ms, next_seq);
+	ts_demux_init(&demux, es_out, NULL);
+
+	while (1)
+	{
+		int64_t now = esp_timer_get_time();
+		bool idle = true;
+
+		if (stopped())
+		{
+			result = HLS_STOPPED;
+			break;
+		}
+		if (feed_result == -1)
+			break;
+
+		// playlist reload
+		if (!pl.endlist)
+		{
+			if (list->state == SLOT_DONE)
+			{
+				uint32_t last = pl.last_seq;
+				list->buf[list->fill] = 0;
+				if (m3u8_parse((const char *)list->buf, sched_seq, &fresh) && !fresh.master)
+				{
+					memcpy(&pl, &fresh, sizeof(pl));
+					strcpy(media, list->url);
+					// wait half as long when nothing was added
+					refresh_us = now + ((pl.last_seq > last) ? pl.target_ms : pl.target_ms / 2) * 1000LL;
+					retries = 0;
+				}
+				else
+					list->state = SLOT_FAILED;
+				// segments gone from the window before their turn
+				if (sched_seq < pl.first_seq)
+					sched_seq = pl.first_seq;
+			}
+			if (list->state == SLOT_FAILED)
+			{
+				if (++retries >= HLS_RETRIES)
+				{
+					ESP_LOGE(TAG, "%s: playlist lost", media);
+					break;
+				}
+				refresh_us = now + HLS_RETRY_MS * 1000LL;
+			}
+			if (list->state != SLOT_FETCHING)
+				list->state = SLOT_FREE;
+			if (list->state == SLOT_FREE && now >= refresh_us)
+			{
+				strcpy(list->url, media);
+				fetch(HLS_PLAYLIST);
+			}
+		}
+		else if (pl.count > 0 && pl.seg[pl.count - 1].seq < sched_seq && sched_seq <= pl.last_seq)
+			// a closed playlist lists more than kept, its text stays
+			m3u8_parse((const char *)list->buf, sched_seq, &pl);
+
+		// prefetch
+		for (int i = 0; i < pl.count; i++)
+		{
+			m3u8_segment_t *sg = &pl.seg[i];
+			int k;
+			if (sg->seq < sched_seq)
+				continue;
+			for (k = 0; k < HLS_SLOTS && slots[k].state != SLOT_FREE; k++)
+				;
+			if (k == HLS_SLOTS)
+				break;
+			sched_seq = sg->seq + 1;
+			if (sg->uri[0] == 0 || !m3u8_resolve(media, sg->uri, slots[k].url, sizeof(slots[k].url)))
+				continue;
+			slots[k].seq = sg->seq;
+			slots[k].discontinuity = sg->discontinuity;
+			fetch(k);
+		}
+
+		// feed
+		if (cur == NULL)
+		{
+			for (int k = 0; k < HLS_SLOTS; k++)
+				if (slots[k].state != SLOT_FREE && slots[k].seq == next_seq)
+					cur = &slots[k];
+			if (cur != NULL)
+			{
+				need_us = now;
+				fifo = spiRamFifoFill();
+				fed = 0;
+				ts_demux_segment(&demux, cur->discontinuity);
+			}
+			else if (next_seq < sched_seq)
+			{
+				// never fetched: expired from the window or no url
+				ESP_LOGW(TAG, "seq %" PRIu32 " skipped", next_seq);
+				stats.gaps++;
+				next_seq++;
+				continue;
+			}
+			else if (pl.endlist && next_seq > pl.last_seq)
+			{
+				result = HLS_ENDED;
+				break;
+			}
+		}
+		if (cur != NULL)
+		{
+			xSemaphoreTake(lock, portMAX_DELAY);
+			size_t n = cur->fill - fed;
+			if (n > sizeof(feed))
+				n = sizeof(feed);
+			memcpy(feed, cur->buf + fed, n);
+			slot_state_t state = cur->state;
+			xSemaphoreGive(lock);
+
+			if (n > 0)
+			{
+				ts_demux_push(&demux, feed, n);
+				es_flush();
+				fed += n;
+				idle = false;
+				if (wait_us != 0)
+				{
+					stats.stall_ms += (now - wait_us) / 1000;
+					wait_us = 0;
+				}
+			}
+			else if (state != SLOT_FETCHING)
+			{
+				segment_end(cur, need_us, fifo);
+				cur = NULL;
+				next_seq++;
+				continue;
+			}
+			else if (wait_us == 0)
+				wait_us = now;
+		}
+		vTaskDelay(idle ? pdMS_TO_TICKS(20) : 1);
+	}
+
+	ESP_LOGI(TAG, "%" PRIu32 " segments, %" PRIu32 " gaps, %" PRIu32 " late, stalled %" PRIu32 " ms, lowest lead %" PRId32 " ms, lowest fifo %" PRIu32 ", %" PRIu32 " cc errors",
+			 stats.segments, stats.gaps, stats.late, stats.stall_ms, stats.lead_min, stats.fifo_min, demux.cc_errors);
+end:
+	// let the fetchers give up before the slots are reused
+	aborting = true;
+	for (int k = 0; k <= HLS_SLOTS; k++)
+	{
+		while (slots[k].state == SLOT_FETCHING)
+			vTaskDelay(pdMS_TO_TICKS(10));
+		slots[k].state = SLOT_FREE;
+	}
+	if (feed_result == -1)
+		result = HLS_FAILED;
+	return result;
+}
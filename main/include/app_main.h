@@ -76,6 +76,7 @@
 #define PRIO_SUBSERV	5
 #define PRIO_TIMER		8
 #define PRIO_OTA		5
+#define PRIO_HLS		9  // segment downloads, under the feeding client
 
 // CPU for task
 #define CPU_MAD			1  // internal decoder and vs1053
@@ -88,6 +89,7 @@
 #define CPU_SUBSERV		0
 #define CPU_TIMER		0
 #define CPU_OTA			0
+#define CPU_HLS			0
 
 #define TEMPO_SAVE_VOL	10000
 
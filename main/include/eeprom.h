@@ -23,6 +23,8 @@
 #define T_WOLFSSL	0x60
 #define NT_WOLFSSL	0x9F
 #define S_WOLFSSL	0x5 //Shift right 
+#define T_DRIFT		0x80
+#define NT_DRIFT	0x7F
 //define for bit array options32
 #define T_DDMM		1
 #define NT_DDMM		0xFE
@@ -36,6 +38,9 @@
 #define NT_WIFIAUTO 0xEF
 #define T_TOGGLETIME  0x20
 #define NT_TOGGLETIME 0xDF
+#define T_RATE		0xC0
+#define NT_RATE		0x3F
+#define S_RATE		0x6 //Shift right
 
 #define APMODE		0
 #define STA1		1
@@ -71,7 +76,7 @@ struct device_settings {
 	uint8_t i2sspeed; // 0 = 48kHz, 1 = 96kHz, 2 = 128kHz
 	uint32_t uartspeed; // serial baud
 	uint8_t options;  // bit0:0 theme ligth blue, 1 Dark brown, bit1: 0 patch load  1 no patch, bit2: O blink led  1 led on On play, bit3:led polarity 0 normal 1 reverse, bit 4: log syst on telnet, 
-	// bit 3&4: log wolfssl  OFF(0)  ERROR&INFO(1) ENTER&LEAVE(2)  OTHER_LOG(3)
+	// bit 3&4: log wolfssl  OFF(0)  ERROR&INFO(1) ENTER&LEAVE(2)  OTHER_LOG(3), bit 7: clock drift compensation
 	char ua[USERAGLEN]; // user agent
 	int8_t tzoffsetm; //timezone offset (minutes)
 	int8_t tzoffseth; //timezone offset	(hour)
@@ -85,7 +90,7 @@ struct device_settings {
 	uint32_t filler;	// timeout in seconds to switch off the lcd. 0 = no timeout
 	uint8_t options32;	// bit0:0 = MMDD, 1 = DDMM  in the time display, bit1: 0= lcd without rotation  1 = lcd rotated 180
 						// bit 2: Half step of encoder0, bit3: Half step of encoder1, bit4: wifi auto reconnect
-						// bit5: TOGGLE time or main sreen
+						// bit5: TOGGLE time or main sreen, bit6-7: output rate 0 = the stream's, 1 = 44100, 2 = 48000
 	char hostname[HOSTLEN];
 	uint32_t tp_calx;
 	uint32_t tp_caly;
@@ -0,0 +1,28 @@
+/*
+ * HLS live streaming
+ * Playlist refresh and segment prefetch over parallel connections,
+ * the audio of the segments goes to the player as one stream.
+ */
+#ifndef __HLS_H__
+#define __HLS_H__
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum
+{
+	HLS_NOT_HLS,	// not an HLS playlist, or no PSRAM for the segments
+	HLS_STOPPED,	// stop asked
+	HLS_ENDED,		// last segment of a closed playlist fed
+	HLS_FAILED
+} hls_result_t;
+
+typedef struct
+{
+	bool (*stop)(void);		// polled, true to end the stream
+	void (*started)(void);	// the player was started on the first audio
+} hls_hooks_t;
+
+// play the playlist at url (scheme, host, port and path) until it ends or is stopped
+hls_result_t hls_run(const char *url, const hls_hooks_t *hooks);
+
+#endif
@@ -28,6 +28,7 @@ void setLogLevel(esp_log_level_t level);
 void wifiConnectMem();
 char* webInfo();
 char* webList(int id);
+char* webFifo();
 uint16_t getCurrentStation();
 void setCurrentStation( uint16_t vol);
 void clientVol(char *s);
@@ -47,6 +48,7 @@ void setDdmm(uint8_t dm);
 uint8_t getDdmm();
 void setRotat(uint8_t dm);
 uint8_t getRotat();
+uint32_t getFixedRate();
 void setHostname(char* s);
 
 #define kprintf(fmt, ...) do {    \
@@ -29,7 +29,7 @@
 
 typedef enum
 {
-    KMIME_UNKNOWN = 1, KOCTET_STREAM, KAUDIO_AAC, KAUDIO_MP4, KAUDIO_MPEG, KAUDIO_OGG
+    KMIME_UNKNOWN = 1, KOCTET_STREAM, KAUDIO_AAC, KAUDIO_MP4, KAUDIO_MPEG, KAUDIO_OGG, KAUDIO_FLAC
 } contentType_t;
 
 
@@ -18,6 +18,8 @@
 #include "gpio.h"
 #include "ota.h"
 #include "spiram_fifo.h"
+#include "audio_player.h"
+#include "audio_renderer.h"
 #include "addon.h"
 #include "addonu8g2.h"
 #include "app_main.h"
@@ -56,7 +58,12 @@ Commands:\n\
   Debug commands   \n\
 //////////////////\n\
 dbg.ssl(\"x\"): Display or Tune the log level of the wolfssl component. 0: error to 3 full log.\n\
-dbg.fifo: Display the audio buffer level.\n\n\
+dbg.fifo: Display the audio buffer level, throughput, underrun/overrun histograms and fill history.\n\
+dbg.clear: Empty the audio buffer and clear its statistics.\n\
+dbg.frames(\"x\"): Display or set (on, off) the whole frame buffering of MP3 and AAC streams, from the next stream.\n\
+dbg.preroll: Display the tune-in latency and underruns of the current stream.\n\
+dbg.preroll(\"x\"): Select the pre-roll profile, fast or safe.\n\
+dbg.render: Display the renderer scratch arena, its peak use and allocations of the current stream, and the clock drift correction.\n\n\
 //////////////////\n\
  Wifi related commands\n\
 //////////////////\n\
@@ -138,6 +145,8 @@ sys.ledgpio and sys.ledgpio(\"x\"): Display and Change the default Led GPIO (4)
 sys.ddmm and sys.ddmm(\"x\"):  Display and Change  the date format. 0:MMDD, 1:DDMM\n\
 sys.host and sys.host(\"your hostname\"): display and change the hostname for mDNS\n\
 sys.rotat and sys.rotat(\"x\"): Change and display the lcd rotation option (reset needed). 0:no rotation, 1: rotation\n\
+sys.rate and sys.rate(\"x\"): Display and Change the output rate. 0: the stream's, 1: 44100 Hz, 2: 48000 Hz, other rates resampled\n\
+sys.drift and sys.drift(\"x\"): Display and Change the clock drift compensation of live streams. 0: off, 1: on\n\
 sys.henc0 or sys.henc1: Display the current step setting for the encoder. Normal= 4 steps/notch, Half: 2 steps/notch\n\
 sys.hencx(\"y\") with y=0 Normal, y=1 Half\n\
 sys.cali[brate]: start a touch screen calibration\n\
@@ -770,6 +779,58 @@ char *webInfo()
 	}
 	return resp;
 }
+#define FIFO_JSON_LEN 1536
+
+/* printf at n into a webFifo response, as far as it has room; returns where the text would end */
+static int fifoJson(char *resp, int n, const char *fmt, ...)
+{
+	va_list ap;
+	if (n >= FIFO_JSON_LEN)
+		return n;
+	va_start(ap, fmt);
+	n += vsnprintf(resp + n, FIFO_JSON_LEN - n, fmt, ap);
+	va_end(ap);
+	return n;
+}
+
+// fifo telemetry as json, see spiRamFifoGetTelemetry
+char *webFifo()
+{
+	char *resp = kmalloc(FIFO_JSON_LEN);
+	if (resp == NULL)
+		return NULL;
+	fifo_telemetry_t *t = kmalloc(sizeof(fifo_telemetry_t));
+	if (t == NULL)
+	{
+		strcpy(resp, "{}");
+		return resp;
+	}
+	int i, n;
+	spiRamFifoGetTelemetry(t);
+	n = fifoJson(resp, 0, "{\"len\":%u,\"fill\":%u,\"hotlen\":%u,\"hotfill\":%u,\"in\":%" PRIu32 ",\"out\":%" PRIu32 ",\"inrate\":%" PRIu32 ",\"outrate\":%" PRIu32
+				 ",\"udr\":%" PRIu32 ",\"udrms\":%" PRIu32 ",\"ovr\":%" PRIu32 ",\"ovrms\":%" PRIu32
+				 ",\"frames\":%" PRIu32 ",\"dropped\":%" PRIu32 ",\"bufms\":%" PRIu32 ",\"bounds\":[",
+				 t->len, t->fill, t->hot_len, t->hot_fill, t->bytes_in, t->bytes_out, t->in_rate, t->out_rate,
+				 t->underruns, t->underrun_ms, t->overruns, t->overrun_ms, t->frames, t->frames_dropped, t->buffered_ms);
+	for (i = 0; i < FIFO_TEL_BUCKETS - 1; i++)
+		n = fifoJson(resp, n, "%s%u", i ? "," : "", spiRamFifoHistBounds[i]);
+	n = fifoJson(resp, n, "],\"udrhist\":[");
+	for (i = 0; i < FIFO_TEL_BUCKETS; i++)
+		n = fifoJson(resp, n, "%s%" PRIu32, i ? "," : "", t->underrun_hist[i]);
+	n = fifoJson(resp, n, "],\"ovrhist\":[");
+	for (i = 0; i < FIFO_TEL_BUCKETS; i++)
+		n = fifoJson(resp, n, "%s%" PRIu32, i ? "," : "", t->overrun_hist[i]);
+	n = fifoJson(resp, n, "],\"period\":%u,\"fillkb\":[", t->period_ms);
+	for (i = 0; i < t->samples; i++)
+		n = fifoJson(resp, n, "%s%u", i ? "," : "", t->fill_kb[i]);
+	n = fifoJson(resp, n, "]}");
+	free(t);
+	// cut short, it would not parse
+	if (n >= FIFO_JSON_LEN)
+		strcpy(resp, "{}");
+	return resp;
+}
+
 char *webList(int id)
 {
 	struct shoutcast_info *si;
@@ -1029,6 +1090,67 @@ void syslcd(char *s)
 	kprintf("##LCD is %d on next reset#\n", value);
 }
 
+// output rate of the renderer for the rate option
+uint32_t getFixedRate()
+{
+	static const uint32_t rates[] = {0, 44100, 48000, 0};
+	return rates[(g_device->options32 & T_RATE) >> S_RATE];
+}
+
+// display or change the output rate: the stream's, or a fixed one with resampling
+void sysrate(char *s)
+{
+	char *t = strstr(s, parslashquote);
+
+	if (t == NULL)
+	{
+		kprintf("##Output rate is %d#\n", (g_device->options32 & T_RATE) >> S_RATE);
+		return;
+	}
+	char *t_end = strstr(t, parquoteslash);
+	if (t_end == NULL)
+	{
+		kprintf(stritCMDERROR);
+		return;
+	}
+	uint8_t value = atoi(t + 2);
+	if (value > 2)
+		value = 0;
+	g_device->options32 &= NT_RATE; // clear
+	g_device->options32 |= (value << S_RATE) & T_RATE;
+	saveDeviceSettings(g_device);
+	if (renderer_get() != NULL)
+		renderer_fixed_rate(getFixedRate());
+	sysrate((char *)"");
+}
+
+// display or change the clock drift compensation
+void sysdrift(char *s)
+{
+	char *t = strstr(s, parslashquote);
+
+	if (t == NULL)
+	{
+		kprintf("##Drift compensation is %d#\n", (g_device->options & T_DRIFT) ? 1 : 0);
+		return;
+	}
+	char *t_end = strstr(t, parquoteslash);
+	if (t_end == NULL)
+	{
+		kprintf(stritCMDERROR);
+		return;
+	}
+	uint8_t value = atoi(t + 2);
+	if (value == 0)
+		g_device->options &= NT_DRIFT;
+	else
+		g_device->options |= T_DRIFT;
+	saveDeviceSettings(g_device);
+	if (renderer_get() != NULL)
+		renderer_drift(value != 0);
+	sysdrift((char *)"");
+}
+
 // display or change the DDMM display mode
 void sysddmm(char *s)
 {
@@ -1526,6 +1648,88 @@ void dbgSSL(char *s)
 	saveDeviceSettings(g_device);
 }
 
+void dbgFifo()
+{
+	fifo_telemetry_t *t = kmalloc(sizeof(fifo_telemetry_t));
+	int i;
+	if (t == NULL) return;
+	spiRamFifoGetTelemetry(t);
+	kprintf("Buffer fill %u%%, %u bytes, OverRun: %ld, UnderRun: %ld\n",
+			(t->fill * 100) / t->len, t->fill, spiRamGetOverrunCt(), spiRamGetUnderrunCt());
+	if (t->hot_len)
+		kprintf("Internal tier %u of %u bytes\n", t->hot_fill, t->hot_len);
+	kprintf("In %" PRIu32 " B/s, Out %" PRIu32 " B/s, total in %" PRIu32 ", out %" PRIu32 " bytes\n",
+			t->in_rate, t->out_rate, t->bytes_in, t->bytes_out);
+	if (spiRamFifoGetFrameMode())
+		kprintf("Frames %" PRIu32 ", dropped %" PRIu32 ", buffered %" PRIu32 " ms, resyncs %" PRIu32 "\n",
+				t->frames, t->frames_dropped, t->buffered_ms, audio_player_get_resyncs());
+	kprintf("Starved %" PRIu32 " times, %" PRIu32 " ms. Blocked %" PRIu32 " times, %" PRIu32 " ms\n",
+			t->underruns, t->underrun_ms, t->overruns, t->overrun_ms);
+	kprintf("Duration (ms)  UnderRun  OverRun\n");
+	for (i = 0; i < FIFO_TEL_BUCKETS; i++)
+	{
+		if (i < FIFO_TEL_BUCKETS - 1)
+			kprintf("  < %-9u  %8" PRIu32 "  %7" PRIu32 "\n", spiRamFifoHistBounds[i], t->underrun_hist[i], t->overrun_hist[i]);
+		else
+			kprintf("  >=%-9u  %8" PRIu32 "  %7" PRIu32 "\n", spiRamFifoHistBounds[i - 1], t->underrun_hist[i], t->overrun_hist[i]);
+	}
+	kprintf("Fill (KB) every %u ms, oldest first:", t->period_ms);
+	for (i = 0; i < t->samples; i++)
+		kprintf("%s%u", (i % 20) ? " " : "\n", t->fill_kb[i]);
+	kprintf("\n");
+	free(t);
+}
+
+void dbgFrames(char *s)
+{
+	char *t = strstr(s, parslashquote);
+	if (t != NULL)
+	{
+		if (strstr(t, "on"))
+			audio_player_set_frame_mode(true);
+		else if (strstr(t, "off"))
+			audio_player_set_frame_mode(false);
+	}
+	kprintf("##dbg.frames is %s#\n", audio_player_get_frame_mode() ? "on" : "off");
+	if (spiRamFifoGetFrameMode())
+		kprintf("Buffered %" PRIu32 " ms\n", spiRamFifoBufferedMs());
+}
+
+void dbgPreroll(char *s)
+{
+	player_stats_t stats;
+	char *t = strstr(s, parslashquote);
+	if (t != NULL)
+	{
+		if (strstr(t, "fast"))
+			audio_player_set_buffer_pref(BUF_PREF_FAST);
+		else if (strstr(t, "safe"))
+			audio_player_set_buffer_pref(BUF_PREF_SAFE);
+	}
+	audio_player_get_stats(&stats);
+	kprintf("##dbg.preroll is %s#\n", (audio_player_get_buffer_pref() == BUF_PREF_FAST) ? "fast" : "safe");
+	kprintf("Pre-roll %" PRIu32 " ms, %" PRIu32 " bytes at %u kbps (%s), tune-in %" PRIu32 " ms, decoder start %" PRIu32 " us, first sample %" PRIu32 " ms after the switch\n",
+			stats.preroll_ms, stats.preroll_bytes, stats.bitrate, audio_player_rate_source_str(stats.rate_source), stats.tune_in_ms, stats.decoder_start_us, stats.first_sample_ms);
+	kprintf("Played %" PRIu32 " s, UnderRun: %ld (%" PRIu32 " per hour)\n", stats.play_ms / 1000, stats.underruns,
+			(stats.play_ms >= 1000) ? (uint32_t)((uint64_t)stats.underruns * 3600000 / stats.play_ms) : 0);
+}
+
+void dbgRender()
+{
+	renderer_stats_t rs;
+	player_stats_t stats;
+	renderer_get_stats(&rs);
+	audio_player_get_stats(&stats);
+	kprintf("##dbg.render#\n");
+	kprintf("Scratch arena %u bytes, peak %u, %" PRIu32 " allocations for %" PRIu32 " blocks\n",
+			rs.arena_bytes, rs.peak_bytes, rs.allocs, rs.blocks);
+	if (stats.play_ms >= 1000)
+		kprintf("Played %" PRIu32 " s, %" PRIu32 " blocks per second\n", stats.play_ms / 1000,
+				(uint32_t)((uint64_t)rs.blocks * 1000 / stats.play_ms));
+	if (renderer_get() != NULL && renderer_get()->drift)
+		kprintf("Clock drift correction %" PRId32 " ppm\n", rs.drift_ppm);
+}
+
 void checkCommand(int size, char *s)
 {
 	char *tmp = (char *)kmalloc((size + 1) * sizeof(char));
@@ -1547,12 +1751,20 @@ void checkCommand(int size, char *s)
 	if (startsWith("dbg.", tmp))
 	{
 		if (strcmp(tmp + 4, "fifo") == 0)
-			kprintf("Buffer fill %u%%, %d bytes, OverRun: %ld, UnderRun: %ld\n",
-					(spiRamFifoFill() * 100) / spiRamFifoLen(), spiRamFifoFill(), spiRamGetOverrunCt(), spiRamGetUnderrunCt());
+			dbgFifo();
 		else if (strcmp(tmp + 4, "clear") == 0)
+		{
 			spiRamFifoReset();
+			spiRamFifoClearTelemetry();
+		}
 		else if (startsWith("ssl", tmp + 4))
 			dbgSSL(tmp);
+		else if (startsWith("preroll", tmp + 4))
+			dbgPreroll(tmp);
+		else if (startsWith("frames", tmp + 4))
+			dbgFrames(tmp);
+		else if (strcmp(tmp + 4, "render") == 0)
+			dbgRender();
 		else
 			printInfo(tmp);
 	}
@@ -1699,6 +1911,10 @@ void checkCommand(int size, char *s)
 			hostname(tmp);
 		else if (startsWith("rotat", tmp + 4))
 			sysrotat(tmp);
+		else if (startsWith("rate", tmp + 4))
+			sysrate(tmp);
+		else if (startsWith("drift", tmp + 4))
+			sysdrift(tmp);
 		else if (startsWith("henc0", tmp + 4))
 			syshenc(0, tmp);
 		else if (startsWith("henc1", tmp + 4))
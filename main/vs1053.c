@@ -711,15 +711,15 @@ void VS1053_flush_cancel()
 		VS1053_SendMusicBytes(buf, 32); // 2080 bytes
 }
 
-void vsTask(void *pvParams)
+static void vsStream(player_t *player)
 {
 #define VSTASKBUF 1024
 	portBASE_TYPE uxHighWaterMark;
 	uint8_t b[VSTASKBUF];
 	uint16_t size, s;
+	bool first = true;
 
-	player_t *player = pvParams;
-
+	audio_player_decoder_ready();
 	while (1)
 	{
 		// stop requested, terminate immediately
@@ -744,17 +744,32 @@ void vsTask(void *pvParams)
 			{
 				s += VS1053_SendMusicBytes(b + s, size - s);
 			}
+			if (first)
+				audio_player_first_sample();
+			first = false;
 		}
 		else
 			vTaskDelay(10);
 		vTaskDelay(2);
 	}
 
-	player->decoder_status = STOPPED;
-	player->decoder_command = CMD_NONE;
 	spiRamFifoReset();
+	// STOPPED last, audio_player_stop() waits for it
+	player->decoder_command = CMD_NONE;
+	player->decoder_status = STOPPED;
 	ESP_LOGD(TAG, "Decoder vs1053 stopped.\n");
 	uxHighWaterMark = uxTaskGetStackHighWaterMark(NULL);
 	ESP_LOGI(TAG, "watermark: %x  %d", uxHighWaterMark, uxHighWaterMark);
-	vTaskDelete(NULL);
+}
+
+// created for the first stream, then feeds a stream to the VS1053 per notification from the player
+void vsTask(void *pvParams)
+{
+	player_t *player = pvParams;
+
+	while (1)
+	{
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+		vsStream(player);
+	}
 }
@@ -26,6 +26,7 @@
 #include "audio_player.h"
 #include "spiram_fifo.h"
 #include "app_main.h"
+#include "hls.h"
 
 extern player_t *player_config;
 #define min(a, b) (((a) < (b)) ? (a) : (b))
@@ -908,7 +909,16 @@ bool clientParseHeader(char *s)
 		if (strstr(t, "audio/ogg"))
 			contentType = KAUDIO_OGG;
 
-		if (contentType == KMIME_UNKNOWN)
+		if (strstr(t, "audio/flac"))
+			contentType = KAUDIO_FLAC;
+
+		// some other audio type: the player looks at the data
+		const char *v = t + strlen("Content-Type:");
+		while (*v == ' ')
+			v++;
+		if ((contentType == KMIME_UNKNOWN) && (strncmp(v, "audio/", 6) == 0) && !strstr(v, "mpegurl") && !strstr(v, "scpls"))
+			ESP_LOGW(TAG, "unknown contentType, left to the data: %.32s", v);
+		else if (contentType == KMIME_UNKNOWN)
 		{
 			ESP_LOGD(TAG, "unknown contentType: %s", t);
 			clientSaveOneHeader("unknown contentType", 19, METANAME);
@@ -951,6 +961,8 @@ bool clientParseHeader(char *s)
 			}
 		}
 	}
+	// announced bitrate, used for the pre-roll until the first frames are parsed
+	player_config->media_stream->bitrate = (header.members.single.bitrate == NULL) ? 0 : atoi(header.members.single.bitrate);
 	if (ret == true)
 	{
 		wsHeaders(); // update all server
@@ -1010,6 +1022,7 @@ void clientSetPort(uint16_t port)
 
 void clientConnect()
 {
+	audio_player_switch();
 	cstatus = C_HEADER;
 	once = 0;
 	if ((serverInfo = (struct hostent *)gethostbyname(cleanURL())))
@@ -1027,6 +1040,7 @@ void clientConnect()
 }
 void clientConnectOnce()
 {
+	audio_player_switch();
 	cstatus = C_HEADER;
 	if ((serverInfo = (struct hostent *)gethostbyname(cleanURL())))
 	{
@@ -1197,7 +1211,7 @@ void clientReceiveCallback(int sockfd, char *pdata, int len)
 				cstatus = C_DATA; // a stream found
 				setVolumei(1);
 				/////////////////////////////////////////////////////////////////////////////////////////////////
-				player_config->media_stream->eof = false;
+				// clears eof once the decoder of the last stream is out of it
 				audio_player_start();
 				/////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -1557,6 +1571,68 @@ uint8_t wolfSSL_getLogState()
 	return (level[(g_device->options & T_WOLFSSL) >> S_WOLFSSL]);
 }
 
+static bool clientHlsStop()
+{
+	return xSemaphoreTake(sDisconnect, 0);
+}
+
+static void clientHlsStarted()
+{
+	extern bool ledPolarity;
+	cstatus = C_DATA;
+	playing = 1;
+	kprintf(CLIPLAY, 0x0d, 0x0a);
+	if (!ledStatus)
+	{
+		if (getLedGpio() != GPIO_NONE)
+			gpio_set_level(getLedGpio(), ledPolarity ? 0 : 1);
+	}
+	setVolumei(getVolume());
+}
+
+static const hls_hooks_t hlsHooks = {clientHlsStop, clientHlsStarted};
+
+// HLS playlist: segments are fetched and fed by hls_run. false if not one
+static bool clientHls()
+{
+	char *url = (char *)bufrec;
+	hls_result_t res;
+
+	if (strstr(clientPath, ".m3u8") == NULL)
+		return false;
+	snprintf(url, RECEIVE, "%s:%d%s", clientURL, clientPort, clientPath);
+	xSemaphoreTake(sConnected, 0);
+	wsMonitor();
+	ramSinit();
+	res = hls_run(url, &hlsHooks);
+	if (res == HLS_NOT_HLS)
+		return false;
+	if (res == HLS_ENDED)
+		while (spiRamFifoFill() && !xSemaphoreTake(sDisconnect, 0))
+			vTaskDelay(200);
+	if (playing)
+	{
+		if (get_player_status() != STOPPED)
+			audio_player_stop();
+		player_config->media_stream->eof = true;
+		if (get_audio_output_mode() == VS1053)
+			VS1053_flush_cancel();
+		playing = 0;
+		if (get_audio_output_mode() == VS1053)
+			VS1053_LowPower();
+	}
+	spiRamFifoReset();
+	if (res == HLS_FAILED)
+	{
+		clientSaveOneHeader("HLS error", 9, METANAME);
+		wsHeaders();
+		clientDisconnect("HLS");
+	}
+	else if (res == HLS_ENDED)
+		clientDisconnect("once");
+	return true;
+}
+
 void clientTask(void *pvParams)
 {
 	portBASE_TYPE uxHighWaterMark;
@@ -1612,6 +1688,8 @@ void clientTask(void *pvParams)
 			if (get_audio_output_mode() == VS1053)
 				VS1053_HighPower();
 			xSemaphoreTake(sDisconnect, 0);
+			if (clientHls())
+				continue;
 			sockfd = socket(AF_INET, SOCK_STREAM, 0);
 			ESP_LOGD(TAG, "Socket: %d", sockfd);
 			if (sockfd < 0)
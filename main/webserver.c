@@ -90,6 +90,14 @@ static void respOk(int conn,const char* message)
 	write(conn, fresp, strlen(fresp));
 }
 
+static void respJson(int conn,const char* message)
+{
+	if (message == NULL) {respOk(conn,NULL); return;}
+	char fresp[strlen(strsROK)+strlen(message)+30];
+	sprintf(fresp,strsROK,"application/json",strlen(message),message);
+	write(conn, fresp, strlen(fresp));
+}
+
 static void respKo(int conn)
 {
 	write(conn, lowmemory, strlen(lowmemory));
@@ -212,6 +220,18 @@ static bool getSParameterFromResponse(char* result,uint32_t size, const char* pa
 static char* getParameterFromComment(const char* param, char* data, uint16_t data_length) {
 	return getParameter("\"",param,data, data_length) ;
 }
+// true when key is one of the query's parameters, not a part of another one or of a value
+static bool getKeyFromResponse(const char* key, char* data) {
+	size_t len = strlen(key);
+	char* p = strchr(data, '?');
+	while (p != NULL) {
+		p++;
+		if ((strncmp(p, key, len) == 0) && ((p[len] == 0) || (p[len] == '&') || (p[len] == '=')))
+			return true;
+		p = strchr(p, '&');
+	}
+	return false;
+}
 
 // volume offset
 static void clientSetOvol(int8_t ovol)
@@ -481,59 +501,54 @@ static void handlePOST(char* name, char* data, int data_size, int conn) {
 				if (g_device->bass != atoi(bass))
 				{
 					if (get_audio_output_mode() == VS1053)
-					{
 						VS1053_SetBass(atoi(bass));
-						changed = true;
-						g_device->bass = atoi(bass);
-					}
+					changed = true;
+					g_device->bass = atoi(bass);
 				}
 			}
 			if(getSParameterFromResponse(treble,6,"treble=", data, data_size)) {
 				if (g_device->treble != atoi(treble))
 				{
 					if (get_audio_output_mode() == VS1053)
-					{
 						VS1053_SetTreble(atoi(treble));
-						changed = true;
-						g_device->treble = atoi(treble);
-					}
+					changed = true;
+					g_device->treble = atoi(treble);
 				}
 			}
 			if(getSParameterFromResponse(bassfreq,6,"bassfreq=", data, data_size)) {
 				if (g_device->freqbass != atoi(bassfreq))
 				{
 					if (get_audio_output_mode() == VS1053)
-					{
 						VS1053_SetBassFreq(atoi(bassfreq));
-						changed = true;
-						g_device->freqbass = atoi(bassfreq);
-					}
+					changed = true;
+					g_device->freqbass = atoi(bassfreq);
 				}
 			}
 			if(getSParameterFromResponse(treblefreq,6,"treblefreq=", data, data_size)) {
 				if (g_device->freqtreble != atoi(treblefreq))
 				{
 					if (get_audio_output_mode() == VS1053)
-					{
 						VS1053_SetTrebleFreq(atoi(treblefreq));
-						changed = true;
-						g_device->freqtreble = atoi(treblefreq);
-					}
+					changed = true;
+					g_device->freqtreble = atoi(treblefreq);
 				}
 			}
 			if(getSParameterFromResponse(spacial,6,"spacial=", data, data_size)) {
 				if (g_device->spacial != atoi(spacial))
 				{
-						if (get_audio_output_mode() == VS1053)
-						{
-							VS1053_SetSpatial(atoi(spacial));
-							changed = true;
-							g_device->spacial = atoi(spacial);
-						}
+					if (get_audio_output_mode() == VS1053)
+						VS1053_SetSpatial(atoi(spacial));
+					changed = true;
+					g_device->spacial = atoi(spacial);
 				}
 			}
 			if (changed)
+			{
+				// the renderer's DSP for the other outputs
+				if (get_audio_output_mode() != VS1053)
+					renderer_tone(g_device->treble, g_device->freqtreble, g_device->bass, g_device->freqbass, g_device->spacial);
 				saveDeviceSettings(g_device);
+			}
 		}
 	} else if(strcmp(name, "/getStation") == 0) {
 		if(data_size > 0) {
@@ -704,11 +719,11 @@ static void handlePOST(char* name, char* data, int data_size, int conn) {
 		ESP_LOGV(TAG,"icy vol");
 		char currentSt[7]; sprintf(currentSt,"%d",getCurrentStation());
 		char vol[7]; sprintf(vol,"%d",(getVolume() ));
-		char treble[7]; sprintf(treble,"%d",(get_audio_output_mode() == VS1053)?VS1053_GetTreble():0);
-		char bass[7]; sprintf(bass,"%d",(get_audio_output_mode() == VS1053)?VS1053_GetBass():0);
-		char tfreq[7]; sprintf(tfreq,"%d",(get_audio_output_mode() == VS1053)?VS1053_GetTrebleFreq():0);
-		char bfreq[7]; sprintf(bfreq,"%d",(get_audio_output_mode() == VS1053)?VS1053_GetBassFreq():0);
-		char spac[7]; sprintf(spac,"%d",(get_audio_output_mode() == VS1053)?VS1053_GetSpatial():0);
+		char treble[7]; sprintf(treble,"%d",(get_audio_output_mode() == VS1053)?VS1053_GetTreble():g_device->treble);
+		char bass[7]; sprintf(bass,"%d",(get_audio_output_mode() == VS1053)?VS1053_GetBass():g_device->bass);
+		char tfreq[7]; sprintf(tfreq,"%d",(get_audio_output_mode() == VS1053)?VS1053_GetTrebleFreq():g_device->freqtreble);
+		char bfreq[7]; sprintf(bfreq,"%d",(get_audio_output_mode() == VS1053)?VS1053_GetBassFreq():g_device->freqbass);
+		char spac[7]; sprintf(spac,"%d",(get_audio_output_mode() == VS1053)?VS1053_GetSpatial():g_device->spacial);
 
 		struct icyHeader *header = clientGetHeader();
 		ESP_LOGV(TAG,"icy start header %x",(int)header);
@@ -1092,6 +1107,13 @@ static bool httpServerHandleConnection(int conn, char* buf, uint16_t buflen) {
 					infree(vr);
 					return true;
 				}
+// fifo command, buffer telemetry as json
+				if (getKeyFromResponse("fifo", c)) {
+					char* vr = webFifo();
+					respJson(conn,vr);
+					infree(vr);
+					return true;
+				}
 // list command	 ?list=1 to list the name of the station 1
 				param = getParameterFromResponse("list=", c, strlen(c)) ;
 				if ((param != NULL)&&(atoi(param)>=0)&&(atoi(param)<=254))
@@ -0,0 +1,35 @@
+/*
+ * check.c
+ *
+ *  See check.h.
+ */
+
+#include <stdint.h>
+#include <time.h>
+
+#include "check.h"
+
+int failed;
+
+static uint32_t x = 2463534242u;
+
+unsigned rnd(void)
+{
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x;
+}
+
+void rnd_seed(unsigned seed)
+{
+    // xorshift never leaves 0
+    x = seed ? seed : 2463534242u;
+}
+
+double now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
@@ -0,0 +1,29 @@
+/*
+ * check.h
+ *
+ *  What the host checks share: CHECK() prints the condition that failed
+ *  and sets failed, the exit status. rnd() is a xorshift generator seeded
+ *  the same in every program, so a check draws the same numbers on every
+ *  host; rnd_seed() starts it from another seed. now() is the monotonic clock in seconds, for the benchmarks.
+ */
+
+#ifndef CHECK_H_
+#define CHECK_H_
+
+#include <stdio.h>
+
+extern int failed;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            printf("%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            failed = 1; \
+        } \
+    } while (0)
+
+unsigned rnd(void);
+void rnd_seed(unsigned seed);
+double now(void);
+
+#endif /* CHECK_H_ */
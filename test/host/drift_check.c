@@ -0,0 +1,147 @@
+/*
+ * drift_check.c
+ *
+ *  The drift loop of audio_drift.c against a simulated live stream: the
+ *  server's clock runs skew ppm off the local one, delivery comes in
+ *  bursts every 50 to 1500 ms into an 8 s fifo with a 3 s pre-roll, and
+ *  the fill the player reports is off by up to 5 % as a VBR stream's
+ *  bytes to ms conversion is. Over 12 hours from -200 to +200 ppm the
+ *  corrected playback must neither run dry nor block the writer, the
+ *  integral part must settle at the skew and the fill stay near its
+ *  setpoint. Also with a 2 s network stall every 10 minutes, and without
+ *  the correction, when the fifo must run dry or overflow.
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "check.h"
+#include "audio_drift.h"
+
+/* simulation step, ms */
+#define STEP_MS 5
+#define HOURS 12
+#define FIFO_MS 8000
+#define PREROLL_MS 3000
+/* how often the renderer passes the fill, ms */
+#define UPDATE_MS 25
+/* the integral part over the second half is this close to the skew, ppm */
+#define SETTLED_PPM 10
+/* mean distance of the fill from the setpoint after the first hour, ms */
+#define MEAN_DEV_MS 500
+
+typedef struct {
+    int underruns;          /* steps the fifo ran dry in */
+    int overruns;           /* deliveries the fifo had no room for */
+    double mean_dev;        /* of the fill from the setpoint after the first hour, ms */
+    double integral;        /* mean of the integral part over the second half, ppm */
+    drift_t d;
+} result_t;
+
+static void simulate(result_t *r, int skew_ppm, bool correct, uint32_t stall_ms)
+{
+    double fill = PREROLL_MS, pending = 0, ppm = 0, dev = 0, integral = 0;
+    uint32_t next_net = 0, stall_until = 0, n = 0, m = 0;
+
+    drift_reset(&r->d);
+    r->underruns = r->overruns = 0;
+    for (uint32_t t = STEP_MS; t <= HOURS * 3600000u; t += STEP_MS) {
+        // the server sends at its clock
+        pending += STEP_MS * (1.0 + skew_ppm * 1e-6);
+        if (stall_ms > 0 && t % 600000 == 0)
+            stall_until = t + stall_ms;
+        if (t >= next_net && t >= stall_until) {
+            double room = FIFO_MS - fill;
+            if (pending > room) {
+                // the writer blocks on a full fifo: the socket backs up
+                r->overruns++;
+                fill = FIFO_MS;
+                pending -= room;
+            } else {
+                fill += pending;
+                pending = 0;
+            }
+            next_net = t + 50 + rnd() % 1450;
+        }
+
+        double take = STEP_MS * (1.0 + ppm * 1e-6);
+        if (fill >= take) {
+            fill -= take;
+        } else {
+            r->underruns += fill > 0;
+            fill = 0;
+        }
+
+        if (correct && t % UPDATE_MS == 0) {
+            double vbr = 1.0 + 0.1 * ((rnd() % 1001) / 1000.0 - 0.5);
+            ppm = drift_update(&r->d, t, (uint32_t)(fill * vbr));
+        }
+        if (t > 3600000 && t % 1000 == 0) {
+            dev += fabs(fill - ((r->d.target > 0) ? r->d.target : PREROLL_MS));
+            n++;
+        }
+        if (t > HOURS * 1800000u && t % 1000 == 0) {
+            integral += r->d.integral;
+            m++;
+        }
+    }
+    r->mean_dev = dev / n;
+    r->integral = integral / m;
+}
+
+int main(void)
+{
+    static const int skews[] = { -200, -100, 0, 100, 200 };
+    drift_t d;
+    result_t r;
+
+    // no correction while the start settles, then none for a steady fill
+    drift_reset(&d);
+    CHECK(drift_update(&d, 1, 3000) == 0);
+    for (uint32_t t = 1000; t < DRIFT_SETTLE_MS; t += 1000)
+        CHECK(drift_update(&d, t, 6000) == 0);
+    CHECK(d.target < 0);
+    CHECK(drift_update(&d, DRIFT_SETTLE_MS + 1, 3000) == 0);
+    CHECK(d.target > 0);
+    float target = d.target;
+    for (uint32_t t = DRIFT_SETTLE_MS + 1001; t < 2 * DRIFT_SETTLE_MS; t += 1000)
+        drift_update(&d, t, (uint32_t)target);
+    CHECK(abs(d.ppm) <= 1);
+    // samples closer than the period are not taken
+    int32_t ppm = d.ppm;
+    uint32_t last = d.last_ms;
+    CHECK(drift_update(&d, last + 1, 8000) == ppm);
+    CHECK(drift_update(&d, last + DRIFT_PERIOD_MS - 1, 8000) == ppm);
+    // a fill far off the setpoint: the correction is bounded
+    for (uint32_t t = last + DRIFT_PERIOD_MS; t < last + 3600000; t += 1000)
+        CHECK(drift_update(&d, t, 100000) <= DRIFT_MAX_PPM);
+    CHECK(d.ppm == DRIFT_MAX_PPM);
+    CHECK(d.integral <= DRIFT_MAX_PPM);
+
+    printf("  skew   stall  underruns  overruns  integral  mean dev\n");
+    for (int s = 0; s < sizeof(skews) / sizeof(skews[0]); s++)
+        for (uint32_t stall = 0; stall <= 2000; stall += 2000) {
+            simulate(&r, skews[s], true, stall);
+            printf("%+6d %6u ms %9d %9d %+9.1f %6.0f ms\n", skews[s], stall, r.underruns, r.overruns,
+                   r.integral, r.mean_dev);
+            // a stall at the bottom of the delivery sawtooth runs dry whatever the correction
+            CHECK(r.underruns <= ((stall > 0) ? HOURS * 6 / 20 : 0));
+            CHECK(r.overruns == 0);
+            CHECK(fabs(r.integral - skews[s]) < SETTLED_PPM);
+            CHECK(r.mean_dev < MEAN_DEV_MS);
+        }
+
+    // uncompensated the fifo runs dry or blocks the writer
+    simulate(&r, -200, false, 0);
+    printf("-200 ppm uncorrected: %d underruns\n", r.underruns);
+    CHECK(r.underruns > 0);
+    simulate(&r, 200, false, 0);
+    printf("+200 ppm uncorrected: %d overruns\n", r.overruns);
+    CHECK(r.overruns > 0);
+
+    if (!failed)
+        printf("drift ok\n");
+    return failed;
+}
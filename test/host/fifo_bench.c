@@ -0,0 +1,111 @@
+/*
+ * fifo_bench.c
+ *
+ *  Streams a counter pattern through the audio fifo, the writer and the
+ *  reader on their own threads with random chunk sizes, checks every byte
+ *  and prints the throughput.
+ *
+ *    fifo_bench [-p] [-x] [-s size] MiB
+ *
+ *  -p reads through spiRamFifoPeek/Commit instead of spiRamFifoRead, -x
+ *  puts the fifo in external RAM behind the hot ring, -s sets its size.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "check.h"
+#include "esp_memory_utils.h"
+#include "spiram_fifo.h"
+
+#define PATTERN(i) ((char)(((i) * 2654435761u) >> 24))
+
+static unsigned total;
+
+static void *writer(void *arg)
+{
+    char buf[3000];
+    unsigned seed = 1, sent = 0;
+    while (sent < total) {
+        unsigned n = 1 + rand_r(&seed) % sizeof(buf);
+        if (n > total - sent)
+            n = total - sent;
+        for (unsigned i = 0; i < n; i++)
+            buf[i] = PATTERN(sent + i);
+        spiRamFifoWrite(buf, n);
+        sent += n;
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    int opt, peek = 0;
+    unsigned size = 0, seed = 2, got = 0, errors = 0, shorts = 0;
+
+    while ((opt = getopt(argc, argv, "pxs:")) != -1) {
+        switch (opt) {
+            case 'p':
+                peek = 1;
+                break;
+            case 'x':
+                host_external_ram = true;
+                break;
+            case 's':
+                size = atoi(optarg);
+                break;
+            default:
+                optind = argc;
+                break;
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "usage: %s [-p] [-x] [-s size] MiB\n", argv[0]);
+        return 2;
+    }
+    total = atoi(argv[optind]) * 1024u * 1024u;
+    // odd sizes, so the rings wrap at every offset
+    setSPIRAMSIZE(size ? size : host_external_ram ? 200 * 1024 + 7 : 30 * 1024 + 7);
+    spiRamFifoInit();
+
+    double start = now();
+    pthread_t thread;
+    pthread_create(&thread, NULL, writer, NULL);
+    while (got < total) {
+        unsigned want = 1 + rand_r(&seed) % 2900;
+        if (want > total - got)
+            want = total - got;
+        if (peek) {
+            char *p;
+            unsigned len;
+            spiRamFifoWaitFill(want, 1000);
+            spiRamFifoPeek(&p, &len);
+            // the window is contiguous up to what is buffered
+            if (len < want && spiRamFifoFill() >= want)
+                shorts++;
+            unsigned n = len < want ? len : want;
+            for (unsigned i = 0; i < n; i++)
+                errors += p[i] != PATTERN(got + i);
+            spiRamFifoCommit(n);
+            got += n;
+        } else {
+            char buf[2900];
+            spiRamFifoRead(buf, want);
+            for (unsigned i = 0; i < want; i++)
+                errors += buf[i] != PATTERN(got + i);
+            got += want;
+        }
+    }
+    pthread_join(thread, NULL);
+    double t = now() - start;
+
+    fifo_telemetry_t tel;
+    spiRamFifoGetTelemetry(&tel);
+    printf("%s, %s, %u bytes: %u MiB in %.2f s, %.0f MiB/s, %u errors, %u short windows, %u underruns, %u overruns\n",
+           peek ? "peek" : "read", host_external_ram ? "tiered" : "single", tel.len,
+           total >> 20, t, (total >> 20) / t, errors, shorts, tel.underruns, tel.overruns);
+    spiRamFifoDestroy();
+    return errors || shorts;
+}
@@ -0,0 +1,131 @@
+/*
+ * fifo_reset.c
+ *
+ *  Resets the audio fifo every 300 us while a writer fills it with a
+ *  rising counter and the reader reads and peeks it. A reset may drop
+ *  data, but what the reader gets must still rise, and the fill must never
+ *  exceed the fifo.
+ *
+ *    fifo_reset [-f] [-x] MiB
+ *
+ *  -f writes frames (frame mode), -x puts the fifo in external RAM behind
+ *  the hot ring.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "esp_memory_utils.h"
+#include "spiram_fifo.h"
+
+static bool frames;
+static uint32_t words;
+static atomic_bool done, stop;
+static atomic_uint resets;
+static atomic_bool resetting;
+
+static void put(uint32_t *buf, unsigned n, uint32_t *x)
+{
+    for (unsigned i = 0; i < n; i++)
+        buf[i] = (*x)++;
+    if (frames)
+        spiRamFifoWriteFrame((char *)buf, n * 4, 26000);
+    else
+        spiRamFifoWrite((char *)buf, n * 4);
+}
+
+static void *writer(void *arg)
+{
+    pthread_t *resetter = arg;
+    uint32_t buf[700], x = 1;
+    unsigned seed = 7;
+    while (x < words)
+        put(buf, 1 + rand_r(&seed) % 700, &x);
+    // a read the last reset emptied waits for 64 more bytes: they come after it
+    atomic_store(&stop, true);
+    pthread_join(*resetter, NULL);
+    put(buf, 16, &x);
+    atomic_store(&done, true);
+    return NULL;
+}
+
+static void *resetter(void *arg)
+{
+    while (!atomic_load(&stop)) {
+        usleep(300);
+        atomic_store(&resetting, true);
+        spiRamFifoReset();
+        atomic_fetch_add(&resets, 1);
+        atomic_store(&resetting, false);
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "fx")) != -1) {
+        switch (opt) {
+            case 'f':
+                frames = true;
+                break;
+            case 'x':
+                host_external_ram = true;
+                break;
+            default:
+                optind = argc;
+                break;
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "usage: %s [-f] [-x] MiB\n", argv[0]);
+        return 2;
+    }
+    words = atoi(argv[optind]) * 1024u * 1024u / 4;
+    setSPIRAMSIZE(host_external_ram ? 200 * 1024 : 24 * 1024);
+    spiRamFifoInit();
+    spiRamFifoSetFrameMode(frames);
+
+    pthread_t w, r;
+    pthread_create(&r, NULL, resetter, NULL);
+    pthread_create(&w, NULL, writer, &r);
+
+    uint32_t last = 0, got = 0, disorder = 0, overfull = 0;
+    unsigned seed = 3;
+    while (!atomic_load(&done) || spiRamFifoFill() >= 4) {
+        uint32_t buf[600];
+        unsigned n = 0;
+        if (rand_r(&seed) & 1) {
+            char *p;
+            unsigned len;
+            unsigned before = atomic_load(&resets);
+            bool during = atomic_load(&resetting);
+            spiRamFifoPeek(&p, &len);
+            n = len / 4 < 600 ? len / 4 : 600;
+            memcpy(buf, p, n * 4);
+            // the data behind a peek is only the reader's until the next reset
+            if (during || atomic_load(&resetting) || atomic_load(&resets) != before)
+                n = 0;
+            spiRamFifoCommit(n * 4);
+        } else if (spiRamFifoWaitFill(64, 5) >= 64) {
+            n = 16;
+            spiRamFifoRead((char *)buf, 64);
+        }
+        for (unsigned i = 0; i < n; i++) {
+            disorder += buf[i] <= last;
+            last = buf[i];
+        }
+        got += n;
+        overfull += spiRamFifoFill() > spiRamFifoLen();
+    }
+    pthread_join(w, NULL);
+
+    printf("%s, %s: %u of %u words read, %u resets, %u out of order, %u overfull\n",
+           frames ? "frames" : "bytes", host_external_ram ? "tiered" : "single",
+           got, words, atomic_load(&resets), disorder, overfull);
+    return disorder || overfull;
+}
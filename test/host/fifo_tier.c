@@ -0,0 +1,103 @@
+/*
+ * fifo_tier.c
+ *
+ *  The hot ring tier of the audio fifo: when it is there, how the two
+ *  rings add up in the fill and the telemetry, that the refill task moves
+ *  the data in order, and that a reset empties both rings.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "check.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_memory_utils.h"
+#include "spiram_fifo.h"
+
+#define BYTES 50000
+
+// until the refill task leaves the hot ring alone
+static void settle(void)
+{
+    fifo_telemetry_t t;
+    unsigned last;
+    do {
+        spiRamFifoGetTelemetry(&t);
+        last = t.hot_fill;
+        vTaskDelay(20);
+        spiRamFifoGetTelemetry(&t);
+    } while (t.hot_fill != last);
+}
+
+static void tiers(bool external, unsigned size, unsigned hot_len)
+{
+    fifo_telemetry_t t;
+    host_external_ram = external;
+    setSPIRAMSIZE(size);
+    spiRamFifoInit();
+    spiRamFifoGetTelemetry(&t);
+    printf("%s %u bytes: hot ring %u\n", external ? "external" : "internal", size, t.hot_len);
+    CHECK(t.hot_len == hot_len);
+    CHECK(t.len == size + hot_len);
+    CHECK(spiRamFifoLen() == size + hot_len);
+    spiRamFifoDestroy();
+}
+
+int main(void)
+{
+    static char in[BYTES], out[BYTES];
+    fifo_telemetry_t t;
+
+    // the hot ring only goes in front of 64 KB and more of PSRAM
+    tiers(false, 200 * 1024, 0);
+    tiers(true, 48 * 1024, 0);
+    tiers(true, 200 * 1024, 16 * 1024);
+
+    host_external_ram = true;
+    setSPIRAMSIZE(200 * 1024);
+    spiRamFifoInit();
+    for (unsigned i = 0; i < BYTES; i++)
+        in[i] = (char)(i * 7 + (i >> 8));
+    spiRamFifoWrite(in, BYTES);
+    settle();
+    spiRamFifoGetTelemetry(&t);
+    printf("after %u bytes: fill %u, hot ring %u/%u\n", BYTES, t.fill, t.hot_fill, t.hot_len);
+    CHECK(t.fill == BYTES);
+    CHECK(spiRamFifoFill() == BYTES);
+    CHECK(t.hot_fill > 0 && t.hot_fill <= t.hot_len);
+    // what the reader gets without waiting, all of it in the hot ring
+    CHECK(spiRamFifoWaitFill(BYTES, 0) == t.hot_fill);
+
+    // half through Read, half through Peek, the refill task keeps up
+    spiRamFifoRead(out, BYTES / 2);
+    unsigned got = BYTES / 2;
+    while (got < BYTES) {
+        char *p;
+        unsigned len;
+        spiRamFifoWaitFill(BYTES - got, 100);
+        spiRamFifoPeek(&p, &len);
+        if (len > BYTES - got)
+            len = BYTES - got;
+        memcpy(out + got, p, len);
+        spiRamFifoCommit(len);
+        got += len;
+    }
+    CHECK(memcmp(in, out, BYTES) == 0);
+    CHECK(spiRamFifoFill() == 0);
+
+    spiRamFifoWrite(in, BYTES);
+    settle();
+    spiRamFifoReset();
+    spiRamFifoGetTelemetry(&t);
+    printf("after a reset: fill %u, hot ring %u\n", t.fill, t.hot_fill);
+    CHECK(t.fill == 0 && t.hot_fill == 0);
+    // and it still runs after it
+    spiRamFifoWrite(in, 1000);
+    spiRamFifoRead(out, 1000);
+    CHECK(memcmp(in, out, 1000) == 0);
+
+    spiRamFifoDestroy();
+    printf(failed ? "FAIL\n" : "OK\n");
+    return failed;
+}
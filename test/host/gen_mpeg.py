@@ -0,0 +1,323 @@
+#!/usr/bin/env python3
+#
+# Random but structurally valid MPEG audio streams for the decoder checks:
+# real headers and side information, random main data. The streams go
+# through every Layer III path (long, short and mixed blocks, MS and
+# intensity stereo, the bit reservoir, LSF and MPEG 2.5) and Layers I and II.
+# Seeded from the stream name, so a name always gives the same bytes.
+# The damaged streams for the frame sync come with NAME.frames, where each
+# frame starts and whether it is whole.
+#
+#   gen_mpeg.py DIR [NAME...]
+import random
+import sys
+import zlib
+
+
+class Bits:
+    def __init__(self):
+        self.bits = []
+
+    def put(self, value, n):
+        for i in range(n - 1, -1, -1):
+            self.bits.append((value >> i) & 1)
+
+    def bytes(self):
+        b = self.bits + [0] * (-len(self.bits) % 8)
+        return bytes(int(''.join(map(str, b[i:i + 8])), 2) for i in range(0, len(b), 8))
+
+
+BR_L3 = [0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320]
+BR_LSF = [0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160]
+BR_L2 = [0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384]
+BR_L1 = [0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448]
+RATES = {1: [44100, 48000, 32000], 2: [22050, 24000, 16000], 25: [11025, 12000, 8000]}
+# global gain ranges: loud enough to clip now and then, and well below
+# full scale for the accuracy checks
+GAIN = (120, 215)
+QUIET = (60, 130)
+
+
+def header(ver, layer, bri, sri, pad, mode, modext):
+    b = Bits()
+    b.put(0x7ff, 11); b.put({1: 3, 2: 2, 25: 0}[ver], 2); b.put(4 - layer, 2); b.put(1, 1)
+    b.put(bri, 4); b.put(sri, 2); b.put(pad, 1); b.put(0, 1)
+    b.put(mode, 2); b.put(modext, 2); b.put(0, 1); b.put(1, 1); b.put(0, 2)
+    return b.bytes()
+
+
+def l3frame(r, ver, bri, sri, mode, prev_main, gain=GAIN):
+    nch = 1 if mode == 3 else 2
+    br = (BR_L3 if ver == 1 else BR_LSF)[bri]
+    sr = RATES[ver][sri]
+    pad = r.randint(0, 1)
+    flen = (144 if ver == 1 else 72) * br * 1000 // sr + pad
+    si = (17 if nch == 1 else 32) if ver == 1 else (9 if nch == 1 else 17)
+    main_len = flen - 4 - si
+    if main_len <= 0:
+        return None, 0
+    ngr = 2 if ver == 1 else 1
+    # main_data_begin reaches back into the previous frame now and then
+    mdb = r.choice([0, 0, r.randint(0, min(prev_main, 511 if ver == 1 else 255))])
+    share = (mdb + main_len) * 8 // (ngr * nch)
+    # window switching per granule and channel, joint stereo keeps both alike
+    blocks = [[None] * nch for _ in range(ngr)]
+    for gr in range(ngr):
+        for ch in range(nch):
+            if ch == 1 and mode == 1:
+                blocks[gr][1] = blocks[gr][0]
+                continue
+            ws = r.random() < 0.35
+            bt = r.choice([1, 2, 2, 3]) if ws else 0
+            blocks[gr][ch] = (ws, bt, r.random() < 0.3 if bt == 2 else False)
+    b = Bits()
+    if ver == 1:
+        b.put(mdb, 9); b.put(0, 5 if nch == 1 else 3)
+        for ch in range(nch):
+            b.put(0 if any(blocks[gr][ch][0] for gr in range(ngr)) else r.randint(0, 15), 4)
+    else:
+        b.put(mdb, 8); b.put(0, 1 if nch == 1 else 2)
+    table = lambda: r.choice([t for t in range(32) if t not in (4, 14)])
+    for gr in range(ngr):
+        for ch in range(nch):
+            part23 = min(r.randint(share * 3 // 4, share) if share > 0 else 0, 4095)
+            b.put(part23, 12)
+            b.put(r.randint(0, min(288, part23 // 14)), 9)
+            b.put(r.randint(*gain), 8)
+            if ver == 1:
+                b.put(r.randint(0, 15), 4)
+            else:
+                b.put(r.randint(0, 511), 9)
+            ws, bt, mixed = blocks[gr][ch]
+            b.put(ws, 1)
+            if ws:
+                b.put(bt, 2); b.put(mixed, 1)
+                b.put(table(), 5); b.put(table(), 5)
+                for i in range(3):
+                    b.put(r.randint(0, 7), 3)
+            else:
+                for i in range(3):
+                    b.put(table(), 5)
+                b.put(r.randint(0, 15), 4); b.put(r.randint(0, 7), 3)
+            if ver == 1:
+                b.put(r.randint(0, 1), 1)
+            b.put(r.randint(0, 1), 1); b.put(r.randint(0, 1), 1)
+    side = b.bytes()
+    assert len(side) == si, (len(side), si)
+    modext = r.randint(0, 3) if mode == 1 else 0
+    main = bytes(r.getrandbits(8) for _ in range(main_len))
+    return header(ver, 3, bri, sri, pad, mode, modext) + side + main, main_len
+
+
+# MPEG-1 scalefactor bit lengths by scalefac_compress
+SLEN = [(0, 0), (0, 1), (0, 2), (0, 3), (3, 0), (1, 1), (1, 2), (1, 3),
+        (2, 1), (2, 2), (2, 3), (3, 1), (3, 2), (3, 3), (4, 2), (4, 3)]
+# Huffman pair table 1, (x, y): (code, length)
+PAIRS1 = {(0, 0): (1, 1), (1, 0): (1, 2), (0, 1): (1, 3), (1, 1): (0, 3)}
+
+
+def l3granule(r, bits, ws, bt, mixed):
+    """Scalefactors and Huffman data of one granule and channel, coded with
+    pair table 1 and quadruple table B, at most bits long."""
+    b = Bits()
+    sfc = r.randint(0, 15)
+    slen1, slen2 = SLEN[sfc]
+    if ws and bt == 2:
+        counts = (17, 18) if mixed else (18, 18)
+    else:
+        counts = (11, 10)
+    if counts[0] * slen1 + counts[1] * slen2 > bits // 2:
+        sfc, slen1, slen2 = 0, 0, 0
+    for n, slen in zip(counts, (slen1, slen2)):
+        for i in range(n):
+            b.put(r.getrandbits(slen) if slen else 0, slen)
+    # big values, then quadruples, to at most the 576 lines
+    pairs = r.randint(0, 288)
+    bv = 0
+    while bv < pairs and len(b.bits) + 5 <= bits:
+        x, y = r.getrandbits(1), r.getrandbits(1)
+        code, n = PAIRS1[(x, y)]
+        b.put(code, n)
+        for v in (x, y):
+            if v:
+                b.put(r.getrandbits(1), 1)
+        bv += 1
+    line = 2 * bv
+    while line + 4 <= 576 and len(b.bits) + 8 <= bits:
+        quad = r.getrandbits(4)
+        b.put(15 - quad, 4)
+        for i in range(bin(quad).count('1')):
+            b.put(r.getrandbits(1), 1)
+        line += 4
+    return b.bits, bv, sfc
+
+
+def l3exact(name, frames):
+    """MPEG-1 Layer III with well formed main data: every part2_3_length
+    ends where its Huffman data does, and main_data_begin points at the
+    free tail of the earlier frames. The decode does not depend on the
+    bytes around main_data, copied or read in place."""
+    r = random.Random(zlib.crc32(name.encode()))
+    md = bytearray()
+    layout = []
+    free = 0
+    for i in range(frames):
+        mode, bri, pad = r.choice([0, 1, 1, 2, 3]), r.randint(5, 14), r.randint(0, 1)
+        nch = 1 if mode == 3 else 2
+        flen = 144 * BR_L3[bri] * 1000 // 44100 + pad
+        si = 17 if nch == 1 else 32
+        main_len = flen - 4 - si
+        mdb = r.randint(0, min(free, 511))
+        room = (mdb + main_len) * 8
+        data = []
+        side = Bits()
+        side.put(mdb, 9); side.put(0, 5 if nch == 1 else 3)
+        side.put(0, 4 * nch)
+        for gr in range(2):
+            for ch in range(nch):
+                left = room - sum(len(d) for d in data)
+                # joint stereo keeps the channels' blocks alike
+                if ch == 0 or mode != 1:
+                    ws = r.random() < 0.35
+                    bt = r.choice([1, 2, 2, 3]) if ws else 0
+                    mixed = bt == 2 and r.random() < 0.3
+                bits, bv, sfc = l3granule(r, min(4095, r.randint(left // 4, left // (2 * nch - ch))), ws, bt, mixed)
+                data.append(bits)
+                side.put(len(bits), 12); side.put(bv, 9); side.put(r.randint(120, 190), 8)
+                side.put(sfc, 4); side.put(ws, 1)
+                if ws:
+                    side.put(bt, 2); side.put(mixed, 1)
+                    side.put(1, 5); side.put(1, 5)
+                    for w in range(3):
+                        side.put(r.randint(0, 7), 3)
+                else:
+                    side.put(1, 5); side.put(1, 5); side.put(1, 5)
+                    side.put(r.randint(0, 15), 4); side.put(r.randint(0, 7), 3)
+                side.put(r.randint(0, 1), 1); side.put(r.randint(0, 1), 1); side.put(1, 1)
+        payload = Bits()
+        payload.bits = [bit for d in data for bit in d]
+        payload = payload.bytes()
+        start = len(md) - mdb
+        md += bytes(r.getrandbits(8) for _ in range(main_len))
+        md[start:start + len(payload)] = payload
+        free = mdb + main_len - len(payload)
+        modext = r.randint(0, 3) if mode == 1 else 0
+        layout.append((header(1, 3, bri, 0, pad, mode, modext) + side.bytes(), len(md) - main_len, main_len))
+    return b''.join(h + md[o:o + n] for h, o, n in layout)
+
+
+def l12frame(r, layer, bri, sri, mode):
+    br = (BR_L1 if layer == 1 else BR_L2)[bri]
+    sr = RATES[1][sri]
+    pad = r.randint(0, 1)
+    flen = (12 * br * 1000 // sr + pad) * 4 if layer == 1 else 144 * br * 1000 // sr + pad
+    modext = r.randint(0, 3) if mode == 1 else 0
+    h = header(1, layer, bri, sri, pad, mode, modext)
+    if layer == 2:
+        return h + bytes(r.getrandbits(8) for _ in range(flen - 4))
+    # Layer I: valid allocations, 15 is forbidden
+    nch = 1 if mode == 3 else 2
+    bound = 4 + 4 * modext if mode == 1 else 32
+    b = Bits()
+    for sb in range(32):
+        for ch in range(nch if sb < bound else 1):
+            b.put(r.randint(0, 14), 4)
+    alloc = b.bytes()
+    return h + alloc + bytes(r.getrandbits(8) for _ in range(flen - 4 - len(alloc)))
+
+
+def stream(name, frames):
+    if name == 'l3exact':
+        return l3exact(name, frames)
+    r = random.Random(zlib.crc32(name.encode()))
+    out = bytearray()
+    prev = 0
+    mode = None
+    for i in range(frames):
+        if name == 'l2':
+            out += l12frame(r, 2, r.randint(1, 14), 0, r.choice([0, 1, 2]))
+            continue
+        if name == 'l1':
+            out += l12frame(r, 1, r.randint(1, 14), 1, r.choice([0, 1, 3]))
+            continue
+        if name == 'l3':
+            ver, sri, mode, bri = 1, 0, r.choice([0, 1, 1, 2]), r.randint(1, 14)
+        elif name == 'l3mono':
+            ver, sri, mode, bri = 1, 1, 3, r.randint(1, 14)
+        elif name == 'l3lsf':
+            # one mode per stream
+            ver, sri, bri = 2, 1, r.randint(1, 14)
+            mode = r.choice([0, 1, 3]) if i == 0 else mode
+        elif name == 'l3lsfjs':
+            ver, sri, mode, bri = 2, 0, 1, r.randint(1, 14)
+        elif name == 'l3mpeg25':
+            ver, sri, mode, bri = 25, 2, 1, r.randint(1, 10)
+        elif name == 'l3cbr128':
+            ver, sri, mode, bri = 1, 0, 1, 9
+        elif name in ('l3q128', 'l3q320'):
+            ver, sri, mode, bri = 1, 0, 1, 9 if name == 'l3q128' else 14
+        else:
+            raise SystemExit('unknown stream ' + name)
+        f, prev = l3frame(r, ver, bri, sri, mode, prev, QUIET if name.startswith('l3q') else GAIN)
+        if f:
+            out += f
+    return bytes(out)
+
+
+def fake_syncs(r, n):
+    """n random bytes with a frame header of any kind every 20 to 200"""
+    b = bytearray(r.getrandbits(8) for _ in range(n))
+    i = r.randint(0, 200)
+    while i + 4 <= n:
+        b[i:i + 4] = header(1, 3, r.randint(1, 14), r.randint(0, 2), r.randint(0, 1), r.randint(0, 3), 0)
+        i += r.randint(20, 200)
+    return b
+
+
+def damaged(name, frames):
+    """Layer III at 128 or 320 kbit/s, damaged as streams come:
+    sync_id3: a 40 KB ID3v2 tag full of fake syncs, the stream behind it
+              starting in the middle of a frame
+    sync_burst: garbage with fake syncs after every 40th frame
+    sync_cut: 10 to 800 bytes cut out of every 40th frame
+    Returns the stream and the frames, as offset and whether it is whole."""
+    r = random.Random(zlib.crc32(name.encode()))
+    out = bytearray()
+    index = []
+    prev = 0
+    if name == 'sync_id3':
+        tag = fake_syncs(r, 40 * 1024)
+        out += b'ID3\x04\x00\x00' + bytes((len(tag) >> k) & 0x7f for k in (21, 14, 7, 0)) + tag
+    for i in range(frames):
+        f, prev = l3frame(r, 1, 9 if name == 'sync_id3' else 14, 0, 1, prev)
+        if name == 'sync_id3' and i == 0:
+            out += f[len(f) // 2:]
+            continue
+        whole = True
+        if name == 'sync_cut' and i % 40 == 39:
+            cut = r.randint(10, 800)
+            at = r.randint(36, len(f) - cut)
+            f = f[:at] + f[at + cut:]
+            whole = False
+        index.append((len(out), whole))
+        out += f
+        if name == 'sync_burst' and i % 40 == 39:
+            out += fake_syncs(r, r.randint(50, 1500))
+    return bytes(out), index
+
+
+# name and frames
+STREAMS = {'l3': 600, 'l3mono': 300, 'l3lsf': 300, 'l3lsfjs': 300, 'l3mpeg25': 200,
+           'l2': 200, 'l1': 200, 'l3cbr128': 1000, 'l3q128': 300, 'l3q320': 300, 'l3exact': 600}
+DAMAGED = {'sync_id3': 300, 'sync_burst': 600, 'sync_cut': 600}
+
+if __name__ == '__main__':
+    for name in sys.argv[2:] or list(STREAMS) + list(DAMAGED):
+        if name in DAMAGED:
+            data, index = damaged(name, DAMAGED[name])
+            with open('%s/%s.frames' % (sys.argv[1], name), 'w') as f:
+                f.writelines('%d %d\n' % (o, w) for o, w in index)
+        else:
+            data = stream(name, STREAMS[name])
+        with open('%s/%s.mp3' % (sys.argv[1], name), 'wb') as f:
+            f.write(data)
@@ -0,0 +1,246 @@
+/*
+ * m3u8_check.c
+ *
+ *  HLS playlist parsing of common_m3u8.c: the variant a master playlist
+ *  comes down to, the segments of a media playlist kept from a sequence
+ *  number on, URIs too long to keep, and the segment URLs resolved
+ *  against the playlist's.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "check.h"
+#include "common_m3u8.h"
+
+static const char audio_variants[] =
+        "\xef\xbb\xbf#EXTM3U\r\n"
+        "#EXT-X-STREAM-INF:AVERAGE-BANDWIDTH=50000,BANDWIDTH=64000,CODECS=\"mp4a.40.5\"\r\n"
+        "lo/index.m3u8\r\n"
+        "#EXT-X-STREAM-INF:BANDWIDTH=320000,CODECS=\"mp4a.40.2\"\r\n"
+        "mid/index.m3u8\r\n"
+        "#EXT-X-STREAM-INF:BANDWIDTH=900000,CODECS=\"mp4a.40.2\"\r\n"
+        "hi/index.m3u8\r\n";
+
+// all variants too fast: the slowest
+static const char fast_variants[] =
+        "#EXTM3U\n"
+        "#EXT-X-STREAM-INF:BANDWIDTH=1200000\n"
+        "a.m3u8\n"
+        "#EXT-X-STREAM-INF:BANDWIDTH=600000\n"
+        "b.m3u8\n"
+        "#EXT-X-STREAM-INF:BANDWIDTH=800000\n"
+        "c.m3u8\n";
+
+// an audio only variant beats any video one, even a slower one
+static const char mixed_variants[] =
+        "#EXTM3U\n"
+        "#EXT-X-STREAM-INF:BANDWIDTH=300000,CODECS=\"avc1.42e00a,mp4a.40.2\",RESOLUTION=416x234\n"
+        "v300.m3u8\n"
+        "#EXT-X-STREAM-INF:BANDWIDTH=96000,CODECS=\"mp4a.40.2\"\n"
+        "a96.m3u8\n"
+        "#EXT-X-STREAM-INF:BANDWIDTH=200000,CODECS=\"avc1.42e00a,mp4a.40.2\"\n"
+        "v200.m3u8\n";
+
+// video only variants: the default audio rendition
+static const char video_variants[] =
+        "#EXTM3U\n"
+        "#EXT-X-MEDIA:TYPE=AUDIO,GROUP-ID=\"aud\",NAME=\"Commentary\",DEFAULT=NO,URI=\"commentary/a.m3u8\"\n"
+        "#EXT-X-MEDIA:TYPE=AUDIO,GROUP-ID=\"aud\",NAME=\"English\",DEFAULT=YES,URI=\"en/a.m3u8\"\n"
+        "#EXT-X-MEDIA:TYPE=AUDIO,GROUP-ID=\"aud\",NAME=\"Deutsch\",DEFAULT=NO,URI=\"de/a.m3u8\"\n"
+        "#EXT-X-STREAM-INF:BANDWIDTH=2000000,CODECS=\"avc1.64001f,mp4a.40.2\",AUDIO=\"aud\"\n"
+        "v/2000.m3u8\n";
+
+static const char live[] =
+        "#EXTM3U\n"
+        "#EXT-X-VERSION:3\n"
+        "#EXT-X-TARGETDURATION:10\n"
+        "#EXT-X-MEDIA-SEQUENCE:4711\n"
+        "#EXTINF:9.984,\n"
+        "seg4711.ts\n"
+        "#EXTINF:10.005,title\n"
+        "seg4712.ts\n"
+        "#EXT-X-DISCONTINUITY\n"
+        "#EXTINF:6,\n"
+        "seg4713.ts\n"
+        "#EXTINF:10.0,\n"
+        "seg4714.ts\n"
+        "#EXTINF:10.0,\n"
+        "seg4715.ts\n"
+        "#EXTINF:10.0,\n"
+        "seg4716.ts\n"
+        "#EXTINF:10.0,\n"
+        "seg4717.ts\n"
+        "#EXTINF:10.0,\n"
+        "seg4718.ts";
+
+static const char vod[] =
+        "#EXTM3U\n"
+        "#EXT-X-TARGETDURATION:6\n"
+        "#EXT-X-KEY:METHOD=NONE\n"
+        "#EXTINF:6.0,\n"
+        "http://cdn.example.com/a/0.aac\n"
+        "#EXTINF:3.5,\n"
+        "http://cdn.example.com/a/1.aac\n"
+        "#EXT-X-ENDLIST\n";
+
+static const char encrypted[] =
+        "#EXTM3U\n"
+        "#EXT-X-TARGETDURATION:6\n"
+        "#EXT-X-KEY:METHOD=AES-128,URI=\"key.bin\",IV=0x1\n"
+        "#EXTINF:6.0,\n"
+        "0.ts\n";
+
+static const char fmp4[] =
+        "#EXTM3U\n"
+        "#EXT-X-TARGETDURATION:6\n"
+        "#EXT-X-MAP:URI=\"init.mp4\"\n"
+        "#EXTINF:6.0,\n"
+        "0.m4s\n";
+
+// a plain m3u lists streams, it is no HLS
+static const char plain[] =
+        "#EXTM3U\n"
+        "#EXTINF:-1,Radio\n"
+        "http://radio.example.com:8000/stream.mp3\n";
+
+static void masters(void)
+{
+    m3u8_t pl;
+
+    CHECK(m3u8_parse(audio_variants, 0, &pl));
+    CHECK(pl.master);
+    CHECK(strcmp(pl.uri, "mid/index.m3u8") == 0);
+    CHECK(pl.bandwidth == 320000);
+
+    CHECK(m3u8_parse(fast_variants, 0, &pl));
+    CHECK(strcmp(pl.uri, "b.m3u8") == 0);
+    CHECK(pl.bandwidth == 600000);
+
+    CHECK(m3u8_parse(mixed_variants, 0, &pl));
+    CHECK(strcmp(pl.uri, "a96.m3u8") == 0);
+
+    CHECK(m3u8_parse(video_variants, 0, &pl));
+    CHECK(pl.master);
+    CHECK(strcmp(pl.uri, "en/a.m3u8") == 0);
+    CHECK(pl.bandwidth == 0);
+    // the rendition was parked in the segment list
+    CHECK(pl.count == 0 && pl.seg[0].uri[0] == 0);
+}
+
+static void media(void)
+{
+    m3u8_t pl;
+
+    CHECK(m3u8_parse(live, 0, &pl));
+    CHECK(!pl.master && !pl.endlist && !pl.unsupported);
+    CHECK(pl.target_ms == 10000);
+    CHECK(pl.first_seq == 4711 && pl.last_seq == 4718);
+    CHECK(pl.count == M3U8_SEGMENTS);
+    CHECK(pl.seg[0].seq == 4711 && pl.seg[0].duration_ms == 9984);
+    CHECK(strcmp(pl.seg[0].uri, "seg4711.ts") == 0);
+    CHECK(pl.seg[1].duration_ms == 10005 && !pl.seg[1].discontinuity);
+    CHECK(pl.seg[2].duration_ms == 6000 && pl.seg[2].discontinuity);
+    CHECK(!pl.seg[3].discontinuity);
+
+    // from the live edge on, the last segment has no line end
+    CHECK(m3u8_parse(live, 4716, &pl));
+    CHECK(pl.count == 3);
+    CHECK(pl.seg[0].seq == 4716 && pl.seg[2].seq == 4718);
+    CHECK(strcmp(pl.seg[2].uri, "seg4718.ts") == 0);
+
+    // past the end: nothing kept, the sequence numbers still known
+    CHECK(m3u8_parse(live, 5000, &pl));
+    CHECK(pl.count == 0 && pl.first_seq == 4711 && pl.last_seq == 4718);
+
+    CHECK(m3u8_parse(vod, 0, &pl));
+    CHECK(pl.endlist && !pl.unsupported);
+    CHECK(pl.first_seq == 0 && pl.last_seq == 1 && pl.count == 2);
+    CHECK(pl.seg[1].duration_ms == 3500);
+
+    CHECK(m3u8_parse(encrypted, 0, &pl) && pl.unsupported);
+    CHECK(m3u8_parse(fmp4, 0, &pl) && pl.unsupported);
+
+    CHECK(!m3u8_parse(plain, 0, &pl));
+    CHECK(!m3u8_parse("", 0, &pl));
+    CHECK(!m3u8_parse("<html>#EXT-X-TARGETDURATION</html>", 0, &pl));
+}
+
+/* a tokenised URI of len characters */
+static void token_uri(char *out, size_t len, const char *ext)
+{
+    size_t n = snprintf(out, len + 1, "https://cdn.example.com/seg.%s?token=", ext);
+    while (n < len)
+        out[n++] = 'a' + len % 26;
+    out[len] = 0;
+}
+
+/* URIs that do not fit are not cut short: the segment is left without one, the variant passed over */
+static void long_uris(void)
+{
+    static char text[4096];
+    char fits[M3U8_URI_MAX], over[M3U8_URI_MAX + 64];
+    m3u8_t pl;
+
+    token_uri(fits, M3U8_URI_MAX - 1, "ts");
+    token_uri(over, M3U8_URI_MAX, "ts");
+    snprintf(text, sizeof(text),
+             "#EXTM3U\n#EXT-X-TARGETDURATION:10\n#EXT-X-MEDIA-SEQUENCE:7\n"
+             "#EXTINF:10,\nseg7.ts\n#EXTINF:10,\n%s\n#EXTINF:10,\n%s\n#EXTINF:10,\nseg10.ts\n", over, fits);
+    CHECK(m3u8_parse(text, 0, &pl));
+    CHECK(pl.count == 4 && pl.last_seq == 10);
+    CHECK(strcmp(pl.seg[0].uri, "seg7.ts") == 0);
+    CHECK(pl.seg[1].seq == 8 && pl.seg[1].uri[0] == 0);
+    CHECK(strcmp(pl.seg[2].uri, fits) == 0);
+    CHECK(strcmp(pl.seg[3].uri, "seg10.ts") == 0);
+
+    token_uri(over, sizeof(over) - 1, "m3u8");
+    snprintf(text, sizeof(text),
+             "#EXTM3U\n#EXT-X-STREAM-INF:BANDWIDTH=128000\n%s\n#EXT-X-STREAM-INF:BANDWIDTH=64000\nlo.m3u8\n", over);
+    CHECK(m3u8_parse(text, 0, &pl));
+    CHECK(strcmp(pl.uri, "lo.m3u8") == 0 && pl.bandwidth == 64000);
+    // and with no other, there is no playlist to go to
+    snprintf(text, sizeof(text), "#EXTM3U\n#EXT-X-STREAM-INF:BANDWIDTH=128000\n%s\n", over);
+    CHECK(!m3u8_parse(text, 0, &pl));
+}
+
+static void resolve(const char *base, const char *ref, size_t size, const char *want)
+{
+    char out[M3U8_URI_MAX];
+    bool ok = m3u8_resolve(base, ref, out, size);
+
+    if (want == NULL ? ok : (!ok || strcmp(out, want) != 0)) {
+        printf("%s + %s: %s, expected %s\n", base, ref, ok ? out : "(fails)", want ? want : "(fails)");
+        failed = 1;
+    }
+}
+
+static void urls(void)
+{
+    const char *base = "http://cdn.example.com:8080/live/radio/index.m3u8?token=a/b";
+
+    resolve(base, "seg1.ts", M3U8_URI_MAX, "http://cdn.example.com:8080/live/radio/seg1.ts");
+    resolve(base, "../hi/index.m3u8", M3U8_URI_MAX, "http://cdn.example.com:8080/live/radio/../hi/index.m3u8");
+    resolve(base, "/abs/seg1.ts", M3U8_URI_MAX, "http://cdn.example.com:8080/abs/seg1.ts");
+    resolve(base, "//other.example.com/seg1.ts", M3U8_URI_MAX, "http://other.example.com/seg1.ts");
+    resolve(base, "https://other.example.com/x.ts", M3U8_URI_MAX, "https://other.example.com/x.ts");
+    resolve("http://radio.example.com", "seg1.ts", M3U8_URI_MAX, "http://radio.example.com/seg1.ts");
+    resolve("http://radio.example.com", "/seg1.ts", M3U8_URI_MAX, "http://radio.example.com/seg1.ts");
+    resolve("http://radio.example.com/a/", "seg1.ts", M3U8_URI_MAX, "http://radio.example.com/a/seg1.ts");
+    // what does not fit fails, what just fits does not
+    resolve("http://h/a/b.m3u8", "seg1.ts", 18, NULL);
+    resolve("http://h/a/b.m3u8", "seg1.ts", 19, "http://h/a/seg1.ts");
+    resolve("http://h", "seg1.ts", 16, NULL);
+    resolve("http://h", "seg1.ts", 17, "http://h/seg1.ts");
+}
+
+int main(void)
+{
+    masters();
+    media();
+    long_uris();
+    urls();
+    if (!failed)
+        printf("m3u8 ok\n");
+    return failed;
+}
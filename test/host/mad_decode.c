@@ -0,0 +1,375 @@
+/*
+ * mad_decode.c
+ *
+ *  Decodes MPEG audio files with components/mad as the firmware builds it
+ *  and prints, per file, the frames, the recoverable errors, the FNV-1a 64
+ *  hash of the 16 bit PCM the renderer would get, and the decode time per
+ *  frame, the best of the runs.
+ *
+ *    mad_decode [-i] [-s] [-b bytes] [-r runs] [-x hash] [-w pcm | -c pcm [-m dB]] [-e rate,seed[,burst]] file...
+ *
+ *  -i reads the Layer III main data in place (MAD_OPTION_INPLACEMD), -b
+ *  hands the decoder windows of that many bytes, each starting at the next
+ *  frame of the last one, like mp3_decoder peeks the fifo. -s runs the
+ *  frame sync of common_frame.c ahead of MAD as mp3_decoder does, and
+ *  starts the next window where it asks for more data. -x
+ *  fails unless every file hashes to the given value. -w writes the PCM of
+ *  the last file, -c compares the PCM with such a file and prints the PSNR,
+ *  -m fails below that PSNR. -e flips ERROR_BITS bits behind the header of
+ *  rate percent of the frames, or of bursts of that many frames, drawn
+ *  from seed, and has the frames MAD cannot decode concealed as
+ *  mp3_decoder does. It fails unless the counters of common_conceal.c tell
+ *  the runs of lost frames as they were and, with -c, unless the output is
+ *  as long as the reference and at most two frame edges in three lost
+ *  frames step more than STEP_LIMIT beyond the reference's.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "check.h"
+#include "common_conceal.h"
+#include "common_frame.h"
+#include "mad.h"
+#include "synth.h"
+
+/* the decoder's static reservoir buffer, from layer3.h */
+extern main_data_t MainData;
+
+/*
+ * Zeroes behind the guard: on corrupt frames layers I and II read as many
+ * samples as the allocation asks for, past the end of the frame. In the
+ * firmware more of the fifo follows.
+ */
+#define SLACK 8192
+
+/* as mp3_decoder's */
+#define SYNC_WINDOW (3 * 1024)
+
+/* bits flipped in a damaged frame, within its first ERROR_SPAN bytes */
+#define ERROR_BITS 24
+#define ERROR_SPAN 100
+/* a frame edge stepping that much more than the reference's is heard as a click */
+#define STEP_LIMIT 4096
+
+#define FNV_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+static frame_sync_t frame_sync;
+static uint64_t hash;
+static unsigned long samples;
+static FILE *pcm_out;
+// reference PCM and the squared error against it
+static short *ref;
+static size_t ref_len, ref_pos;
+static double ref_err;
+// -e: the concealment and the frame edges that click against the reference
+static bool concealing;
+static conceal_t conceal;
+static short conceal_pcm[1152 * 2];
+static short edge[2];
+static unsigned long steps;
+// the runs of lost frames as the decode saw them: length of the current one, ended ones, frames beyond CONCEAL_MAX_RUN
+static unsigned long lost_run, lost_runs, lost_beyond;
+
+static void hash_pcm(const short *pcm, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        hash ^= (uint16_t)pcm[i];
+        hash *= FNV_PRIME;
+    }
+    if (pcm_out != NULL)
+        fwrite(pcm, sizeof(short), n, pcm_out);
+    for (size_t i = 0; i < n && ref_pos < ref_len; i++, ref_pos++) {
+        double d = pcm[i] - ref[ref_pos];
+        ref_err += d * d;
+    }
+}
+
+/* count a step from the last frame into pcm far beyond the reference's */
+static void frame_edge(const short *pcm, size_t n, unsigned nch)
+{
+    if (ref != NULL && ref_pos > 0 && ref_pos + nch <= ref_len && nch <= 2) {
+        for (unsigned ch = 0; ch < nch; ch++) {
+            int step = abs(pcm[ch] - edge[ch]), ref_step = abs(ref[ref_pos + ch] - ref[ref_pos - nch + ch]);
+            if (step - ref_step > STEP_LIMIT) {
+                steps++;
+                break;
+            }
+        }
+    }
+    if (nch <= 2)
+        memcpy(edge, &pcm[n - nch], nch * sizeof(short));
+}
+
+/* the renderer callbacks of synth.h */
+void render_sample_block(short *sample_buff, int num_samples, unsigned int num_channels)
+{
+    if (concealing) {
+        lost_runs += (lost_run > 0);
+        lost_run = 0;
+        conceal_good(&conceal, sample_buff, num_samples, num_channels);
+        frame_edge(sample_buff, (size_t)num_samples * num_channels, num_channels);
+    }
+    hash_pcm(sample_buff, (size_t)num_samples * num_channels);
+    samples += num_samples;
+}
+
+void render_sample_block_mono(short *short_sample_buff, int no_samples)
+{
+    hash_pcm(short_sample_buff, no_samples);
+    samples += no_samples;
+}
+
+void set_dac_sample_rate(int rate)
+{
+}
+
+/* mp3_decoder's sync_scan: -1 if the window ends before the frame is certain */
+static int sync_scan(struct mad_stream *stream)
+{
+    size_t pos;
+    frame_sync_result_t ret = frame_sync_scan(&frame_sync, stream->next_frame, stream->bufend - stream->next_frame,
+            SYNC_WINDOW, &pos);
+
+    stream->next_frame += pos;
+    if (frame_sync.off)
+        return 0;
+    if (ret == FRAME_SYNC_GAP) {
+        stream->sync = 0;
+        stream->md_len = 0;
+    }
+    return (ret == FRAME_SYNC_MORE) ? -1 : 0;
+}
+
+/* flip bits in bursts starting at rate percent of the frames after the first, the headers left alone */
+static unsigned long damage(unsigned char *p, size_t len, double rate, unsigned burst)
+{
+    frame_header_t hdr;
+    unsigned long damaged = 0;
+    unsigned left = 0;
+
+    for (size_t pos = 0; pos + FRAME_HEADER_SIZE <= len && frame_header_parse(p + pos, &hdr); pos += hdr.frame_len) {
+        size_t span = (hdr.frame_len < ERROR_SPAN) ? hdr.frame_len : ERROR_SPAN;
+        if (left == 0 && pos > 0 && rnd() % 10000 < rate * 100)
+            left = burst;
+        if (left == 0 || pos + span > len)
+            continue;
+        left--;
+        for (int i = 0; i < ERROR_BITS; i++)
+            p[pos + FRAME_HEADER_SIZE + rnd() % (span - FRAME_HEADER_SIZE)] ^= 1 << (rnd() % 8);
+        damaged++;
+    }
+    return damaged;
+}
+
+static unsigned char *load(const char *path, size_t *len)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        perror(path);
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    *len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    // the guard libmad wants behind the last frame
+    unsigned char *buf = calloc(1, *len + MAD_BUFFER_GUARD + SLACK);
+    if (buf != NULL && fread(buf, 1, *len, f) != *len) {
+        free(buf);
+        buf = NULL;
+    }
+    fclose(f);
+    return buf;
+}
+
+#define USAGE "usage: %s [-i] [-s] [-b bytes] [-r runs] [-x hash] [-w pcm | -c pcm [-m dB]] [-e rate,seed[,burst]] file...\n"
+
+int main(int argc, char **argv)
+{
+    int opt, runs = 1, options = 0, sync = 0, failed = 0;
+    size_t window = 0;
+    const char *expect = NULL, *write = NULL, *compare = NULL;
+    double min_psnr = 0, error_rate = 0;
+    unsigned seed = 0, burst = 1;
+
+    while ((opt = getopt(argc, argv, "isb:r:x:w:c:m:e:")) != -1) {
+        switch (opt) {
+            case 'i':
+                options |= MAD_OPTION_INPLACEMD;
+                break;
+            case 's':
+                sync = 1;
+                break;
+            case 'b':
+                window = strtoul(optarg, NULL, 0);
+                break;
+            case 'r':
+                runs = atoi(optarg);
+                break;
+            case 'x':
+                expect = optarg;
+                break;
+            case 'w':
+                write = optarg;
+                break;
+            case 'c':
+                compare = optarg;
+                break;
+            case 'm':
+                min_psnr = atof(optarg);
+                break;
+            case 'e':
+                if (sscanf(optarg, "%lf,%u,%u", &error_rate, &seed, &burst) < 2 || burst < 1) {
+                    fprintf(stderr, USAGE, argv[0]);
+                    return 2;
+                }
+                concealing = true;
+                break;
+            default:
+                fprintf(stderr, USAGE, argv[0]);
+                return 2;
+        }
+    }
+    if (optind == argc || runs < 1 || (write && compare)) {
+        fprintf(stderr, USAGE, argv[0]);
+        return 2;
+    }
+    if (compare != NULL) {
+        size_t len;
+        ref = (short *)load(compare, &len);
+        if (ref == NULL)
+            return 2;
+        ref_len = len / sizeof(short);
+    }
+
+    for (int a = optind; a < argc; a++) {
+        size_t len;
+        unsigned char *orig = load(argv[a], &len);
+        unsigned char *buf = malloc(len + MAD_BUFFER_GUARD + SLACK);
+        if (orig == NULL || buf == NULL)
+            return 2;
+        unsigned long damaged = 0;
+        if (concealing) {
+            rnd_seed(seed);
+            damaged = damage(orig, len, error_rate, burst);
+        }
+
+        unsigned long frames = 0, errors = 0, lost = 0;
+        double best = 0;
+        for (int run = 0; run < runs; run++) {
+            struct mad_stream stream;
+            struct mad_frame frame;
+            struct mad_synth synth;
+
+            // in place decoding may write the buffer, and the count1
+            // decode peeks past main_data into what the last run left
+            memcpy(buf, orig, len + MAD_BUFFER_GUARD + SLACK);
+            memset(MainData, 0, sizeof(MainData));
+            mad_stream_init(&stream);
+            mad_frame_init(&frame);
+            mad_synth_init(&synth);
+            mad_stream_options(&stream, options);
+            hash = FNV_BASIS;
+            memset(&frame_sync, 0, sizeof(frame_sync));
+            memset(&conceal, 0, sizeof(conceal));
+            samples = frames = errors = lost = steps = 0;
+            lost_run = lost_runs = lost_beyond = 0;
+            ref_pos = 0;
+            ref_err = 0;
+            if (write != NULL && run == runs - 1 && a == argc - 1) {
+                pcm_out = fopen(write, "wb");
+                if (pcm_out == NULL) {
+                    perror(write);
+                    return 2;
+                }
+            }
+
+            double start = now();
+            size_t pos = 0, end = len + MAD_BUFFER_GUARD;
+            for (;;) {
+                size_t n = (window && end - pos > window) ? window : end - pos;
+                mad_stream_buffer(&stream, buf + pos, n);
+                int more = 0;
+                for (;;) {
+                    if (sync && !frame_sync.off
+                            && !frame_sync_locked(&frame_sync, stream.next_frame, stream.bufend - stream.next_frame)
+                            && (more = sync_scan(&stream)) < 0)
+                        break;
+                    if (mad_frame_decode(&frame, &stream) == -1) {
+                        if (!MAD_RECOVERABLE(stream.error))
+                            break;
+                        errors++;
+                        // as mp3_decoder: the header was good, the frame's slot is filled
+                        if (concealing && (stream.error & 0xff00) == 0x0200) {
+                            lost++;
+                            lost_beyond += (lost_run++ >= CONCEAL_MAX_RUN);
+                            if (conceal_lost(&conceal, synth.pcm.samples, conceal_pcm, synth.pcm.length,
+                                             synth.pcm.channels)) {
+                                size_t n = (size_t)synth.pcm.length * synth.pcm.channels;
+                                frame_edge(conceal_pcm, n, synth.pcm.channels);
+                                hash_pcm(conceal_pcm, n);
+                                samples += synth.pcm.length;
+                            }
+                        }
+                        continue;
+                    }
+                    mad_synth_frame(&synth, &frame);
+                    frames++;
+                }
+                // the last window, or a frame longer than a window
+                size_t used = stream.next_frame - (buf + pos);
+                if (n == end - pos || (stream.error != MAD_ERROR_BUFLEN && !more) || used == 0)
+                    break;
+                pos += used;
+            }
+            double t = now() - start;
+            if (run == 0 || t < best)
+                best = t;
+
+            mad_synth_finish(&synth);
+            mad_frame_finish(&frame);
+            mad_stream_finish(&stream);
+            if (pcm_out != NULL) {
+                fclose(pcm_out);
+                pcm_out = NULL;
+            }
+        }
+
+        char hex[17];
+        snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)hash);
+        printf("%-24s frames %6lu errors %5lu samples %8lu hash %s %8.2f us/frame\n",
+               argv[a], frames, errors, samples, hex, frames ? best * 1e6 / frames : 0);
+        if (expect != NULL && strcmp(expect, hex) != 0) {
+            fprintf(stderr, "%s: hash %s, expected %s\n", argv[a], hex, expect);
+            failed = 1;
+        }
+        if (concealing) {
+            printf("%-24s %lu damaged, %lu lost: %u concealed, %u muted, %u recovered, %lu steps\n",
+                   argv[a], damaged, lost, conceal.concealed, conceal.muted, conceal.recovered, steps);
+            // a faded repeat for the first lost frames of a run, silence beyond, a crossfade out of each
+            if (conceal.concealed != lost - lost_beyond || conceal.muted != lost_beyond
+                    || conceal.recovered != lost_runs || steps * 3 > lost * 2) {
+                fprintf(stderr, "%s: concealment does not add up\n", argv[a]);
+                failed = 1;
+            }
+        }
+        if (ref != NULL) {
+            // over the samples both have, a length mismatch fails on its own
+            double psnr = ref_err ? 10 * log10(32767.0 * 32767.0 * ref_pos / ref_err) : INFINITY;
+            printf("%-24s PSNR %.1f dB against %s\n", argv[a], psnr, compare);
+            if (ref_pos != ref_len || ref_pos == 0 || psnr < min_psnr) {
+                fprintf(stderr, "%s: %zu of %zu reference samples, PSNR %.1f dB, at least %.1f wanted\n",
+                        argv[a], ref_pos, ref_len, psnr, min_psnr);
+                failed = 1;
+            }
+        }
+        free(buf);
+        free(orig);
+    }
+    return failed;
+}
@@ -0,0 +1,587 @@
+/*
+ * mp4_check.c
+ *
+ *  The MP4 demuxer of common_mp4.c as the AAC decoder drives it: the
+ *  stream goes through the fifo in pieces of random size, or of one byte,
+ *  into a buffer_t of the decoder's size, and every access unit that comes
+ *  out must be the next one of the AAC track. The streams are built here:
+ *  progressive, progressive with a video track interleaved and co64 chunk
+ *  offsets, fragmented, and fragmented with a video traf and two truns per
+ *  traf. Also the ways a stream is refused or cut short.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_memory_utils.h"
+#include "spiram_fifo.h"
+#include "common_mp4.h"
+
+/* as fdk_aac_decoder.c */
+#define MP4_INPUT_SIZE 4096
+#define MP4_SAMPLES 4096
+
+#define FILE_LEN (512 * 1024)
+#define SAMPLES 600
+
+static const uint8_t asc[] = { 0x12, 0x10 };
+
+/* the stream being written, and where the AAC access units of it are */
+static uint8_t file[FILE_LEN];
+static size_t wpos;
+static size_t stack[16];
+static int depth;
+static struct { uint32_t offset, size; bool dropped; } au[SAMPLES];
+static unsigned au_count;
+static uint16_t sizes[SAMPLES];
+
+static void u8(uint8_t v)
+{
+    file[wpos++] = v;
+}
+
+static void u16(uint16_t v)
+{
+    u8(v >> 8);
+    u8(v);
+}
+
+static void u32(uint32_t v)
+{
+    u16(v >> 16);
+    u16(v);
+}
+
+static void zeros(size_t n)
+{
+    memset(file + wpos, 0, n);
+    wpos += n;
+}
+
+static void box(const char *type)
+{
+    stack[depth++] = wpos;
+    u32(0);
+    memcpy(file + wpos, type, 4);
+    wpos += 4;
+}
+
+static void full(const char *type, uint8_t version, uint32_t flags)
+{
+    box(type);
+    u32(((uint32_t) version << 24) | flags);
+}
+
+static void end(void)
+{
+    size_t at = stack[--depth];
+    uint32_t size = wpos - at;
+    file[at] = size >> 24;
+    file[at + 1] = size >> 16;
+    file[at + 2] = size >> 8;
+    file[at + 3] = size;
+}
+
+static void put32(size_t at, uint32_t v)
+{
+    size_t keep = wpos;
+    wpos = at;
+    u32(v);
+    wpos = keep;
+}
+
+/* an access unit of the AAC track, or a sample of the video one */
+static void sample(unsigned size, bool audio)
+{
+    if (audio) {
+        au[au_count].offset = wpos;
+        au[au_count].size = size;
+        au[au_count].dropped = size > MP4_INPUT_SIZE;
+        au_count++;
+    }
+    for (unsigned i = 0; i < size; i++)
+        u8(rnd());
+}
+
+static void descriptor(uint8_t tag, uint32_t len, bool long_len)
+{
+    u8(tag);
+    if (long_len) {
+        // the length in four bytes, as some muxers write it
+        u8(0x80 | (len >> 21));
+        u8(0x80 | (len >> 14));
+        u8(0x80 | (len >> 7));
+    }
+    u8(len & 0x7f);
+}
+
+static void esds(bool long_len)
+{
+    unsigned dsi = 2 + (long_len ? 3 : 0) + sizeof(asc);
+    unsigned dcd = 13 + dsi, sl = 3;
+    full("esds", 0, 0);
+    descriptor(0x03, 3 + 2 + (long_len ? 3 : 0) + dcd + sl, long_len);
+    u16(1);
+    u8(0);
+    descriptor(0x04, dcd, long_len);
+    u8(0x40);
+    u8(0x15);
+    zeros(11);
+    descriptor(0x05, sizeof(asc), long_len);
+    memcpy(file + wpos, asc, sizeof(asc));
+    wpos += sizeof(asc);
+    descriptor(0x06, 1, false);
+    u8(2);
+    end();
+}
+
+/* mp4a sample entry, QuickTime version 1 with the esds in a wave box */
+static void mp4a(bool quicktime)
+{
+    box("mp4a");
+    zeros(6);
+    u16(1);
+    u16(quicktime ? 1 : 0);
+    zeros(6);
+    u16(2);
+    u16(16);
+    zeros(4);
+    u32(44100 << 16);
+    if (quicktime) {
+        zeros(16);
+        box("wave");
+        box("frma");
+        memcpy(file + wpos, "mp4a", 4);
+        wpos += 4;
+        end();
+        esds(true);
+        end();
+    } else {
+        esds(false);
+    }
+    end();
+}
+
+static void tkhd(uint32_t id)
+{
+    full("tkhd", 0, 7);
+    zeros(8);
+    u32(id);
+    zeros(68);
+    end();
+}
+
+static void hdlr(const char *type)
+{
+    full("hdlr", 0, 0);
+    zeros(4);
+    memcpy(file + wpos, type, 4);
+    wpos += 4;
+    zeros(13);
+    end();
+}
+
+/* trak up to its stbl, the stbl left open */
+static void trak_start(uint32_t id, bool audio, const char *codec, bool quicktime)
+{
+    box("trak");
+    tkhd(id);
+    box("mdia");
+    full("mdhd", 0, 0);
+    zeros(20);
+    end();
+    hdlr(audio ? "soun" : "vide");
+    box("minf");
+    full(audio ? "smhd" : "vmhd", 0, 0);
+    zeros(audio ? 4 : 8);
+    end();
+    box("dinf");
+    end();
+    box("stbl");
+    full("stsd", 0, 0);
+    u32(1);
+    if (strcmp(codec, "mp4a") == 0) {
+        mp4a(quicktime);
+    } else {
+        box(codec);
+        zeros(78);
+        end();
+    }
+    end();
+}
+
+static void trak_end(void)
+{
+    end();      // stbl
+    end();      // minf
+    end();      // mdia
+    end();      // trak
+}
+
+static void ftyp(const char *brand)
+{
+    box("ftyp");
+    memcpy(file + wpos, brand, 4);
+    wpos += 4;
+    u32(0);
+    memcpy(file + wpos, "isomiso2mp41", 12);
+    wpos += 12;
+    end();
+}
+
+typedef struct
+{
+    bool video;         /* a video trak ahead of the audio, its chunks between the audio ones */
+    bool co64;
+    bool quicktime;
+    bool moov_last;
+    const char *codec;
+    unsigned big;       /* that sample, from 1, does not fit the buffer */
+} progressive_t;
+
+/*
+ * Audio in chunks of 1 to 12 samples, per stsc entry. The chunk offsets
+ * are only known once the moov is written: it is written twice.
+ */
+static void progressive(const progressive_t *o, unsigned samples)
+{
+    static uint32_t chunks[SAMPLES];
+    static uint32_t per_chunk[SAMPLES];
+    unsigned nchunks = 0;
+
+    for (unsigned n = 0; n < samples; nchunks++) {
+        // a few stsc entries, each for a run of chunks
+        per_chunk[nchunks] = (nchunks < 4 || nchunks % 7 != 0) ? 10 : 1 + rnd() % 12;
+        if (n + per_chunk[nchunks] > samples)
+            per_chunk[nchunks] = samples - n;
+        n += per_chunk[nchunks];
+    }
+    for (unsigned i = 0; i < samples; i++)
+        sizes[i] = 100 + rnd() % 600;
+    if (o->big)
+        sizes[o->big - 1] = MP4_INPUT_SIZE + 1;
+
+    for (int pass = 0; pass < 2; pass++) {
+        wpos = 0;
+        au_count = 0;
+        ftyp("M4A ");
+        if (o->moov_last) {
+            box("mdat");
+            for (unsigned i = 0; i < samples; i++)
+                sample(sizes[i], true);
+            end();
+        }
+        box("moov");
+        full("mvhd", 0, 0);
+        zeros(96);
+        end();
+        if (o->video) {
+            trak_start(1, false, "avc1", false);
+            full("stsz", 0, 0);
+            u32(2000);
+            u32(nchunks);
+            end();
+            trak_end();
+        }
+        trak_start(2, true, o->codec, o->quicktime);
+        full("stts", 0, 0);
+        u32(1);
+        u32(samples);
+        u32(1024);
+        end();
+        // an entry where the chunk size changes
+        full("stsc", 0, 0);
+        size_t count_at = wpos;
+        u32(0);
+        unsigned entries = 0;
+        for (unsigned c = 0; c < nchunks; c++) {
+            if (c == 0 || per_chunk[c] != per_chunk[c - 1]) {
+                u32(c + 1);
+                u32(per_chunk[c]);
+                u32(1);
+                entries++;
+            }
+        }
+        put32(count_at, entries);
+        end();
+        full("stsz", 0, 0);
+        u32(0);
+        u32(samples);
+        for (unsigned i = 0; i < samples; i++)
+            u32(sizes[i]);
+        end();
+        full(o->co64 ? "co64" : "stco", 0, 0);
+        u32(nchunks);
+        for (unsigned c = 0; c < nchunks; c++) {
+            if (o->co64)
+                u32(0);
+            u32(chunks[c]);
+        }
+        end();
+        trak_end();
+        box("udta");
+        zeros(40);
+        end();
+        end();
+        if (!o->moov_last) {
+            box("mdat");
+            unsigned n = 0;
+            for (unsigned c = 0; c < nchunks; c++) {
+                chunks[c] = wpos;
+                for (unsigned i = 0; i < per_chunk[c]; i++, n++)
+                    sample(sizes[n], true);
+                if (o->video)
+                    sample(2000, false);
+            }
+            end();
+        }
+    }
+}
+
+/* trun flags */
+#define DATA_OFFSET 0x001
+#define DURATION 0x100
+#define SIZE 0x200
+
+/* trun of n samples of the sizes in s, the place of its data offset in *offset_at */
+static void trun(uint32_t flags, const uint16_t *s, unsigned n, size_t *offset_at)
+{
+    full("trun", 0, flags);
+    u32(n);
+    if (flags & DATA_OFFSET) {
+        *offset_at = wpos;
+        u32(0);
+    }
+    for (unsigned i = 0; i < n; i++) {
+        if (flags & DURATION)
+            u32(1024);
+        if (flags & SIZE)
+            u32(s[i]);
+    }
+    end();
+}
+
+/*
+ * Fragments of 20 samples: the sizes in the trun, the default of the tfhd
+ * or of the trex, a base data offset, a video traf ahead of the audio one
+ * and the audio in two truns, the second one without a data offset.
+ */
+static void fragmented(bool video, unsigned samples)
+{
+    const uint32_t default_size = 333;
+    wpos = 0;
+    au_count = 0;
+    ftyp("iso6");
+    box("moov");
+    full("mvhd", 0, 0);
+    zeros(96);
+    end();
+    trak_start(1, true, "mp4a", false);
+    full("stsz", 0, 0);
+    u32(0);
+    u32(0);
+    end();
+    full("stco", 0, 0);
+    u32(0);
+    end();
+    trak_end();
+    box("mvex");
+    full("trex", 0, 0);
+    u32(1);
+    u32(1);
+    u32(1024);
+    u32(default_size);
+    u32(0);
+    end();
+    end();
+    end();
+
+    for (unsigned f = 0, n = 0; n < samples; f++) {
+        unsigned count = (samples - n < 20) ? samples - n : 20;
+        int kind = f % 4;  // 0 sizes, 1 tfhd default, 2 trex default, 3 base offset
+        uint16_t s[20];
+        for (unsigned i = 0; i < count; i++)
+            s[i] = (kind == 1) ? 444 : (kind == 2) ? default_size : 100 + rnd() % 600;
+
+        size_t moof = wpos, offset_at[3] = { 0 }, base_at = 0;
+        box("moof");
+        full("mfhd", 0, 0);
+        u32(f + 1);
+        end();
+        if (video) {
+            box("traf");
+            full("tfhd", 0, 0x020000);
+            u32(2);
+            end();
+            uint16_t v = 1500;
+            trun(DATA_OFFSET | SIZE, &v, 1, &offset_at[2]);
+            end();
+        }
+        box("traf");
+        if (kind == 1) {
+            full("tfhd", 0, 0x020000 | 0x10);
+            u32(1);
+            u32(444);
+        } else if (kind == 3) {
+            full("tfhd", 0, 0x01);
+            u32(1);
+            base_at = wpos;
+            u32(0);
+            u32(0);
+        } else {
+            full("tfhd", 0, 0x020000);
+            u32(1);
+        }
+        end();
+        full("tfdt", 0, 0);
+        u32(f * 20 * 1024);
+        end();
+        // no per sample fields at all with the default size of the tfhd
+        uint32_t flags = (kind == 0 || kind == 3) ? DURATION | SIZE : (kind == 2) ? DURATION : 0;
+        unsigned first = video ? count / 2 : count;
+        trun(DATA_OFFSET | flags, s, first, &offset_at[0]);
+        if (first < count)
+            trun(flags, s + first, count - first, NULL);
+        end();
+        end();
+
+        box("mdat");
+        size_t data = wpos;
+        if (video) {
+            put32(offset_at[2], data - moof);
+            sample(1500, false);
+        }
+        if (kind == 3) {
+            put32(base_at + 4, wpos);
+            put32(offset_at[0], 0);
+        } else {
+            put32(offset_at[0], wpos - moof);
+        }
+        for (unsigned i = 0; i < count; i++)
+            sample(s[i], true);
+        end();
+        n += count;
+    }
+}
+
+/* the stream through the fifo in pieces of 1 to max bytes, as mp4_feed() reads it */
+static mp4_result_t demux(mp4_t *m, buffer_t *buf, const uint8_t *p, size_t len, unsigned max, unsigned *got)
+{
+    size_t written = 0;
+    unsigned next = 0;
+    uint8_t *data;
+    uint32_t data_len;
+    bool config = false;
+
+    spiRamFifoReset();
+    mp4_reset(m);
+    buf_clear(buf);
+    *got = 0;
+    while (1) {
+        switch (mp4_next(m, buf, &data, &data_len)) {
+        case MP4_SAMPLE:
+            while (next < au_count && au[next].dropped)
+                next++;
+            if (!config || next >= au_count || data_len != au[next].size
+                    || memcmp(data, file + au[next].offset, data_len) != 0) {
+                printf("access unit %u of %u bytes is not the one of the stream\n", next, data_len);
+                return MP4_ERROR;
+            }
+            next++;
+            (*got)++;
+            break;
+        case MP4_CONFIG:
+            config = m->asc_len == sizeof(asc) && memcmp(m->asc, asc, sizeof(asc)) == 0;
+            if (!config)
+                printf("config of %u bytes is not the one of the stream\n", m->asc_len);
+            break;
+        case MP4_MORE:
+            if (fill_read_buffer(buf) > 0)
+                break;
+            if (written == len)
+                return MP4_MORE;
+            size_t n = 1 + rnd() % max;
+            if (n > len - written)
+                n = len - written;
+            spiRamFifoWrite((const char *) p + written, n);
+            written += n;
+            break;
+        case MP4_ERROR:
+            return MP4_ERROR;
+        }
+    }
+}
+
+static void check(const char *what, mp4_t *m, buffer_t *buf, unsigned expect)
+{
+    static const unsigned pieces[] = { 1, 100, 1500, 8192 };
+
+    for (int i = 0; i < sizeof(pieces) / sizeof(pieces[0]); i++) {
+        unsigned got;
+        mp4_result_t res = demux(m, buf, file, wpos, pieces[i], &got);
+        printf("%-32s in pieces of %4u: %u of %u access units, %u dropped, %u fragments\n", what, pieces[i],
+                got, au_count, (unsigned) m->dropped, (unsigned) m->fragments);
+        if (res != MP4_MORE || got != expect || m->dropped != au_count - expect) {
+            printf("  FAIL\n");
+            failed = 1;
+        }
+    }
+}
+
+static void refused(const char *what, mp4_t *m, buffer_t *buf)
+{
+    unsigned got;
+    mp4_result_t res = demux(m, buf, file, wpos, 1500, &got);
+    printf("%-32s refused: %s\n", what, (res == MP4_ERROR && got == 0) ? "yes" : "no");
+    if (res != MP4_ERROR || got != 0)
+        failed = 1;
+}
+
+int main(void)
+{
+    mp4_t m;
+    buffer_t *buf = buf_create(MP4_INPUT_SIZE);
+
+    host_external_ram = false;
+    setSPIRAMSIZE(64 * 1024);
+    spiRamFifoInit();
+    mp4_open(&m, MP4_SAMPLES);
+
+    progressive(&(progressive_t) { .codec = "mp4a" }, SAMPLES);
+    check("progressive", &m, buf, au_count);
+    CHECK(m.run_count == 1);
+    progressive(&(progressive_t) { .codec = "mp4a", .video = true, .co64 = true, .quicktime = true }, SAMPLES);
+    check("interleaved, co64, QuickTime", &m, buf, au_count);
+    CHECK(m.run_count > 50);
+    fragmented(false, SAMPLES);
+    check("fragmented", &m, buf, au_count);
+    CHECK(m.fragments == 30);
+    fragmented(true, SAMPLES);
+    check("fragmented, video traf", &m, buf, au_count);
+
+    // samples past the limit of the sizes kept are dropped
+    mp4_close(&m);
+    mp4_open(&m, 250);
+    progressive(&(progressive_t) { .codec = "mp4a" }, SAMPLES);
+    check("progressive, 250 sizes kept", &m, buf, 250);
+    mp4_close(&m);
+    mp4_open(&m, MP4_SAMPLES);
+
+    // an access unit bigger than the buffer is dropped, the rest plays
+    progressive(&(progressive_t) { .codec = "mp4a", .big = 8 }, 20);
+    check("an access unit too big", &m, buf, 19);
+
+    progressive(&(progressive_t) { .codec = "mp4a", .moov_last = true }, 50);
+    refused("moov after the mdat", &m, buf);
+    progressive(&(progressive_t) { .codec = "ac-3" }, 50);
+    refused("no AAC track", &m, buf);
+
+    mp4_close(&m);
+    buf_destroy(buf);
+    spiRamFifoDestroy();
+    printf(failed ? "FAIL\n" : "OK\n");
+    return failed;
+}
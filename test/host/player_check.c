@@ -0,0 +1,171 @@
+/*
+ * player_check.c
+ *
+ *  audio_player.c between the network side and its decoder workers, over
+ *  the audio fifo. Streams alternate between MP3 and AAC, each one stopped
+ *  as soon as its decoder was started or a few chunks later, the next one
+ *  started right after the stop. The workers here do what mp3_decoder.c
+ *  and fdk_aac_decoder.c do around a stream. No worker may read a stream
+ *  other than the one it was started for, only one may be in a stream at a
+ *  time, and the fifo reset a worker leaves its stream with must come
+ *  before the next start. A worker stopping the player itself, as the
+ *  renderer does on an output error, must not wait for itself.
+ *
+ *    player_check
+ */
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "check.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "audio_player.h"
+#include "spiram_fifo.h"
+
+#define ROUNDS 40
+#define CHUNK 1024
+/* the pre-roll of BUF_PREF_FAST at 128 kbit/s, in chunks */
+#define PREROLL_CHUNKS 8
+/* a worker decoding and rendering a frame, us */
+#define FRAME_US 2000
+/* every that many rounds the worker stops the player itself */
+#define SELF_STOP 5
+
+static media_stream_t media;
+static player_t player = { .media_stream = &media, .buffer_pref = BUF_PREF_FAST };
+
+/* the stream audio_player_start() returned for */
+static atomic_int started;
+static atomic_int inside, most_inside, foreign, late_resets, self_stops, self_stopped;
+
+/* the decoder worker of mp3_decoder.c and fdk_aac_decoder.c: a stream per
+ * notification, read until CMD_STOP or eof, the fifo reset on the way out,
+ * STOPPED last */
+static void worker(void *param)
+{
+    player_t *p = param;
+
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        int id = started, n = ++inside;
+        if (n > most_inside)
+            most_inside = n;
+        // once: the decoder restarts on the data that keeps coming
+        if (id % SELF_STOP == 0 && self_stopped != id) {
+            int64_t t = esp_timer_get_time();
+            audio_player_stop();
+            CHECK(esp_timer_get_time() - t < 100000);
+            self_stops++;
+            self_stopped = id;
+        }
+
+        while (p->decoder_command != CMD_STOP) {
+            char *data;
+            unsigned len;
+            if (spiRamFifoWaitFill(1, 10) == 0) {
+                if (p->media_stream->eof)
+                    break;
+                continue;
+            }
+            spiRamFifoPeek(&data, &len);
+            for (unsigned i = 0; i < len; i++) {
+                if (data[i] != (char)id) {
+                    foreign++;
+                    break;
+                }
+            }
+            spiRamFifoCommit(len);
+            usleep(FRAME_US);
+        }
+
+        inside--;
+        spiRamFifoReset();
+        late_resets += (started != id);
+        p->decoder_command = CMD_NONE;
+        p->decoder_status = STOPPED;
+    }
+}
+
+void mp3_decoder_task(void *pvParameters)
+{
+    worker(pvParameters);
+}
+
+void fdkaac_decoder_task(void *pvParameters)
+{
+    worker(pvParameters);
+}
+
+void vsTask(void *pvParams)
+{
+    worker(pvParams);
+}
+
+/* what the player takes from main and the renderer */
+output_mode_t get_audio_output_mode()
+{
+    return I2S;
+}
+
+bool bigSram()
+{
+    return true;
+}
+
+void clientDisconnect(const char *from)
+{
+}
+
+void clientSilentDisconnect()
+{
+}
+
+void renderer_start()
+{
+}
+
+void renderer_stop()
+{
+}
+
+int main(void)
+{
+    static char chunk[CHUNK];
+
+    setSPIRAMSIZE(64 * 1024);
+    spiRamFifoInit();
+    audio_player_init(&player);
+
+    for (int round = 1; round <= ROUNDS; round++) {
+        media.content_type = (round % 2) ? AUDIO_MPEG : AUDIO_AAC;
+        media.bitrate = 128;
+        audio_player_start();
+        started = round;
+        memset(chunk, round, sizeof(chunk));
+        // the pre-roll, then none to three chunks more: stopped before, as and after the worker takes it
+        int chunks = 0;
+        while (player.decoder_status != RUNNING || chunks < PREROLL_CHUNKS + round % 4) {
+            audio_stream_consumer(chunk, sizeof(chunk));
+            chunks++;
+        }
+        audio_player_stop();
+        CHECK(player.decoder_status == STOPPED);
+    }
+    // what a worker still in a stream would do next
+    vTaskDelay(50);
+
+    printf("%d streams: at most %d worker in a stream, %d read another's data, %d late fifo resets, %d stopped by the worker\n",
+           ROUNDS, (int)most_inside, (int)foreign, (int)late_resets, (int)self_stops);
+    CHECK(most_inside == 1);
+    CHECK(foreign == 0);
+    CHECK(late_resets == 0);
+    CHECK(self_stops == ROUNDS / SELF_STOP);
+
+    if (!failed)
+        printf("player ok\n");
+    return failed;
+}
@@ -0,0 +1,340 @@
+/*
+ * render_check.c
+ *
+ *  The output conversion of audio_renderer.c through the host I2S channel:
+ *  16 bit PCM in each source layout to the words of each output mode, at
+ *  several volumes and block sizes, against a conversion written out
+ *  sample by sample here. The source must come back as it went in.
+ *
+ *  S/PDIF is checked against the encoder the table driven one replaced,
+ *  a BMC lookup per byte and the fixups per subframe: every 16 bit value
+ *  on both channels, and slices starting anywhere in the 192 frame block.
+ *
+ *  Streams at other rates switch the I2S clock, or are resampled to the
+ *  fixed output rate with the clock left alone.
+ *
+ *    render_check [-b]
+ *
+ *  -b prints the conversion throughput per output and layout instead, in
+ *  million frames per second, the best of 5 runs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "check.h"
+#include "audio_renderer.h"
+#include "audio_resampler.h"
+
+#define MAX_FRAMES 2048
+/* every 16 bit value once */
+#define ALL_FRAMES 65536
+#define SPDIF_BLOCK 192
+
+typedef struct {
+    const char *name;
+    output_mode_t mode;
+    uint8_t bit_depth;
+} output_t;
+
+static const output_t outputs[] = {
+    { "i2s16", I2S, I2S_DATA_BIT_WIDTH_16BIT },
+    { "i2s32", I2S, I2S_DATA_BIT_WIDTH_32BIT },
+    { "dac", DAC_BUILT_IN, I2S_DATA_BIT_WIDTH_16BIT },
+    { "pdm", PDM, I2S_DATA_BIT_WIDTH_16BIT },
+    { "spdif", SPDIF, I2S_DATA_BIT_WIDTH_16BIT },
+};
+
+enum { STEREO, HALVES, MONO };
+static const char *layouts[] = { "stereo", "halves", "mono" };
+
+static renderer_config_t config;
+
+static uint8_t out[ALL_FRAMES * 16];
+
+/* BMC of a byte, the first cell in bit 0: each 1 flips the cells after its middle */
+static uint16_t bmc[256];
+/* frame of the S/PDIF block the reference is at */
+static uint32_t spdif_frame;
+
+static uint16_t volume(int16_t s, uint32_t mult)
+{
+    return ((int32_t)s * mult) >> 16;
+}
+
+static void bmc_init(void)
+{
+    for (int b = 0; b < 256; b++) {
+        uint16_t w = 0xcccc;
+        for (int j = 0; j < 8; j++)
+            if (b & (0x80 >> j))
+                w ^= 0xffff << (2 * j + 1);
+        bmc[b] = w;
+    }
+}
+
+/* one subframe as the former encoder built it */
+static void subframe(uint32_t *p, uint16_t sample, uint32_t preamble)
+{
+    uint16_t hi = bmc[sample >> 8];
+    uint16_t lo = bmc[sample & 0xff];
+    // the low byte inverted when the high one ends low
+    lo ^= ~((int16_t)hi) >> 16;
+    p[0] = ((uint32_t)lo << 16) | hi;
+    // aux bits, the first one the parity, inverted when the low word ends high
+    uint16_t aux = 0xb333 ^ (((uint32_t)(int16_t)lo) >> 17);
+    p[1] = preamble | aux;
+}
+
+/* bytes of a frame on output o */
+static size_t frame_bytes(const output_t *o)
+{
+    if (o->mode == SPDIF)
+        return 16;
+    return (o->mode != DAC_BUILT_IN && o->bit_depth == I2S_DATA_BIT_WIDTH_32BIT) ? 8 : 4;
+}
+
+/* what the output should be: one word of the output mode per frame */
+static size_t expected(uint8_t *p, const output_t *o, int layout, const int16_t *src, uint32_t frames, uint32_t mult)
+{
+    for (uint32_t i = 0; i < frames; i++) {
+        int16_t l = (layout == STEREO) ? src[2 * i] : src[i];
+        int16_t r = (layout == STEREO) ? src[2 * i + 1] : (layout == HALVES) ? src[frames + i] : l;
+        uint16_t vl = volume(l, mult), vr = volume(r, mult);
+        if (o->mode == SPDIF) {
+            uint32_t w[4];
+            subframe(w, vl, (spdif_frame == 0) ? 0xcce80000 : 0xcce20000);
+            subframe(w + 2, vr, 0xcce40000);
+            memcpy(p + 16 * i, w, 16);
+            spdif_frame = (spdif_frame + 1) % SPDIF_BLOCK;
+        } else if (o->mode == DAC_BUILT_IN) {
+            // unsigned, left in the high half
+            uint32_t w = ((uint32_t)(uint16_t)(vl + 0x8000) << 16) | (uint16_t)(vr + 0x8000);
+            memcpy(p + 4 * i, &w, 4);
+        } else if (o->bit_depth == I2S_DATA_BIT_WIDTH_32BIT) {
+            // each sample in the upper half of its slot
+            uint16_t w[4] = { 0, vl, 0, vr };
+            memcpy(p + 8 * i, w, 8);
+        } else {
+            uint16_t w[2] = { vl, vr };
+            memcpy(p + 4 * i, w, 4);
+        }
+    }
+    return frames * frame_bytes(o);
+}
+
+/* a new stream on output o: the S/PDIF block starts over */
+static void output_set(const output_t *o)
+{
+    renderer_stop();
+    config.output_mode = o->mode;
+    config.bit_depth = o->bit_depth;
+    renderer_start();
+    spdif_frame = 0;
+}
+
+static void compare(const char *what, const uint8_t *expect, size_t len)
+{
+    if (host_i2s_len != len || memcmp(out, expect, len) != 0) {
+        size_t i = 0;
+        while (i < host_i2s_len && i < len && out[i] == expect[i])
+            i++;
+        printf("%s: %zu bytes out, %zu expected, first difference at %zu\n", what, host_i2s_len, len, i);
+        failed = 1;
+    }
+    host_i2s_len = 0;
+}
+
+static void render(const int16_t *src, int layout, uint32_t frames, uint32_t rate)
+{
+    pcm_format_t format = {
+        .sample_rate = rate,
+        .bit_depth = I2S_DATA_BIT_WIDTH_16BIT,
+        .num_channels = (layout == MONO) ? 1 : 2,
+        .buffer_format = (layout == HALVES) ? PCM_LEFT_RIGHT : PCM_INTERLEAVED,
+    };
+    render_samples((const char *)src, frames * format.num_channels * sizeof(int16_t), &format);
+}
+
+/* MAX_FRAMES in at stream_rate came out as frames at rate, but for what the resampler holds back */
+static bool resampled(uint64_t frames, uint32_t rate, uint32_t stream_rate)
+{
+    if (rate == stream_rate)
+        return frames == MAX_FRAMES;
+    uint64_t in = frames * stream_rate / rate;
+    return in <= MAX_FRAMES && in + RESAMPLER_TAPS + RESAMPLER_CHUNK >= MAX_FRAMES;
+}
+
+static void bench(const int16_t *src)
+{
+    renderer_stats_t before, after;
+
+    host_i2s_collect(NULL, 0);
+    config.volume = 0xb000;
+    for (int o = 0; o < sizeof(outputs) / sizeof(outputs[0]); o++) {
+        renderer_get_stats(&before);
+        output_set(&outputs[o]);
+        printf("%-6s", outputs[o].name);
+        for (int l = STEREO; l <= MONO; l++) {
+            double best = 0;
+            for (int run = 0; run < 5; run++) {
+                double start = now();
+                for (int i = 0; i < 200; i++)
+                    render(src, l, MAX_FRAMES, 44100);
+                double mfps = 200.0 * MAX_FRAMES / (now() - start) / 1e6;
+                if (mfps > best)
+                    best = mfps;
+            }
+            printf("  %s %7.1f", layouts[l], best);
+        }
+        // the stream, allocations with the one at its start over its seconds at 44.1 kHz
+        renderer_get_stats(&after);
+        double seconds = 3 * 5 * 200.0 * MAX_FRAMES / 44100;
+        printf("  %u allocs in %.0f s, %u blocks, peak %zu of %zu bytes\n", after.allocs - before.allocs, seconds,
+               after.blocks, after.peak_bytes, after.arena_bytes);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    static int16_t src[MAX_FRAMES * 2], keep[MAX_FRAMES * 2];
+    static uint8_t expect[sizeof(out)];
+    static const uint32_t blocks[] = { 1, 511, 1152, MAX_FRAMES };
+    static const uint32_t volumes[] = { 255, 200, 50 };
+    int opt, bench_only = 0;
+
+    while ((opt = getopt(argc, argv, "b")) != -1) {
+        if (opt != 'b') {
+            fprintf(stderr, "usage: %s [-b]\n", argv[0]);
+            return 2;
+        }
+        bench_only = 1;
+    }
+
+    for (int i = 0; i < MAX_FRAMES * 2; i++)
+        src[i] = rnd();
+    // full scale at both ends
+    src[0] = INT16_MIN;
+    src[1] = INT16_MAX;
+    memcpy(keep, src, sizeof(src));
+    bmc_init();
+
+    renderer_init(&config);
+    CHECK(i2s_init());
+    renderer_start();
+
+    if (bench_only) {
+        bench(src);
+        return 0;
+    }
+
+    // one arena for the first stream, kept across its blocks and the next streams until one needs more
+    renderer_stats_t stats;
+    renderer_get_stats(&stats);
+    CHECK(stats.allocs == 1 && stats.blocks == 0);
+    host_i2s_collect(NULL, 0);
+    output_set(&outputs[0]);
+    for (int i = 0; i < 100; i++)
+        render(src, rnd() % 3, 1 + rnd() % MAX_FRAMES, 44100);
+    renderer_get_stats(&stats);
+    CHECK(stats.allocs == 1 && stats.blocks == 100);
+    // frames the arena holds, whatever the output; the peak a block bigger than that
+    size_t slots = stats.arena_bytes / frame_bytes(&outputs[0]);
+    static const struct {
+        int output;
+        uint32_t allocs;
+        size_t frame_bytes;     /* of the arena */
+    } arenas[] = { { 0, 1, 4 }, { 2, 1, 4 }, { 3, 1, 4 }, { 1, 2, 8 }, { 0, 2, 8 }, { 4, 3, 16 }, { 1, 3, 16 } };
+    for (int i = 0; i < sizeof(arenas) / sizeof(arenas[0]); i++) {
+        const output_t *o = &outputs[arenas[i].output];
+        output_set(o);
+        render(src, STEREO, MAX_FRAMES, 44100);
+        renderer_get_stats(&stats);
+        CHECK(stats.allocs == arenas[i].allocs && stats.blocks == 1);
+        CHECK(stats.arena_bytes == slots * arenas[i].frame_bytes && stats.peak_bytes == slots * frame_bytes(o));
+    }
+    printf("arena  %u allocations for %zu bytes\n", stats.allocs, stats.arena_bytes);
+
+    host_i2s_collect(out, sizeof(out));
+    for (int o = 0; o < sizeof(outputs) / sizeof(outputs[0]); o++) {
+        output_set(&outputs[o]);
+        for (int l = STEREO; l <= MONO; l++)
+            for (int v = 0; v < sizeof(volumes) / sizeof(volumes[0]); v++)
+                for (int b = 0; b < sizeof(blocks) / sizeof(blocks[0]); b++) {
+                    char what[64];
+                    renderer_volume(volumes[v]);
+                    host_i2s_len = 0;
+                    render(src, l, blocks[b], 44100);
+                    snprintf(what, sizeof(what), "%s %s, volume %u, %u frames", outputs[o].name, layouts[l],
+                             volumes[v], blocks[b]);
+                    compare(what, expect, expected(expect, &outputs[o], l, src, blocks[b], config.volume));
+                    CHECK(memcmp(src, keep, sizeof(src)) == 0);
+                }
+        printf("%-6s converted\n", outputs[o].name);
+    }
+
+    // S/PDIF slices of 1 to 400 frames over a few blocks, each start in the block
+    const output_t *spdif = &outputs[sizeof(outputs) / sizeof(outputs[0]) - 1];
+    output_set(spdif);
+    renderer_volume(200);
+    for (uint32_t done = 0; done < 40 * SPDIF_BLOCK;) {
+        int l = rnd() % 3;
+        uint32_t n = 1 + rnd() % 400;
+        render(src, l, n, 44100);
+        compare("spdif slice", expect, expected(expect, spdif, l, src, n, config.volume));
+        done += n;
+    }
+
+    // every 16 bit value on the left, the bits turned over on the right, at full volume
+    static int16_t all[ALL_FRAMES * 2];
+    for (int i = 0; i < ALL_FRAMES; i++) {
+        all[2 * i] = i;
+        all[2 * i + 1] = ~i;
+    }
+    output_set(spdif);
+    renderer_volume(255);
+    for (int i = 0; i < ALL_FRAMES; i += MAX_FRAMES)
+        render(all + 2 * i, STEREO, MAX_FRAMES, 44100);
+    compare("spdif every value", expect, expected(expect, spdif, STEREO, all, ALL_FRAMES, config.volume));
+    printf("spdif  encoded as the bit loop did\n");
+
+    // the clock follows the stream, S/PDIF at two slots per subframe and 32 kHz at least
+    static const struct {
+        int output;
+        uint32_t rate, clock;
+    } clocks[] = {
+        { 4, 48000, 96000 }, { 4, 22050, 88200 }, { 4, 16000, 96000 }, { 4, 44100, 88200 },
+        { 0, 48000, 48000 }, { 0, 32000, 32000 }, { 0, 22050, 22050 }, { 0, 44100, 44100 },
+    };
+    renderer_volume(255);
+    for (int i = 0; i < sizeof(clocks) / sizeof(clocks[0]); i++) {
+        const output_t *o = &outputs[clocks[i].output];
+        output_set(o);
+        render(src, STEREO, MAX_FRAMES, clocks[i].rate);
+        CHECK(host_i2s_rate == clocks[i].clock);
+        // resampled up to the output rate, else as it came
+        uint32_t rate = host_i2s_rate / ((o->mode == SPDIF) ? 2 : 1);
+        CHECK(resampled(host_i2s_len / frame_bytes(o), rate, clocks[i].rate));
+        if (rate == clocks[i].rate)
+            compare(o->name, expect, expected(expect, o, STEREO, src, MAX_FRAMES, config.volume));
+        host_i2s_len = 0;
+    }
+
+    // or stays at the fixed rate, the streams resampled to it
+    renderer_fixed_rate(44100);
+    output_set(&outputs[0]);
+    for (uint32_t rate = 32000; rate <= 48000; rate += 16000) {
+        render(src, STEREO, MAX_FRAMES, rate);
+        CHECK(host_i2s_rate == 44100);
+        CHECK(resampled(host_i2s_len / 4, 44100, rate));
+        host_i2s_len = 0;
+    }
+    renderer_fixed_rate(0);
+    printf("clock  switched and fixed\n");
+
+    if (!failed)
+        printf("render ok\n");
+    return failed;
+}
@@ -0,0 +1,238 @@
+/*
+ * resample_check.c
+ *
+ *  The polyphase resampler of audio_resampler.c, fed as the renderer
+ *  feeds it: stereo input in pieces of random size, output taken in
+ *  blocks smaller than a piece yields. For 32, 44.1 and 48 kHz (and the
+ *  22.05 kHz of the low rate streams) to 44.1 and 48 kHz, sines across
+ *  the band must come out at their level with the THD+N below the limit,
+ *  and a tone above the output Nyquist frequency must be filtered down.
+ *  Also the number of frames out, mono against stereo, and the ppm trim.
+ *
+ *    resample_check [-b]
+ *
+ *  -b prints the throughput per conversion instead, in million stereo
+ *  frames out per second, the best of 5 runs.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "check.h"
+#include "audio_resampler.h"
+
+#define MAX_RATE 48000
+/* the tones are at this part of full scale */
+#define LEVEL 0.89
+/* THD+N limits in dB, the 16 bit sine alone is at -97 */
+#define THDN_DB -86.0
+#define THDN_DB_HIGH -82.0
+/* tones this far up the output band, the pass band edge */
+#define HIGH_HZ 12000
+/* at most this far off in level, in dB */
+#define GAIN_DB 0.1
+/* 1 kHz short of the input Nyquist frequency, in the transition band of
+ * the 32 taps and folded back above 20 kHz, a tone is this far down */
+#define STOP_DB -34.0
+
+typedef struct {
+    uint32_t in_rate, out_rate;
+} conversion_t;
+
+static const conversion_t conversions[] = {
+    { 32000, 44100 }, { 32000, 48000 }, { 44100, 48000 },
+    { 48000, 44100 }, { 22050, 44100 }, { 22050, 48000 },
+};
+
+static const double tones[] = { 997, 6000, 15000 };
+
+static resampler_t rs;
+/* a second of input and of output, stereo */
+static int16_t in[MAX_RATE * 2], out[MAX_RATE * 2 + 64];
+
+static void sine(double hz, uint32_t rate, uint32_t frames)
+{
+    for (uint32_t i = 0; i < frames; i++)
+        in[2 * i] = in[2 * i + 1] = lrint(32767 * LEVEL * sin(2 * M_PI * hz * i / rate));
+}
+
+/* the input through the resampler in random pieces, then what the history holds, returns the frames out */
+static uint32_t run(uint8_t channels, uint32_t frames)
+{
+    uint32_t got = 0, pos = 0;
+    while (pos < frames) {
+        uint32_t piece = 1 + rnd() % 700;
+        if (piece > frames - pos)
+            piece = frames - pos;
+        const int16_t *p = in + 2 * pos;
+        uint32_t left = piece, used;
+        while (left > 0) {
+            // mono takes every other sample of the stereo input
+            got += resampler_run(&rs, p, p + 1, 2, left, &used, out + channels * got, 333);
+            p += 2 * used;
+            left -= used;
+        }
+        pos += piece;
+    }
+    uint32_t used, n;
+    while ((n = resampler_run(&rs, in, in + 1, 2, 0, &used, out + channels * got, 333)) > 0)
+        got += n;
+    return got;
+}
+
+/* the sine at hz that fits the channel best, its level and the rest of the signal, in dB */
+static void fit(const int16_t *y, int stride, int n, double hz, double rate, double *level, double *thdn)
+{
+    // least squares for a sin + b cos + dc
+    double m[3][4] = { { 0 } };
+    for (int i = 0; i < n; i++) {
+        double v[3] = { sin(2 * M_PI * hz * i / rate), cos(2 * M_PI * hz * i / rate), 1 };
+        for (int r = 0; r < 3; r++) {
+            for (int k = 0; k < 3; k++)
+                m[r][k] += v[r] * v[k];
+            m[r][3] += v[r] * y[i * stride];
+        }
+    }
+    for (int r = 0; r < 3; r++) {
+        double d = m[r][r];
+        for (int k = r; k < 4; k++)
+            m[r][k] /= d;
+        for (int q = 0; q < 3; q++) {
+            double f = m[q][r];
+            if (q != r)
+                for (int k = r; k < 4; k++)
+                    m[q][k] -= f * m[r][k];
+        }
+    }
+    double a = m[0][3], b = m[1][3], dc = m[2][3], rest = 0;
+    for (int i = 0; i < n; i++) {
+        double e = y[i * stride] - a * sin(2 * M_PI * hz * i / rate) - b * cos(2 * M_PI * hz * i / rate) - dc;
+        rest += e * e;
+    }
+    *level = 20 * log10(sqrt(a * a + b * b) / (32767 * LEVEL));
+    *thdn = 10 * log10(rest / n / ((a * a + b * b) / 2));
+}
+
+/* the RMS of the channel in dB of the input sine */
+static double rms(const int16_t *y, int stride, int n)
+{
+    double sum = 0;
+    for (int i = 0; i < n; i++)
+        sum += (double)y[i * stride] * y[i * stride];
+    return 10 * log10(sum / n / (32767 * LEVEL * 32767 * LEVEL / 2));
+}
+
+static void bench(void)
+{
+    for (int i = 0; i < MAX_RATE * 2; i++)
+        in[i] = rnd();
+    for (int c = 0; c < sizeof(conversions) / sizeof(conversions[0]); c++) {
+        const conversion_t *cv = &conversions[c];
+        double best = 0;
+        resampler_setup(&rs, cv->in_rate, cv->out_rate, 2);
+        for (int r = 0; r < 5; r++) {
+            uint64_t total = 0;
+            double start = now();
+            for (int i = 0; i < 10; i++) {
+                const int16_t *p = in;
+                uint32_t left = cv->in_rate, used;
+                while (left > 0) {
+                    total += resampler_run(&rs, p, p + 1, 2, left, &used, out, 512);
+                    p += 2 * used;
+                    left -= used;
+                }
+            }
+            double mfps = total / (now() - start) / 1e6;
+            if (mfps > best)
+                best = mfps;
+        }
+        printf("%5u -> %5u Hz %7.1f\n", cv->in_rate, cv->out_rate, best);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int opt, bench_only = 0;
+
+    while ((opt = getopt(argc, argv, "b")) != -1) {
+        if (opt != 'b') {
+            fprintf(stderr, "usage: %s [-b]\n", argv[0]);
+            return 2;
+        }
+        bench_only = 1;
+    }
+    if (bench_only) {
+        bench();
+        return 0;
+    }
+
+    for (int c = 0; c < sizeof(conversions) / sizeof(conversions[0]); c++) {
+        const conversion_t *cv = &conversions[c];
+        // past the filter's start, half a second
+        uint32_t skip = cv->out_rate / 10, len = cv->out_rate / 2;
+        printf("%5u -> %5u Hz:", cv->in_rate, cv->out_rate);
+        for (int t = 0; t < sizeof(tones) / sizeof(tones[0]); t++) {
+            double level, thdn;
+            // in the pass band of both rates
+            if (tones[t] > 0.45 * cv->in_rate || tones[t] > 0.45 * cv->out_rate)
+                continue;
+            sine(tones[t], cv->in_rate, cv->in_rate);
+            CHECK(resampler_setup(&rs, cv->in_rate, cv->out_rate, 2));
+            uint32_t got = run(2, cv->in_rate);
+            // one for each step the taps fit in, the first centered on the first frame
+            uint64_t end = (uint64_t)(cv->in_rate - RESAMPLER_TAPS / 2) << 32;
+            CHECK(got == (end + rs.step - 1) / rs.step);
+            fit(out + 2 * skip, 2, len, tones[t], cv->out_rate, &level, &thdn);
+            printf("  %5.0f Hz %+5.2f dB %6.1f dB", tones[t], level, thdn);
+            CHECK(fabs(level) < GAIN_DB);
+            CHECK(thdn < ((tones[t] < HIGH_HZ) ? THDN_DB : THDN_DB_HIGH));
+            for (uint32_t i = 0; i < got; i++)
+                CHECK(out[2 * i] == out[2 * i + 1]);
+        }
+        printf("\n");
+
+        // mono comes out as either channel of stereo
+        static int16_t stereo[MAX_RATE * 2 + 64];
+        sine(tones[1], cv->in_rate, cv->in_rate);
+        CHECK(resampler_setup(&rs, cv->in_rate, cv->out_rate, 2));
+        uint32_t got = run(2, cv->in_rate);
+        memcpy(stereo, out, got * 4);
+        CHECK(resampler_setup(&rs, cv->in_rate, cv->out_rate, 1));
+        CHECK(run(1, cv->in_rate) == got);
+        for (uint32_t i = 0; i < got; i++)
+            CHECK(out[i] == stereo[2 * i]);
+
+        // a tone the output rate cannot carry is filtered down before it folds back
+        if (cv->in_rate > cv->out_rate) {
+            uint32_t hz = cv->in_rate / 2 - 1000;
+            sine(hz, cv->in_rate, cv->in_rate);
+            CHECK(resampler_setup(&rs, cv->in_rate, cv->out_rate, 2));
+            run(2, cv->in_rate);
+            double stop = rms(out + 2 * skip, 2, len);
+            printf("  %5u Hz %6.1f dB\n", hz, stop);
+            CHECK(stop < STOP_DB);
+        }
+
+        // 1000 ppm more input per output frame: 0.1 % fewer frames
+        sine(tones[0], cv->in_rate, cv->in_rate);
+        CHECK(resampler_setup(&rs, cv->in_rate, cv->out_rate, 2));
+        uint32_t nominal = run(2, cv->in_rate);
+        CHECK(resampler_setup(&rs, cv->in_rate, cv->out_rate, 2));
+        resampler_trim(&rs, 1000);
+        uint32_t trimmed = run(2, cv->in_rate);
+        CHECK(abs((int)(nominal - trimmed) - (int)(nominal / 1000)) <= 1);
+    }
+    resampler_free(&rs);
+
+    // ratios the history cannot hold are refused
+    CHECK(!resampler_setup(&rs, 16 * 48000, 48000, 2));
+    CHECK(!resampler_setup(&rs, 44100, 48000, 3));
+    resampler_free(&rs);
+
+    if (!failed)
+        printf("resample ok\n");
+    return failed;
+}
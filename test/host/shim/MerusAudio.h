@@ -0,0 +1,14 @@
+/*
+ * MerusAudio.h
+ *
+ *  Host shim: no amplifier to set up.
+ */
+
+#ifndef SHIM_MERUSAUDIO_H_
+#define SHIM_MERUSAUDIO_H_
+
+#include <stdint.h>
+
+uint8_t init_ma120(uint8_t vol);
+
+#endif /* SHIM_MERUSAUDIO_H_ */
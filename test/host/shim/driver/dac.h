@@ -0,0 +1,10 @@
+/*
+ * dac.h
+ *
+ *  Host shim: the built-in DAC is fed through the I2S channel.
+ */
+
+#ifndef SHIM_DRIVER_DAC_H_
+#define SHIM_DRIVER_DAC_H_
+
+#endif /* SHIM_DRIVER_DAC_H_ */
@@ -0,0 +1,14 @@
+/*
+ * gpio.h
+ *
+ *  Host shim: pin numbers only.
+ */
+
+#ifndef SHIM_DRIVER_GPIO_H_
+#define SHIM_DRIVER_GPIO_H_
+
+typedef int gpio_num_t;
+
+#define GPIO_NUM_NC -1
+
+#endif /* SHIM_DRIVER_GPIO_H_ */
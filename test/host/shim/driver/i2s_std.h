@@ -0,0 +1,99 @@
+/*
+ * i2s_std.h
+ *
+ *  Host shim: the standard mode I2S channel of the ESP-IDF v5 driver, as
+ *  far as the renderer configures it. What is written goes to the test,
+ *  see i2s.c.
+ */
+
+#ifndef SHIM_DRIVER_I2S_STD_H_
+#define SHIM_DRIVER_I2S_STD_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "driver/gpio.h"
+
+typedef int i2s_port_t;
+typedef struct i2s_channel *i2s_chan_handle_t;
+
+#define I2S_NUM_0 0
+#define I2S_ROLE_MASTER 0
+#define I2S_SLOT_MODE_STEREO 2
+#define I2S_GPIO_UNUSED GPIO_NUM_NC
+#define I2S_CLK_SRC_DEFAULT 0
+#define I2S_CLK_SRC_APLL 1
+#define I2S_MCLK_MULTIPLE_256 256
+#define SOC_I2S_SUPPORTS_APLL 1
+
+#define I2S_DATA_BIT_WIDTH_16BIT 16
+#define I2S_DATA_BIT_WIDTH_32BIT 32
+
+typedef struct {
+    int id;
+    int role;
+    uint32_t dma_desc_num;
+    uint32_t dma_frame_num;
+    bool auto_clear;
+} i2s_chan_config_t;
+
+typedef struct {
+    uint32_t sample_rate_hz;
+    int clk_src;
+    int mclk_multiple;
+} i2s_std_clk_config_t;
+
+typedef struct {
+    int data_bit_width;
+    int slot_mode;
+    uint32_t ws_width;
+    bool ws_pol;
+    bool bit_shift;
+    bool msb_right;
+} i2s_std_slot_config_t;
+
+typedef struct {
+    gpio_num_t mclk;
+    gpio_num_t bclk;
+    gpio_num_t ws;
+    gpio_num_t dout;
+    gpio_num_t din;
+    struct {
+        bool mclk_inv;
+        bool bclk_inv;
+        bool ws_inv;
+    } invert_flags;
+} i2s_std_gpio_config_t;
+
+typedef struct {
+    i2s_std_clk_config_t clk_cfg;
+    i2s_std_slot_config_t slot_cfg;
+    i2s_std_gpio_config_t gpio_cfg;
+} i2s_std_config_t;
+
+#define I2S_CHANNEL_DEFAULT_CONFIG(i2s_num, i2s_role) \
+    ((i2s_chan_config_t){ .id = (i2s_num), .role = (i2s_role), .dma_desc_num = 6, .dma_frame_num = 240 })
+#define I2S_STD_CLK_DEFAULT_CONFIG(rate) \
+    ((i2s_std_clk_config_t){ .sample_rate_hz = (rate), .clk_src = I2S_CLK_SRC_DEFAULT, .mclk_multiple = I2S_MCLK_MULTIPLE_256 })
+#define I2S_STD_MSB_SLOT_DEFAULT_CONFIG(bits, mode) \
+    ((i2s_std_slot_config_t){ .data_bit_width = (bits), .slot_mode = (mode), .ws_width = (bits) })
+
+/* the test's end of the channel: what is written goes into buf, size
+ * bytes at most, and is counted in host_i2s_len; without a buffer it is
+ * only counted. host_i2s_rate is the clock the channel is at */
+void host_i2s_collect(void *buf, size_t size);
+extern size_t host_i2s_len;
+extern uint32_t host_i2s_rate;
+
+esp_err_t i2s_new_channel(const i2s_chan_config_t *chan_cfg, i2s_chan_handle_t *ret_tx, i2s_chan_handle_t *ret_rx);
+esp_err_t i2s_del_channel(i2s_chan_handle_t handle);
+esp_err_t i2s_channel_init_std_mode(i2s_chan_handle_t handle, const i2s_std_config_t *std_cfg);
+esp_err_t i2s_channel_reconfig_std_clock(i2s_chan_handle_t handle, const i2s_std_clk_config_t *clk_cfg);
+esp_err_t i2s_channel_enable(i2s_chan_handle_t handle);
+esp_err_t i2s_channel_disable(i2s_chan_handle_t handle);
+esp_err_t i2s_channel_write(i2s_chan_handle_t handle, const void *src, size_t size, size_t *bytes_written,
+                            uint32_t timeout_ms);
+
+#endif /* SHIM_DRIVER_I2S_STD_H_ */
@@ -0,0 +1,13 @@
+/*
+ * esp_attr.h
+ *
+ *  Host shim: one kind of memory, the placement attributes are empty.
+ */
+
+#ifndef SHIM_ESP_ATTR_H_
+#define SHIM_ESP_ATTR_H_
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+
+#endif /* SHIM_ESP_ATTR_H_ */
@@ -0,0 +1,21 @@
+/*
+ * esp_chip_info.h
+ *
+ *  Host shim: a chip without features.
+ */
+
+#ifndef SHIM_ESP_CHIP_INFO_H_
+#define SHIM_ESP_CHIP_INFO_H_
+
+#include <stdint.h>
+
+typedef struct {
+    int model;
+    uint32_t features;
+    uint16_t revision;
+    uint8_t cores;
+} esp_chip_info_t;
+
+void esp_chip_info(esp_chip_info_t *info);
+
+#endif /* SHIM_ESP_CHIP_INFO_H_ */
@@ -0,0 +1,17 @@
+/*
+ * esp_err.h
+ *
+ *  Host shim: the error type, ESP_ERROR_CHECK does not abort.
+ */
+
+#ifndef SHIM_ESP_ERR_H_
+#define SHIM_ESP_ERR_H_
+
+typedef int esp_err_t;
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+
+#define ESP_ERROR_CHECK(x) ((void)(x))
+
+#endif /* SHIM_ESP_ERR_H_ */
@@ -0,0 +1,21 @@
+/*
+ * esp_heap_caps.h
+ *
+ *  Host shim: one heap, the capabilities are ignored.
+ */
+
+#ifndef SHIM_ESP_HEAP_CAPS_H_
+#define SHIM_ESP_HEAP_CAPS_H_
+
+#include <stdlib.h>
+
+#define MALLOC_CAP_8BIT     (1 << 2)
+#define MALLOC_CAP_DMA      (1 << 3)
+#define MALLOC_CAP_SPIRAM   (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+
+#define heap_caps_malloc(size, caps) malloc(size)
+#define heap_caps_calloc(n, size, caps) calloc(n, size)
+#define heap_caps_free(ptr) free(ptr)
+
+#endif /* SHIM_ESP_HEAP_CAPS_H_ */
@@ -0,0 +1,19 @@
+/*
+ * esp_log.h
+ *
+ *  Host shim: errors, warnings and info to stderr, the rest dropped.
+ */
+
+#ifndef SHIM_ESP_LOG_H_
+#define SHIM_ESP_LOG_H_
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#define ESP_LOGE(tag, format, ...) fprintf(stderr, "E %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) fprintf(stderr, "W %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) fprintf(stderr, "I %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) do { } while (0)
+#define ESP_LOGV(tag, format, ...) do { } while (0)
+
+#endif /* SHIM_ESP_LOG_H_ */
@@ -0,0 +1,20 @@
+/*
+ * esp_memory_utils.h
+ *
+ *  Host shim: whether kmalloc() hands out PSRAM is up to the test, through
+ *  host_external_ram.
+ */
+
+#ifndef SHIM_ESP_MEMORY_UTILS_H_
+#define SHIM_ESP_MEMORY_UTILS_H_
+
+#include <stdbool.h>
+
+extern bool host_external_ram;
+
+static inline bool esp_ptr_external_ram(const void *p)
+{
+    return p != NULL && host_external_ram;
+}
+
+#endif /* SHIM_ESP_MEMORY_UTILS_H_ */
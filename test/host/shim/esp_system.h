@@ -0,0 +1,20 @@
+/*
+ * esp_system.h
+ *
+ *  Host shim: the version header it brings along, as in ESP-IDF, and the
+ *  free heap, which the host does not know.
+ */
+
+#ifndef SHIM_ESP_SYSTEM_H_
+#define SHIM_ESP_SYSTEM_H_
+
+#include <stdint.h>
+
+#include "esp_idf_version.h"
+
+static inline uint32_t esp_get_free_heap_size(void)
+{
+    return 0;
+}
+
+#endif /* SHIM_ESP_SYSTEM_H_ */
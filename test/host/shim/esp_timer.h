@@ -0,0 +1,14 @@
+/*
+ * esp_timer.h
+ *
+ *  Host shim: the monotonic clock in us.
+ */
+
+#ifndef SHIM_ESP_TIMER_H_
+#define SHIM_ESP_TIMER_H_
+
+#include <stdint.h>
+
+int64_t esp_timer_get_time(void);
+
+#endif /* SHIM_ESP_TIMER_H_ */
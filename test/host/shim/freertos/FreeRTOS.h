@@ -0,0 +1,29 @@
+/*
+ * FreeRTOS.h
+ *
+ *  Host shim: the FreeRTOS types and constants the firmware sources use,
+ *  with a 1 ms tick. The tasks run as pthreads, see rtos.c.
+ */
+
+#ifndef SHIM_FREERTOS_H_
+#define SHIM_FREERTOS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS 1
+#define portMAX_DELAY 0xffffffffu
+#define configTICK_RATE_HZ 1000
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+#endif /* SHIM_FREERTOS_H_ */
@@ -0,0 +1,12 @@
+/*
+ * queue.h
+ *
+ *  Host shim: the sources built here include it but use no queue.
+ */
+
+#ifndef SHIM_QUEUE_H_
+#define SHIM_QUEUE_H_
+
+#include "freertos/FreeRTOS.h"
+
+#endif /* SHIM_QUEUE_H_ */
@@ -0,0 +1,15 @@
+/*
+ * gpio.h
+ *
+ *  Host shim: the board's pins, in place of main/include/gpio.h, as far as
+ *  the renderer asks for them.
+ */
+
+#ifndef SHIM_GPIO_H_
+#define SHIM_GPIO_H_
+
+#include "driver/gpio.h"
+
+void gpio_get_i2s(gpio_num_t *lrck, gpio_num_t *bclk, gpio_num_t *i2sdata);
+
+#endif /* SHIM_GPIO_H_ */
@@ -0,0 +1,109 @@
+/*
+ * i2s.c
+ *
+ *  Host shim: an I2S channel that hands what is written to the test, and
+ *  the rest of the hardware the renderer sets up, which does nothing.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "driver/i2s_std.h"
+#include "esp_chip_info.h"
+#include "gpio.h"
+#include "MerusAudio.h"
+#include "soc/rtc.h"
+
+struct i2s_channel {
+    bool enabled;
+};
+
+static uint8_t *sink;
+static size_t sink_size;
+size_t host_i2s_len;
+uint32_t host_i2s_rate;
+
+void host_i2s_collect(void *buf, size_t size)
+{
+    sink = buf;
+    sink_size = size;
+    host_i2s_len = 0;
+}
+
+esp_err_t i2s_new_channel(const i2s_chan_config_t *chan_cfg, i2s_chan_handle_t *ret_tx, i2s_chan_handle_t *ret_rx)
+{
+    *ret_tx = calloc(1, sizeof(struct i2s_channel));
+    return (*ret_tx != NULL) ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t i2s_del_channel(i2s_chan_handle_t handle)
+{
+    free(handle);
+    return ESP_OK;
+}
+
+esp_err_t i2s_channel_init_std_mode(i2s_chan_handle_t handle, const i2s_std_config_t *std_cfg)
+{
+    host_i2s_rate = std_cfg->clk_cfg.sample_rate_hz;
+    return ESP_OK;
+}
+
+esp_err_t i2s_channel_reconfig_std_clock(i2s_chan_handle_t handle, const i2s_std_clk_config_t *clk_cfg)
+{
+    if (handle->enabled)
+        return ESP_FAIL;
+    host_i2s_rate = clk_cfg->sample_rate_hz;
+    return ESP_OK;
+}
+
+esp_err_t i2s_channel_enable(i2s_chan_handle_t handle)
+{
+    handle->enabled = true;
+    return ESP_OK;
+}
+
+esp_err_t i2s_channel_disable(i2s_chan_handle_t handle)
+{
+    handle->enabled = false;
+    return ESP_OK;
+}
+
+esp_err_t i2s_channel_write(i2s_chan_handle_t handle, const void *src, size_t size, size_t *bytes_written,
+                            uint32_t timeout_ms)
+{
+    if (!handle->enabled)
+        return ESP_FAIL;
+    if (sink != NULL && host_i2s_len + size <= sink_size)
+        memcpy(sink + host_i2s_len, src, size);
+    host_i2s_len += size;
+    *bytes_written = size;
+    return ESP_OK;
+}
+
+void esp_chip_info(esp_chip_info_t *info)
+{
+    info->model = 1;
+    info->features = 0;
+    info->revision = 3;
+    info->cores = 2;
+}
+
+void rtc_clk_apll_enable(bool enable)
+{
+}
+
+void rtc_clk_apll_coeff_set(uint32_t o_div, uint32_t sdm0, uint32_t sdm1, uint32_t sdm2)
+{
+}
+
+void gpio_get_i2s(gpio_num_t *lrck, gpio_num_t *bclk, gpio_num_t *i2sdata)
+{
+    *lrck = 25;
+    *bclk = 26;
+    *i2sdata = 22;
+}
+
+uint8_t init_ma120(uint8_t vol)
+{
+    return 0;
+}
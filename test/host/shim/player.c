@@ -0,0 +1,27 @@
+/*
+ * player.c
+ *
+ *  Host shim: the player and app_main as the renderer calls them. The
+ *  output is I2S at start, the test changes the renderer's config after
+ *  i2s_init(). No fifo fill is known.
+ */
+
+#include "audio_player.h"
+
+output_mode_t get_audio_output_mode()
+{
+    return I2S;
+}
+
+bool audio_player_get_buffered_ms(uint32_t *ms)
+{
+    return false;
+}
+
+void audio_player_first_sample()
+{
+}
+
+void audio_player_stop()
+{
+}
@@ -0,0 +1,28 @@
+/*
+ * app_main.h
+ *
+ *  Host shim: in place of main/include/app_main.h, what the player takes
+ *  from it. The test defines the functions.
+ */
+
+#ifndef SHIM_APP_MAIN_H_
+#define SHIM_APP_MAIN_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define PRIO_MAD 		20
+#define PRIO_VS1053 	17
+#define CPU_MAD			1
+
+typedef enum {
+    I2S, I2S_MERUS, DAC_BUILT_IN, PDM, VS1053, SPDIF, BTOOTH
+} output_mode_t;
+
+output_mode_t get_audio_output_mode();
+bool bigSram();
+
+void *kmalloc(size_t size);
+void *kcalloc(size_t n, size_t size);
+
+#endif /* SHIM_APP_MAIN_H_ */
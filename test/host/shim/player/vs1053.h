@@ -0,0 +1,15 @@
+/*
+ * vs1053.h
+ *
+ *  Host shim: in place of main/include/vs1053.h, the VS1053 worker, which
+ *  the test defines, and the min() that comes with the header.
+ */
+
+#ifndef SHIM_VS1053_H_
+#define SHIM_VS1053_H_
+
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+
+void vsTask(void *pvParams);
+
+#endif /* SHIM_VS1053_H_ */
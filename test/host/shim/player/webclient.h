@@ -0,0 +1,14 @@
+/*
+ * webclient.h
+ *
+ *  Host shim: in place of main/include/webclient.h, the disconnects the
+ *  player asks for. The test defines them.
+ */
+
+#ifndef SHIM_WEBCLIENT_H_
+#define SHIM_WEBCLIENT_H_
+
+void clientDisconnect(const char *from);
+void clientSilentDisconnect();
+
+#endif /* SHIM_WEBCLIENT_H_ */
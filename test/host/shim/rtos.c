@@ -0,0 +1,138 @@
+/*
+ * rtos.c
+ *
+ *  Host shim: FreeRTOS tasks on pthreads. Each thread gets a notification
+ *  value on first use, ticks are ms of CLOCK_MONOTONIC.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_memory_utils.h"
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t value;
+} task_t;
+
+typedef struct {
+    TaskFunction_t code;
+    void *param;
+    task_t *task;
+} start_t;
+
+bool host_external_ram;
+
+static __thread task_t *current;
+
+static task_t *task_new(void)
+{
+    task_t *t = calloc(1, sizeof(*t));
+    pthread_mutex_init(&t->lock, NULL);
+    pthread_cond_init(&t->cond, NULL);
+    return t;
+}
+
+static void *task_run(void *arg)
+{
+    start_t s = *(start_t *)arg;
+    free(arg);
+    current = s.task;
+    s.code(s.param);
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t code, const char *name, uint32_t stack, void *param,
+                                   UBaseType_t prio, TaskHandle_t *handle, BaseType_t core)
+{
+    pthread_t thread;
+    start_t *s = malloc(sizeof(*s));
+    s->code = code;
+    s->param = param;
+    s->task = task_new();
+    if (handle != NULL)
+        *handle = s->task;
+    if (pthread_create(&thread, NULL, task_run, s) != 0)
+        return pdFALSE;
+    pthread_detach(thread);
+    return pdPASS;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    if (current == NULL)
+        current = task_new();
+    return current;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(esp_timer_get_time() / 1000);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    usleep(ticks * 1000);
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    task_t *t = task;
+    pthread_mutex_lock(&t->lock);
+    t->value++;
+    pthread_cond_signal(&t->cond);
+    pthread_mutex_unlock(&t->lock);
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks)
+{
+    task_t *t = xTaskGetCurrentTaskHandle();
+    struct timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_sec += ticks / 1000;
+    until.tv_nsec += (long)(ticks % 1000) * 1000000;
+    if (until.tv_nsec >= 1000000000) {
+        until.tv_sec++;
+        until.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&t->lock);
+    while (t->value == 0 && ticks != 0) {
+        if (pthread_cond_timedwait(&t->cond, &t->lock, &until) == ETIMEDOUT)
+            break;
+    }
+    uint32_t value = t->value;
+    if (clear)
+        t->value = 0;
+    else if (value)
+        t->value--;
+    pthread_mutex_unlock(&t->lock);
+    return value;
+}
+
+/* the firmware's allocators, PSRAM first on the device */
+void *kmalloc(size_t size)
+{
+    return malloc(size);
+}
+
+void *kcalloc(size_t n, size_t size)
+{
+    return calloc(n, size);
+}
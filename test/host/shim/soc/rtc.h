@@ -0,0 +1,16 @@
+/*
+ * rtc.h
+ *
+ *  Host shim: the APLL settings go nowhere.
+ */
+
+#ifndef SHIM_SOC_RTC_H_
+#define SHIM_SOC_RTC_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+void rtc_clk_apll_enable(bool enable);
+void rtc_clk_apll_coeff_set(uint32_t o_div, uint32_t sdm0, uint32_t sdm1, uint32_t sdm2);
+
+#endif /* SHIM_SOC_RTC_H_ */
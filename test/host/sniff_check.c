@@ -0,0 +1,223 @@
+/*
+ * sniff_check.c
+ *
+ *  Format detection of common_sniff.c on the MPEG test streams given on
+ *  the command line, from their start, behind an ID3v2 tag and joined in
+ *  the middle, and on ADTS, Ogg, FLAC and MP4 starts and on data that is
+ *  no audio, built here. Each input is sniffed through windows of 2, 4 and
+ *  8 KiB, as much as the pre-roll may have buffered.
+ *
+ *    sniff_check file.mp3...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+#include "common_sniff.h"
+
+#define LEN (64 * 1024)
+
+/* frame headers in a row common_sniff.c is sure from */
+#define SNIFF_FRAMES 6
+
+static void noise(uint8_t *p, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        p[i] = rnd();
+}
+
+/* ID3v2.4 tag of n bytes in all, its size syncsafe */
+static size_t id3(uint8_t *p, size_t n)
+{
+    size_t size = n - 10;
+    memcpy(p, "ID3\4\0\0", 6);
+    p[6] = (size >> 21) & 0x7f;
+    p[7] = (size >> 14) & 0x7f;
+    p[8] = (size >> 7) & 0x7f;
+    p[9] = size & 0x7f;
+    memset(p + 10, 0, size);
+    return n;
+}
+
+/* AAC LC, 44.1 kHz stereo, frames of 300 to 400 bytes */
+static size_t adts(uint8_t *p, size_t n)
+{
+    size_t pos = 0;
+    while (pos + 400 <= n) {
+        unsigned len = 300 + rnd() % 101;
+        uint8_t *f = p + pos;
+        noise(f, len);
+        f[0] = 0xff;
+        f[1] = 0xf1;
+        f[2] = (1 << 6) | (4 << 2);
+        f[3] = (2 << 6) | (len >> 11);
+        f[4] = len >> 3;
+        f[5] = ((len & 7) << 5) | 0x1f;
+        f[6] = 0xfc;
+        pos += len;
+    }
+    return pos;
+}
+
+/* Ogg pages of 2 to 6 segments, two of them fit the smallest window */
+static size_t ogg(uint8_t *p, size_t n)
+{
+    size_t pos = 0;
+    for (uint32_t seq = 0; pos + 27 + 6 + 6 * 255 <= n; seq++) {
+        uint8_t *g = p + pos;
+        unsigned segments = 2 + rnd() % 5, len = 27 + segments;
+        memset(g, 0, 27);
+        memcpy(g, "OggS", 4);
+        g[5] = (seq == 0) ? 2 : 0;
+        memcpy(g + 18, &seq, 4);
+        g[26] = segments;
+        for (unsigned i = 0; i < segments; i++) {
+            g[27 + i] = (i < segments - 1) ? 255 : rnd() % 255;
+            len += g[27 + i];
+        }
+        noise(g + 27 + segments, len - 27 - segments);
+        pos += len;
+    }
+    return pos;
+}
+
+static size_t flac(uint8_t *p, size_t n, int streaminfo)
+{
+    noise(p, n);
+    memcpy(p, "fLaC", 4);
+    memcpy(p + 4, streaminfo ? "\0\0\0\42" : "\4\0\0\42", 4);
+    return n;
+}
+
+static size_t mp4(uint8_t *p, size_t n, const char *box)
+{
+    noise(p, n);
+    memcpy(p, "\0\0\0\30", 4);
+    memcpy(p + 4, box, 4);
+    return n;
+}
+
+static size_t text(uint8_t *p, size_t n)
+{
+    static const char html[] = "<html><head><title>404 Not Found</title></head>"
+            "<body><h1>Not Found</h1><p>The requested URL was not found on this server.</p></body></html>\n";
+    size_t len = 0;
+    while (len + sizeof(html) - 1 <= n) {
+        memcpy(p + len, html, sizeof(html) - 1);
+        len += sizeof(html) - 1;
+    }
+    return len;
+}
+
+/* end of the SNIFF_FRAMES-th frame header from p on */
+static size_t run_end(const uint8_t *p, size_t len)
+{
+    frame_header_t hdr;
+    size_t pos = 0;
+    for (int i = 1; i < SNIFF_FRAMES && pos + FRAME_HEADER_SIZE <= len && frame_header_parse(p + pos, &hdr); i++)
+        pos += hdr.frame_len;
+    return pos + FRAME_HEADER_SIZE;
+}
+
+/*
+ * Sniffs p[0..len) through each window: the format must be the one wanted
+ * with at least min_conf, and MPEG and ADTS must point at a frame header.
+ * A window that ends before the SNIFF_FRAMES-th header from there on may
+ * leave a correct guess unconfident. SNIFF_UNKNOWN wants no confident guess.
+ */
+static void check(const char *name, const uint8_t *p, size_t len, sniff_format_t want, unsigned min_conf)
+{
+    for (size_t w = 2048; w <= SNIFF_WINDOW; w *= 2) {
+        sniff_t s;
+        size_t n = (len < w) ? len : w;
+        sniff_stream(p, n, &s);
+        int ok, short_window = 0;
+        if (want == SNIFF_UNKNOWN) {
+            ok = s.confidence < SNIFF_CONFIDENT;
+        } else {
+            frame_header_t hdr;
+            ok = s.format == want;
+            if (ok && (want == SNIFF_MPEG || want == SNIFF_ADTS) && s.frames > 0) {
+                ok = frame_header_parse(p + s.offset, &hdr) && hdr.kind == s.hdr.kind
+                        && hdr.sample_rate == s.hdr.sample_rate;
+                short_window = n < run_end(p + s.offset, len - s.offset) + s.offset;
+            }
+            if (ok && !short_window)
+                ok = s.confidence >= min_conf;
+        }
+        printf("%-28s %5zu: %-7s %3u at %5u%s\n", name, w, sniff_format_str(s.format), s.confidence,
+                (unsigned) s.offset, !ok ? "  WRONG" : short_window ? "  short window" : "");
+        if (!ok)
+            failed = 1;
+    }
+}
+
+static size_t load(const char *path, uint8_t *p, size_t n)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        perror(path);
+        exit(2);
+    }
+    size_t len = fread(p, 1, n, f);
+    fclose(f);
+    return len;
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t buf[LEN];
+    char name[64];
+    size_t len, tag;
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s file.mp3...\n", argv[0]);
+        return 2;
+    }
+
+    for (int a = 1; a < argc; a++) {
+        const char *base = strrchr(argv[a], '/') ? strrchr(argv[a], '/') + 1 : argv[a];
+        len = load(argv[a], buf, LEN);
+        check(base, buf, len, SNIFF_MPEG, SNIFF_CONFIDENT);
+        // joined the stream anywhere
+        for (size_t at = 333; at < 3000; at += 1111) {
+            snprintf(name, sizeof(name), "%s+%zu", base, at);
+            check(name, buf + at, len - at, SNIFF_MPEG, SNIFF_CONFIDENT);
+        }
+        tag = id3(buf, 1000);
+        len = tag + load(argv[a], buf + tag, LEN - tag);
+        snprintf(name, sizeof(name), "id3 %s", base);
+        check(name, buf, len, SNIFF_MPEG, SNIFF_CONFIDENT);
+    }
+
+    len = adts(buf, LEN);
+    check("adts", buf, len, SNIFF_ADTS, SNIFF_CONFIDENT);
+    check("adts+777", buf + 777, len - 777, SNIFF_ADTS, SNIFF_CONFIDENT);
+    tag = id3(buf, 500);
+    len = tag + adts(buf + tag, LEN - tag);
+    check("id3 adts", buf, len, SNIFF_ADTS, SNIFF_CONFIDENT);
+
+    len = ogg(buf, LEN);
+    check("ogg", buf, len, SNIFF_OGG, 100);
+    check("ogg+1234", buf + 1234, len - 1234, SNIFF_OGG, SNIFF_CONFIDENT);
+
+    check("flac", buf, flac(buf, LEN, 1), SNIFF_FLAC, 100);
+    check("flac, no streaminfo", buf, flac(buf, LEN, 0), SNIFF_FLAC, SNIFF_CONFIDENT);
+    check("mp4 ftyp", buf, mp4(buf, LEN, "ftyp"), SNIFF_MP4, 100);
+    check("mp4 moof", buf, mp4(buf, LEN, "moof"), SNIFF_MP4, 100);
+
+    // a tag the window does not get past: likely MP3, not sure
+    len = id3(buf, 20000);
+    check("id3 only", buf, len, SNIFF_MPEG, 30);
+    check("id3 only, sure", buf, len, SNIFF_UNKNOWN, 0);
+
+    noise(buf, LEN);
+    check("noise", buf, LEN, SNIFF_UNKNOWN, 0);
+    memset(buf, 0, LEN);
+    check("zeros", buf, LEN, SNIFF_UNKNOWN, 0);
+    check("html", buf, text(buf, LEN), SNIFF_UNKNOWN, 0);
+
+    return failed;
+}
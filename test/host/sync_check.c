@@ -0,0 +1,262 @@
+/*
+ * sync_check.c
+ *
+ *  The frame sync of common_frame.c as the MP3 decoder runs it: a stream
+ *  comes in windows of 3 to 8 KiB as the fifo shows it, five times over, a frame the lock
+ *  holds on is stepped over by its length as MAD does, and the scanner
+ *  takes over where the lock does not hold. On the damaged streams of
+ *  gen_mpeg.py, the ones with a .frames file, no frame may be taken where
+ *  none starts, every whole frame must be taken but those a cut frame
+ *  hides, and each break in the stream must be one resync. On the clean
+ *  streams nothing is skipped, and on noise the sync is given up on.
+ *
+ *    sync_check [-b] file.mp3...
+ *
+ *  -b prints the time per frame taken instead, the best of 20 runs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "check.h"
+#include "common_frame.h"
+
+/* what the fifo always shows, as the decoder's SYNC_WINDOW */
+#define SYNC_WINDOW (3 * 1024)
+#define MAX_WINDOW (8 * 1024)
+#define NOISE (128 * 1024)
+/* window sequences each stream is run through */
+#define PASSES 5
+
+typedef struct {
+    uint32_t offset;
+    uint8_t whole;
+    uint8_t taken;
+} frame_t;
+
+typedef struct {
+    uint32_t taken;         /* frames taken where a whole frame starts */
+    uint32_t damaged;       /* where a damaged one does */
+    uint32_t bad;           /* where no frame starts */
+    uint32_t lost;          /* whole frames not taken */
+    uint32_t gaps;          /* locks after bytes were dropped */
+    frame_sync_t s;
+} result_t;
+
+static uint8_t *load(const char *path, size_t *len)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        perror(path);
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    *len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *buf = malloc(*len + 1);
+    if (buf != NULL && fread(buf, 1, *len, f) != *len) {
+        free(buf);
+        buf = NULL;
+    }
+    fclose(f);
+    return buf;
+}
+
+/* the frames of path's .frames file, or of a clean stream as its headers chain */
+static frame_t *frames(const char *path, const uint8_t *p, size_t len, size_t *count, bool *clean)
+{
+    char name[512];
+    frame_header_t hdr;
+    unsigned offset, whole;
+    size_t n = 0;
+    frame_t *f = calloc(len / 24 + 1, sizeof(frame_t));
+
+    snprintf(name, sizeof(name), "%.*s.frames", (int)(strlen(path) - 4), path);
+    FILE *in = fopen(name, "r");
+    *clean = (in == NULL);
+    if (in != NULL) {
+        while (fscanf(in, "%u %u", &offset, &whole) == 2) {
+            f[n].offset = offset;
+            f[n++].whole = whole;
+        }
+        fclose(in);
+    } else {
+        for (size_t pos = 0; pos + FRAME_HEADER_SIZE <= len && frame_header_parse(p + pos, &hdr); pos += hdr.frame_len) {
+            f[n].offset = pos;
+            f[n++].whole = 1;
+        }
+    }
+    *count = n;
+    return f;
+}
+
+static frame_t *find(frame_t *f, size_t count, uint32_t offset)
+{
+    size_t lo = 0, hi = count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (f[mid].offset < offset)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return (lo < count && f[lo].offset == offset) ? &f[lo] : NULL;
+}
+
+/* the decoder loop over p[0..len), frames taken marked in f if given; returns the frames taken */
+static uint32_t run(const uint8_t *p, size_t len, frame_t *f, size_t count, result_t *r)
+{
+    uint32_t taken = 0;
+    size_t pos = 0;
+    frame_header_t hdr;
+
+    memset(&r->s, 0, sizeof(r->s));
+    while (pos < len) {
+        size_t n = SYNC_WINDOW + rnd() % (MAX_WINDOW - SYNC_WINDOW + 1);
+        if (n > len - pos)
+            n = len - pos;
+        const uint8_t *q = p + pos, *end = q + n;
+        while (1) {
+            if (!r->s.off && !frame_sync_locked(&r->s, q, end - q)) {
+                size_t at;
+                frame_sync_result_t ret = frame_sync_scan(&r->s, q, end - q, SYNC_WINDOW, &at);
+                q += at;
+                if (ret == FRAME_SYNC_MORE)
+                    break;
+                r->gaps += (ret == FRAME_SYNC_GAP);
+            }
+            if (end - q < FRAME_HEADER_SIZE)
+                break;
+            // off, MAD's own sync steps through the bytes
+            if (!frame_header_parse(q, &hdr)) {
+                q++;
+                continue;
+            }
+            // the rest of it comes with the next window
+            if (hdr.frame_len > end - q)
+                break;
+            if (f != NULL) {
+                frame_t *at = find(f, count, q - p);
+                if (at == NULL) {
+                    r->bad++;
+                } else {
+                    at->taken = 1;
+                    if (at->whole)
+                        r->taken++;
+                    else
+                        r->damaged++;
+                }
+            }
+            taken++;
+            q += hdr.frame_len;
+        }
+        // no frame fits in what is left
+        if (q == p + pos && pos + n == len)
+            break;
+        pos = q - p;
+    }
+    return taken;
+}
+
+static void bench(int argc, char **argv)
+{
+    result_t r;
+
+    for (int a = 0; a < argc; a++) {
+        size_t len;
+        uint8_t *p = load(argv[a], &len);
+        if (p == NULL)
+            continue;
+        double best = 1e9;
+        uint32_t n = 0;
+        for (int i = 0; i < 20; i++) {
+            double start = now();
+            n = run(p, len, NULL, 0, &r);
+            double t = (now() - start) / n;
+            if (t < best)
+                best = t;
+        }
+        const char *base = strrchr(argv[a], '/') ? strrchr(argv[a], '/') + 1 : argv[a];
+        printf("%-16s %5u frames %6.1f ns per frame\n", base, n, best * 1e9);
+        free(p);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int opt, bench_only = 0;
+    result_t r;
+
+    while ((opt = getopt(argc, argv, "b")) != -1) {
+        if (opt != 'b') {
+            fprintf(stderr, "usage: %s [-b] file.mp3...\n", argv[0]);
+            return 2;
+        }
+        bench_only = 1;
+    }
+    if (bench_only) {
+        bench(argc - optind, argv + optind);
+        return 0;
+    }
+
+    for (int a = optind; a < argc; a++) {
+        size_t len, count, whole = 0, cut = 0, breaks = 0;
+        bool clean;
+        uint8_t *p = load(argv[a], &len);
+        if (p == NULL) {
+            failed = 1;
+            continue;
+        }
+        const char *base = strrchr(argv[a], '/') ? strrchr(argv[a], '/') + 1 : argv[a];
+        frame_t *f = frames(argv[a], p, len, &count, &clean);
+        // and where the frames do not follow each other, each a gap to sync across
+        for (size_t i = 0; i < count; i++) {
+            frame_header_t hdr;
+            whole += f[i].whole;
+            cut += !f[i].whole;
+            if (i == 0)
+                breaks += f[0].offset != 0;
+            else if (frame_header_parse(p + f[i - 1].offset, &hdr))
+                breaks += f[i].offset != f[i - 1].offset + hdr.frame_len;
+        }
+        // through other windows each time
+        for (int pass = 0; pass < PASSES; pass++) {
+            memset(&r, 0, sizeof(r));
+            for (size_t i = 0; i < count; i++)
+                f[i].taken = 0;
+            run(p, len, f, count, &r);
+            for (size_t i = 0; i < count; i++)
+                r.lost += f[i].whole && !f[i].taken;
+            if (pass == 0)
+                printf("%-16s %5zu frames, %2zu cut: %5u taken, %2u damaged, %u bad, %2u lost, %2u gaps, %2u resyncs\n",
+                       base, count, cut, r.taken, r.damaged, r.bad, r.lost, r.gaps, r.s.resyncs);
+            CHECK(count > 0 && r.bad == 0 && !r.s.off);
+            CHECK(r.taken + r.lost == whole);
+            CHECK(r.gaps == breaks);
+            if (clean) {
+                // a change of channel mode is followed, up to the last frame
+                CHECK(r.lost == 0);
+            } else {
+                // a cut frame's length points past the header of the next one, which is lost with it
+                CHECK(r.lost <= cut);
+            }
+        }
+        free(f);
+        free(p);
+    }
+
+    // a stream the scanner cannot lock on is left to the decoder
+    uint8_t *noise = malloc(NOISE);
+    for (int i = 0; i < NOISE; i++)
+        noise[i] = rnd();
+    run(noise, NOISE, NULL, 0, &r);
+    printf("noise: %s after %u bytes\n", r.s.off ? "left to the decoder" : "still scanning", r.s.skipped);
+    CHECK(r.s.off && r.s.skipped > FRAME_SYNC_LIMIT);
+    free(noise);
+
+    if (!failed)
+        printf("sync ok\n");
+    return failed;
+}
@@ -0,0 +1,245 @@
+/*
+ * tone_check.c
+ *
+ *  The bass and treble stage of audio_renderer.c through render_samples
+ *  and the host I2S channel. For settings across their range, sines from
+ *  25 Hz to 18 kHz must come out at the gain of the RBJ shelves designed
+ *  here in double, and the fixed point chain must stay close to the same
+ *  chain run in double. The width matrix with the volume folded in, mono
+ *  and split layouts, and the stage off are checked on single frames.
+ *
+ *    tone_check [-b]
+ *
+ *  -b prints the throughput with every stage on instead, in million
+ *  stereo frames per second and the part of a host core 44.1 kHz takes.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "check.h"
+#include "audio_renderer.h"
+
+#define RATE 44100
+/* two seconds, the second one analyzed */
+#define FRAMES (2 * RATE)
+/* of the sines, dB of full scale */
+#define LEVEL_DB -20.0
+/* measured gain against the design, dB */
+#define GAIN_DB 0.01
+/* the fixed point chain against double, dB of full scale: the 16 bit
+ * rounding of the output alone is at -101, the Q28 coefficients move a
+ * 40 Hz shelf boosted by 15 dB to -92 */
+#define ERROR_DB -90.0
+
+typedef struct {
+    int8_t treble;          /* 1.5 dB steps */
+    uint8_t treble_khz;
+    uint8_t bass;           /* dB */
+    uint8_t bass_freq;      /* 10 Hz steps */
+} setting_t;
+
+static const setting_t settings[] = {
+    { 7, 4, 15, 6 }, { -8, 10, 15, 2 }, { -3, 15, 6, 15 }, { 0, 1, 10, 2 }, { 4, 3, 0, 2 },
+};
+
+static const double freqs[] = { 25, 50, 100, 200, 500, 1000, 3000, 6000, 12000, 18000 };
+
+typedef struct {
+    double b0, b1, b2, a1, a2;
+    double x1, x2, y1, y2;
+} shelf_t;
+
+static renderer_config_t config;
+static int16_t in[FRAMES * 2], out[FRAMES * 2 + 2];
+
+/* RBJ cookbook shelf, slope 1, gain db, halfway at f0 */
+static void shelf(shelf_t *s, int high, double db, double f0)
+{
+    double A = pow(10, db / 40), w0 = 2 * M_PI * f0 / RATE;
+    double alpha = sin(w0) / 2 * sqrt(2), c = cos(w0), k = 2 * sqrt(A) * alpha;
+    double a0;
+    if (high) {
+        s->b0 = A * ((A + 1) + (A - 1) * c + k);
+        s->b1 = -2 * A * ((A - 1) + (A + 1) * c);
+        s->b2 = A * ((A + 1) + (A - 1) * c - k);
+        a0 = (A + 1) - (A - 1) * c + k;
+        s->a1 = 2 * ((A - 1) - (A + 1) * c);
+        s->a2 = (A + 1) - (A - 1) * c - k;
+    } else {
+        s->b0 = A * ((A + 1) - (A - 1) * c + k);
+        s->b1 = 2 * A * ((A - 1) - (A + 1) * c);
+        s->b2 = A * ((A + 1) - (A - 1) * c - k);
+        a0 = (A + 1) + (A - 1) * c + k;
+        s->a1 = -2 * ((A - 1) + (A + 1) * c);
+        s->a2 = (A + 1) + (A - 1) * c - k;
+    }
+    s->b0 /= a0;
+    s->b1 /= a0;
+    s->b2 /= a0;
+    s->a1 /= a0;
+    s->a2 /= a0;
+    s->x1 = s->x2 = s->y1 = s->y2 = 0;
+}
+
+/* the shelves of setting t, as the renderer places them */
+static void design(shelf_t *low, shelf_t *high, const setting_t *t)
+{
+    // a shelf halfway an octave above the VS1053's bass limit
+    shelf(low, 0, t->bass, t->bass_freq * 20.0);
+    shelf(high, 1, t->treble * 1.5, fmin(t->treble_khz * 1000.0, RATE * 0.45));
+}
+
+static double gain_db(const shelf_t *s, double f)
+{
+    double w = 2 * M_PI * f / RATE;
+    double nr = s->b0 + s->b1 * cos(w) + s->b2 * cos(2 * w), ni = -(s->b1 * sin(w) + s->b2 * sin(2 * w));
+    double dr = 1 + s->a1 * cos(w) + s->a2 * cos(2 * w), di = -(s->a1 * sin(w) + s->a2 * sin(2 * w));
+    return 10 * log10((nr * nr + ni * ni) / (dr * dr + di * di));
+}
+
+static double run(shelf_t *s, double x)
+{
+    double y = s->b0 * x + s->b1 * s->x1 + s->b2 * s->x2 - s->a1 * s->y1 - s->a2 * s->y2;
+    s->x2 = s->x1;
+    s->x1 = x;
+    s->y2 = s->y1;
+    s->y1 = y;
+    return y;
+}
+
+static void render(const int16_t *src, int channels, pcm_buffer_layout_t layout, uint32_t frames)
+{
+    pcm_format_t format = {
+        .sample_rate = RATE,
+        .bit_depth = I2S_DATA_BIT_WIDTH_16BIT,
+        .num_channels = channels,
+        .buffer_format = layout,
+    };
+    render_samples((const char *)src, frames * channels * sizeof(int16_t), &format);
+}
+
+/* a new stream: the filter states start at rest */
+static void restart(void)
+{
+    renderer_stop();
+    renderer_start();
+    host_i2s_len = 0;
+}
+
+static void bench(void)
+{
+    host_i2s_collect(NULL, 0);
+    renderer_tone(5, 6, 10, 6, 2);
+    for (int i = 0; i < FRAMES * 2; i++)
+        in[i] = rnd();
+    double best = 0;
+    for (int r = 0; r < 5; r++) {
+        double start = now();
+        for (int i = 0; i < 10; i++)
+            render(in, 2, PCM_INTERLEAVED, FRAMES);
+        double mfps = 10.0 * FRAMES / (now() - start) / 1e6;
+        if (mfps > best)
+            best = mfps;
+    }
+    printf("tone, width and volume: %.1f Mframes/s, %.3f %% of a core at 44.1 kHz\n", best, RATE / (best * 1e4));
+}
+
+int main(int argc, char **argv)
+{
+    int opt, bench_only = 0;
+
+    while ((opt = getopt(argc, argv, "b")) != -1) {
+        if (opt != 'b') {
+            fprintf(stderr, "usage: %s [-b]\n", argv[0]);
+            return 2;
+        }
+        bench_only = 1;
+    }
+
+    renderer_init(&config);
+    CHECK(i2s_init());
+    renderer_start();
+    config.output_mode = I2S;
+    config.bit_depth = I2S_DATA_BIT_WIDTH_16BIT;
+    config.volume = 0x10000;
+
+    if (bench_only) {
+        bench();
+        return 0;
+    }
+
+    host_i2s_collect(out, sizeof(out));
+    double amp = 32767 * pow(10, LEVEL_DB / 20);
+    for (int s = 0; s < sizeof(settings) / sizeof(settings[0]); s++) {
+        const setting_t *t = &settings[s];
+        double worst_gain = 0, worst_error = -200;
+        renderer_tone(t->treble, t->treble_khz, t->bass, t->bass_freq, 0);
+        printf("treble %+2d x 1.5 dB at %2u kHz, bass %2u dB at %3u Hz:", t->treble, t->treble_khz, t->bass,
+               t->bass_freq * 20);
+        for (int f = 0; f < sizeof(freqs) / sizeof(freqs[0]); f++) {
+            shelf_t low, high;
+            design(&low, &high, t);
+            // dithered, as a decoder's output is
+            for (int i = 0; i < FRAMES; i++)
+                in[2 * i] = in[2 * i + 1] = lrint(amp * sin(2 * M_PI * freqs[f] * i / RATE) + (rnd() % 1001) / 1000.0 - 0.5);
+            restart();
+            render(in, 2, PCM_INTERLEAVED, FRAMES);
+            CHECK(host_i2s_len == FRAMES * 4);
+
+            double sig = 0, ref = 0, err = 0;
+            for (int i = 0; i < FRAMES; i++) {
+                double x = in[2 * i];
+                if (t->bass != 0)
+                    x = run(&low, x);
+                if (t->treble != 0)
+                    x = run(&high, x);
+                if (i >= FRAMES / 2) {
+                    sig += (double)out[2 * i] * out[2 * i];
+                    ref += (double)in[2 * i] * in[2 * i];
+                    err += (out[2 * i] - x) * (out[2 * i] - x);
+                    CHECK(out[2 * i] == out[2 * i + 1]);
+                }
+            }
+            double expect = ((t->bass != 0) ? gain_db(&low, freqs[f]) : 0) +
+                            ((t->treble != 0) ? gain_db(&high, freqs[f]) : 0);
+            double gain = 10 * log10(sig / ref);
+            double error = 10 * log10(err / (FRAMES / 2) / (32768.0 * 32768.0 / 2));
+            worst_gain = fmax(worst_gain, fabs(gain - expect));
+            worst_error = fmax(worst_error, error);
+        }
+        printf(" gain off by %.3f dB, %.1f dB from double\n", worst_gain, worst_error);
+        CHECK(worst_gain < GAIN_DB);
+        CHECK(worst_error < ERROR_DB);
+    }
+
+    // width 3 at half volume: the sides doubled, with the volume folded into the matrix
+    int16_t frame[2] = { 10000, 0 };
+    renderer_tone(0, 1, 0, 2, 3);
+    config.volume = 0x8000;
+    restart();
+    render(frame, 2, PCM_INTERLEAVED, 1);
+    CHECK(host_i2s_len == 4 && out[0] == 7500 && out[1] == -2500);
+    printf("width 3 at half volume, 10000 and 0: %d and %d\n", out[0], out[1]);
+
+    // mono and split channels come through the same matrix
+    restart();
+    render(frame, 1, PCM_INTERLEAVED, 1);
+    CHECK(host_i2s_len == 4 && out[0] == 5000 && out[1] == 5000);
+    restart();
+    render(frame, 2, PCM_LEFT_RIGHT, 1);
+    CHECK(host_i2s_len == 4 && out[0] == 7500 && out[1] == -2500);
+
+    // off, the samples pass at the volume
+    renderer_tone(0, 1, 0, 2, 0);
+    restart();
+    render(frame, 2, PCM_INTERLEAVED, 1);
+    CHECK(host_i2s_len == 4 && out[0] == 5000 && out[1] == 0);
+
+    if (!failed)
+        printf("tone ok\n");
+    return failed;
+}
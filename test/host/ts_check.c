@@ -0,0 +1,268 @@
+/*
+ * ts_check.c
+ *
+ *  The HLS segment demuxer of common_ts.c: MPEG-TS segments and packed
+ *  audio built here are fed in pieces of random size, and of one byte,
+ *  and the elementary stream that comes out must be the one put in. Also
+ *  lost, repeated and unsynced packets, and a discontinuity that moves
+ *  the audio to another PID and format.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+#include "common_ts.h"
+
+#define ES_LEN (48 * 1024)
+#define SEG_LEN (2 * ES_LEN)
+
+#define PMT_PID 0x1000
+#define VIDEO_PID 0x100
+
+static uint8_t out[SEG_LEN];
+static size_t out_len;
+
+static void collect(void *ctx, const uint8_t *data, size_t len)
+{
+    if (out_len + len <= sizeof(out))
+        memcpy(out + out_len, data, len);
+    out_len += len;
+}
+
+/* ADTS frames, AAC LC 44.1 kHz stereo, or MPEG-1 Layer III 128 kbit/s 44.1 kHz */
+static size_t frames(uint8_t *p, size_t n, ts_es_t es)
+{
+    size_t pos = 0;
+    while (pos + 420 <= n) {
+        unsigned len = (es == TS_ES_ADTS) ? 300 + rnd() % 101 : 417 + rnd() % 2;
+        uint8_t *f = p + pos;
+        for (unsigned i = 0; i < len; i++)
+            f[i] = rnd();
+        if (es == TS_ES_ADTS) {
+            memcpy(f, "\xff\xf1\x50\x80", 4);
+            f[3] |= len >> 11;
+            f[4] = len >> 3;
+            f[5] = ((len & 7) << 5) | 0x1f;
+            f[6] = 0xfc;
+        } else {
+            memcpy(f, "\xff\xfb\x90\x44", 4);
+            f[2] |= (len == 418) << 1;
+        }
+        pos += len;
+    }
+    return pos;
+}
+
+/* payload of pid in packets, the first one starting a unit, the last one stuffed */
+static size_t ts_put(uint8_t *p, uint16_t pid, uint8_t *cc, const uint8_t *pl, size_t n)
+{
+    size_t pos = 0;
+    for (bool first = true; n > 0; first = false) {
+        uint8_t *t = p + pos;
+        size_t take = (n < 184) ? n : 184;
+        t[0] = 0x47;
+        t[1] = (first ? 0x40 : 0) | (pid >> 8);
+        t[2] = pid;
+        t[3] = 0x10 | (*cc & 0x0f);
+        *cc += 1;
+        if (take < 184) {
+            // adaptation field of stuffing bytes
+            t[3] |= 0x20;
+            t[4] = 183 - take;
+            if (t[4] > 0) {
+                t[5] = 0;
+                memset(t + 6, 0xff, t[4] - 1);
+            }
+        }
+        memcpy(t + 188 - take, pl, take);
+        pl += take;
+        n -= take;
+        pos += 188;
+    }
+    return pos;
+}
+
+static size_t psi_put(uint8_t *p, uint16_t pid, uint8_t *cc, const uint8_t *section, size_t n)
+{
+    uint8_t pl[184];
+    memset(pl, 0xff, sizeof(pl));
+    pl[0] = 0;
+    memcpy(pl + 1, section, n);
+    return ts_put(p, pid, cc, pl, sizeof(pl));
+}
+
+/* PAT with the network PID ahead of the program, PMT with a video stream ahead of the audio */
+static size_t psi(uint8_t *p, uint16_t audio_pid, ts_es_t es, uint8_t *cc)
+{
+    static const uint8_t pat[] = {
+        0x00, 0xb0, 17, 0x00, 0x01, 0xc1, 0, 0,
+        0x00, 0x00, 0xe0, 0x10,
+        0x00, 0x01, 0xe0 | (PMT_PID >> 8), PMT_PID & 0xff,
+        0, 0, 0, 0
+    };
+    uint8_t pmt[] = {
+        0x02, 0xb0, 34, 0x00, 0x01, 0xc1, 0, 0,
+        0xe1, 0x00, 0xf0, 0x00,
+        0x1b, 0xe0 | (VIDEO_PID >> 8), VIDEO_PID & 0xff, 0xf0, 6, 0x28, 4, 0x64, 0x00, 0x1f, 0xbf,
+        0, 0xe0 | (audio_pid >> 8), audio_pid & 0xff, 0xf0, 0,
+        0, 0, 0, 0
+    };
+    pmt[23] = (es == TS_ES_ADTS) ? 0x0f : 0x03;
+    size_t len = psi_put(p, 0, &cc[0], pat, sizeof(pat));
+    return len + psi_put(p + len, PMT_PID, &cc[1], pmt, sizeof(pmt));
+}
+
+/* a segment: PSI, then the ES in PES packets of 1 to 3 KiB interleaved with video */
+static size_t segment(uint8_t *p, const uint8_t *es, size_t es_len, uint16_t audio_pid, ts_es_t type)
+{
+    static uint8_t pes[4096], video[400];
+    uint8_t cc[4] = { 0 };
+    size_t len = psi(p, audio_pid, type, cc);
+
+    while (es_len > 0) {
+        size_t n = 1024 + rnd() % 2048;
+        if (n > es_len)
+            n = es_len;
+        // PES header with a PTS
+        static const uint8_t head[] = { 0, 0, 1, 0xc0, 0, 0, 0x80, 0x80, 5, 0x21, 0, 1, 0, 1 };
+        memcpy(pes, head, sizeof(head));
+        memcpy(pes + sizeof(head), es, n);
+        len += ts_put(p + len, audio_pid, &cc[2], pes, sizeof(head) + n);
+        memset(video, 0, sizeof(video));
+        video[2] = 1;
+        video[3] = 0xe0;
+        len += ts_put(p + len, VIDEO_PID, &cc[3], video, sizeof(video));
+        es += n;
+        es_len -= n;
+    }
+    return len;
+}
+
+static uint16_t pid(const uint8_t *p)
+{
+    return ((p[1] & 0x1f) << 8) | p[2];
+}
+
+/* feeds p[0..len) in pieces of 1 to max bytes */
+static void feed(ts_demux_t *d, const uint8_t *p, size_t len, unsigned max)
+{
+    while (len > 0) {
+        size_t n = 1 + rnd() % max;
+        if (n > len)
+            n = len;
+        ts_demux_push(d, p, n);
+        p += n;
+        len -= n;
+    }
+}
+
+static void expect(const char *what, const uint8_t *es, size_t es_len)
+{
+    if (out_len != es_len || memcmp(out, es, es_len) != 0) {
+        size_t i = 0;
+        while (i < out_len && i < es_len && out[i] == es[i])
+            i++;
+        printf("%s: %zu bytes out, %zu in, first difference at %zu\n", what, out_len, es_len, i);
+        failed = 1;
+    }
+    out_len = 0;
+}
+
+int main(void)
+{
+    static uint8_t es[ES_LEN], es2[ES_LEN], seg[SEG_LEN], seg2[SEG_LEN];
+    static const unsigned pieces[] = { 1, 7, 188, 1500, SEG_LEN };
+    ts_demux_t d;
+
+    size_t es_len = frames(es, sizeof(es), TS_ES_ADTS);
+    size_t len = segment(seg, es, es_len, 0x101, TS_ES_ADTS);
+
+    for (int i = 0; i < sizeof(pieces) / sizeof(pieces[0]); i++) {
+        char what[32];
+        snprintf(what, sizeof(what), "ts in pieces of %u", pieces[i]);
+        ts_demux_init(&d, collect, NULL);
+        ts_demux_segment(&d, false);
+        feed(&d, seg, len, pieces[i]);
+        CHECK(d.es == TS_ES_ADTS && d.audio_pid == 0x101 && d.pmt_pid == PMT_PID);
+        CHECK(d.cc_errors == 0 && d.packets == len / TS_PACKET_SIZE && d.es_bytes == es_len);
+        expect(what, es, es_len);
+    }
+
+    // the next segment of the stream goes on where this one ended
+    ts_demux_init(&d, collect, NULL);
+    ts_demux_segment(&d, false);
+    feed(&d, seg, len, 1500);
+    ts_demux_segment(&d, false);
+    feed(&d, seg, len, 1500);
+    CHECK(d.cc_errors == 0);
+    CHECK(out_len == 2 * es_len && memcmp(out + es_len, es, es_len) == 0);
+    out_len = 0;
+
+    // a lost and a repeated packet of the audio, garbage between packets
+    size_t lost = 0, at, pos;
+    // a full audio packet that does not start a PES
+    while (pid(seg + lost) != 0x101 || (seg[lost + 1] & 0x40) || (seg[lost + 3] & 0x20))
+        lost += TS_PACKET_SIZE;
+    ts_demux_init(&d, collect, NULL);
+    ts_demux_segment(&d, false);
+    feed(&d, seg, lost, 1500);
+    at = out_len;
+    for (pos = lost + TS_PACKET_SIZE; pid(seg + pos) != 0x101; pos += TS_PACKET_SIZE)
+        ;
+    feed(&d, seg + lost + TS_PACKET_SIZE, pos + TS_PACKET_SIZE - lost - TS_PACKET_SIZE, 1500);
+    CHECK(d.cc_errors == 1);
+    size_t before = out_len;
+    feed(&d, seg + pos, TS_PACKET_SIZE, 1500);
+    CHECK(d.cc_errors == 1 && out_len == before);
+    pos += TS_PACKET_SIZE;
+    // the rest, with bytes that are no packet after the fifth one
+    memcpy(seg2, seg + pos, 5 * TS_PACKET_SIZE);
+    memcpy(seg2 + 5 * TS_PACKET_SIZE, "\x01\x02\x03\x04\x05", 5);
+    memcpy(seg2 + 5 * TS_PACKET_SIZE + 5, seg + pos + 5 * TS_PACKET_SIZE, len - pos - 5 * TS_PACKET_SIZE);
+    feed(&d, seg2, len - pos + 5, 1500);
+    CHECK(d.cc_errors == 1);
+    memcpy(es2, es, at);
+    memcpy(es2 + at, es + at + 184, es_len - at - 184);
+    expect("a packet lost", es2, es_len - 184);
+
+    // a discontinuity: another PID and MPEG audio
+    size_t es2_len = frames(es2, sizeof(es2), TS_ES_MPEG);
+    size_t len2 = segment(seg2, es2, es2_len, 0x1e1, TS_ES_MPEG);
+    ts_demux_init(&d, collect, NULL);
+    ts_demux_segment(&d, false);
+    feed(&d, seg, len, 1500);
+    expect("before the discontinuity", es, es_len);
+    ts_demux_segment(&d, true);
+    CHECK(d.es == TS_ES_UNKNOWN && d.audio_pid == 0);
+    feed(&d, seg2, len2, 1500);
+    CHECK(d.es == TS_ES_MPEG && d.audio_pid == 0x1e1 && d.cc_errors == 0);
+    expect("after the discontinuity", es2, es2_len);
+
+    // packed audio: an ID3 tag with the timestamp, then the frames as they are
+    static const uint8_t id3[] = "ID3\4\0\0\0\0\0\77";
+    for (int i = 0; i < 2; i++) {
+        ts_es_t type = i ? TS_ES_MPEG : TS_ES_ADTS;
+        const uint8_t *e = i ? es2 : es;
+        size_t e_len = i ? es2_len : es_len;
+        memcpy(seg, id3, 10);
+        memset(seg + 10, 0, 63);
+        memcpy(seg + 73, e, e_len);
+        ts_demux_init(&d, collect, NULL);
+        ts_demux_segment(&d, false);
+        feed(&d, seg, 73 + e_len, i ? 1 : 1500);
+        CHECK(d.es == type);
+        expect(i ? "packed MPEG audio" : "packed ADTS", e, e_len);
+        // without a tag
+        ts_demux_init(&d, collect, NULL);
+        ts_demux_segment(&d, false);
+        feed(&d, e, e_len, 3);
+        CHECK(d.es == type);
+        expect("raw audio", e, e_len);
+    }
+
+    if (!failed)
+        printf("ts ok\n");
+    return failed;
+}